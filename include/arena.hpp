@@ -0,0 +1,171 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Bump allocator for AST nodes. Everything parsed from a
+ * statement (or a batch of them) is carved out of a few large blocks
+ * and released in one shot once the statement has been evaluated.
+ */
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class Arena
+{
+private:
+  struct Block
+  {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  // Destructors to run on release, kept as a list inside the arena itself
+  struct Finalizer
+  {
+    void (*destroy)(void *);
+    void *object;
+    Finalizer *next;
+  };
+
+  std::vector<Block> blocks;
+  size_t block_size;
+  // Current block and the bump offset inside it
+  size_t current = 0;
+  size_t offset = 0;
+  size_t used = 0;
+  Finalizer *finalizers = nullptr;
+
+  void *allocateSlow(size_t size, size_t align)
+  {
+    // Reuse the blocks kept by release() before asking for a new one
+    while (current + 1 < blocks.size())
+    {
+      current++;
+      offset = 0;
+      if (size + align <= blocks[current].size)
+      {
+        return allocate(size, align);
+      }
+    }
+    size_t bytes = std::max(block_size, size + align);
+    blocks.push_back(Block{std::unique_ptr<char[]>(new char[bytes]), bytes});
+    current = blocks.size() - 1;
+    offset = 0;
+    return allocate(size, align);
+  }
+
+public:
+  static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+  /**
+   * @brief Creates an empty arena. Blocks are only allocated on first use.
+   *
+   * @param block_size [default: 64KiB] size of each block, larger requests get their own block
+   */
+  explicit Arena(size_t block_size = DEFAULT_BLOCK_SIZE) : block_size(block_size) {}
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  ~Arena()
+  {
+    release();
+  }
+
+  /**
+   * @brief Returns size bytes aligned to align. Freed only by release().
+   */
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t))
+  {
+    if (!blocks.empty())
+    {
+      Block &block = blocks[current];
+      uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+      uintptr_t aligned = (base + offset + align - 1) & ~(uintptr_t)(align - 1);
+      if (aligned + size <= base + block.size)
+      {
+        offset = aligned + size - base;
+        used += size;
+        return reinterpret_cast<void *>(aligned);
+      }
+    }
+    return allocateSlow(size, align);
+  }
+
+  /**
+   * @brief Constructs a T in the arena. Its destructor runs on release() if it has one.
+   */
+  template <typename T, typename... Args>
+  T *make(Args &&...args)
+  {
+    void *memory = allocate(sizeof(T), alignof(T));
+    T *object = new (memory) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value)
+    {
+      Finalizer *finalizer = static_cast<Finalizer *>(allocate(sizeof(Finalizer), alignof(Finalizer)));
+      finalizer->destroy = [](void *ptr)
+      { static_cast<T *>(ptr)->~T(); };
+      finalizer->object = object;
+      finalizer->next = finalizers;
+      finalizers = finalizer;
+    }
+    return object;
+  }
+
+  /**
+   * @brief Destroys everything made in the arena and rewinds it.
+   * The first block is kept for the next statement, oversized ones are freed
+   * so a single huge statement doesn't pin its memory for the whole session.
+   */
+  void release()
+  {
+    // Newest first, like a stack unwinding
+    while (finalizers != nullptr)
+    {
+      Finalizer *finalizer = finalizers;
+      finalizers = finalizer->next;
+      finalizer->destroy(finalizer->object);
+    }
+    if (blocks.size() > 1)
+    {
+      blocks.resize(1);
+    }
+    if (!blocks.empty() && blocks[0].size > block_size)
+    {
+      blocks.clear();
+    }
+    current = 0;
+    offset = 0;
+    used = 0;
+  }
+
+  /**
+   * @brief Bytes handed out since the last release
+   */
+  size_t bytesUsed() const
+  {
+    return used;
+  }
+
+  /**
+   * @brief Bytes held in blocks, used or not
+   */
+  size_t capacity() const
+  {
+    size_t total = 0;
+    for (const Block &block : blocks)
+    {
+      total += block.size;
+    }
+    return total;
+  }
+};
+
+#endif /* __ARENA_HPP__ */
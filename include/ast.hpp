@@ -9,6 +9,9 @@
 #ifndef __AST_HPP__
 #define __AST_HPP__
 
+#include <algorithm>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <sstream>
 #include <tokens.hpp>
@@ -36,7 +39,7 @@ namespace ast
     Node(Token token) : token(token) {}
     virtual string tokenLiteral()
     {
-      return token.literal;
+      return string(token.literal);
     };
     virtual operator string() = 0;
   };
@@ -52,7 +55,7 @@ namespace ast
 
     virtual operator string() override
     {
-      return token.literal;
+      return string(token.literal);
     }
   };
 
@@ -67,12 +70,13 @@ namespace ast
 
     virtual operator string() override
     {
-      return token.literal;
+      return string(token.literal);
     }
 
+    // The command's name in upper case, however it was typed
     string tokenLiteral() override
     {
-      return token.literal;
+      return token_type::name(token.type);
     }
   };
 
@@ -129,11 +133,11 @@ namespace ast
   {
     string value;
 
-    Identifier(Token token, string value) : Expression(token), value(value) {}
+    Identifier(Token token, string_view value) : Expression(token), value(value) {}
 
     operator string() override
     {
-      return token.literal;
+      return string(token.literal);
     }
   };
 
@@ -148,7 +152,7 @@ namespace ast
 
     operator string() override
     {
-      return token.literal;
+      return string(token.literal);
     }
   };
 
@@ -160,7 +164,7 @@ namespace ast
     string opsymbol;
     IntegerLiteral *right;
 
-    PrefixExpression(Token token, string opsymbol) : Expression(token),
+    PrefixExpression(Token token, string_view opsymbol) : Expression(token),
                                                      opsymbol(opsymbol) {}
 
     operator string() override
@@ -185,7 +189,7 @@ namespace ast
 
     string tokenLiteral() override 
     {
-      return token.literal;
+      return string(token.literal);
     }
 
     operator string() override
@@ -208,7 +212,7 @@ namespace ast
 
     string tokenLiteral() override
     {
-      return token.literal;
+      return string(token.literal);
     }
 
     operator string() override
@@ -232,7 +236,7 @@ namespace ast
 
     string tokenLiteral() override
     {
-      return token.literal;
+      return string(token.literal);
     }
 
     operator string() override
@@ -259,7 +263,7 @@ namespace ast
      */
     string tokenLiteral() override
     {
-      return token.literal;
+      return string(token.literal);
     }
 
     operator string() override 
@@ -286,7 +290,7 @@ namespace ast
 
       string tokenLiteral() override
       {
-        return token.literal;
+        return string(token.literal);
       }
 
       operator string() override
@@ -318,7 +322,7 @@ namespace ast
 
     string tokenLiteral() override
     {
-      return token.literal;
+      return string(token.literal);
     }
 
     operator string() override
@@ -328,8 +332,51 @@ namespace ast
     }
   };
 
+  // Functions a selected column can be aggregated with
+  enum class AggregateFunction : char
+  {
+    NONE,
+    COUNT,
+    SUM,
+    MIN,
+    MAX,
+    AVG,
+  };
+
+  /**
+   * @brief Looks up an aggregate function by name, ignoring case
+   *
+   * @return AggregateFunction NONE when the name isn't an aggregate function
+   */
+  inline AggregateFunction aggregateFunction(std::string_view name)
+  {
+    constexpr std::pair<std::string_view, AggregateFunction> functions[] = {
+        {"COUNT", AggregateFunction::COUNT},
+        {"SUM", AggregateFunction::SUM},
+        {"MIN", AggregateFunction::MIN},
+        {"MAX", AggregateFunction::MAX},
+        {"AVG", AggregateFunction::AVG},
+    };
+    for (const auto &function : functions)
+    {
+      if (function.first.size() == name.size() &&
+          std::equal(name.begin(), name.end(), function.first.begin(),
+                     [](char a, char b) { return token_type::upper(a) == b; }))
+      {
+        return function.second;
+      }
+    }
+    return AggregateFunction::NONE;
+  }
+
+  /**
+   * @brief A selected column, or an aggregate over one such as COUNT(*)
+   * token is the column or asterisk
+   * aggregate is the function's name, null for plain columns
+   */
   struct ColumnQueryExpression : public Expression
   {
+    Token *aggregate = nullptr;
     ColumnQueryExpression *right = nullptr;
 
     ColumnQueryExpression(Token token) : Expression(token) {}
@@ -342,7 +389,73 @@ namespace ast
     operator string() override
     {
       ostringstream ss;
-      ss << token.literal;
+      if (aggregate != nullptr) {
+        ss << aggregate->literal << "(" << token.literal << ")";
+      } else {
+        ss << token.literal;
+      }
+      if (right != nullptr) {
+        ss << ", " << std::string(*right);
+      }
+      return ss.str();
+    }
+  };
+
+  /**
+   * @brief A column of ORDER BY, or an aggregate of the select list like COUNT(*)
+   * token is the column or asterisk
+   * the next columns are saved into right as a linked list
+   */
+  struct OrderByExpression : public Expression
+  {
+    Token *aggregate = nullptr;
+    bool descending = false;
+    OrderByExpression *right = nullptr;
+
+    OrderByExpression(Token token) : Expression(token) {}
+
+    string tokenLiteral() override
+    {
+      return "ORDER";
+    }
+
+    operator string() override
+    {
+      ostringstream ss;
+      if (aggregate != nullptr) {
+        ss << aggregate->literal << "(" << token.literal << ")";
+      } else {
+        ss << token.literal;
+      }
+      ss << (descending ? " DESC" : " ASC");
+      if (right != nullptr) {
+        ss << ", " << std::string(*right);
+      }
+      return ss.str();
+    }
+  };
+
+  /**
+   * @brief An option in the WITH of a CREATE TABLE, e.g. bloom_filter = pid
+   * token is the option's name, value its value
+   * the next options are saved into right as a linked list
+   */
+  struct TableOptionExpression : public Expression
+  {
+    Token value;
+    TableOptionExpression *right = nullptr;
+
+    TableOptionExpression(Token token, Token value) : Expression(token), value(value) {}
+
+    string tokenLiteral() override
+    {
+      return "WITH";
+    }
+
+    operator string() override
+    {
+      ostringstream ss;
+      ss << token.literal << " = " << value.literal;
       if (right != nullptr) {
         ss << ", " << std::string(*right);
       }
@@ -398,6 +511,8 @@ namespace ast
   {
     Identifier *name;
     ColumnDefinitionExpression *column_list;
+    // Options after WITH, null without them
+    TableOptionExpression *options = nullptr;
 
     CreateTableStatement(Token token) : Statement(token) {}
 
@@ -417,7 +532,12 @@ namespace ast
         ss << std::string(*column_list) << ", ";
       }
       ss << std::string(*column_list);
-      ss << ");";
+      ss << ")";
+      if (options != nullptr)
+      {
+        ss << " WITH (" << std::string(*options) << ")";
+      }
+      ss << ";";
       return ss.str();
     }
   };
@@ -466,6 +586,54 @@ namespace ast
     }
   };
 
+  struct AnalyzeTableStatement : public Statement
+  {
+    Identifier *name;
+
+    AnalyzeTableStatement(Token token) : Statement(token)
+    {
+    }
+
+    string tokenLiteral() override
+    {
+      return "ANALYZE";
+    }
+
+    operator string() override
+    {
+      ostringstream ss;
+      ss << "ANALYZE ";
+      ss << std::string(*name) << ";";
+      return ss.str();
+    }
+  };
+
+  /**
+   * @brief EXPLAIN [ANALYZE] statement shows the plan of a statement, and with
+   * ANALYZE runs it and shows what each operator did
+   */
+  struct ExplainStatement : public Statement
+  {
+    bool analyze = false;
+    Statement *statement;
+
+    ExplainStatement(Token token) : Statement(token)
+    {
+    }
+
+    string tokenLiteral() override
+    {
+      return "EXPLAIN";
+    }
+
+    operator string() override
+    {
+      ostringstream ss;
+      ss << "EXPLAIN " << (analyze ? "ANALYZE " : "") << std::string(*statement);
+      return ss.str();
+    }
+  };
+
   struct AlterTableStatement : public Statement
   {
     Identifier *name;
@@ -536,6 +704,13 @@ namespace ast
     ColumnQueryExpression *column_query;
     JoinExpression *join_expr = nullptr;
     WhereExpression *query = nullptr;
+    // Columns of GROUP BY, null without one
+    ColumnQueryExpression *group_by = nullptr;
+    // Columns of ORDER BY, null without one
+    OrderByExpression *order_by = nullptr;
+    // Row counts of LIMIT and OFFSET, null without them
+    Token *limit = nullptr;
+    Token *offset = nullptr;
 
     SelectTableStatement(Token token) : Statement(token)
     {
@@ -561,6 +736,18 @@ namespace ast
           ss << std::string(*query);
         }
       }
+      if (group_by) {
+        ss << " GROUP BY " << std::string(*group_by);
+      }
+      if (order_by) {
+        ss << " ORDER BY " << std::string(*order_by);
+      }
+      if (limit) {
+        ss << " LIMIT " << limit->literal;
+      }
+      if (offset) {
+        ss << " OFFSET " << offset->literal;
+      }
       ss << ";";
       return ss.str();
     }
@@ -623,7 +810,10 @@ namespace ast
   struct InsertTableStatement : public Statement
   {
     Identifier *name;
+    // First row of values, same as rows[0]
     ColumnLiteralExpression *column_list;
+    // Every parenthesized row of VALUES (...), (...)
+    vector<ColumnLiteralExpression *> rows;
 
     InsertTableStatement(Token token) : Statement(token) 
     {
@@ -649,5 +839,104 @@ namespace ast
       return ss.str();
     }
   };
+
+  /**
+   * @brief COPY name FROM 'path' imports a CSV file, COPY name TO 'path' exports one
+   */
+  struct CopyTableStatement : public Statement
+  {
+    Identifier *name;
+    // FROM or TO
+    Token direction;
+    // Raw text between the quotes
+    Token path;
+
+    CopyTableStatement(Token token) : Statement(token)
+    {
+    }
+
+    string tokenLiteral() override
+    {
+      return "COPY";
+    }
+
+    operator string() override
+    {
+      ostringstream ss;
+      ss << "COPY " << std::string(*name) << " " << direction.literal << " '" << path.literal << "';";
+      return ss.str();
+    }
+  };
+
+  /**
+   * @brief A placeholder (? or $n) of a prepared statement. Binding a value
+   * rewrites the token it was parsed into, and the literal's type if it has one.
+   */
+  struct ParamSlot
+  {
+    // Zero based parameter number
+    size_t index;
+    Token *value;
+    // Type token of an INSERT literal, nullptr elsewhere
+    Token *vartype;
+  };
+
+  /**
+   * @brief PREPARE name AS statement. Keeps the statement text to parse it once more
+   * into storage that outlives the line it was typed on.
+   */
+  struct PrepareStatement : public Statement
+  {
+    Identifier *name;
+    string_view text;
+    size_t param_count = 0;
+
+    PrepareStatement(Token token) : Statement(token)
+    {
+    }
+
+    string tokenLiteral() override
+    {
+      return "PREPARE";
+    }
+
+    operator string() override
+    {
+      ostringstream ss;
+      ss << "PREPARE " << std::string(*name) << " AS " << text;
+      return ss.str();
+    }
+  };
+
+  /**
+   * @brief EXECUTE name(args) runs a prepared statement with args bound to its placeholders
+   */
+  struct ExecuteStatement : public Statement
+  {
+    Identifier *name;
+    // Arguments in order, nullptr without any
+    ColumnLiteralExpression *args = nullptr;
+
+    ExecuteStatement(Token token) : Statement(token)
+    {
+    }
+
+    string tokenLiteral() override
+    {
+      return "EXECUTE";
+    }
+
+    operator string() override
+    {
+      ostringstream ss;
+      ss << "EXECUTE " << std::string(*name) << "(";
+      for (ColumnLiteralExpression *arg = args; arg != nullptr; arg = arg->right)
+      {
+        ss << std::string(*arg) << (arg->right != nullptr ? ", " : "");
+      }
+      ss << ");";
+      return ss.str();
+    }
+  };
 };
 #endif /* __AST_HPP__ */
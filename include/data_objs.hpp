@@ -30,6 +30,8 @@ public:
   std::vector<std::pair<std::string, std::tuple<std::string, int>>> fields;
 
   std::vector<variant_type> records;
+  // Columns whose zone map pages keep Bloom filters, from CREATE TABLE ... WITH (bloom_filter = col)
+  std::vector<std::string> bloom_filters;
 
   TableObject(std::string name) : table_name(name) {}
                                                       
@@ -97,10 +99,10 @@ public:
     return false;
   }
 
-  std::string getFormat() {
+  std::string getFormat() const {
     std::string res;
     for (auto field : fields) {
-      std::string type = get<0>(field.second);
+      std::string type = std::get<0>(field.second);
       if (type == "varchar" || type == "char") {
         res += "s";
       } else if (type == "int") {
@@ -116,7 +118,7 @@ public:
     return res;
   }
 
-  bool addRecord(char* fmt, ...) {
+  bool addRecord(const char* fmt, ...) {
     std::va_list args;
     va_start(args, fmt);
     for (int i = 0; fmt[i] != '\0'; i++) {
@@ -125,7 +127,7 @@ public:
         int i;
         double f;
         bool b;
-        char *s;
+        const char *s;
       } Union;
 
       std::string str;
@@ -139,7 +141,7 @@ public:
           records.push_back(Union.f);
           break;
         case 's':
-          Union.s = va_arg(args, char*);
+          Union.s = va_arg(args, const char*);
           int i;
           for(i = 0; Union.s[i] != '\0'; i++) {
             str += Union.s[i];
@@ -147,7 +149,8 @@ public:
           records.push_back(str);
           break;
         case 'b':
-          Union.b = va_arg(args, bool);
+          // bool is promoted to int when passed through ...
+          Union.b = va_arg(args, int) != 0;
           records.push_back(Union.b);
           break;
         default:
@@ -166,6 +169,8 @@ private:
 
 public:
   std::vector<TableObject> tables;
+  // Table name and the milliseconds it took to parse, filled in by ProtoGenerator::loadDB
+  std::vector<std::pair<std::string, double>> load_timings;
 
   DatabaseObject(std::string name) : database_name(name)
   {
@@ -178,7 +183,7 @@ public:
 
   void insertTable(TableObject table)
   {
-    tables.push_back(table);
+    tables.push_back(std::move(table));
   }
 };
 
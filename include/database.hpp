@@ -0,0 +1,457 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Library API for running statements in-process. A Database
+ * points at a data directory, a Connection runs statements against it and
+ * each statement comes back as a ResultSet holding its status, message and
+ * typed rows, or as a Cursor that fetches the rows in batches. Statements
+ * can also be submitted to run on the worker pool, with a CancelToken to
+ * cancel them or give them a timeout. Nothing here writes to stdout; the
+ * repl is one client of it.
+ * Implemented in src/database.cpp.
+ */
+#ifndef __DATABASE_HPP__
+#define __DATABASE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <data_objs.hpp>
+#include <status.hpp>
+#include <thread_pool.hpp>
+
+class Connection;
+class TableScan;
+
+/**
+ * @brief The outcome of one statement. Statements other than SELECT only
+ * have a status and a message, SELECT also has its rows.
+ *
+ * Example:
+ *   ResultSet result = connection.execute("SELECT * FROM Product;");
+ *   for (const ResultSet::Row &row : result)
+ *     std::string name(row.get<std::string>(1));
+ */
+class ResultSet
+{
+private:
+  friend class Connection;
+
+  Status result_status = Status::OK;
+  std::string result_message;
+  std::shared_ptr<const TableObject> table;
+
+public:
+  /**
+   * @brief A row of the result, valid while its ResultSet is alive
+   */
+  class Row
+  {
+  private:
+    const TableObject *table;
+    size_t row;
+
+  public:
+    Row(const TableObject *table, size_t row) : table(table), row(row) {}
+
+    size_t size() const
+    {
+      return table->fields_size;
+    }
+
+    const variant_type &operator[](size_t col) const
+    {
+      return table->records[row * table->fields_size + col];
+    }
+
+    /**
+     * @brief The value of a column as T, one of int, double, bool or std::string
+     *
+     * @throws std::bad_variant_access when the column holds another type
+     */
+    template <typename T>
+    const T &get(size_t col) const
+    {
+      return std::get<T>((*this)[col]);
+    }
+
+    /**
+     * @brief Whether the column is blank, like the missing side of an outer join
+     */
+    bool isNull(size_t col) const;
+  };
+
+  class iterator
+  {
+  private:
+    const TableObject *table;
+    size_t row;
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Row;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Row;
+
+    iterator(const TableObject *table, size_t row) : table(table), row(row) {}
+
+    Row operator*() const
+    {
+      return Row(table, row);
+    }
+
+    iterator &operator++()
+    {
+      row++;
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const
+    {
+      return row == other.row;
+    }
+
+    bool operator!=(const iterator &other) const
+    {
+      return row != other.row;
+    }
+  };
+
+  Status status() const
+  {
+    return result_status;
+  }
+
+  bool ok() const
+  {
+    return result_status == Status::OK;
+  }
+
+  /**
+   * @brief The line the repl prints for the statement, e.g. "Table Product created."
+   */
+  const std::string &message() const
+  {
+    return result_message;
+  }
+
+  /**
+   * @brief Whether the statement produced rows, only SELECT does
+   */
+  bool hasRows() const
+  {
+    return table != nullptr;
+  }
+
+  size_t columnCount() const;
+  size_t rowCount() const;
+
+  /**
+   * @brief Column names in select order
+   */
+  std::vector<std::string> columns() const;
+
+  /**
+   * @brief Column types as declared, e.g. int, float, varchar(20)
+   */
+  std::vector<std::string> columnTypes() const;
+
+  Row row(size_t index) const
+  {
+    return Row(table.get(), index);
+  }
+
+  iterator begin() const
+  {
+    return iterator(table.get(), 0);
+  }
+
+  iterator end() const
+  {
+    return iterator(table.get(), rowCount());
+  }
+
+  /**
+   * @brief The rows as the pipe delimited table the repl prints
+   */
+  std::string format() const;
+};
+
+/**
+ * @brief Rows fetched from a Cursor, stored by column. Strings view the
+ * table the cursor reads and stay valid while the batch is alive.
+ */
+class RowBatch
+{
+public:
+  // How a column's values are stored, from its declared type
+  enum class Type : char
+  {
+    INT,
+    FLOAT,
+    STRING,
+    BOOL,
+  };
+
+  /**
+   * @brief One column of the batch. Only the vector of its type is filled,
+   * nulls has an entry for every row.
+   */
+  struct Column
+  {
+    Type type;
+    std::vector<int32_t> ints;
+    std::vector<double> doubles;
+    std::vector<std::string_view> strings;
+    std::vector<char> bools;
+    std::vector<char> nulls;
+  };
+
+private:
+  friend class Cursor;
+
+  std::shared_ptr<const TableObject> source;
+  std::vector<Column> column_data;
+  size_t row_count = 0;
+
+  const Column &typed(size_t col, Type type) const;
+
+public:
+  size_t size() const
+  {
+    return row_count;
+  }
+
+  bool empty() const
+  {
+    return row_count == 0;
+  }
+
+  size_t columnCount() const
+  {
+    return column_data.size();
+  }
+
+  const Column &column(size_t col) const
+  {
+    return column_data[col];
+  }
+
+  bool isNull(size_t row, size_t col) const
+  {
+    return column_data[col].nulls[row];
+  }
+
+  /**
+   * @throws std::invalid_argument when the column isn't an int column
+   */
+  int32_t getInt(size_t row, size_t col) const
+  {
+    return typed(col, Type::INT).ints[row];
+  }
+
+  /**
+   * @brief The value of a float column, or an int column widened to double
+   *
+   * @throws std::invalid_argument when the column isn't a number
+   */
+  double getDouble(size_t row, size_t col) const;
+
+  /**
+   * @throws std::invalid_argument when the column isn't a char or varchar column
+   */
+  std::string_view getString(size_t row, size_t col) const
+  {
+    return typed(col, Type::STRING).strings[row];
+  }
+
+  /**
+   * @throws std::invalid_argument when the column isn't a bool column
+   */
+  bool getBool(size_t row, size_t col) const
+  {
+    return typed(col, Type::BOOL).bools[row];
+  }
+};
+
+/**
+ * @brief Reads the rows of a SELECT incrementally. Rows are only filtered
+ * and copied as they are fetched, so memory is bounded by the batch size
+ * rather than by the size of the result.
+ *
+ * Example:
+ *   Cursor cursor = connection.query("SELECT pid, name FROM Product;");
+ *   for (RowBatch batch = cursor.fetch(1024); !batch.empty(); batch = cursor.fetch(1024))
+ *     for (size_t row = 0; row < batch.size(); row++)
+ *       use(batch.getInt(row, 0), batch.getString(row, 1));
+ */
+class Cursor
+{
+private:
+  friend class Connection;
+
+  Status cursor_status = Status::OK;
+  std::string cursor_message;
+  std::shared_ptr<TableScan> scan;
+  // Row numbers of the batch being fetched, reused between fetches
+  std::vector<int> row_buffer;
+
+public:
+  Status status() const
+  {
+    return cursor_status;
+  }
+
+  bool ok() const
+  {
+    return cursor_status == Status::OK;
+  }
+
+  const std::string &message() const
+  {
+    return cursor_message;
+  }
+
+  /**
+   * @brief Whether the statement produced rows, only SELECT does
+   */
+  bool hasRows() const
+  {
+    return scan != nullptr;
+  }
+
+  std::vector<std::string> columns() const;
+  std::vector<std::string> columnTypes() const;
+
+  /**
+   * @brief Whether every row has been fetched
+   */
+  bool done() const;
+
+  /**
+   * @brief Fetches up to count more rows, an empty batch once the rows run out
+   */
+  RowBatch fetch(size_t count);
+};
+
+class Database;
+
+/**
+ * @brief A session on a Database. It tracks the database in use, like the
+ * repl's USE, and has its own transaction, prepared statements and plan
+ * cache. Connections share the table files, so statements from every
+ * connection run one at a time; each one still uses the whole pool for its
+ * morsels.
+ */
+class Connection
+{
+private:
+  // Kept alive by queries submitted on the connection
+  struct Session;
+  std::shared_ptr<Session> session;
+
+public:
+  explicit Connection(Database &database);
+  Connection(Connection &&other) noexcept;
+  Connection &operator=(Connection &&other) noexcept;
+  ~Connection();
+
+  /**
+   * @brief Runs one or more statements
+   *
+   * @param sql the statements, each ended with ';'
+   * @return ResultSet the result of the last statement
+   */
+  ResultSet execute(std::string_view sql);
+
+  /**
+   * @brief Queues statements to run on the worker pool and returns at once.
+   * Queries run in submission order, after the ones already queued. They keep
+   * the connection's session alive, so the future stays valid after the
+   * Connection and its Database are destroyed.
+   *
+   * Submitted queries from every connection share one queue, drained by a
+   * single pool task, and like execute() they run one statement at a time
+   * across the process. A long query delays every query queued after it, so
+   * give it a timeout: the clock starts when the query starts running, and
+   * time spent in the queue doesn't count against it.
+   *
+   * Example:
+   *   CancelToken token = CancelToken::withTimeout(std::chrono::seconds(5));
+   *   std::future<ResultSet> result = connection.submit("SELECT * FROM A a, B b WHERE a.id = b.id;", token);
+   *   token.cancel(); // the result's status becomes Status::CANCELLED
+   *
+   * @param sql the statements, each ended with ';'
+   * @param token [default: never cancelled] checked between morsels, a cancelled
+   * or timed out query stops and reports Status::CANCELLED, a query cancelled
+   * while still queued never runs
+   * @return std::future<ResultSet> the result of the last statement
+   */
+  std::future<ResultSet> submit(std::string sql, CancelToken token = CancelToken());
+
+  /**
+   * @brief Runs one or more statements and opens a cursor on the last one's
+   * rows without reading them
+   *
+   * @param sql the statements, each ended with ';'
+   * @return Cursor over the rows of the last statement
+   */
+  Cursor query(std::string_view sql);
+
+  /**
+   * @brief Runs a script, handing over each statement's result as it finishes
+   * so large scripts don't keep every result around
+   *
+   * @param script the statements
+   * @param each called with every result in script order
+   * @return bool false when the script ran .EXIT and stopped there
+   */
+  bool executeScript(std::string_view script, const std::function<void(const ResultSet &)> &each);
+
+  /**
+   * @brief Runs a script and collects every statement's result
+   */
+  std::vector<ResultSet> executeScript(std::string_view script);
+
+  /**
+   * @brief Name of the database in use, "nil" before USE
+   */
+  std::string currentDatabase() const;
+};
+
+/**
+ * @brief A directory of databases. Tables live in <path>/<database>/<table>.proto
+ */
+class Database
+{
+private:
+  std::string data_path;
+
+public:
+  /**
+   * @brief Opens the data directory, which is created by the first CREATE DATABASE
+   *
+   * @param path [default: data] the directory holding the databases
+   */
+  explicit Database(std::string path = "data");
+
+  const std::string &path() const
+  {
+    return data_path;
+  }
+
+  Connection connect()
+  {
+    return Connection(*this);
+  }
+};
+
+#endif /* __DATABASE_HPP__ */
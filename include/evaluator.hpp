@@ -11,20 +11,37 @@
 
 #include <typeinfo>
 #include <any>
+#include <cctype>
+#include <charconv>
 #include <string>
 #include <functional>
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <limits>
 #include <objects.hpp>
+#include <status.hpp>
 #include <data_objs.hpp>
 #include <proto_generator.hpp>
+#include <table_scan.hpp>
+#include <hash_aggregate.hpp>
+#include <planner.hpp>
 #include <ast.hpp>
 
-object::Object *eval(ast::Node *node, DatabaseObject *current_database);
+object::Result *eval(ast::Node *node, DatabaseObject *current_database);
+// Defined in prepared.hpp
+object::Result *evalPrepare(ast::PrepareStatement *node, DatabaseObject *current_database);
+object::Result *evalExecute(ast::ExecuteStatement *node, DatabaseObject *current_database);
+// Defined in plan_cache.hpp
+object::Result *evalStats(ast::Node *node, DatabaseObject *current_database);
+// Defined in explain.hpp
+object::Result *evalExplain(ast::ExplainStatement *node, DatabaseObject *current_database);
 
 // Fieldname , <Type, Count>
 using fieldmapType = std::vector<std::pair<std::string, std::tuple<std::string, int>>>;
 
 // Evaluate column definition expression node and create a fieldMapType from it
-fieldmapType evalFields(ast::ColumnDefinitionExpression *node)
+inline fieldmapType evalFields(ast::ColumnDefinitionExpression *node)
 {
   fieldmapType res;
   int fieldNum = 1;
@@ -37,10 +54,278 @@ fieldmapType evalFields(ast::ColumnDefinitionExpression *node)
   return res;
 }
 
-// Typedef for std::function parameters
-using evalFnType = std::function<object::Object *(ast::Node *, DatabaseObject *)>;
+/**
+ * @brief Finds a column tables can't store. bool is a keyword, but there is
+ * no literal to insert one with and table files don't read them back.
+ *
+ * @return std::string the first bool column, empty when there is none
+ */
+inline std::string unstorableColumn(const fieldmapType &fields)
+{
+  for (const auto &field : fields)
+  {
+    std::string type = std::get<0>(field.second);
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    if (type == "bool")
+    {
+      return field.first;
+    }
+  }
+  return "";
+}
+
+/**
+ * @brief Checks the WITH options of a CREATE TABLE
+ *
+ * @return std::vector<std::string> the columns to keep Bloom filters for
+ * @throws std::invalid_argument when an option is unknown or names a column that can't have one
+ */
+inline std::vector<std::string> evalTableOptions(const std::string &tbl_name, const fieldmapType &fields,
+                                                 ast::TableOptionExpression *option)
+{
+  std::vector<std::string> bloom_filters;
+  for (; option != nullptr; option = option->right)
+  {
+    std::string name(option->token.literal);
+    std::string column(option->value.literal);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name != "bloom_filter")
+    {
+      throw std::invalid_argument("!Failed to create " + tbl_name + " since option " + std::string(option->token.literal) + " is unknown.");
+    }
+    auto field = std::find_if(fields.begin(), fields.end(), [&](const auto &field)
+                              { return field.first == column; });
+    if (field == fields.end())
+    {
+      throw std::invalid_argument("!Failed to create " + tbl_name + " since column " + column + " does not exist.");
+    }
+    std::string type = std::get<0>(field->second);
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    if (type != "int" && type != "char" && type != "varchar")
+    {
+      throw std::invalid_argument("!Failed to create " + tbl_name + " since a Bloom filter needs an int or char column.");
+    }
+    if (std::find(bloom_filters.begin(), bloom_filters.end(), field->first) == bloom_filters.end())
+    {
+      bloom_filters.push_back(field->first);
+    }
+  }
+  return bloom_filters;
+}
+
+/**
+ * @brief Whether a SELECT has aggregates or GROUP BY and so runs through HashAggregate
+ */
+inline bool isAggregateSelect(ast::SelectTableStatement *node)
+{
+  for (ast::ColumnQueryExpression *column = node->column_query; column != nullptr; column = column->right)
+  {
+    if (column->aggregate != nullptr)
+    {
+      return true;
+    }
+  }
+  return node->group_by != nullptr;
+}
+
+/**
+ * @brief Names the columns a single table SELECT reads, in its select list,
+ * WHERE, GROUP BY and ORDER BY, so the reader can leave out the rest
+ *
+ * @param columns filled with the column names, which may repeat
+ * @return bool false when the select reads every column, as with SELECT *
+ */
+inline bool referencedColumns(ast::SelectTableStatement *node, std::vector<std::string> &columns)
+{
+  for (ast::ColumnQueryExpression *column = node->column_query; column != nullptr; column = column->right)
+  {
+    if (column->token.type == token_type::ASTERISK)
+    {
+      // COUNT(*) counts rows without reading any column
+      if (column->aggregate == nullptr)
+      {
+        return false;
+      }
+      continue;
+    }
+    columns.emplace_back(column->token.literal);
+  }
+  if (node->query != nullptr)
+  {
+    columns.emplace_back(node->query->token.literal);
+  }
+  for (ast::ColumnQueryExpression *column = node->group_by; column != nullptr; column = column->right)
+  {
+    columns.emplace_back(column->token.literal);
+  }
+  for (ast::OrderByExpression *order_by = node->order_by; order_by != nullptr; order_by = order_by->right)
+  {
+    if (order_by->token.type != token_type::ASTERISK)
+    {
+      columns.emplace_back(order_by->token.literal);
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Aggregates the rows of tbl that pass the where expression
+ *
+ * @throws std::invalid_argument when the select list doesn't fit the table
+ */
+inline std::shared_ptr<TableScan> evalAggregate(ast::SelectTableStatement *node, const TableObject &tbl,
+                                                std::tuple<std::string, std::string, std::string> *where)
+{
+  std::vector<HashAggregate::Output> select;
+  for (ast::ColumnQueryExpression *column = node->column_query; column != nullptr; column = column->right)
+  {
+    select.push_back(HashAggregate::Output{
+        column->aggregate == nullptr ? ast::AggregateFunction::NONE : ast::aggregateFunction(column->aggregate->literal),
+        std::string(column->token.literal)});
+  }
+  std::vector<std::string> group_by;
+  for (ast::ColumnQueryExpression *column = node->group_by; column != nullptr; column = column->right)
+  {
+    group_by.emplace_back(column->token.literal);
+  }
+  HashAggregate aggregate(tbl, select, group_by);
+  QueryProfile::Timer timer("aggregate");
+  std::vector<int> rows = ProtoGenerator::getWhereRows(tbl, WherePredicate(tbl, where));
+  auto groups = std::make_shared<TableObject>(aggregate.run(rows));
+  if (timer.enabled())
+  {
+    timer.op.rows_in = tbl.fields_size == 0 ? 0 : tbl.records.size() / tbl.fields_size;
+    timer.op.rows_out = groups->fields_size == 0 ? 0 : groups->records.size() / groups->fields_size;
+    timer.op.memory = QueryProfile::tableBytes(*groups);
+  }
+  return std::make_shared<TableScan>(groups);
+}
+
+/**
+ * @brief The row count of LIMIT or OFFSET
+ *
+ * @throws std::invalid_argument when it isn't a non-negative int
+ */
+inline size_t evalRowCount(const Token *count, const std::string &clause)
+{
+  size_t value = 0;
+  std::string_view literal = count->literal;
+  auto [end, error] = std::from_chars(literal.data(), literal.data() + literal.size(), value);
+  if (count->type != token_type::INT || error != std::errc() || end != literal.data() + literal.size())
+  {
+    throw std::invalid_argument("!Failed to query since " + clause + " needs a non-negative int.");
+  }
+  return value;
+}
+
+/**
+ * @brief Orders the rows of a scan by the ORDER BY columns, which name columns
+ * of the table it reads or, after aggregation, aggregates like COUNT(*)
+ *
+ * @throws std::invalid_argument when a column doesn't exist
+ */
+inline void evalOrderBy(ast::OrderByExpression *order_by, TableScan &rows)
+{
+  const TableObject &tbl = rows.source();
+  std::vector<ExternalSort::Key> keys;
+  for (; order_by != nullptr; order_by = order_by->right)
+  {
+    std::string name(order_by->token.literal);
+    if (order_by->aggregate != nullptr)
+    {
+      name = HashAggregate::outputName(ast::aggregateFunction(order_by->aggregate->literal), name);
+    }
+    auto field = std::find_if(tbl.fields.begin(), tbl.fields.end(), [&](const auto &field)
+                              { return field.first == name; });
+    if (field == tbl.fields.end())
+    {
+      throw std::invalid_argument("!Failed to order by " + name + " since it is not a column.");
+    }
+    keys.push_back(ExternalSort::Key{(int)(field - tbl.fields.begin()), order_by->descending});
+  }
+  rows.orderBy(keys);
+}
+
+/**
+ * @brief The where expression of a select from one table
+ *
+ * @param where set to (column_name operator value)
+ * @return bool false when the select has no where expression
+ */
+inline bool evalSelectWhere(ast::SelectTableStatement *node, std::tuple<std::string, std::string, std::string> &where)
+{
+  ast::WhereExpression *where_query = node->query;
+  if (where_query == nullptr)
+  {
+    return false;
+  }
+  where = make_tuple(std::string(where_query->token.literal), std::string(where_query->op.literal),
+                     std::string(where_query->value.literal));
+  return true;
+}
+
+/**
+ * @brief The tables and sections of a select joining two tables by alias
+ *
+ * @param var_table filled with the tables and their aliases
+ * @param joins set to the left outer, inner and right outer sections joined
+ * @param where set to the (left key, operator, right key) checks
+ * @return bool false when neither the join nor the select has checks
+ */
+inline bool evalJoinTables(ast::SelectTableStatement *node, std::vector<std::pair<std::string, std::string>> &var_table,
+                           std::array<bool, 3> &joins, std::tuple<std::string, std::string, std::string> &where)
+{
+  ast::TableIdentifierList *names = node->names;
+  joins = {false, false, false};
+  for (ast::TableIdentifierList *table_ident_ptr = names; table_ident_ptr != nullptr; table_ident_ptr = table_ident_ptr->right)
+  {
+    var_table.push_back(std::make_pair(std::string(table_ident_ptr->token.literal), std::string(table_ident_ptr->alias->literal)));
+    joins[1] = true;
+  }
+  // A single alias joins the table named by the join expression, as an inner join
+  // unless it says which outer sections to include
+  if (names->right == nullptr)
+  {
+    ast::JoinExpression *join_expr = node->join_expr;
+    var_table.push_back(std::make_pair(std::string(join_expr->join_ident->literal), std::string(join_expr->join_alias->literal)));
+    joins[1] = true;
+    if (join_expr->token.type != token_type::INNER)
+    {
+      if (join_expr->include->type == token_type::LEFT) joins[0] = true;
+      if (join_expr->include->type == token_type::RIGHT) joins[2] = true;
+      if (join_expr->include->type == token_type::FULL) joins[0] = joins[2] = true;
+    }
+  }
+  // Get Where from Join or from statement
+  ast::WhereExpression *where_query = (node->query == nullptr) ? node->join_expr->where : node->query;
+  if (where_query == nullptr)
+  {
+    return false;
+  }
+  where = make_tuple(std::string(where_query->token_alias->literal), std::string(where_query->op.literal),
+                     std::string(where_query->value_alias->literal));
+  return true;
+}
+
+/**
+ * @brief The transaction opened by BEGIN TRANSACTION in a session
+ *
+ * @param active set until the next COMMIT
+ * @param tables tables locked by UPDATEs in the transaction
+ */
+struct TransactionState
+{
+  bool active = false;
+  std::vector<std::string> tables;
+};
+// Defined in session.hpp, the transaction of the session running on this thread
+TransactionState &currentTransaction();
+
+// Typedef for std::function parameters. Statements report their outcome
+// in the returned result and never write to stdout themselves.
+using evalFnType = std::function<object::Result *(ast::Node *, DatabaseObject *)>;
 // Map token identifiers with equivalent runtimes
-std::unordered_map<std::string, evalFnType> evalStatementFns = {
+inline std::unordered_map<std::string, evalFnType> evalStatementFns = {
     // Create a table using ProtoGenerator::createTBL based on fields evaluated using evalFields()
     {"CREATETBL", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                              {
@@ -48,99 +333,128 @@ std::unordered_map<std::string, evalFnType> evalStatementFns = {
       fieldmapType fields = evalFields(node_->column_list);
       if (current_database->name() == "nil") 
       {
-        cout << "Not currently using any database.\n";
-        return new object::Integer(1);
+        return object::Result::failed(1, "Not currently using any database.");
+      }
+      std::string unstorable = unstorableColumn(fields);
+      if (!unstorable.empty())
+      {
+        return object::Result::failed(2, "!Failed to create " + std::string(*node_->name) + " since column " + unstorable + " is a bool, which tables can't store.");
+      }
+      std::vector<std::string> bloom_filters;
+      try
+      {
+        bloom_filters = evalTableOptions(std::string(*node_->name), fields, node_->options);
       }
-      DatabaseObject new_db = ProtoGenerator::createTBL(current_database->name(), std::string(*node_->name), fields);
+      catch (const std::invalid_argument &e)
+      {
+        return object::Result::failed(2, e.what());
+      }
+      DatabaseObject new_db = ProtoGenerator::createTBL(current_database->name(), std::string(*node_->name), fields, bloom_filters);
       if(new_db.name() != "nil") 
       {
         //*current_database = ProtoGenerator::loadDB(current_database->name());
-        cout << "Table " << std::string(*node_->name) << " created.\n";
-        return new object::Integer(0); 
+        return object::Result::ok(0, "Table " + std::string(*node_->name) + " created.");
       }
-      cout << "!Failed to create " << std::string(*node_->name) << " because it already exists.\n";
-      return new object::Integer(1); })},
+      return object::Result::failed(1, "!Failed to create " + std::string(*node_->name) + " because it already exists."); })},
     // Create a database using  current database object node information
     {"CREATEDB", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                             {
       auto node_ = dynamic_cast<ast::CreateDatabaseStatement*>(node);
       if(ProtoGenerator::createDB(std::string(*node_->name))){
-        cout << "Database " << std::string(*node_->name) << " created.\n";
-        return new object::Integer(0); 
+        return object::Result::ok(0, "Database " + std::string(*node_->name) + " created.");
+      }
+      return object::Result::failed(1, "!Failed to create " + std::string(*node_->name) + " as it already exists."); })},
+    // Collect the statistics of a table in the current database
+    {"ANALYZE", evalFnType([](ast::Node *node, DatabaseObject *current_database)
+                           {
+      auto node_ = dynamic_cast<ast::AnalyzeTableStatement*>(node);
+      if (current_database->name() == "nil")
+      {
+        return object::Result::failed(1, "!Failed to analyze " + std::string(*node_->name) + " because no database was selected.");
+      }
+      try
+      {
+        auto stats = ProtoGenerator::analyzeTBL(current_database->name(), std::string(*node_->name));
+        return object::Result::ok(0, "Table " + std::string(*node_->name) + " analyzed, " + std::to_string(stats->rows) + " rows.");
       }
-      cout << "!Failed to create " << std::string(*node_->name) << " as it already exists.\n";
-      return new object::Integer(1); })},
+      catch (const std::invalid_argument &e)
+      {
+        return object::Result::failed(2, e.what());
+      } })},
     // Drop table in the current database
     {"DROPTBL", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                            {
       auto node_ = dynamic_cast<ast::DropTableStatement*>(node);
       if (current_database->name() == "nil") 
       {
-        cout << "!Failed to delete " << std::string(*node_->name) << " because no database was selected.\n";
-        return new object::Integer(1);
+        return object::Result::failed(1, "!Failed to delete " + std::string(*node_->name) + " because no database was selected.");
       }
       if (ProtoGenerator::dropTBL(current_database->name(), std::string(*node_->name))) 
       {
-        cout << "!Failed to delete " << std::string(*node_->name) << " because it does not exist.\n";
-        return new object::Integer(2);
+        return object::Result::failed(2, "!Failed to delete " + std::string(*node_->name) + " because it does not exist.");
       }
-      cout << "Table " << std::string(*node_->name) << " deleted.\n";
-      return new object::Integer(0); })},
+      return object::Result::ok(0, "Table " + std::string(*node_->name) + " deleted."); })},
     // Deletes database directory
     {"DROPDB", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                           {
       auto node_ = dynamic_cast<ast::DropDatabaseStatement*>(node);
       if (ProtoGenerator::deleteDB(std::string(*node_->name))) 
       {
-        cout << "-- !Failed to delete " << std::string(*node_->name) << " because it does not exist.\n";
-        return new object::Integer(2);
+        return object::Result::failed(2, "-- !Failed to delete " + std::string(*node_->name) + " because it does not exist.");
       }
-      cout << "Database " << std::string(*node_->name) << " deleted.\n";
-      return new object::Integer(0); })},
+      return object::Result::ok(0, "Database " + std::string(*node_->name) + " deleted."); })},
     // Select the currently used database
     {"USE", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                        {
       auto node_ = dynamic_cast<ast::UseDatabaseStatement*>(node);
       if(ProtoGenerator::DBExists(*node_->name)) 
       {
-        cout << "Using database " << std::string(*node_->name) << ".\n";
         *current_database = ProtoGenerator::loadDB(std::string(*node_->name));
-        return new object::Integer(0);
+        return object::Result::ok(0, "Using database " + std::string(*node_->name) + ".");
       } 
-      cout << "!Failed to use " << std::string(*node_->name) << " because it doesn't exist.\n";
-      return new object::Integer(1); })},
+      return object::Result::failed(1, "!Failed to use " + std::string(*node_->name) + " because it doesn't exist."); })},
     // Alter a table
     {"ALTER", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                          {
       auto node_ = dynamic_cast<ast::AlterTableStatement*>(node);
       if (current_database->name() == "nil") 
       {
-        cout << "!Failed to alter " << std::string(*node_->name) << " because no database was selected.\n";
-        return new object::Integer(1);
+        return object::Result::failed(1, "!Failed to alter " + std::string(*node_->name) + " because no database was selected.");
       }
       ast::ColumnDefinitionExpression *column_def = node_->column_list;
+      if (!unstorableColumn(evalFields(column_def)).empty())
+      {
+        return object::Result::failed(2, "!Failed to alter " + std::string(*node_->name) + " since column " + column_def->tokenLiteral() + " is a bool, which tables can't store.");
+      }
       DatabaseObject addedFieldDb = ProtoGenerator::addFieldTBL(
         current_database->name(),
         std::string(*node_->name), 
         column_def->tokenLiteral(), 
         (column_def->count != nullptr ? ("(" + column_def->count->tokenLiteral() + ")") : ""), 
-        column_def->token_vartype.literal).name();
+        std::string(column_def->token_vartype.literal)).name();
       if (addedFieldDb.name() != "nil") 
       {
         *current_database = ProtoGenerator::loadDB(current_database->name());
-        cout <<"Table " << std::string(*node_->name) << " modified.\n";
-        return new object::Integer(0);
+        return object::Result::ok(0, "Table " + std::string(*node_->name) + " modified.");
       }
-      cout << "!Could not modify or find table.\n";
-      return new object::Integer(1); 
+      return object::Result::failed(1, "!Could not modify or find table."); 
     })},
-    // Prints the table based on the node parameters
+    // Selects the rows of the table based on the node parameters
     // Checks whether table has alias or not
     // Checks whether there's a join or not
     {"SELECT", evalFnType([](ast::Node *node, DatabaseObject *current_database){
       auto node_ = dynamic_cast<ast::SelectTableStatement*>(node);
       if (current_database->name() == "nil") {
-        cout << "!Failed to select from table since no database is selected.\n";
+        return object::Result::failed(1, "!Failed to select from table since no database is selected.");
+      }
+      std::shared_ptr<TableScan> rows;
+      size_t offset = 0;
+      size_t limit = std::numeric_limits<size_t>::max();
+      try {
+        if (node_->limit != nullptr) limit = evalRowCount(node_->limit, "LIMIT");
+        if (node_->offset != nullptr) offset = evalRowCount(node_->offset, "OFFSET");
+      } catch (const std::invalid_argument &e) {
+        return object::Result::failed(2, e.what());
       }
 
       ast::TableIdentifierList *names = node_->names;
@@ -155,85 +469,140 @@ std::unordered_map<std::string, evalFnType> evalStatementFns = {
             filter_ptr = nullptr;
             break;
           }
-          filter_vec.push_back(column_query->token.literal);
+          filter_vec.emplace_back(column_query->token.literal);
           column_query = column_query->right;
         }
         // Now get where
-        ast::WhereExpression *where_query = node_->query;
         std::tuple<std::string, std::string, std::string> where_tpl;
-        std::tuple<std::string, std::string, std::string> *where_ptr = nullptr;
-        if (where_query != nullptr) {
-          where_tpl = make_tuple(where_query->token.literal, where_query->op.literal, where_query->value.literal);
-          where_ptr = &where_tpl;
+        std::tuple<std::string, std::string, std::string> *where_ptr = evalSelectWhere(node_, where_tpl) ? &where_tpl : nullptr;
+        // A plain scan only needs its first offset + limit rows, so the reader stops there
+        size_t max_rows = std::numeric_limits<size_t>::max();
+        if (where_ptr == nullptr && node_->order_by == nullptr && !isAggregateSelect(node_)) {
+          max_rows = limit > max_rows - offset ? max_rows : offset + limit;
+        }
+        // Columns the select never names aren't decoded
+        std::vector<std::string> read_columns;
+        bool projected = referencedColumns(node_, read_columns);
+        // The reader only skips pages by the where expression when the planner finds that cheaper
+        std::string tbl_name(names->token.literal);
+        Planner::Plan plan = Planner::planScan(current_database->name(), tbl_name, where_ptr);
+        bool skip_pages = !plan.tables.empty() && plan.tables[0].access == Planner::Access::ZONE_MAP_SCAN;
+        std::shared_ptr<TableObject> tbl = ProtoGenerator::openTBL(current_database->name(), tbl_name, max_rows,
+                                                                   projected ? &read_columns : nullptr,
+                                                                   skip_pages ? where_ptr : nullptr);
+        if (tbl == nullptr) {
+          return object::Result::failed(2, "!Failed to query table because it does not exist.");
+        }
+        if (isAggregateSelect(node_)) {
+          try {
+            rows = evalAggregate(node_, *tbl, where_ptr);
+          } catch (const std::invalid_argument &e) {
+            return object::Result::failed(2, e.what());
+          }
+        } else {
+          rows = std::make_shared<TableScan>(tbl, filter_ptr, where_ptr);
         }
-        cout << ProtoGenerator::printTBL(current_database->name(), names->token.literal, filter_ptr, where_ptr) << endl;
       } else { // multi alias where or single alias join
         // Load references of all variables and alias
         std::vector<std::pair<std::string, std::string>> var_table;
-        std::array<bool, 3> joins{false, false, false}; 
-        ast::TableIdentifierList *table_ident_ptr = names;
-        while (table_ident_ptr != nullptr) {
-          std::string ident = table_ident_ptr->token.literal;
-          std::string alias = table_ident_ptr->alias->literal;
-          var_table.push_back(std::make_pair(ident, alias));
-          table_ident_ptr = table_ident_ptr->right;
-          joins[1] = true;
-        }
-        // single alias join, only one ident-alias pair was added
-        if (names->right == nullptr && node_->join_expr->token.type != token_type::INNER) {
-          ast::JoinExpression *join_expr = node_->join_expr;
-          std::string ident = join_expr->join_ident->literal;
-          std::string alias = join_expr->join_alias->literal;
-          var_table.push_back(std::make_pair(ident, alias));
-          joins[1] = true;
-          if (join_expr->include->type == token_type::LEFT) joins[0] = true;
-          if (join_expr->include->type == token_type::RIGHT) joins[2] = true;
-        } else if (names->right == nullptr) { // must set as a inner join based on syntax used
-          ast::JoinExpression *join_expr = node_->join_expr;
-          std::string ident = join_expr->join_ident->literal;
-          std::string alias = join_expr->join_alias->literal;
-          var_table.push_back(std::make_pair(ident, alias));
-          joins[1] = true;
-        }
-        // Get Where from Join or from statement
-        ast::WhereExpression *where_query = (node_->query == nullptr) ? node_->join_expr->where : node_->query;
+        std::array<bool, 3> joins;
         std::tuple<std::string, std::string, std::string> where_tpl;
-        std::tuple<std::string, std::string, std::string> *where_ptr = nullptr;
-        if (where_query != nullptr) {
-          where_tpl = make_tuple(where_query->token_alias->literal, where_query->op.literal, where_query->value_alias->literal);
-          where_ptr = &where_tpl;
+        std::tuple<std::string, std::string, std::string> *where_ptr =
+            evalJoinTables(node_, var_table, joins, where_tpl) ? &where_tpl : nullptr;
+        try {
+          Planner::Plan plan = Planner::planJoin(current_database->name(), where_ptr, var_table, joins);
+          auto joined = std::make_shared<TableObject>(
+              ProtoGenerator::joinTBL(current_database->name(), where_ptr, var_table, joins, plan.join_choice));
+          // The join already applied the where expression
+          rows = isAggregateSelect(node_) ? evalAggregate(node_, *joined, nullptr) : std::make_shared<TableScan>(joined);
+        } catch (const std::invalid_argument &e) {
+          return object::Result::failed(2, e.what());
+        }
+      }
+      // Set before ordering, so ORDER BY ... LIMIT only keeps the top rows
+      rows->limit(offset, limit);
+      if (node_->order_by != nullptr) {
+        try {
+          evalOrderBy(node_->order_by, *rows);
+        } catch (const std::invalid_argument &e) {
+          return object::Result::failed(2, e.what());
         }
-        std::cout << ProtoGenerator::printTBLJoin(current_database->name(), where_ptr, var_table, joins) << std::endl;
       }
-      return new object::Integer(7); })},
+      return new object::Result(Status::OK, 7, "", rows); })},
     /**
-     * @brief Connects AST nodes on INSERT statement to run insertTBL statement
+     * @brief Connects AST nodes on INSERT statement to run ProtoGenerator::appendTBL
      */
     {"INSERT", evalFnType([](ast::Node *node, DatabaseObject *current_database) {
       auto node_ = dynamic_cast<ast::InsertTableStatement*>(node);
       // Database check
       if (current_database->name() == "nil") {
-        cout << "!Failed to insert to table since no database is selected.\n";
-      }
-      ast::ColumnLiteralExpression *column_list = node_->column_list;
-      std::vector<std::variant<int, bool, std::string, double>> value_list;
-      std::string format = "";
-      while (column_list != nullptr) {
-        if (column_list->token_vartype.literal == "IDENTIFIER") {
-          value_list.push_back(column_list->token.literal);
-        } else if (column_list->token_vartype.literal == "INT") {
-          value_list.push_back(std::stoi(column_list->token.literal));
-        } else if (column_list->token_vartype.literal == "FLOAT") {
-          value_list.push_back(std::stod(column_list->token.literal));
+        return object::Result::failed(1, "!Failed to insert to table since no database is selected.");
+      }
+      std::string table_name(*node_->name);
+      std::vector<std::vector<std::variant<int, bool, std::string, double>>> rows;
+      rows.reserve(node_->rows.size());
+      for (ast::ColumnLiteralExpression *column_list : node_->rows) {
+        std::vector<std::variant<int, bool, std::string, double>> value_list;
+        while (column_list != nullptr) {
+          std::string_view literal = column_list->token.literal;
+          const char *last = literal.data() + literal.size();
+          std::from_chars_result parsed{last, std::errc()};
+          if (column_list->token_vartype.type == token_type::IDENTIFIER) {
+            value_list.push_back(std::string(literal));
+          } else if (column_list->token_vartype.type == token_type::INT) {
+            int number = 0;
+            parsed = std::from_chars(literal.data(), last, number);
+            value_list.push_back(number);
+          } else if (column_list->token_vartype.type == token_type::FLOAT) {
+            double number = 0;
+            parsed = std::from_chars(literal.data(), last, number);
+            value_list.push_back(number);
+          }
+          // Literals too large for their type fail the statement before anything is written
+          if (parsed.ec != std::errc() || parsed.ptr != last) {
+            return object::Result::failed(3, "!Failed to insert into " + table_name + ", row " + std::to_string(rows.size() + 1) +
+                                                 " has an invalid value " + std::string(literal) + ".");
+          }
+          column_list = column_list->right;
+        }
+        rows.push_back(std::move(value_list));
+      }
+      // All rows are validated together and appended in one write
+      try {
+        if (!ProtoGenerator::appendTBL(current_database->name(), table_name, std::move(rows))) {
+          return object::Result::failed(2, "!Failed to insert into " + table_name + " because it does not exist.");
         }
-        column_list = column_list->right;
+      } catch (const std::invalid_argument &e) {
+        return object::Result::failed(3, "!Failed to insert into " + table_name + ", " + e.what() + ".");
       }
-      *current_database = ProtoGenerator::insertTBL(current_database->name(), std::string(*node_->name), value_list, format);
+      if (node_->rows.size() == 1) {
+        return object::Result::ok(1, "1 new record inserted.");
+      }
+      return object::Result::ok(1, std::to_string(node_->rows.size()) + " new records inserted.");
+    })},
+    /**
+     * @brief Connects AST nodes on COPY statement to ProtoGenerator::copyFromCSV and copyToCSV
+     */
+    {"COPY", evalFnType([](ast::Node *node, DatabaseObject *current_database) {
+      auto node_ = dynamic_cast<ast::CopyTableStatement*>(node);
       if (current_database->name() == "nil") {
-        std::cout << "!Insertion failed, try to reload the database using USE <database-name>.\n";
+        return object::Result::failed(1, "!Failed to copy table since no database is selected.");
       }
-      std::cout << "1 new record inserted.\n";
-      return new object::Integer(1);
+      std::string table_name(*node_->name);
+      std::string path(node_->path.literal);
+      bool import = node_->direction.type == token_type::FROM;
+      long count;
+      try {
+        count = import ? ProtoGenerator::copyFromCSV(current_database->name(), table_name, path)
+                       : ProtoGenerator::copyToCSV(current_database->name(), table_name, path);
+      } catch (const std::invalid_argument &e) {
+        return object::Result::failed(3, "!Failed to copy into " + table_name + ", " + e.what() + ".");
+      }
+      if (count < 0) {
+        return object::Result::failed(2, "!Failed to copy " + table_name + " because it does not exist.");
+      }
+      return object::Result::ok(0, std::to_string(count) + (count == 1 ? " record" : " records") + " copied " +
+                                   (import ? "from '" : "to '") + path + "'.");
     })},
     /**
      * @brief Connects AST nodes on DELETE statement to run ProtoGenerator::deleteTBL
@@ -242,100 +611,41 @@ std::unordered_map<std::string, evalFnType> evalStatementFns = {
       auto node_ = dynamic_cast<ast::DeleteTableStatement*>(node);
       // Database check
       if (current_database->name() == "nil") {
-        cout << "!Failed to insert to table since no database is selected.\n";
+        return object::Result::failed(1, "!Failed to insert to table since no database is selected.");
       }
       ast::WhereExpression *where_query = node_->query;
       std::tuple<std::string, std::string, std::string> where_tpl;
-      std::tuple<std::string, std::string, std::string> *where_ptr;
+      std::tuple<std::string, std::string, std::string> *where_ptr = nullptr;
       if (where_query != nullptr) {
         where_tpl = make_tuple(where_query->token.literal, where_query->op.literal, where_query->value.literal);
         where_ptr = &where_tpl;
       }
       int delete_count = 0;
       *current_database = ProtoGenerator::deleteTBL(current_database->name(), std::string(*node_->name), &delete_count, where_ptr);
-      std::cout << delete_count << " records deleted.\n";
-      return new object::Integer(1);
+      return object::Result::ok(1, std::to_string(delete_count) + " records deleted.");
     })},
     /**
      * @brief Connects AST nodes on UPDATE statement to run ProtoGenerator::updateTable
      */
     {"TRANSACTION", evalFnType([](ast::Node *node, DatabaseObject *current_database) {
-      auto node_ = dynamic_cast<ast::BeginTransactionStatement*>(node);
       if (current_database->name() == "nil") {
-        cout << "!Failed to update to table since no database is selected.\n";
-        return new object::Integer(1);
-      }
-      // Create an inner repl
-        std::cout << "Transaction started.\n";
-        const std::string repl_prompt = isatty(fileno(stdin)) ? "(transaction) >> " : "";
-        std::string input;
-        std::vector<std::string> transaction_tables;
-        bool breakout = false; //Set to true once we find commit;
-        // Create a sub-REPL
-        do {
-            std::cout << repl_prompt;
-            getline(cin, input);
-            Lexer lexer(input);
-            SQLParser parser(&lexer);
-            // Try to evaluate the program in this sub REPL.
-            // If the lock exists we want to replace any table that is attempted with this lock, so we replace the name of the table
-            try {
-                ast::Program *program = parser.parseSql();
-                // Loop through all statements in the program and try to evaluate them
-                // If they are altering statements then we want to substitute x_lock.proto for them
-
-                // Check the type of the statment here
-                for (ast::Statement *statement : program->statements) {
-                    if (statement->tokenLiteral() == "UPDATE") {
-                        ast::UpdateTableStatement *update_stmt = dynamic_cast<ast::UpdateTableStatement *>(statement);
-                        std::string table_name = std::string(*update_stmt->name);
-                        // Lock the table
-                        if(!ProtoGenerator::lockTbl(current_database->name(), table_name)) {
-                          cout << "Error: Table Flights is locked!\n";
-                        } else {
-                          transaction_tables.push_back(table_name);
-                          // Delegate the task to the original function performed on x_lock.proto
-                          evalStatementFns[update_stmt->tokenLiteral()](update_stmt, current_database);
-                        }
-                    } else if (statement->tokenLiteral() == "COMMIT") {
-                      if (transaction_tables.size() > 0) {
-                        for (std::string table_name : transaction_tables) {
-                            ProtoGenerator::commitTransaction(current_database->name(), table_name);
-                        }
-                        transaction_tables.clear();
-                        cout << "Transaction committed.\n";
-                      } else {
-                        cout << "Transaction abort.\n";
-                      }
-                    } else {
-                      evalStatementFns[statement->tokenLiteral()](statement, current_database);
-                    }
-                }
-            }
-            catch (const expected_token_error &e)
-            {
-            cerr << e.what() << endl;
-            }
-            catch (const unknown_type_error &e)
-            {
-            cerr << e.what() << endl;
-            }
-            catch (const unassigned_parse_function_error &e)
-            {
-            cerr << e.what() << endl;
-            }
-            catch (const unknown_command_error &e)
-            {
-            cerr << e.what() << endl;
-            }
-            catch (const runtime_error &e)
-            {
-            cerr << e.what() << endl;
-            }
-        } while (!breakout);
-
-
-      return new object::Integer(0);
+        return object::Result::failed(1, "!Failed to update to table since no database is selected.");
+      }
+      currentTransaction().active = true;
+      return object::Result::ok(0, "Transaction started.");
+    })},
+    /**
+     * @brief Keeps the changes made on the tables locked by the transaction.
+     * Nothing locked means every update was refused, so the transaction aborts.
+     */
+    {"COMMIT", evalFnType([](ast::Node *, DatabaseObject *current_database) {
+      TransactionState &current_transaction = currentTransaction();
+      bool committed = !current_transaction.tables.empty();
+      for (const std::string &table_name : current_transaction.tables) {
+        ProtoGenerator::commitTransaction(current_database->name(), table_name);
+      }
+      current_transaction = TransactionState();
+      return object::Result::ok(0, committed ? "Transaction committed." : "Transaction abort.");
     })},
     /**
      * @brief Connects AST nodes on UPDATE statement to run ProtoGenerator::updateTable
@@ -344,11 +654,21 @@ std::unordered_map<std::string, evalFnType> evalStatementFns = {
       auto node_ = dynamic_cast<ast::UpdateTableStatement*>(node);
       // Database check
       if (current_database->name() == "nil") {
-        cout << "!Failed to update to table since no database is selected.\n";
+        return object::Result::failed(1, "!Failed to update to table since no database is selected.");
+      }
+      // Inside a transaction the table has to be locked by us before it's changed
+      std::string table_name(*node_->name);
+      TransactionState &current_transaction = currentTransaction();
+      if (current_transaction.active &&
+          std::find(current_transaction.tables.begin(), current_transaction.tables.end(), table_name) == current_transaction.tables.end()) {
+        if (!ProtoGenerator::lockTbl(current_database->name(), table_name)) {
+          return object::Result::failed(1, "Error: Table " + table_name + " is locked!");
+        }
+        current_transaction.tables.push_back(table_name);
       }
       ast::WhereExpression *where_query = node_->query;
       std::tuple<std::string, std::string, std::string> where_tpl;
-      std::tuple<std::string, std::string, std::string> *where_ptr;
+      std::tuple<std::string, std::string, std::string> *where_ptr = nullptr;
       if (where_query != nullptr) {
         where_tpl = make_tuple(where_query->token.literal, where_query->op.literal, where_query->value.literal);
         where_ptr = &where_tpl;
@@ -357,34 +677,52 @@ std::unordered_map<std::string, evalFnType> evalStatementFns = {
       ast::ColumnValueExpression *column_values = node_->column_value;
       std::unordered_map<std::string, std::string> what;
       while (column_values != nullptr) {
-        what[column_values->token.literal] = column_values->value.literal;
+        what[std::string(column_values->token.literal)] = column_values->value.literal;
         column_values = column_values->right;
       }
       int update_count = 0;
-      *current_database = ProtoGenerator::updateTBL(current_database->name(), std::string(*node_->name), what, &update_count, where_ptr);
-      std::cout << update_count << " records modified.\n";
-      return new object::Integer(1);
+      try {
+        *current_database = ProtoGenerator::updateTBL(current_database->name(), table_name, what, &update_count, where_ptr);
+      } catch (const std::invalid_argument &e) {
+        return object::Result::failed(3, "!Failed to update " + table_name + ", " + e.what() + ".");
+      }
+      return object::Result::ok(1, std::to_string(update_count) + " records modified.");
+    })},
+    // Parse a statement once and keep it for EXECUTE
+    {"PREPARE", evalFnType([](ast::Node *node, DatabaseObject *current_database) {
+      return evalPrepare(dynamic_cast<ast::PrepareStatement*>(node), current_database);
+    })},
+    // Run a prepared statement with its arguments bound
+    {"EXECUTE", evalFnType([](ast::Node *node, DatabaseObject *current_database) {
+      return evalExecute(dynamic_cast<ast::ExecuteStatement*>(node), current_database);
     })},
     // Program statement
     {"PROGRAM", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                            {
       auto node_ = dynamic_cast<ast::Program*>(node);
-      object::Object *ret;
+      std::unique_ptr<object::Result> ret;
       for (auto &stmt : node_->statements) 
       {
-        ret = eval(stmt, current_database);
+        ret.reset(eval(stmt, current_database));
+        if (ret->status == Status::EXIT)
+        {
+          break;
+        }
       }
-      return ret; })},
-    // Exit program
+      return ret != nullptr ? ret.release() : object::Result::ok(0, ""); })},
+    // Show the plan of a statement, or run it and show what each operator did
+    {"EXPLAIN", evalFnType([](ast::Node *node, DatabaseObject *current_database) {
+      return evalExplain(dynamic_cast<ast::ExplainStatement*>(node), current_database);
+    })},
+    // Print the plan cache counters
+    {"STATS", evalFnType(evalStats)},
+    // Exit program, the client stops running statements and exits
     {"EXIT", evalFnType([](ast::Node *node, DatabaseObject *current_database)
                         {
-      auto node_ = dynamic_cast<ast::Program*>(node);
-      cout << "All done.\n";
-      exit(EXIT_SUCCESS);
-      return new object::Integer(0); })},
+      return new object::Result(Status::EXIT, 0, "All done."); })},
 };
 
-object::Object *eval(ast::Node *node, DatabaseObject *current_database)
+inline object::Result *eval(ast::Node *node, DatabaseObject *current_database)
 {
   if (evalStatementFns.find(node->tokenLiteral()) != evalStatementFns.end())
   {
@@ -392,8 +730,13 @@ object::Object *eval(ast::Node *node, DatabaseObject *current_database)
   }
   else
   {
-    return new object::Integer(-1);
+    return new object::Result(Status::ERROR, -1, "!Unknown statement " + node->tokenLiteral() + ".");
   }
 }
 
+#include <prepared.hpp>
+#include <plan_cache.hpp>
+#include <explain.hpp>
+#include <session.hpp>
+
 #endif /* __EVALUATOR_HPP__ */
\ No newline at end of file
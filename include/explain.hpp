@@ -0,0 +1,364 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: EXPLAIN and EXPLAIN ANALYZE. EXPLAIN prints the physical plan
+ * the planner picks for a SELECT as a tree of operators with their
+ * estimated rows and cost. EXPLAIN ANALYZE runs the statement with a
+ * QueryProfile active and adds what each operator did to its line.
+ */
+#ifndef __EXPLAIN_HPP__
+#define __EXPLAIN_HPP__
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <ast.hpp>
+#include <data_objs.hpp>
+#include <objects.hpp>
+#include <planner.hpp>
+#include <query_profile.hpp>
+#include <evaluator.hpp>
+
+// An operator of the plan as EXPLAIN prints it
+struct ExplainNode
+{
+  std::string text;
+  // Estimated rows and cost, empty when the planner doesn't estimate the operator
+  std::string estimate;
+  // The QueryProfile operator it is matched with, empty for none
+  std::string key;
+  std::vector<ExplainNode> children;
+  const QueryProfile::Operator *actual = nullptr;
+};
+
+// Rows and costs print whole, small fractions with 3 digits
+inline std::string explainNumber(double value)
+{
+  std::ostringstream ss;
+  if (value >= 100 || value == std::floor(value))
+  {
+    ss << std::llround(value);
+  }
+  else
+  {
+    ss << std::setprecision(3) << value;
+  }
+  return ss.str();
+}
+
+inline std::string explainWhere(const std::tuple<std::string, std::string, std::string> &where)
+{
+  return std::get<0>(where) + " " + std::get<1>(where) + " " + std::get<2>(where);
+}
+
+inline ExplainNode explainScan(const Planner::TableEstimate &table, const std::string &filter)
+{
+  ExplainNode node;
+  node.text = (table.access == Planner::Access::ZONE_MAP_SCAN ? "Zone Map Scan on " : "Full Scan on ") + table.name;
+  if (table.pages > 0)
+  {
+    node.text += ", pages " + std::to_string(table.pages_read) + "/" + std::to_string(table.pages);
+  }
+  if (!filter.empty())
+  {
+    node.text += ", skipping by " + filter;
+  }
+  node.estimate = "estimated rows=" + explainNumber(table.rows) + ", cost=" + explainNumber(table.cost);
+  if (!table.analyzed)
+  {
+    node.estimate += ", not analyzed";
+  }
+  // loadTBL names lock copies of a table X_lock
+  node.key = "scan " + table.name + (table.path.extension() == ".lock" ? "_lock" : "");
+  return node;
+}
+
+/**
+ * @brief The plan of a SELECT, the way the SELECT evaluator will run it
+ *
+ * @throws std::invalid_argument with the message to show when a table doesn't exist
+ */
+inline ExplainNode explainSelect(ast::SelectTableStatement *node, DatabaseObject *current_database)
+{
+  bool aggregate = isAggregateSelect(node);
+  std::tuple<std::string, std::string, std::string> where_tpl;
+  std::string filter;
+  double rows = 0;
+  ExplainNode input;
+  if (node->names->alias == nullptr)
+  {
+    bool has_where = evalSelectWhere(node, where_tpl);
+    filter = has_where ? explainWhere(where_tpl) : "";
+    std::string tbl_name(node->names->token.literal);
+    Planner::Plan plan = Planner::planScan(current_database->name(), tbl_name, has_where ? &where_tpl : nullptr);
+    if (plan.tables.empty())
+    {
+      throw std::invalid_argument("!Failed to query table because it does not exist.");
+    }
+    bool skip_pages = plan.tables[0].access == Planner::Access::ZONE_MAP_SCAN;
+    input = explainScan(plan.tables[0], skip_pages ? filter : "");
+    rows = plan.rows;
+  }
+  else
+  {
+    std::vector<std::pair<std::string, std::string>> var_table;
+    std::array<bool, 3> joins;
+    bool has_where = evalJoinTables(node, var_table, joins, where_tpl);
+    Planner::Plan plan = Planner::planJoin(current_database->name(), has_where ? &where_tpl : nullptr, var_table, joins);
+    if (plan.tables.size() < 2)
+    {
+      throw std::invalid_argument("!Failed to query table because it does not exist.");
+    }
+    const JoinChoice &choice = plan.join_choice;
+    const std::string &left = plan.tables[0].name, &right = plan.tables[1].name;
+    static const char *strategies[] = {"Nested Loop", "Hash", "Sort Merge"};
+    std::string kind = joins[0] && joins[2] ? "Full Outer" : joins[0] ? "Left Outer" : joins[2] ? "Right Outer" : "Inner";
+    input.text = std::string(strategies[(int)choice.strategy]) + " " + kind + " Join";
+    if (has_where)
+    {
+      input.text += " on " + var_table[0].second + "." + std::get<0>(where_tpl) + " " + std::get<1>(where_tpl) + " " +
+                    var_table[1].second + "." + std::get<2>(where_tpl);
+    }
+    if (choice.strategy == JoinStrategy::HASH)
+    {
+      input.text += ", hash table on " + (choice.build_left ? left : right);
+    }
+    if (kind == "Inner")
+    {
+      input.text += ", keys of " + (choice.filter_from_left ? left : right) + " skip pages of " +
+                    (choice.filter_from_left ? right : left);
+    }
+    input.estimate = "estimated rows=" + explainNumber(plan.rows) + ", cost=" + explainNumber(plan.cost);
+    input.key = "join";
+    // The side read first finishes first
+    input.children.push_back(explainScan(plan.tables[choice.filter_from_left ? 0 : 1], ""));
+    input.children.push_back(explainScan(plan.tables[choice.filter_from_left ? 1 : 0], ""));
+    rows = plan.rows;
+  }
+
+  // The where expression of one table is tested by the first operator above the scan
+  if (aggregate)
+  {
+    ExplainNode group;
+    group.text = "Hash Aggregate";
+    std::string sep = " by ";
+    for (ast::ColumnQueryExpression *column = node->group_by; column != nullptr; column = column->right)
+    {
+      group.text += sep + std::string(column->token.literal);
+      sep = ", ";
+    }
+    if (!filter.empty())
+    {
+      group.text += ", filter " + filter;
+      filter.clear();
+    }
+    group.key = "aggregate";
+    group.children.push_back(std::move(input));
+    input = std::move(group);
+  }
+  if (node->order_by != nullptr)
+  {
+    ExplainNode sort;
+    sort.text = "Sort";
+    std::string sep = " by ";
+    for (ast::OrderByExpression *order_by = node->order_by; order_by != nullptr; order_by = order_by->right)
+    {
+      std::string name(order_by->token.literal);
+      if (order_by->aggregate != nullptr)
+      {
+        name = HashAggregate::outputName(ast::aggregateFunction(order_by->aggregate->literal), name);
+      }
+      sort.text += sep + name + (order_by->descending ? " desc" : "");
+      sep = ", ";
+    }
+    if (!filter.empty())
+    {
+      sort.text += ", filter " + filter;
+      filter.clear();
+    }
+    sort.key = "sort";
+    sort.children.push_back(std::move(input));
+    input = std::move(sort);
+  }
+  ExplainNode project;
+  project.text = "Project";
+  std::string sep = " ";
+  for (ast::ColumnQueryExpression *column = node->column_query; column != nullptr; column = column->right)
+  {
+    std::string name(column->token.literal);
+    if (column->aggregate != nullptr)
+    {
+      name = HashAggregate::outputName(ast::aggregateFunction(column->aggregate->literal), name);
+    }
+    project.text += sep + name;
+    sep = ", ";
+  }
+  if (!filter.empty())
+  {
+    project.text += ", filter " + filter;
+  }
+  if (node->limit != nullptr)
+  {
+    project.text += ", limit " + std::string(node->limit->literal);
+  }
+  if (node->offset != nullptr)
+  {
+    project.text += ", offset " + std::string(node->offset->literal);
+  }
+  if (!aggregate)
+  {
+    project.estimate = "estimated rows=" + explainNumber(rows);
+  }
+  project.key = "project";
+  project.children.push_back(std::move(input));
+  return project;
+}
+
+/**
+ * @brief Matches the recorded operators to the plan, children first since they
+ * finish first. Operators the plan doesn't have, like the tables an UPDATE
+ * reads, are added under the root.
+ */
+inline void matchProfile(ExplainNode &node, const QueryProfile &profile, std::vector<char> &used)
+{
+  for (ExplainNode &child : node.children)
+  {
+    matchProfile(child, profile, used);
+  }
+  for (size_t i = 0; i < profile.operators.size() && !node.key.empty(); i++)
+  {
+    if (!used[i] && profile.operators[i].key == node.key)
+    {
+      used[i] = 1;
+      node.actual = &profile.operators[i];
+      return;
+    }
+  }
+}
+
+inline void printExplain(const ExplainNode &node, int depth, std::ostringstream &ss)
+{
+  ss << std::string(depth == 0 ? 0 : 2 * depth, ' ') << (depth == 0 ? "" : "-> ") << node.text;
+  if (!node.estimate.empty())
+  {
+    ss << "  (" << node.estimate << ")";
+  }
+  if (node.actual != nullptr)
+  {
+    const QueryProfile::Operator &op = *node.actual;
+    std::ostringstream time;
+    time << std::fixed << std::setprecision(3) << op.ms;
+    ss << "  (actual time=" << time.str() << " ms";
+    // A statement other than SELECT only has its time, what it read is under it
+    if (op.key != "statement")
+    {
+      ss << ", rows in=" << op.rows_in << ", rows out=" << op.rows_out << ", bytes read=" << op.bytes_read
+         << ", page cache hits=" << op.cache_hits << ", misses=" << op.cache_misses << ", memory=" << op.memory << " bytes";
+    }
+    ss << ")";
+  }
+  ss << "\n";
+  for (const ExplainNode &child : node.children)
+  {
+    printExplain(child, depth + 1, ss);
+  }
+}
+
+inline object::Result *evalExplain(ast::ExplainStatement *node, DatabaseObject *current_database)
+{
+  ExplainNode plan;
+  auto select = dynamic_cast<ast::SelectTableStatement *>(node->statement);
+  if (select != nullptr)
+  {
+    if (current_database->name() == "nil")
+    {
+      return object::Result::failed(1, "!Failed to select from table since no database is selected.");
+    }
+    try
+    {
+      plan = explainSelect(select, current_database);
+    }
+    catch (const std::invalid_argument &e)
+    {
+      return object::Result::failed(2, e.what());
+    }
+  }
+  else
+  {
+    // Other statements run as one operator
+    plan.text = token_type::name(node->statement->token.type) + " statement";
+    plan.key = "statement";
+  }
+
+  std::ostringstream ss;
+  if (node->analyze)
+  {
+    QueryProfile profile;
+    auto start = std::chrono::steady_clock::now();
+    {
+      QueryProfile::Scope scope(&profile);
+      std::unique_ptr<object::Result> result;
+      if (select != nullptr)
+      {
+        result.reset(eval(node->statement, current_database));
+      }
+      else
+      {
+        QueryProfile::Timer timer("statement");
+        result.reset(eval(node->statement, current_database));
+      }
+      if (result->status != Status::OK)
+      {
+        return result.release();
+      }
+      // SELECT only reads its rows as they are taken, so take them all
+      if (result->rows != nullptr)
+      {
+        QueryProfile::Timer timer("project");
+        const TableObject &source = result->rows->source();
+        timer.op.rows_in = source.fields_size == 0 ? 0 : source.records.size() / source.fields_size;
+        TableObject rows = result->rows->drain();
+        timer.op.rows_out = rows.fields_size == 0 ? 0 : rows.records.size() / rows.fields_size;
+        timer.op.memory = QueryProfile::tableBytes(rows);
+      }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::vector<char> used(profile.operators.size(), 0);
+    matchProfile(plan, profile, used);
+    for (size_t i = 0; i < profile.operators.size(); i++)
+    {
+      if (!used[i])
+      {
+        ExplainNode other;
+        other.text = profile.operators[i].key;
+        other.actual = &profile.operators[i];
+        plan.children.push_back(std::move(other));
+      }
+    }
+    printExplain(plan, 0, ss);
+    // Every operator's rows are still held when the result is taken
+    size_t memory = 0;
+    for (const QueryProfile::Operator &op : profile.operators)
+    {
+      memory += op.memory;
+    }
+    ss << "Execution time: " << std::fixed << std::setprecision(3) << ms << " ms, memory peak: " << memory << " bytes";
+  }
+  else
+  {
+    printExplain(plan, 0, ss);
+  }
+  std::string text = ss.str();
+  if (!text.empty() && text.back() == '\n')
+  {
+    text.pop_back();
+  }
+  return object::Result::ok(0, text);
+}
+
+#endif /* __EXPLAIN_HPP__ */
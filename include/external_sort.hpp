@@ -0,0 +1,423 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: External merge sort of a table's rows for ORDER BY. Rows are
+ * sorted as small entries holding an order preserving prefix of the first
+ * key and the row number, so most comparisons never touch the table. Runs
+ * larger than the memory budget are spilled to temp files and k-way merged
+ * as the rows are read. When only the first k rows are wanted they are
+ * kept in a bounded heap instead.
+ */
+#ifndef __EXTERNAL_SORT_HPP__
+#define __EXTERNAL_SORT_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <data_objs.hpp>
+#include <thread_pool.hpp>
+
+class ExternalSort
+{
+public:
+  // A column to order by
+  struct Key
+  {
+    int column;
+    bool descending = false;
+  };
+
+  // Default bytes of entries held in memory before a run is spilled
+  static constexpr size_t DEFAULT_MEMORY_BUDGET = 256 << 20;
+  // Entries read from a spilled run at a time while merging
+  static constexpr size_t RUN_READ_ENTRIES = 4096;
+  // Entries sorted by one worker before the sorted chunks are merged
+  static constexpr size_t SORT_CHUNK_ENTRIES = 1 << 16;
+
+private:
+  // Prefix of the first key, compared as an unsigned int, and the row it came from
+  struct Entry
+  {
+    uint64_t prefix;
+    uint32_t row;
+  };
+
+  // Reads a spilled run back a block of entries at a time
+  struct RunReader
+  {
+    std::ifstream file;
+    std::vector<Entry> block;
+    size_t next = 0;
+
+    RunReader(const std::filesystem::path &path) : file(path, std::ios::binary) {}
+
+    bool read(Entry &entry)
+    {
+      if (next == block.size())
+      {
+        block.resize(RUN_READ_ENTRIES);
+        file.read(reinterpret_cast<char *>(block.data()), block.size() * sizeof(Entry));
+        block.resize(file.gcount() / sizeof(Entry));
+        next = 0;
+        if (block.empty())
+        {
+          return false;
+        }
+      }
+      entry = block[next++];
+      return true;
+    }
+  };
+
+  const TableObject &table;
+  std::vector<Key> keys;
+  std::string format;
+  // Whether equal prefixes mean equal keys, so ties go straight to the row number
+  bool exact_prefix;
+  size_t max_entries;
+  // Rows kept by a top-k sort, 0 sorts every row
+  size_t top_k = 0;
+
+  // The run being filled, then the whole result when nothing was spilled
+  std::vector<Entry> entries;
+  size_t next_entry = 0;
+  std::filesystem::path spill_dir;
+  std::vector<std::filesystem::path> runs;
+  std::vector<std::unique_ptr<RunReader>> readers;
+  // Head entry of each run and its run, smallest on top
+  std::vector<std::pair<Entry, size_t>> heap;
+  bool finished = false;
+  // Most bytes of entries held at once
+  size_t peak_bytes = 0;
+
+  static size_t &sharedBudget()
+  {
+    static size_t budget = DEFAULT_MEMORY_BUDGET;
+    return budget;
+  }
+
+  static bool isNull(const variant_type &value)
+  {
+    auto val = std::get_if<int>(&value);
+    return val != nullptr && *val == std::numeric_limits<int>::min();
+  }
+
+  const variant_type &value(uint32_t row, int column) const
+  {
+    return table.records[(size_t)row * table.fields_size + column];
+  }
+
+  /**
+   * @brief Maps the first key of a row to an unsigned int with the same order.
+   * Blanks map to 0 so they come first, strings keep their first 8 bytes.
+   */
+  uint64_t prefix(uint32_t row) const
+  {
+    const Key &key = keys[0];
+    const variant_type &val = value(row, key.column);
+    uint64_t bits = 0;
+    if (isNull(val))
+    {
+      bits = 0;
+    }
+    else if (format[key.column] == 'f' && (std::holds_alternative<int>(val) || std::holds_alternative<double>(val)))
+    {
+      double v = std::holds_alternative<int>(val) ? std::get<int>(val) : std::get<double>(val);
+      std::memcpy(&bits, &v, sizeof(bits));
+      // Negative floats order backwards, so flip every bit of them
+      bits = (bits >> 63) ? ~bits : bits | (1ull << 63);
+    }
+    else if (auto v = std::get_if<int>(&val))
+    {
+      bits = (uint64_t)((uint32_t)*v ^ 0x80000000u);
+    }
+    else if (auto v = std::get_if<bool>(&val))
+    {
+      bits = *v ? 2 : 1;
+    }
+    else if (auto v = std::get_if<std::string>(&val))
+    {
+      for (size_t i = 0; i < 8; i++)
+      {
+        bits = (bits << 8) | (i < v->size() ? (uint8_t)(*v)[i] : 0);
+      }
+    }
+    return key.descending ? ~bits : bits;
+  }
+
+  // Orders two values of a column, blanks first
+  static int compare(const variant_type &a, const variant_type &b)
+  {
+    bool a_null = isNull(a), b_null = isNull(b);
+    if (a_null || b_null)
+    {
+      return (int)b_null - (int)a_null;
+    }
+    if (a.index() != b.index())
+    {
+      // Ints written into float columns compare as numbers
+      auto number = [](const variant_type &v)
+      { return std::holds_alternative<int>(v) ? std::get<int>(v) : std::get<double>(v); };
+      bool numbers = (a.index() == 0 || a.index() == 3) && (b.index() == 0 || b.index() == 3);
+      if (numbers)
+      {
+        return number(a) < number(b) ? -1 : (number(b) < number(a) ? 1 : 0);
+      }
+      return a.index() < b.index() ? -1 : 1;
+    }
+    return a < b ? -1 : (b < a ? 1 : 0);
+  }
+
+  bool less(const Entry &a, const Entry &b) const
+  {
+    if (a.prefix != b.prefix)
+    {
+      return a.prefix < b.prefix;
+    }
+    if (!exact_prefix)
+    {
+      for (const Key &key : keys)
+      {
+        int order = compare(value(a.row, key.column), value(b.row, key.column));
+        if (order != 0)
+        {
+          return key.descending ? order > 0 : order < 0;
+        }
+      }
+    }
+    // Equal keys keep table order
+    return a.row < b.row;
+  }
+
+  /**
+   * @brief Sorts the entries in memory, in chunks on the pool which are then merged pairwise
+   */
+  void sortEntries()
+  {
+    auto cmp = [this](const Entry &a, const Entry &b)
+    { return less(a, b); };
+    size_t count = entries.size();
+    ThreadPool &pool = ThreadPool::shared();
+    size_t chunk = std::max(SORT_CHUNK_ENTRIES, (count + pool.parallelism() - 1) / pool.parallelism());
+    pool.parallelFor(0, count, chunk, [&](size_t from, size_t to)
+                     { std::sort(entries.begin() + from, entries.begin() + to, cmp); });
+    for (size_t width = chunk; width < count; width *= 2)
+    {
+      size_t pairs = (count + 2 * width - 1) / (2 * width);
+      pool.parallelFor(0, pairs, 1, [&](size_t pair, size_t)
+                       {
+        size_t from = pair * 2 * width;
+        size_t middle = std::min(count, from + width);
+        size_t to = std::min(count, from + 2 * width);
+        std::inplace_merge(entries.begin() + from, entries.begin() + middle, entries.begin() + to, cmp); });
+    }
+  }
+
+  void spill()
+  {
+    sortEntries();
+    if (spill_dir.empty())
+    {
+      static std::atomic<size_t> sorts{0};
+      spill_dir = std::filesystem::temp_directory_path() /
+                  ("sort-" + std::to_string(getpid()) + "-" + std::to_string(sorts++));
+      std::filesystem::create_directories(spill_dir);
+    }
+    std::filesystem::path path = spill_dir / ("run" + std::to_string(runs.size()));
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+    if (!file)
+    {
+      throw std::runtime_error("!Failed to spill a sort run to " + path.string() + ".");
+    }
+    runs.push_back(path);
+    peak_bytes = std::max(peak_bytes, entries.capacity() * sizeof(Entry));
+    entries.clear();
+  }
+
+  void pushHeap(const Entry &entry, size_t run)
+  {
+    heap.emplace_back(entry, run);
+    std::push_heap(heap.begin(), heap.end(), [this](const auto &a, const auto &b)
+                   { return less(b.first, a.first); });
+  }
+
+public:
+  /**
+   * @brief Sets the memory budget of sorts made after it, in bytes
+   */
+  static void configure(size_t memory_budget)
+  {
+    sharedBudget() = memory_budget;
+  }
+
+  /**
+   * @brief The memory budget sorts are made with, in bytes
+   */
+  static size_t memoryBudget()
+  {
+    return sharedBudget();
+  }
+
+  /**
+   * @param table the table whose rows are sorted, which has to outlive the sort
+   * @param keys the columns to order by, most significant first
+   * @param memory_budget [default: 0] bytes of entries kept in memory, 0 uses the configured budget
+   * @param limit [default: 0] only the first limit rows are wanted, which are kept in
+   * a heap when they fit the budget; 0 wants every row
+   */
+  ExternalSort(const TableObject &table, std::vector<Key> keys, size_t memory_budget = 0, size_t limit = 0)
+      : table(table), keys(std::move(keys)), format(table.getFormat())
+  {
+    exact_prefix = this->keys.size() == 1 && format[this->keys[0].column] != 's';
+    size_t budget = memory_budget == 0 ? sharedBudget() : memory_budget;
+    max_entries = std::max<size_t>(1, budget / sizeof(Entry));
+    if (limit > 0 && limit <= max_entries)
+    {
+      top_k = limit;
+    }
+    entries.reserve(std::min<size_t>(top_k > 0 ? top_k : max_entries, 1 << 20));
+  }
+
+  ExternalSort(const ExternalSort &) = delete;
+  ExternalSort &operator=(const ExternalSort &) = delete;
+
+  ~ExternalSort()
+  {
+    readers.clear();
+    if (!spill_dir.empty())
+    {
+      std::error_code error;
+      std::filesystem::remove_all(spill_dir, error);
+    }
+  }
+
+  /**
+   * @brief Adds a row to sort, spilling the current run once it reaches the budget
+   */
+  void add(int row)
+  {
+    if (top_k > 0)
+    {
+      // The heap holds the top_k smallest entries with the largest on top
+      auto cmp = [this](const Entry &a, const Entry &b)
+      { return less(a, b); };
+      Entry entry{prefix(row), (uint32_t)row};
+      if (entries.size() < top_k)
+      {
+        entries.push_back(entry);
+        std::push_heap(entries.begin(), entries.end(), cmp);
+      }
+      else if (less(entry, entries.front()))
+      {
+        std::pop_heap(entries.begin(), entries.end(), cmp);
+        entries.back() = entry;
+        std::push_heap(entries.begin(), entries.end(), cmp);
+      }
+      return;
+    }
+    if (entries.size() == max_entries)
+    {
+      spill();
+    }
+    entries.push_back(Entry{prefix(row), (uint32_t)row});
+  }
+
+  /**
+   * @brief Called after the last add, sorts what is left and opens the runs to merge
+   */
+  void finish()
+  {
+    finished = true;
+    peak_bytes = std::max(peak_bytes, entries.capacity() * sizeof(Entry));
+    if (top_k > 0)
+    {
+      std::sort_heap(entries.begin(), entries.end(), [this](const Entry &a, const Entry &b)
+                     { return less(a, b); });
+      return;
+    }
+    if (runs.empty())
+    {
+      sortEntries();
+      return;
+    }
+    if (!entries.empty())
+    {
+      spill();
+    }
+    entries.shrink_to_fit();
+    for (size_t run = 0; run < runs.size(); run++)
+    {
+      readers.push_back(std::make_unique<RunReader>(runs[run]));
+      Entry entry;
+      if (readers.back()->read(entry))
+      {
+        pushHeap(entry, run);
+      }
+    }
+  }
+
+  /**
+   * @brief Number of runs spilled to disk
+   */
+  size_t spilledRuns() const
+  {
+    return runs.size();
+  }
+
+  /**
+   * @brief Most bytes of entries the sort held in memory at once
+   */
+  size_t peakBytes() const
+  {
+    return peak_bytes;
+  }
+
+  bool done() const
+  {
+    return finished && (runs.empty() ? next_entry >= entries.size() : heap.empty());
+  }
+
+  /**
+   * @brief Returns up to count more rows in order
+   *
+   * @param rows filled with the row numbers of the table
+   */
+  void next(size_t count, std::vector<int> &rows)
+  {
+    rows.clear();
+    if (runs.empty())
+    {
+      for (; next_entry < entries.size() && rows.size() < count; next_entry++)
+      {
+        rows.push_back(entries[next_entry].row);
+      }
+      return;
+    }
+    auto cmp = [this](const auto &a, const auto &b)
+    { return less(b.first, a.first); };
+    while (!heap.empty() && rows.size() < count)
+    {
+      std::pop_heap(heap.begin(), heap.end(), cmp);
+      auto [entry, run] = heap.back();
+      heap.pop_back();
+      rows.push_back(entry.row);
+      Entry following;
+      if (readers[run]->read(following))
+      {
+        pushHeap(following, run);
+      }
+    }
+  }
+};
+
+#endif /* __EXTERNAL_SORT_HPP__ */
@@ -0,0 +1,396 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Hash aggregation for SELECT with COUNT, SUM, MIN, MAX, AVG
+ * and GROUP BY. Every thread scanning the table folds its morsels into
+ * its own hash table of groups, and the partial groups are merged once
+ * the scan is done, so no row takes a lock.
+ */
+#ifndef __HASH_AGGREGATE_HPP__
+#define __HASH_AGGREGATE_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <ast.hpp>
+#include <data_objs.hpp>
+#include <proto_generator.hpp>
+#include <thread_pool.hpp>
+
+class HashAggregate
+{
+public:
+  /**
+   * @brief A column of the result, as written in the select list
+   * function is NONE for a grouped column
+   * column is the column name, * for COUNT(*)
+   */
+  struct Output
+  {
+    ast::AggregateFunction function = ast::AggregateFunction::NONE;
+    std::string column;
+  };
+
+private:
+  // Running value of one aggregate in one group. Only the fields for the
+  // column's type are used: ints sum into 64 bits, floats into a double.
+  struct Accumulator
+  {
+    int64_t count = 0;
+    int64_t int_sum = 0;
+    int int_min = 0;
+    int int_max = 0;
+    double float_sum = 0;
+    double float_min = 0;
+    double float_max = 0;
+  };
+
+  struct Group
+  {
+    size_t hash;
+    // First row of the group, so groups come out in the order they appear
+    size_t first_row;
+    std::vector<variant_type> key;
+    std::vector<Accumulator> accumulators;
+  };
+
+  // Groups found by one thread, looked up by the hash of their key
+  struct Partial
+  {
+    std::unordered_multimap<size_t, size_t> index;
+    std::vector<Group> groups;
+  };
+
+  // An output resolved against the table
+  struct Resolved
+  {
+    ast::AggregateFunction function;
+    std::string name;
+    // Column of the table, -1 for COUNT(*)
+    int column;
+    // Position in the group key of a grouped column, or in the accumulators
+    size_t slot;
+    // Format char of the column: i, f, s or b
+    char type;
+  };
+
+  const TableObject &table;
+  std::vector<int> group_columns;
+  std::vector<Resolved> outputs;
+  // Outputs that are aggregates, in accumulator order
+  std::vector<size_t> aggregates;
+
+  static bool isNull(const variant_type &value)
+  {
+    auto val = std::get_if<int>(&value);
+    return val != nullptr && *val == std::numeric_limits<int>::min();
+  }
+
+  static std::string functionName(ast::AggregateFunction function)
+  {
+    switch (function)
+    {
+    case ast::AggregateFunction::COUNT:
+      return "COUNT";
+    case ast::AggregateFunction::SUM:
+      return "SUM";
+    case ast::AggregateFunction::MIN:
+      return "MIN";
+    case ast::AggregateFunction::MAX:
+      return "MAX";
+    case ast::AggregateFunction::AVG:
+      return "AVG";
+    default:
+      return "";
+    }
+  }
+
+  int findColumn(const std::string &name) const
+  {
+    for (int col = 0; col < (int)table.fields.size(); col++)
+    {
+      if (table.fields[col].first == name)
+      {
+        return col;
+      }
+    }
+    throw std::invalid_argument("!Failed to aggregate since column " + name + " does not exist.");
+  }
+
+  size_t hashRow(size_t row) const
+  {
+    size_t hash = 0;
+    for (int col : group_columns)
+    {
+      hash = hash * 31 + std::hash<variant_type>{}(table.records[row * table.fields_size + col]);
+    }
+    return hash;
+  }
+
+  bool sameKey(const Group &group, size_t row) const
+  {
+    for (size_t i = 0; i < group_columns.size(); i++)
+    {
+      if (group.key[i] != table.records[row * table.fields_size + group_columns[i]])
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Group &findGroup(Partial &partial, size_t row) const
+  {
+    size_t hash = hashRow(row);
+    auto range = partial.index.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++)
+    {
+      if (sameKey(partial.groups[it->second], row))
+      {
+        return partial.groups[it->second];
+      }
+    }
+    Group group{hash, row, {}, std::vector<Accumulator>(aggregates.size())};
+    for (int col : group_columns)
+    {
+      group.key.push_back(table.records[row * table.fields_size + col]);
+    }
+    partial.index.emplace(hash, partial.groups.size());
+    partial.groups.push_back(std::move(group));
+    return partial.groups.back();
+  }
+
+  void accumulate(Group &group, size_t row) const
+  {
+    for (size_t i = 0; i < aggregates.size(); i++)
+    {
+      const Resolved &output = outputs[aggregates[i]];
+      Accumulator &acc = group.accumulators[i];
+      if (output.column == -1)
+      {
+        acc.count++;
+        continue;
+      }
+      const variant_type &value = table.records[row * table.fields_size + output.column];
+      if (isNull(value))
+      {
+        continue;
+      }
+      if (auto val = std::get_if<int>(&value))
+      {
+        acc.int_sum += *val;
+        acc.int_min = acc.count == 0 ? *val : std::min(acc.int_min, *val);
+        acc.int_max = acc.count == 0 ? *val : std::max(acc.int_max, *val);
+      }
+      else if (auto val = std::get_if<double>(&value))
+      {
+        acc.float_sum += *val;
+        acc.float_min = acc.count == 0 ? *val : std::min(acc.float_min, *val);
+        acc.float_max = acc.count == 0 ? *val : std::max(acc.float_max, *val);
+      }
+      acc.count++;
+    }
+  }
+
+  static void merge(Accumulator &into, const Accumulator &from)
+  {
+    if (from.count == 0)
+    {
+      return;
+    }
+    into.int_min = into.count == 0 ? from.int_min : std::min(into.int_min, from.int_min);
+    into.int_max = into.count == 0 ? from.int_max : std::max(into.int_max, from.int_max);
+    into.float_min = into.count == 0 ? from.float_min : std::min(into.float_min, from.float_min);
+    into.float_max = into.count == 0 ? from.float_max : std::max(into.float_max, from.float_max);
+    into.int_sum += from.int_sum;
+    into.float_sum += from.float_sum;
+    into.count += from.count;
+  }
+
+  /**
+   * @brief Folds the groups of from into into, matching them by key
+   */
+  static void merge(Partial &into, Partial &from)
+  {
+    for (Group &group : from.groups)
+    {
+      Group *found = nullptr;
+      auto range = into.index.equal_range(group.hash);
+      for (auto it = range.first; it != range.second && found == nullptr; it++)
+      {
+        if (into.groups[it->second].key == group.key)
+        {
+          found = &into.groups[it->second];
+        }
+      }
+      if (found == nullptr)
+      {
+        into.index.emplace(group.hash, into.groups.size());
+        into.groups.push_back(std::move(group));
+        continue;
+      }
+      found->first_row = std::min(found->first_row, group.first_row);
+      for (size_t i = 0; i < group.accumulators.size(); i++)
+      {
+        merge(found->accumulators[i], group.accumulators[i]);
+      }
+    }
+  }
+
+  // Value of an aggregate output for a finished group, blank when it saw no values
+  variant_type finish(const Resolved &output, const Accumulator &acc) const
+  {
+    if (output.function == ast::AggregateFunction::COUNT)
+    {
+      return (int)acc.count;
+    }
+    if (acc.count == 0)
+    {
+      return std::numeric_limits<int>::min();
+    }
+    bool ints = output.type == 'i';
+    switch (output.function)
+    {
+    case ast::AggregateFunction::SUM:
+      if (ints && (acc.int_sum <= std::numeric_limits<int>::min() || acc.int_sum > std::numeric_limits<int>::max()))
+      {
+        throw std::invalid_argument("!Failed to aggregate since " + output.name + " overflows int.");
+      }
+      return ints ? variant_type((int)acc.int_sum) : variant_type(acc.float_sum);
+    case ast::AggregateFunction::MIN:
+      return ints ? variant_type(acc.int_min) : variant_type(acc.float_min);
+    case ast::AggregateFunction::MAX:
+      return ints ? variant_type(acc.int_max) : variant_type(acc.float_max);
+    default:
+      return (ints ? (double)acc.int_sum : acc.float_sum) / acc.count;
+    }
+  }
+
+public:
+  /**
+   * @brief Name of an aggregate's column in the result, e.g. COUNT(*)
+   */
+  static std::string outputName(ast::AggregateFunction function, const std::string &column)
+  {
+    return functionName(function) + "(" + column + ")";
+  }
+
+  /**
+   * @brief Resolves the select list and GROUP BY against the table
+   *
+   * @param table the table to aggregate, which has to outlive the aggregate
+   * @param select the select list in order
+   * @param group_by names of the grouped columns, empty aggregates every row into one group
+   * @throws std::invalid_argument when a column doesn't exist, an aggregate needs
+   * a number column or a plain column isn't grouped
+   */
+  HashAggregate(const TableObject &table, const std::vector<Output> &select, const std::vector<std::string> &group_by)
+      : table(table)
+  {
+    std::string format = table.getFormat();
+    for (const std::string &name : group_by)
+    {
+      group_columns.push_back(findColumn(name));
+    }
+    for (const Output &output : select)
+    {
+      Resolved resolved{output.function, output.column, -1, 0, 'i'};
+      if (output.function == ast::AggregateFunction::NONE)
+      {
+        auto grouped = std::find(group_by.begin(), group_by.end(), output.column);
+        if (grouped == group_by.end())
+        {
+          throw std::invalid_argument("!Failed to aggregate since column " + output.column + " is not in GROUP BY.");
+        }
+        resolved.slot = grouped - group_by.begin();
+        resolved.column = group_columns[resolved.slot];
+        resolved.type = format[resolved.column];
+        outputs.push_back(resolved);
+        continue;
+      }
+      resolved.name = outputName(output.function, output.column);
+      if (output.column != "*")
+      {
+        resolved.column = findColumn(output.column);
+        resolved.type = format[resolved.column];
+        if (output.function != ast::AggregateFunction::COUNT && resolved.type != 'i' && resolved.type != 'f')
+        {
+          throw std::invalid_argument("!Failed to aggregate since " + resolved.name + " needs an int or float column.");
+        }
+      }
+      resolved.slot = aggregates.size();
+      aggregates.push_back(outputs.size());
+      outputs.push_back(resolved);
+    }
+  }
+
+  /**
+   * @brief Aggregates the rows into a table with one row per group
+   *
+   * @param rows row numbers of the table that passed the where expression
+   * @return TableObject the select list as columns, groups in the order they first appear
+   */
+  TableObject run(const std::vector<int> &rows) const
+  {
+    std::vector<Partial> partials = ThreadPool::shared().parallelPartials<Partial>(
+        0, rows.size(), ProtoGenerator::SCAN_MORSEL_ROWS, [&](Partial &partial, size_t from, size_t to)
+        {
+          for (size_t i = from; i < to; i++)
+          {
+            accumulate(findGroup(partial, rows[i]), rows[i]);
+          } });
+    Partial &groups = partials[0];
+    for (size_t i = 1; i < partials.size(); i++)
+    {
+      merge(groups, partials[i]);
+    }
+    // Without GROUP BY there is always one row, even over no rows
+    if (group_columns.empty() && groups.groups.empty())
+    {
+      groups.groups.push_back(Group{0, 0, {}, std::vector<Accumulator>(aggregates.size())});
+    }
+    std::sort(groups.groups.begin(), groups.groups.end(), [](const Group &a, const Group &b)
+              { return a.first_row < b.first_row; });
+
+    TableObject result(table.name());
+    for (const Resolved &output : outputs)
+    {
+      if (output.function == ast::AggregateFunction::NONE)
+      {
+        result.fields.push_back(table.fields[output.column]);
+        continue;
+      }
+      std::string type = "int";
+      if (output.function == ast::AggregateFunction::AVG ||
+          (output.function != ast::AggregateFunction::COUNT && output.type == 'f'))
+      {
+        type = "float";
+      }
+      result.fields.push_back(std::make_pair(output.name, std::make_tuple(type, 1)));
+    }
+    result.fields_size = result.fields.size();
+    result.records.reserve(groups.groups.size() * result.fields_size);
+    for (const Group &group : groups.groups)
+    {
+      for (const Resolved &output : outputs)
+      {
+        if (output.function == ast::AggregateFunction::NONE)
+        {
+          result.records.push_back(group.key[output.slot]);
+        }
+        else
+        {
+          result.records.push_back(finish(output, group.accumulators[output.slot]));
+        }
+      }
+    }
+    return result;
+  }
+};
+
+#endif /* __HASH_AGGREGATE_HPP__ */
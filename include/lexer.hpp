@@ -2,32 +2,47 @@
 #define __LEXER_HPP__
 
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 #include <iostream>
 #include <tokens.hpp>
 using namespace std;
 
 /**
  * @brief Lexer class for finding all the tokens
+ *
+ * The input is only viewed, never copied, and tokens are spans into it.
+ * The input (a string, a script buffer or a mapped file) has to outlive
+ * the lexer and every token or AST node made from it.
  */
 class Lexer
 {
 private:
-  string input;
-  int position = 0;
-  int nextPosition = 0;
+  string_view input;
+  size_t position = 0;
+  size_t nextPosition = 0;
   char ch;
 
 public:
   /**
    * @brief Begins input processing
-   * 
-   * @param input input string provided by user
+   *
+   * @param input input text provided by user
    */
-  Lexer(string input) : input(input)
+  Lexer(string_view input) : input(input)
   {
     readChar();
   }
 
+  /**
+   * @brief Gives back the whole input being tokenized
+   */
+  string_view source() const
+  {
+    return input;
+  }
+
   /**
    * @brief Reads the current char and sets positions and next position as necessary
    */
@@ -42,7 +57,7 @@ public:
 
   /**
    * @brief Looks at the enxt char without updating position
-   * 
+   *
    * @return The next char
    */
   char peekChar()
@@ -55,118 +70,173 @@ public:
 
   /**
    * @brief Processes the next token and restores the position states prior
-   * 
+   *
    * @return Token The next token
    */
   Token peekToken()
   {
-    int old_position = position;
-    int old_nextPosition = nextPosition;
+    size_t old_position = position;
+    size_t old_nextPosition = nextPosition;
     char old_ch = ch;
     Token next = nextToken();
-    position = move(old_position);
-    nextPosition = move(nextPosition);
-    ch = move(old_ch);
+    position = old_position;
+    nextPosition = old_nextPosition;
+    ch = old_ch;
     return next;
   }
 
+  /**
+   * @brief Makes a token spanning length chars of the input from start
+   */
+  Token makeToken(token_type::TokenType type, size_t start, size_t length)
+  {
+    if (start > input.length())
+    {
+      start = input.length();
+    }
+    return Token(type, input.substr(start, length), start);
+  }
+
   /**
    * @brief Progresses to the next token
-   * 
+   *
    * @return Gives back the current token
    */
   Token nextToken()
   {
     Token token;
 
-    // skip whitespace
-    while (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')
+    // skip whitespace and comments running to the end of the line
+    while (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || (ch == '-' && peekChar() == '-'))
     {
+      if (ch == '-')
+      {
+        while (ch != '\n' && ch != '\0')
+        {
+          readChar();
+        }
+        continue;
+      }
       readChar();
     }
     switch (ch)
     {
     case '\'':
-      token = {token_type::QUOTE, ch};
+      token = makeToken(token_type::QUOTE, position, 1);
       break;
     case ';':
-      token = {token_type::SEMICOLON, ch};
+      token = makeToken(token_type::SEMICOLON, position, 1);
       break;
     case '(':
-      token = {token_type::LPAREN, ch};
+      token = makeToken(token_type::LPAREN, position, 1);
       break;
     case ')':
-      token = {token_type::RPAREN, ch};
+      token = makeToken(token_type::RPAREN, position, 1);
       break;
     case ',':
-      token = {token_type::COMMA, ch};
+      token = makeToken(token_type::COMMA, position, 1);
       break;
     case '.':
-      token = {token_type::COMMAND, ch};
+      token = makeToken(token_type::COMMAND, position, 1);
       break;
     case '!':
       if (peekChar() == '=')
       {
-        token = {token_type::NE, "!="};
+        token = makeToken(token_type::NE, position, 2);
         readChar();
       }
       else
       {
-        token = {token_type::BANG, ch};
+        token = makeToken(token_type::BANG, position, 1);
       }
       break;
     case '=':
-      token = {token_type::EQ, ch};
+      token = makeToken(token_type::EQ, position, 1);
       break;
     case '<':
-      token = {token_type::LT, ch};
+      token = makeToken(token_type::LT, position, 1);
       break;
     case '>':
-      token = {token_type::GT, ch};
+      token = makeToken(token_type::GT, position, 1);
       break;
     case '+':
-      token = {token_type::PLUS, ch};
+      token = makeToken(token_type::PLUS, position, 1);
       break;
     case '-':
-      // Skip Comment
-      if (peekChar() == '-') {
-        while(ch != '\0') {
-          readChar();
-        }
-        readChar();
-      }
-      token = {token_type::MINUS, ch};
+      token = makeToken(token_type::MINUS, position, 1);
       break;
     case '/':
-      token = {token_type::SLASH, ch};
+      token = makeToken(token_type::SLASH, position, 1);
       break;
     case '*':
-      token = {token_type::ASTERISK, ch};
+      token = makeToken(token_type::ASTERISK, position, 1);
+      break;
+    case '?':
+      token = makeToken(token_type::PARAM, position, 1);
+      break;
+    case '$':
+      // Numbered placeholder, $1 is the first parameter
+      if (isDigit(peekChar()))
+      {
+        size_t start = position;
+        readChar();
+        while (isDigit(ch))
+        {
+          readChar();
+        }
+        return makeToken(token_type::PARAM, start, position - start);
+      }
+      token = makeToken(token_type::ILLEGAL, position, 1);
       break;
     case '\0':
-      token = Token{token_type::ENDOFFILE, ""};
+      token = makeToken(token_type::ENDOFFILE, position, 0);
       break;
     default:
       if (isLetter(ch))
       {
-        token.literal = readIdentifier();
-        token.type = token_type::lookUpIdentifier(token.literal);
-        return token;
+        size_t start = position;
+        string_view literal = readIdentifier();
+        return Token(token_type::lookUpIdentifier(literal), literal, start);
       }
       else if (isDigit(ch))
       {
+        size_t start = position;
         token.literal = readNumber(&token);
+        token.offset = start;
         return token;
       }
       else
       {
-        token = Token(token_type::ILLEGAL, ch);
+        token = makeToken(token_type::ILLEGAL, position, 1);
       }
     }
     readChar();
     return token;
   }
 
+  /**
+   * @brief Reads the raw text between the quote at quote_offset and its closing quote,
+   * then lexing carries on after the closing quote. For text such as file paths
+   * which doesn't split into tokens.
+   *
+   * @param quote_offset offset of the opening quote in the input
+   * @return Token STRING token of the quoted text, or ILLEGAL when the quote isn't closed
+   */
+  Token readQuoted(size_t quote_offset)
+  {
+    size_t start = quote_offset + 1;
+    size_t end = input.find('\'', start);
+    if (end == string_view::npos)
+    {
+      nextPosition = input.length();
+      readChar();
+      return makeToken(token_type::ILLEGAL, quote_offset, input.length() - quote_offset);
+    }
+    nextPosition = end + 1;
+    readChar();
+    return makeToken(token_type::STRING, start, end - start);
+  }
+
   bool isLetter(char ch)
   {
     return 'a' <= ch && ch <= 'z' || 'A' <= ch && ch <= 'Z' || ch == '_';
@@ -179,13 +249,13 @@ public:
 
   /**
    * @brief Reads number and changes the passed token type to int or float depending on input
-   * 
+   *
    * @param token the token to change the type
-   * @return string The literal string input by the user
+   * @return string_view The literal input by the user
    */
-  string readNumber(Token *token)
+  string_view readNumber(Token *token)
   {
-    int curr_pos = position;
+    size_t curr_pos = position;
     while (isDigit(ch))
     {
       readChar();
@@ -200,17 +270,17 @@ public:
         readChar();
       }
     }
-    return string(input.begin() + curr_pos, input.begin() + position);
+    return input.substr(curr_pos, position - curr_pos);
   }
 
   /**
    * @brief Reads a token to determin whether its an identifier or keyword
-   * 
-   * @return string The token literal
+   *
+   * @return string_view The token literal
    */
-  string readIdentifier()
+  string_view readIdentifier()
   {
-    int curr_pos = position;
+    size_t curr_pos = position;
     if (isLetter(ch))
     {
       readChar();
@@ -219,8 +289,78 @@ public:
     {
       readChar();
     }
-    return string(input.begin() + curr_pos, input.begin() + position);
+    return input.substr(curr_pos, position - curr_pos);
   }
 };
 
-#endif /* __LEXER_HPP__ */
\ No newline at end of file
+/**
+ * @brief A statement with its literals taken out, so statements that only differ
+ * in their values share a fingerprint.
+ *
+ * @param text tokens separated by spaces, keywords in upper case and each literal replaced by ?
+ * @param literals the literals in order, INT, FLOAT or IDENTIFIER for a quoted string
+ * @param cacheable false when the statement can't be run from a cached plan
+ */
+struct Fingerprint
+{
+  std::string text;
+  std::vector<std::pair<token_type::TokenType, string_view>> literals;
+  bool cacheable = true;
+};
+
+/**
+ * @brief Lexes a single statement into its fingerprint. Only SELECT, INSERT, UPDATE
+ * and DELETE are cacheable, as are statements without placeholders of their own.
+ *
+ * @param statement the statement text, which the literals view
+ * @return Fingerprint the normalized text and literals
+ */
+inline Fingerprint fingerprintStatement(string_view statement)
+{
+  Fingerprint res;
+  res.text.reserve(statement.size());
+  Lexer lexer(statement);
+  Token token = lexer.nextToken();
+  res.cacheable = token.type == token_type::SELECT || token.type == token_type::INSERT ||
+                  token.type == token_type::UPDATE || token.type == token_type::DELETE;
+  for (; token.type != token_type::ENDOFFILE && res.cacheable; token = lexer.nextToken())
+  {
+    if (!res.text.empty())
+    {
+      res.text += ' ';
+    }
+    if (token.type == token_type::INT || token.type == token_type::FLOAT)
+    {
+      res.literals.emplace_back(token.type, token.literal);
+      res.text += '?';
+    }
+    else if (token.type == token_type::QUOTE && lexer.peekToken().type == token_type::IDENTIFIER)
+    {
+      // 'string' is lexed as quote, identifier, quote
+      Token value = lexer.nextToken();
+      if (lexer.peekToken().type != token_type::QUOTE)
+      {
+        res.cacheable = false;
+        break;
+      }
+      lexer.nextToken();
+      res.literals.emplace_back(token_type::IDENTIFIER, value.literal);
+      res.text += '?';
+    }
+    else if (token.type == token_type::PARAM || token.type == token_type::ILLEGAL)
+    {
+      res.cacheable = false;
+    }
+    else if (token.type != token_type::IDENTIFIER && token_type::findReserved(token.literal) != nullptr)
+    {
+      res.text += token_type::findReserved(token.literal)->word;
+    }
+    else
+    {
+      res.text += token.literal;
+    }
+  }
+  return res;
+}
+
+#endif /* __LEXER_HPP__ */
@@ -0,0 +1,122 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Maps whole files into memory for the readers that scan them
+ * once from start to end, like scripts and CSV imports.
+ */
+#ifndef __MAPPED_FILE_HPP__
+#define __MAPPED_FILE_HPP__
+
+#include <istream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Read only view of a whole file, mapped from disk or read fully from a stream
+ */
+class MappedFile
+{
+private:
+  std::string buffer;
+  void *mapping = nullptr;
+  size_t length = 0;
+
+public:
+  /**
+   * @brief Maps the file read only. Throws runtime_error when it can't be opened.
+   *
+   * @param path path of the file
+   */
+  explicit MappedFile(const std::string &path)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      throw std::runtime_error("!Failed to open " + path + ".");
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+      length = info.st_size;
+      mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED)
+      {
+        mapping = nullptr;
+        length = 0;
+      }
+      else
+      {
+        madvise(mapping, length, MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+  }
+
+  /**
+   * @brief Reads the whole stream, for input piped into stdin
+   */
+  explicit MappedFile(std::istream &in) : buffer(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()) {}
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile()
+  {
+    if (mapping != nullptr)
+    {
+      munmap(mapping, length);
+    }
+  }
+
+  /**
+   * @brief Which pages of a file are in the OS page cache, without reading them
+   *
+   * @param path path of the file
+   * @return std::vector<unsigned char> one entry per page of sysconf(_SC_PAGESIZE) bytes, bit 0 set
+   * when cached; empty when the file can't be mapped
+   */
+  static std::vector<unsigned char> residentPages(const std::string &path)
+  {
+    std::vector<unsigned char> resident;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      return resident;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+      size_t page_size = sysconf(_SC_PAGESIZE);
+      void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapped != MAP_FAILED)
+      {
+        resident.resize((info.st_size + page_size - 1) / page_size);
+        if (mincore(mapped, info.st_size, resident.data()) != 0)
+        {
+          resident.clear();
+        }
+        munmap(mapped, info.st_size);
+      }
+    }
+    close(fd);
+    return resident;
+  }
+
+  std::string_view text() const
+  {
+    if (mapping != nullptr)
+    {
+      return std::string_view(static_cast<const char *>(mapping), length);
+    }
+    return buffer;
+  }
+};
+
+#endif /* __MAPPED_FILE_HPP__ */
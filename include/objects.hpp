@@ -8,10 +8,16 @@
 #ifndef __OBJECTS_H__
 #define __OBJECTS_H__
 
+#include <memory>
 #include <string>
 #include <sstream>
 #include <iostream>
+#include <utility>
 #include <ast.hpp>
+#include <data_objs.hpp>
+#include <status.hpp>
+
+class TableScan;
 
 namespace ast {
   struct Node;
@@ -34,6 +40,7 @@ namespace object
     PROGRAM_OBJ,
     INTEGER_OBJ,
     CREATE_TBL_OBJ,
+    RESULT_OBJ,
   };
 
   struct Object
@@ -103,6 +110,36 @@ namespace object
       return INTEGER_OBJ;
     }
   };
+
+  /**
+   * @brief What a statement returns: how it ended, the message a client
+   * shows for it and the scan over the rows of a SELECT, which hasn't been
+   * read yet. The value keeps the statement's code.
+   */
+  struct Result : public Integer
+  {
+    Status status;
+    std::string message;
+    std::shared_ptr<TableScan> rows;
+
+    Result(Status status, int64_t val, std::string message, std::shared_ptr<TableScan> rows = nullptr)
+        : Integer(val), status(status), message(std::move(message)), rows(std::move(rows)) {}
+
+    static Result *ok(int64_t val, std::string message)
+    {
+      return new Result(Status::OK, val, std::move(message));
+    }
+
+    static Result *failed(int64_t val, std::string message)
+    {
+      return new Result(Status::FAILED, val, std::move(message));
+    }
+
+    ObjectType type() const override
+    {
+      return RESULT_OBJ;
+    }
+  };
 };
 
 #endif /* __OBJECTS_H__ */
\ No newline at end of file
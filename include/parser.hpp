@@ -10,9 +10,11 @@
 #define __PARSER_HPP__
 
 #include <functional>
+#include <memory>
 #include <unordered_map>
 #include <string>
 #include <cstring>
+#include <arena.hpp>
 #include <ast.hpp>
 #include <tokens.hpp>
 #include <lexer.hpp>
@@ -45,7 +47,7 @@ public:
    * 
    * @param what_arg The token triggering the error
    */
-  not_supported_error(const std::string &what_arg) : runtime_error(what_arg),
+  not_supported_error(std::string_view what_arg) : runtime_error(std::string(what_arg)),
                                                                                    token(what_arg) {}
 
   /**
@@ -77,7 +79,7 @@ public:
    * @param what_arg The token that was provided
    * @param expected The token or token type that was expected
    */
-  expected_token_error(const std::string &what_arg, const std::string &expected) : runtime_error(what_arg),
+  expected_token_error(std::string_view what_arg, const std::string &expected) : runtime_error(std::string(what_arg)),
                                                                                    token(what_arg),
                                                                                    expected(expected) {}
 
@@ -100,7 +102,7 @@ class unknown_command_error : public runtime_error
   std::string cmd;
 
 public:
-  unknown_command_error(const std::string &what_arg) : runtime_error(what_arg),
+  unknown_command_error(std::string_view what_arg) : runtime_error(std::string(what_arg)),
                                                        cmd(what_arg) {}
 
   virtual const char *what() const noexcept override
@@ -117,7 +119,7 @@ class unknown_type_error : public runtime_error
   std::string type;
 
 public:
-  unknown_type_error(const std::string &what_arg) : runtime_error(what_arg),
+  unknown_type_error(std::string_view what_arg) : runtime_error(std::string(what_arg)),
                                                     type(what_arg) {}
 
   virtual const char *what() const noexcept override
@@ -134,7 +136,7 @@ class unassigned_parse_function_error : public runtime_error
   std::string token;
 
 public:
-  unassigned_parse_function_error(const std::string &what_arg) : runtime_error(what_arg),
+  unassigned_parse_function_error(std::string_view what_arg) : runtime_error(std::string(what_arg)),
                                                                  token(what_arg) {}
 
   virtual const char *what() const noexcept override
@@ -146,7 +148,7 @@ public:
   }
 };
 
-std::unordered_map<token_type::TokenType, precedence> precedences = {
+inline std::unordered_map<token_type::TokenType, precedence> precedences = {
     {token_type::EQ, precedence::EQUALS},
     {token_type::NE, precedence::EQUALS},
     {token_type::LT, precedence::LESS_GREATER},
@@ -162,31 +164,49 @@ class SQLParser
 {
 public:
   Lexer *lexer;
+  // Every node and token of the parsed program lives here
+  Arena *arena;
+  std::unique_ptr<Arena> owned_arena;
   Token currToken;
   Token peekToken;
+  // Placeholders found while parsing a prepared statement, nullptr when they aren't allowed
+  std::vector<ast::ParamSlot> *params = nullptr;
+  size_t next_param = 0;
   unordered_map<token_type::TokenType, exprParseFnType *> prefixParseFns;
 
   // Define parsing functions
   exprParseFnType parseIdentifier = exprParseFnType([&, this]()
-                                                    { return new ast::Identifier{currToken, currToken.literal}; });
+                                                    { return arena->make<ast::Identifier>(currToken, currToken.literal); });
   exprParseFnType parseIntegerLiteral = exprParseFnType([&, this]()
                                                         {
     try {
-      int value = std::stoi(currToken.literal);
-      return new ast::IntegerLiteral{currToken, value};
+      int value = std::stoi(string(currToken.literal));
+      return arena->make<ast::IntegerLiteral>(currToken, value);
     } catch (const std::invalid_argument &ia) {
       return static_cast<ast::IntegerLiteral*>(nullptr);
     } });
   exprParseFnType parsePrefixExpression = exprParseFnType([&, this]()
                                                           {
-    ast::PrefixExpression *expr = new ast::PrefixExpression{currToken, currToken.literal};
+    ast::PrefixExpression *expr = arena->make<ast::PrefixExpression>(currToken, currToken.literal);
     // Move on to expression after prefix
     nextToken();
     expr->right = dynamic_cast<ast::IntegerLiteral*>(parseIntegerLiteral());
     return expr; });
 
-  SQLParser(Lexer *lexer) : lexer(lexer)
+  /**
+   * @brief Parses the lexer input into an AST allocated from arena
+   *
+   * @param lexer the token source
+   * @param arena [default: nullptr] arena the AST is made in. Without one the parser
+   *              owns an arena and the AST is freed along with the parser.
+   */
+  SQLParser(Lexer *lexer, Arena *arena = nullptr) : lexer(lexer), arena(arena)
   {
+    if (this->arena == nullptr)
+    {
+      owned_arena.reset(new Arena());
+      this->arena = owned_arena.get();
+    }
     // Set currToken and peekToken
     nextToken();
     nextToken();
@@ -198,6 +218,17 @@ public:
     prefixParseFns[token_type::MINUS] = &parsePrefixExpression;
   };
 
+  /**
+   * @brief Continues parsing from another lexer, keeping the arena and parse functions.
+   * Lets a script reuse one parser for all of its statements.
+   */
+  void reset(Lexer *lexer)
+  {
+    this->lexer = lexer;
+    nextToken();
+    nextToken();
+  }
+
   void nextToken()
   {
     currToken = peekToken;
@@ -206,7 +237,7 @@ public:
 
   ast::Program *parseSql()
   {
-    ast::Program *program = new ast::Program{};
+    ast::Program *program = arena->make<ast::Program>();
     program->statements = {};
 
     while (currToken.type != token_type::ENDOFFILE)
@@ -234,16 +265,36 @@ public:
     }
     else if (currToken.type == token_type::BEGIN)
     {
-      parseBeginTransactionStatement();
+      return parseBeginTransactionStatement();
     }
     else if (currToken.type == token_type::COMMIT)
     {
-      parseCommitStatement();
+      return parseCommitStatement();
     }
     else if (currToken.type == token_type::INSERT)
     {
       return parseInsertTableStatement();
     }
+    else if (currToken.type == token_type::COPY)
+    {
+      return parseCopyTableStatement();
+    }
+    else if (currToken.type == token_type::PREPARE)
+    {
+      return parsePrepareStatement();
+    }
+    else if (currToken.type == token_type::EXECUTE)
+    {
+      return parseExecuteStatement();
+    }
+    else if (currToken.type == token_type::ANALYZE)
+    {
+      return parseAnalyzeTableStatement();
+    }
+    else if (currToken.type == token_type::EXPLAIN)
+    {
+      return parseExplainStatement();
+    }
     else if (currToken.type == token_type::UPDATE)
     {
       return parseUpdateTableStatement();
@@ -298,9 +349,12 @@ public:
   ast::CommandStatement *parseCommand()
   {
     nextToken();
-    if (token_type::lookUpCommand(currToken.literal) != token_type::COMMAND)
+    // The lexer reads the name as an identifier, it is a command only after the '.'
+    Token command = currToken;
+    command.type = token_type::lookUpCommand(currToken.literal);
+    if (command.type != token_type::COMMAND)
     {
-      return new ast::CommandStatement{currToken};
+      return arena->make<ast::CommandStatement>(command);
     }
     else
     {
@@ -313,7 +367,7 @@ public:
     if (currToken.type != token_type::SELECT) {
       throw expected_token_error(currToken.literal, "SELECT");
     }
-    ast::SelectTableStatement *statement = new ast::SelectTableStatement{currToken};
+    ast::SelectTableStatement *statement = arena->make<ast::SelectTableStatement>(currToken);
     nextToken();
 
     statement->column_query = parseQueryExpression();
@@ -324,42 +378,138 @@ public:
     }
     nextToken();
     if (currToken.type != token_type::IDENTIFIER) {
-      throw expected_token_error(currToken.type, "IDENTIFIER");
+      throw expected_token_error(token_type::name(currToken.type), "IDENTIFIER");
     }
     // Change to parseIdentifierList
     //statement->name = new ast::Identifier{currToken, currToken.literal};
     statement->names = parseTableIdentifierList();
 
-    if (peekToken.type == token_type::SEMICOLON) {
-      nextToken();
-      statement->query = static_cast<ast::WhereExpression *>(nullptr);
-    } else if (peekToken.type == token_type::WHERE) {
+    if (peekToken.type == token_type::WHERE) {
       nextToken();
       nextToken();
       statement->query = parseWhereExpression();
-      nextToken();
-      if (currToken.type != token_type::SEMICOLON) {
-        throw expected_token_error(currToken.type, ";");
-      }
-      nextToken();
     } else if (peekToken.type == token_type::LEFT ||
                peekToken.type == token_type::RIGHT ||
+               peekToken.type == token_type::FULL ||
                peekToken.type == token_type::INNER)
     {
 
       nextToken();
       statement->join_expr = parseJoinExpression();
-      nextToken();
-      if (currToken.type != token_type::SEMICOLON) {
-        throw expected_token_error(currToken.type, ";");
-      }
     }
-    else
+    else if (peekToken.type != token_type::SEMICOLON && peekToken.type != token_type::GROUP &&
+             peekToken.type != token_type::ORDER && peekToken.type != token_type::LIMIT &&
+             peekToken.type != token_type::OFFSET)
     {
-      throw expected_token_error(currToken.type, "WHERE, INNER, OUTER, LEFT, RIGHT, OR ;");
+      throw expected_token_error(token_type::name(currToken.type), "WHERE, INNER, OUTER, LEFT, RIGHT, FULL, GROUP BY, ORDER BY, LIMIT OR ;");
+    }
+    nextToken();
+    // GROUP BY
+    if (currToken.type == token_type::GROUP) {
+      statement->group_by = parseGroupByExpression();
+      nextToken();
+    }
+    // ORDER BY
+    if (currToken.type == token_type::ORDER) {
+      statement->order_by = parseOrderByExpression();
+      nextToken();
+    }
+    // LIMIT
+    if (currToken.type == token_type::LIMIT) {
+      nextToken();
+      statement->limit = parseRowCount();
+      nextToken();
+    }
+    // OFFSET
+    if (currToken.type == token_type::OFFSET) {
+      nextToken();
+      statement->offset = parseRowCount();
+      nextToken();
+    }
+    if (currToken.type != token_type::SEMICOLON) {
+      throw expected_token_error(token_type::name(currToken.type), ";");
     }
     return statement;
   }
+
+  /**
+   * @brief Parses GROUP BY {IDENTIFIER} {, IDENTIFIER}, leaving currToken on the last column
+   */
+  ast::ColumnQueryExpression *parseGroupByExpression() {
+    nextToken();
+    if (currToken.type != token_type::BY) {
+      throw expected_token_error(currToken.literal, "BY");
+    }
+    nextToken();
+    return parseColumnList();
+  }
+
+  /**
+   * @brief Parses the count of LIMIT or OFFSET, an int or a placeholder
+   */
+  Token *parseRowCount() {
+    if (currToken.type != token_type::INT && currToken.type != token_type::PARAM) {
+      throw expected_token_error(currToken.literal, "int");
+    }
+    Token *count = arena->make<Token>(currToken);
+    if (currToken.type == token_type::PARAM) {
+      parseParam(count);
+    }
+    return count;
+  }
+
+  /**
+   * @brief Parses ORDER BY {column [ASC | DESC]} {, ...}, leaving currToken on the last token
+   */
+  ast::OrderByExpression *parseOrderByExpression() {
+    nextToken();
+    if (currToken.type != token_type::BY) {
+      throw expected_token_error(currToken.literal, "BY");
+    }
+    nextToken();
+    return parseOrderByList();
+  }
+
+  ast::OrderByExpression *parseOrderByList() {
+    if (currToken.type != token_type::IDENTIFIER) {
+      throw expected_token_error(currToken.literal, "{IDENTIFIER}");
+    }
+    ast::OrderByExpression *expr;
+    // An aggregate of the select list
+    if (peekToken.type == token_type::LPAREN) {
+      ast::ColumnQueryExpression *aggregate = parseAggregateExpression();
+      expr = arena->make<ast::OrderByExpression>(aggregate->token);
+      expr->aggregate = aggregate->aggregate;
+    } else {
+      expr = arena->make<ast::OrderByExpression>(currToken);
+    }
+    if (peekToken.type == token_type::ASC || peekToken.type == token_type::DESC) {
+      nextToken();
+      expr->descending = currToken.type == token_type::DESC;
+    }
+    if (peekToken.type == token_type::COMMA) {
+      nextToken();
+      nextToken();
+      expr->right = parseOrderByList();
+    }
+    return expr;
+  }
+
+  /**
+   * @brief Parses {IDENTIFIER} {, IDENTIFIER}, leaving currToken on the last column
+   */
+  ast::ColumnQueryExpression *parseColumnList() {
+    if (currToken.type != token_type::IDENTIFIER) {
+      throw expected_token_error(currToken.literal, "{IDENTIFIER}");
+    }
+    ast::ColumnQueryExpression *expr = arena->make<ast::ColumnQueryExpression>(currToken);
+    if (peekToken.type == token_type::COMMA) {
+      nextToken();
+      nextToken();
+      expr->right = parseColumnList();
+    }
+    return expr;
+  }
   /*
   ast::TableJoinExpression *parseJoinExpression() {
     ast::TableJoinExpression *expr;
@@ -375,11 +525,16 @@ public:
 
   ast::ColumnQueryExpression *parseQueryExpression() {
     if (currToken.type == token_type::ASTERISK) {
-      ast::ColumnQueryExpression *expr = new ast::ColumnQueryExpression{currToken};
+      ast::ColumnQueryExpression *expr = arena->make<ast::ColumnQueryExpression>(currToken);
       expr->right = static_cast<ast::ColumnQueryExpression *>(nullptr);
       return expr;
     } else if (currToken.type == token_type::IDENTIFIER) {
-      ast::ColumnQueryExpression *expr = new ast::ColumnQueryExpression{currToken};
+      ast::ColumnQueryExpression *expr;
+      if (peekToken.type == token_type::LPAREN) {
+        expr = parseAggregateExpression();
+      } else {
+        expr = arena->make<ast::ColumnQueryExpression>(currToken);
+      }
       if (peekToken.type == token_type::COMMA) {
         nextToken();
         nextToken();
@@ -393,18 +548,42 @@ public:
       }
       else
       {
-        throw expected_token_error(currToken.type, "FROM OR ,");
+        throw expected_token_error(token_type::name(currToken.type), "FROM OR ,");
       }
     }
   }
 
+  /**
+   * @brief Parses COUNT(*) or {COUNT, SUM, MIN, MAX, AVG}({IDENTIFIER}), leaving currToken on ')'
+   */
+  ast::ColumnQueryExpression *parseAggregateExpression() {
+    Token function = currToken;
+    if (ast::aggregateFunction(function.literal) == ast::AggregateFunction::NONE) {
+      throw expected_token_error(currToken.literal, "COUNT, SUM, MIN, MAX OR AVG");
+    }
+    // (
+    nextToken();
+    nextToken();
+    if (currToken.type != token_type::IDENTIFIER &&
+        !(currToken.type == token_type::ASTERISK && ast::aggregateFunction(function.literal) == ast::AggregateFunction::COUNT)) {
+      throw expected_token_error(currToken.literal, "{IDENTIFIER}");
+    }
+    ast::ColumnQueryExpression *expr = arena->make<ast::ColumnQueryExpression>(currToken);
+    expr->aggregate = arena->make<Token>(function);
+    nextToken();
+    if (currToken.type != token_type::RPAREN) {
+      throw expected_token_error(currToken.literal, ")");
+    }
+    return expr;
+  }
+
   ast::UseDatabaseStatement *parseUseDatabaseStatement()
   {
-    ast::UseDatabaseStatement *statement = new ast::UseDatabaseStatement{currToken};
+    ast::UseDatabaseStatement *statement = arena->make<ast::UseDatabaseStatement>(currToken);
     if (peekToken.type == token_type::IDENTIFIER)
     {
       nextToken();
-      statement->name = new ast::Identifier{currToken, currToken.literal};
+      statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
     }
     else
     {
@@ -421,7 +600,7 @@ public:
 
   ast::CreateDatabaseStatement *parseCreateDatabaseStatement()
   {
-    ast::CreateDatabaseStatement *statement = new ast::CreateDatabaseStatement{currToken};
+    ast::CreateDatabaseStatement *statement = arena->make<ast::CreateDatabaseStatement>(currToken);
     nextToken();
     if (peekToken.type == token_type::IDENTIFIER)
     {
@@ -431,7 +610,7 @@ public:
     {
       throw expected_token_error(peekToken.literal, "IDENTIFIER");
     }
-    statement->name = new ast::Identifier{currToken, currToken.literal};
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
     // Ignore everything else
     nextToken();
     if (currToken.type != token_type::SEMICOLON)
@@ -444,7 +623,7 @@ public:
 
   ast::DropDatabaseStatement *parseDropDatabaseStatement()
   {
-    ast::DropDatabaseStatement *statement = new ast::DropDatabaseStatement{currToken};
+    ast::DropDatabaseStatement *statement = arena->make<ast::DropDatabaseStatement>(currToken);
     nextToken();
     if (peekToken.type == token_type::IDENTIFIER)
     {
@@ -454,7 +633,7 @@ public:
     {
       throw expected_token_error(peekToken.literal, "IDENTIFIER");
     }
-    statement->name = new ast::Identifier{currToken, currToken.literal};
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
     // Ignore everything else
     nextToken();
     if (currToken.type != token_type::SEMICOLON)
@@ -467,7 +646,7 @@ public:
 
   ast::CreateTableStatement *parseCreateTableStatement()
   {
-    ast::CreateTableStatement *statement = new ast::CreateTableStatement{currToken};
+    ast::CreateTableStatement *statement = arena->make<ast::CreateTableStatement>(currToken);
     nextToken();
     if (peekToken.type == token_type::IDENTIFIER)
     {
@@ -478,7 +657,7 @@ public:
       // Not identifier error
       throw expected_token_error(peekToken.literal, "IDENTIFIER");
     }
-    statement->name = new ast::Identifier{currToken, currToken.literal};
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
 
     nextToken();
     if (currToken.type != token_type::LPAREN)
@@ -492,6 +671,12 @@ public:
       throw expected_token_error(currToken.literal, ")");
     }
     nextToken();
+    if (currToken.type == token_type::WITH)
+    {
+      nextToken();
+      statement->options = parseTableOptions();
+      nextToken();
+    }
     if (currToken.type != token_type::SEMICOLON)
     {
       throw expected_token_error(currToken.literal, ";");
@@ -499,11 +684,52 @@ public:
     return statement;
   }
 
+  /**
+   * @brief Parses the options after WITH, e.g. (bloom_filter = pid, bloom_filter = name)
+   * Ends on the closing paren
+   */
+  ast::TableOptionExpression *parseTableOptions()
+  {
+    if (currToken.type != token_type::LPAREN)
+    {
+      throw expected_token_error(currToken.literal, "(");
+    }
+    ast::TableOptionExpression *first = nullptr, *last = nullptr;
+    do
+    {
+      nextToken();
+      if (currToken.type != token_type::IDENTIFIER)
+      {
+        throw expected_token_error(token_type::name(currToken.type), "IDENTIFIER");
+      }
+      Token name = currToken;
+      nextToken();
+      if (currToken.type != token_type::EQ)
+      {
+        throw expected_token_error(currToken.literal, "=");
+      }
+      nextToken();
+      if (currToken.type != token_type::IDENTIFIER)
+      {
+        throw expected_token_error(token_type::name(currToken.type), "IDENTIFIER");
+      }
+      ast::TableOptionExpression *option = arena->make<ast::TableOptionExpression>(name, currToken);
+      (last == nullptr ? first : last->right) = option;
+      last = option;
+      nextToken();
+    } while (currToken.type == token_type::COMMA);
+    if (currToken.type != token_type::RPAREN)
+    {
+      throw expected_token_error(currToken.literal, ")");
+    }
+    return first;
+  }
+
   ast::DeleteTableStatement *parseDeleteTableStatement() {
     if (currToken.type != token_type::DELETE) {
       throw expected_token_error(currToken.literal, "DELETE");
     }
-    ast::DeleteTableStatement *statement = new ast::DeleteTableStatement{currToken};
+    ast::DeleteTableStatement *statement = arena->make<ast::DeleteTableStatement>(currToken);
     nextToken();
     if (currToken.type == token_type::FROM) {
       nextToken();
@@ -513,7 +739,7 @@ public:
       throw expected_token_error(currToken.literal, "FROM");
     }
     if (currToken.type == token_type::IDENTIFIER) {
-      statement->name = new ast::Identifier{currToken, currToken.literal};
+      statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
     }
     else
     {
@@ -537,11 +763,11 @@ public:
   }
 
   ast::UpdateTableStatement *parseUpdateTableStatement() {
-    ast::UpdateTableStatement *statement = new ast::UpdateTableStatement{currToken};
+    ast::UpdateTableStatement *statement = arena->make<ast::UpdateTableStatement>(currToken);
     nextToken();
     if (currToken.type == token_type::IDENTIFIER)
     {
-      statement->name = new ast::Identifier{currToken, currToken.literal};
+      statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
       nextToken();
     }
     else
@@ -574,7 +800,7 @@ public:
   }
 
   ast::CommitStatement *parseCommitStatement() {
-    ast::CommitStatement *statement = new ast::CommitStatement{currToken};
+    ast::CommitStatement *statement = arena->make<ast::CommitStatement>(currToken);
     nextToken();
     if (currToken.type != token_type::SEMICOLON) {
       throw expected_token_error(currToken.literal, ";");
@@ -583,7 +809,7 @@ public:
   }
 
   ast::BeginTransactionStatement *parseBeginTransactionStatement() {
-    ast::BeginTransactionStatement *statement = new ast::BeginTransactionStatement{currToken};
+    ast::BeginTransactionStatement *statement = arena->make<ast::BeginTransactionStatement>(currToken);
     nextToken();
     if (currToken.type != token_type::TRANSACTION) {
       throw expected_token_error(currToken.literal, "TRANSACTION");
@@ -595,7 +821,7 @@ public:
   // Parse takens for inserting data into a table
   ast::InsertTableStatement *parseInsertTableStatement() {
     // INSERT
-    ast::InsertTableStatement *statement = new ast::InsertTableStatement{currToken};
+    ast::InsertTableStatement *statement = arena->make<ast::InsertTableStatement>(currToken);
     nextToken();
     // INTO
     if (currToken.type == token_type::INTO)
@@ -608,7 +834,7 @@ public:
     }
 
     // {LITERAL}
-    statement->name = new ast::Identifier{currToken, currToken.literal};
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
     nextToken();
     
     // VALUES
@@ -620,18 +846,64 @@ public:
     {
       throw expected_token_error(currToken.literal, "VALUES");
     }
-    // (
-    if (currToken.type != token_type::LPAREN)
+    // (...) {, (...)}
+    while (true)
     {
-      throw expected_token_error(currToken.literal, "(");
+      if (currToken.type != token_type::LPAREN)
+      {
+        throw expected_token_error(currToken.literal, "(");
+      }
+      nextToken();
+      statement->rows.push_back(parseColumnLiteral());
+      if (currToken.type != token_type::RPAREN)
+      {
+        throw expected_token_error(currToken.literal, ")");
+      }
+      nextToken();
+      if (currToken.type != token_type::COMMA)
+      {
+        break;
+      }
+      nextToken();
+    }
+    statement->column_list = statement->rows[0];
+    if (currToken.type != token_type::SEMICOLON)
+    {
+      throw expected_token_error(currToken.literal, ";");
+    }
+    return statement;
+  }
+
+  ast::CopyTableStatement *parseCopyTableStatement()
+  {
+    // COPY
+    ast::CopyTableStatement *statement = arena->make<ast::CopyTableStatement>(currToken);
+    nextToken();
+    if (currToken.type != token_type::IDENTIFIER)
+    {
+      throw expected_token_error(currToken.literal, "IDENTIFIER");
     }
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
     nextToken();
-    statement->column_list = parseColumnLiteral();
-    // )
-    if (currToken.type != token_type::RPAREN)
+    // FROM | TO
+    if (currToken.type != token_type::FROM && currToken.type != token_type::TO)
     {
-      throw expected_token_error(currToken.literal, ")");
+      throw expected_token_error(currToken.literal, "FROM OR TO");
+    }
+    statement->direction = currToken;
+    nextToken();
+    // 'path'
+    if (currToken.type != token_type::QUOTE)
+    {
+      throw expected_token_error(currToken.literal, "'");
     }
+    currToken = lexer->readQuoted(currToken.offset);
+    peekToken = lexer->nextToken();
+    if (currToken.type != token_type::STRING)
+    {
+      throw expected_token_error(currToken.literal, "'");
+    }
+    statement->path = currToken;
     nextToken();
     if (currToken.type != token_type::SEMICOLON)
     {
@@ -640,9 +912,119 @@ public:
     return statement;
   }
 
+  /**
+   * @brief Records the placeholder in currToken
+   *
+   * @param value token the bound value is written to
+   * @param vartype [default: nullptr] type token rewritten along with it
+   */
+  void parseParam(Token *value, Token *vartype = nullptr)
+  {
+    if (params == nullptr)
+    {
+      throw expected_token_error(currToken.literal, "a value, placeholders are only allowed in PREPARE");
+    }
+    size_t index = next_param++;
+    if (currToken.literal[0] == '$')
+    {
+      // The lexer only makes $ followed by digits a placeholder, stop before they overflow
+      size_t number = 0;
+      for (char digit : currToken.literal.substr(1))
+      {
+        number = number * 10 + (digit - '0');
+        if (number > 0x10000)
+        {
+          throw expected_token_error(currToken.literal, "$1 to $65536");
+        }
+      }
+      if (number == 0)
+      {
+        throw expected_token_error(currToken.literal, "$1 or above");
+      }
+      index = number - 1;
+    }
+    params->push_back(ast::ParamSlot{index, value, vartype});
+  }
+
+  ast::PrepareStatement *parsePrepareStatement()
+  {
+    // PREPARE
+    ast::PrepareStatement *statement = arena->make<ast::PrepareStatement>(currToken);
+    nextToken();
+    if (currToken.type != token_type::IDENTIFIER)
+    {
+      throw expected_token_error(currToken.literal, "IDENTIFIER");
+    }
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
+    nextToken();
+    // AS
+    if (currToken.type != token_type::AS)
+    {
+      throw expected_token_error(currToken.literal, "AS");
+    }
+    nextToken();
+    if (currToken.type == token_type::PREPARE || currToken.type == token_type::EXECUTE)
+    {
+      throw expected_token_error(currToken.literal, "a statement other than PREPARE or EXECUTE");
+    }
+    // Parse the statement once to check it, collecting its placeholders
+    size_t start = currToken.offset;
+    std::vector<ast::ParamSlot> slots;
+    params = &slots;
+    next_param = 0;
+    try
+    {
+      parseStatement();
+    }
+    catch (...)
+    {
+      params = nullptr;
+      throw;
+    }
+    params = nullptr;
+    for (const auto &slot : slots)
+    {
+      statement->param_count = std::max(statement->param_count, slot.index + 1);
+    }
+    statement->text = lexer->source().substr(start, currToken.offset + currToken.length() - start);
+    return statement;
+  }
+
+  ast::ExecuteStatement *parseExecuteStatement()
+  {
+    // EXECUTE
+    ast::ExecuteStatement *statement = arena->make<ast::ExecuteStatement>(currToken);
+    nextToken();
+    if (currToken.type != token_type::IDENTIFIER)
+    {
+      throw expected_token_error(currToken.literal, "IDENTIFIER");
+    }
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
+    nextToken();
+    // [(args)]
+    if (currToken.type == token_type::LPAREN)
+    {
+      nextToken();
+      if (currToken.type != token_type::RPAREN)
+      {
+        statement->args = parseColumnLiteral();
+      }
+      if (currToken.type != token_type::RPAREN)
+      {
+        throw expected_token_error(currToken.literal, ")");
+      }
+      nextToken();
+    }
+    if (currToken.type != token_type::SEMICOLON)
+    {
+      throw expected_token_error(currToken.literal, ";");
+    }
+    return statement;
+  }
+
   ast::AlterTableStatement *parseAlterTableStatement()
   {
-    ast::AlterTableStatement *statement = new ast::AlterTableStatement{currToken};
+    ast::AlterTableStatement *statement = arena->make<ast::AlterTableStatement>(currToken);
     nextToken();
     if (peekToken.type == token_type::IDENTIFIER)
     {
@@ -653,7 +1035,7 @@ public:
       // Not identifier error
       throw expected_token_error(peekToken.literal, "IDENTIFIER");
     }
-    statement->name = new ast::Identifier{currToken, currToken.literal};
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
 
     nextToken();
     if (currToken.type == token_type::ADD) {
@@ -688,7 +1070,7 @@ public:
 
   ast::DropTableStatement *parseDropTableStatement()
   {
-    ast::DropTableStatement *statement = new ast::DropTableStatement{currToken};
+    ast::DropTableStatement *statement = arena->make<ast::DropTableStatement>(currToken);
     nextToken();
     if (peekToken.type == token_type::IDENTIFIER)
     {
@@ -698,7 +1080,7 @@ public:
     {
       throw expected_token_error(peekToken.literal, "IDENTIFIER");
     }
-    statement->name = new ast::Identifier{currToken, currToken.literal};
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
     // Ignore everything else
     nextToken();
     if (currToken.type != token_type::SEMICOLON)
@@ -709,18 +1091,75 @@ public:
     return statement;
   }
 
+  /**
+   * @brief Parses ANALYZE [TABLE] name;
+   */
+  ast::AnalyzeTableStatement *parseAnalyzeTableStatement()
+  {
+    ast::AnalyzeTableStatement *statement = arena->make<ast::AnalyzeTableStatement>(currToken);
+    if (peekToken.type == token_type::TABLE)
+    {
+      nextToken();
+    }
+    if (peekToken.type != token_type::IDENTIFIER)
+    {
+      throw expected_token_error(peekToken.literal, "IDENTIFIER");
+    }
+    nextToken();
+    statement->name = arena->make<ast::Identifier>(currToken, currToken.literal);
+    nextToken();
+    if (currToken.type != token_type::SEMICOLON)
+    {
+      throw expected_token_error(currToken.literal, ";");
+    }
+    return statement;
+  }
+
+  /**
+   * @brief Parses EXPLAIN [ANALYZE] statement. ANALYZE followed by a table name is
+   * the statement explained, otherwise it means running the statement.
+   */
+  ast::ExplainStatement *parseExplainStatement()
+  {
+    ast::ExplainStatement *statement = arena->make<ast::ExplainStatement>(currToken);
+    nextToken();
+    if (currToken.type == token_type::ANALYZE && peekToken.type != token_type::IDENTIFIER &&
+        peekToken.type != token_type::TABLE)
+    {
+      statement->analyze = true;
+      nextToken();
+    }
+    if (currToken.type == token_type::EXPLAIN || currToken.type == token_type::PREPARE ||
+        currToken.type == token_type::EXECUTE || currToken.type == token_type::COMMAND)
+    {
+      throw expected_token_error(currToken.literal, "a statement other than EXPLAIN, PREPARE or EXECUTE");
+    }
+    statement->statement = parseStatement();
+    if (statement->statement == nullptr)
+    {
+      throw expected_token_error(currToken.literal, "a statement");
+    }
+    return statement;
+  }
+
   // Recursively parse column literals
   ast::ColumnLiteralExpression *parseColumnLiteral() {
     // Number
     ast::ColumnLiteralExpression *expr;
     if (currToken.type == token_type::INT)
     {
-      expr = new ast::ColumnLiteralExpression{currToken, Token{token_type::INT, "INT"}};
+      expr = arena->make<ast::ColumnLiteralExpression>(currToken, Token{token_type::INT, "INT"});
       nextToken();
     }
     else if (currToken.type == token_type::FLOAT)
     {
-      expr = new ast::ColumnLiteralExpression{currToken, Token{token_type::FLOAT, "FLOAT"}};
+      expr = arena->make<ast::ColumnLiteralExpression>(currToken, Token{token_type::FLOAT, "FLOAT"});
+      nextToken();
+    }
+    else if (currToken.type == token_type::PARAM)
+    {
+      expr = arena->make<ast::ColumnLiteralExpression>(currToken, Token{token_type::PARAM, "PARAM"});
+      parseParam(&expr->token, &expr->token_vartype);
       nextToken();
     }
     else {
@@ -734,7 +1173,7 @@ public:
       {
         throw expected_token_error(currToken.literal, "{IDENTIFIER}");
       }
-      expr = new ast::ColumnLiteralExpression{currToken, Token{token_type::IDENTIFIER, "IDENTIFIER"}};
+      expr = arena->make<ast::ColumnLiteralExpression>(currToken, Token{token_type::IDENTIFIER, "IDENTIFIER"});
       nextToken();
       if (currToken.type != token_type::QUOTE)
       {
@@ -758,7 +1197,7 @@ public:
 
   ast::ColumnDefinitionExpression *parseColumnDefinition(bool single = false)
   {
-    auto expr = new ast::ColumnDefinitionExpression{currToken, peekToken};
+    auto expr = arena->make<ast::ColumnDefinitionExpression>(currToken, peekToken);
     nextToken();
     token_type::TokenType varType = token_type::lookUpType(currToken.literal);
     if (varType == token_type::TYPE)
@@ -801,7 +1240,7 @@ public:
     if (currToken.type != token_type::IDENTIFIER) {
       throw expected_token_error(currToken.literal, "{IDENTIFIER} (Table name)");
     }
-    ast::TableIdentifierList *expr = new ast::TableIdentifierList{currToken};
+    ast::TableIdentifierList *expr = arena->make<ast::TableIdentifierList>(currToken);
     // If single identifer quit with alias null
     if (peekToken.type != token_type::IDENTIFIER) {
       return expr;
@@ -811,15 +1250,18 @@ public:
       throw expected_token_error(currToken.literal, "{IDENTIFIER} (Table alias)");
     }
     // Alias
-    expr->alias = new Token(currToken);
+    expr->alias = arena->make<Token>(currToken);
     if (peekToken.type == token_type::COMMA) {
       nextToken();
       nextToken();
       expr->right = parseTableIdentifierList();
       return expr;
     } else if (peekToken.type != token_type::WHERE && peekToken.type != token_type::INNER &&
-               peekToken.type != token_type::LEFT && peekToken.type != token_type::RIGHT && peekToken.type != token_type::SEMICOLON) {
-      throw expected_token_error(peekToken.type, "{QUERY-EXPR, JOIN-EXPR}");
+               peekToken.type != token_type::LEFT && peekToken.type != token_type::RIGHT &&
+               peekToken.type != token_type::FULL && peekToken.type != token_type::SEMICOLON &&
+               peekToken.type != token_type::GROUP && peekToken.type != token_type::ORDER &&
+               peekToken.type != token_type::LIMIT && peekToken.type != token_type::OFFSET) {
+      throw expected_token_error(token_type::name(peekToken.type), "{QUERY-EXPR, JOIN-EXPR}");
     } else {
       expr->right = static_cast<ast::TableIdentifierList *>(nullptr);
       return expr;
@@ -831,7 +1273,7 @@ public:
     if (currToken.type != token_type::IDENTIFIER) {
       throw expected_token_error(currToken.literal, "{IDENTIFIER}");
     }
-    ast::ColumnValueExpression *expr = new ast::ColumnValueExpression{currToken};
+    ast::ColumnValueExpression *expr = arena->make<ast::ColumnValueExpression>(currToken);
     nextToken();
     if (currToken.type == token_type::EQ) {
       nextToken();
@@ -844,6 +1286,9 @@ public:
       nextToken();
     }
     expr->value = currToken;
+    if (currToken.type == token_type::PARAM) {
+      parseParam(&expr->value);
+    }
     if (peekToken.type == token_type::QUOTE) {
       nextToken();
     }
@@ -869,13 +1314,13 @@ public:
   ast::JoinExpression *parseJoinExpression() {
     ast::JoinExpression *expr;
     // If Outer join
-    if ((currToken.type == token_type::LEFT || currToken.type == token_type::RIGHT)
-        && peekToken.type == token_type::OUTER) {
-      expr = new ast::JoinExpression(peekToken);
+    if ((currToken.type == token_type::LEFT || currToken.type == token_type::RIGHT ||
+         currToken.type == token_type::FULL) && peekToken.type == token_type::OUTER) {
+      expr = arena->make<ast::JoinExpression>(peekToken);
       if (expr->token.type != token_type::OUTER) {
         throw expected_token_error(peekToken.literal, "OUTER");
       }
-      expr->include = new Token(currToken);
+      expr->include = arena->make<Token>(currToken);
       nextToken();
       nextToken();
       if (currToken.type != token_type::JOIN) {
@@ -883,26 +1328,26 @@ public:
       }
       nextToken();
     } else if (currToken.type == token_type::INNER) {
-      expr = new ast::JoinExpression(currToken);
+      expr = arena->make<ast::JoinExpression>(currToken);
       nextToken();
       if (currToken.type != token_type::JOIN) {
         throw expected_token_error(currToken.literal, "JOIN");
       }
       nextToken();
     } else {
-      throw expected_token_error(currToken.literal, "INNER, LEFT OUTER, or RIGHT OUTER");
+      throw expected_token_error(currToken.literal, "INNER, LEFT OUTER, RIGHT OUTER, or FULL OUTER");
     }
     if (currToken.type != token_type::IDENTIFIER) {
       throw expected_token_error(currToken.literal, "{IDENTIFIER}");
     }
     // RHS Ident
-    expr->join_ident = new Token(currToken);
+    expr->join_ident = arena->make<Token>(currToken);
     nextToken();
     if (currToken.type != token_type::IDENTIFIER) {
       throw expected_token_error(currToken.literal, "{IDENTIFIER}");
     }
     // RHS Alias
-    expr->join_alias = new Token(currToken);
+    expr->join_alias = arena->make<Token>(currToken);
     nextToken();
     if (currToken.type != token_type::ON) {
       throw expected_token_error(currToken.literal, "ON");
@@ -916,7 +1361,7 @@ public:
     if (currToken.type != token_type::IDENTIFIER) {
       throw expected_token_error(currToken.literal, "{IDENTIFIER}");
     } 
-    ast::WhereExpression *expr = new ast::WhereExpression{currToken};
+    ast::WhereExpression *expr = arena->make<ast::WhereExpression>(currToken);
     if (peekToken.type == token_type::COMMAND) {
       nextToken();
       nextToken();
@@ -924,7 +1369,7 @@ public:
     if (currToken.type != token_type::IDENTIFIER) {
       throw expected_token_error(currToken.literal, "{IDENTIFIER}");
     }
-    expr->token_alias = new Token(currToken);
+    expr->token_alias = arena->make<Token>(currToken);
 
 
     nextToken();
@@ -958,6 +1403,10 @@ public:
     else if (currToken.type == token_type::FLOAT || currToken.type == token_type::INT) {
       expr->value = currToken; 
     }
+    else if (currToken.type == token_type::PARAM) {
+      expr->value = currToken;
+      parseParam(&expr->value);
+    }
     else if (currToken.type == token_type::IDENTIFIER) {
       expr->value = currToken;
       if (peekToken.type == token_type::COMMAND) {
@@ -969,7 +1418,7 @@ public:
       if (currToken.type != token_type::IDENTIFIER) {
         throw expected_token_error(currToken.literal, "{IDENTIFIER}");
       }
-      expr->value_alias = new Token(currToken);
+      expr->value_alias = arena->make<Token>(currToken);
     }
     else {
       throw expected_token_error(currToken.literal, "string, int, or float");
@@ -980,7 +1429,7 @@ public:
 
   ast::ExpressionStatement *parseExpressionStatement()
   {
-    ast::ExpressionStatement *statement = new ast::ExpressionStatement{currToken};
+    ast::ExpressionStatement *statement = arena->make<ast::ExpressionStatement>(currToken);
     statement->expression = parseExpression();
     if (peekToken.type == token_type::SEMICOLON)
     {
@@ -1001,7 +1450,7 @@ public:
     }
     else
     {
-      throw unassigned_parse_function_error(string(currToken.type));
+      throw unassigned_parse_function_error(token_type::name(currToken.type));
     }
     return nullptr;
   }
@@ -0,0 +1,136 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: LRU cache of prepared statements keyed by statement fingerprint.
+ * Statements that only differ in their literals reuse one parsed statement
+ * and have their literals bound as parameters, skipping the parser.
+ */
+#ifndef __PLAN_CACHE_HPP__
+#define __PLAN_CACHE_HPP__
+
+#include <sstream>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <lexer.hpp>
+#include <objects.hpp>
+#include <data_objs.hpp>
+#include <prepared.hpp>
+#include <zone_map.hpp>
+
+class PlanCache
+{
+private:
+  // A null plan marks a fingerprint that couldn't be prepared so it isn't retried
+  using Entry = std::pair<std::string, std::shared_ptr<PreparedStatement>>;
+
+  size_t capacity;
+  // Most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+public:
+  static const size_t DEFAULT_CAPACITY = 1024;
+
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+
+  explicit PlanCache(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+  /**
+   * @brief Finds the plan of a fingerprint, preparing it on a miss.
+   * The plan is shared so evicting it doesn't free one still waiting to run.
+   *
+   * @param fingerprint normalized statement text with ? for each literal
+   * @return std::shared_ptr<PreparedStatement> the plan, null when it can't be prepared
+   */
+  std::shared_ptr<PreparedStatement> get(const std::string &fingerprint)
+  {
+    auto found = index.find(fingerprint);
+    if (found != index.end())
+    {
+      entries.splice(entries.begin(), entries, found->second);
+      if (found->second->second != nullptr)
+      {
+        hits++;
+      }
+      return found->second->second;
+    }
+    misses++;
+    std::shared_ptr<PreparedStatement> plan;
+    try
+    {
+      plan = std::make_shared<PreparedStatement>(fingerprint);
+    }
+    catch (const std::runtime_error &e)
+    {
+      plan = nullptr;
+    }
+    entries.emplace_front(fingerprint, plan);
+    index[fingerprint] = entries.begin();
+    if (entries.size() > capacity)
+    {
+      index.erase(entries.back().first);
+      entries.pop_back();
+      evictions++;
+    }
+    return plan;
+  }
+
+  size_t size() const
+  {
+    return entries.size();
+  }
+
+  size_t limit() const
+  {
+    return capacity;
+  }
+
+  void clear()
+  {
+    entries.clear();
+    index.clear();
+  }
+};
+
+// Defined in session.hpp, the plans of the statements run by the session running on this thread
+PlanCache &planCache();
+
+inline object::Result *evalStats(ast::Node *, DatabaseObject *current_database)
+{
+  PlanCache &plan_cache = planCache();
+  size_t lookups = plan_cache.hits + plan_cache.misses;
+  std::ostringstream ss;
+  ss << "Plan cache: " << plan_cache.size() << "/" << plan_cache.limit() << " plans, "
+     << plan_cache.hits << " hits, " << plan_cache.misses << " misses, "
+     << plan_cache.evictions << " evictions, hit ratio "
+     << (lookups == 0 ? 0.0 : (double)plan_cache.hits / lookups);
+  // Skipped pages never held the value, so the rate is over them and the false positives
+  ZoneMap::BloomStats &bloom = ZoneMap::bloomStats();
+  size_t probes = bloom.probes, negatives = bloom.skipped + bloom.false_positives;
+  ss << "\nBloom filters: " << probes << " probes, " << bloom.skipped << " row groups skipped, "
+     << bloom.false_positives << " false positives, false positive rate "
+     << (negatives == 0 ? 0.0 : (double)bloom.false_positives / negatives)
+     << " (expected " << (probes == 0 ? 0.0 : bloom.expected_millionths / 1e6 / probes) << ")";
+  // How long each table file of the database in use took to parse when it was last loaded
+  if (current_database->name() != "nil")
+  {
+    ss << "\nTable loads (" << current_database->name() << "):";
+    for (const auto &timing : current_database->load_timings)
+    {
+      ss << (&timing == &current_database->load_timings.front() ? " " : ", ") << timing.first << " " << timing.second << " ms";
+    }
+    if (current_database->load_timings.empty())
+    {
+      ss << " none";
+    }
+  }
+  return object::Result::ok(0, ss.str());
+}
+
+#endif /* __PLAN_CACHE_HPP__ */
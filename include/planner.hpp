@@ -0,0 +1,444 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Cost based planner between the AST and execution. It estimates
+ * how many rows each table has and how many a where expression keeps, from
+ * the statistics of ANALYZE when there are some and the zone maps otherwise,
+ * and picks the cheapest way to read each table and to join two of them.
+ * Costs are in rows read, a comparison or hash costing a fraction of one.
+ */
+#ifndef __PLANNER_HPP__
+#define __PLANNER_HPP__
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <experimental/filesystem>
+#include <data_objs.hpp>
+#include <external_sort.hpp>
+#include <proto_generator.hpp>
+#include <table_stats.hpp>
+#include <zone_map.hpp>
+
+namespace fs = std::experimental::filesystem;
+
+class Planner
+{
+public:
+  // Bytes a row is guessed to take in a table with neither statistics nor a zone map
+  static constexpr size_t BYTES_PER_ROW_GUESS = 32;
+  // Cost of starting to read at another page, a run of skipped pages has to be seeked over
+  static constexpr double PAGE_SEEK_COST = 64;
+  // Cost of comparing a pair of keys in a nested loop
+  static constexpr double NESTED_LOOP_PAIR_COST = 0.05;
+  // Cost of partitioning both inputs over the pool and sizing the hash tables
+  static constexpr double HASH_SETUP_COST = 256;
+  // Bytes a build row takes in the hash table, which has to fit the sort memory budget
+  static constexpr size_t HASH_ENTRY_BYTES = 64;
+  // Cost of a comparison while sorting for a sort merge join
+  static constexpr double SORT_COMPARE_COST = 0.2;
+
+  enum class Access
+  {
+    FULL_SCAN,
+    // Pages whose zone map and Bloom filter rule out the where expression aren't
+    // read, which is what stands in for an index scan here
+    ZONE_MAP_SCAN
+  };
+
+  // What the planner knows about one table it reads
+  struct TableEstimate
+  {
+    std::string name;
+    fs::path path;
+    double rows = 0;
+    // Fraction of the rows the where expression keeps
+    double selectivity = 1;
+    // Pages in the zone map, 0 without one
+    size_t pages = 0;
+    // Pages the chosen access reads
+    size_t pages_read = 0;
+    // Whether the estimates come from ANALYZE statistics
+    bool analyzed = false;
+    Access access = Access::FULL_SCAN;
+    double cost = 0;
+  };
+
+  struct Plan
+  {
+    // The table read, or the left and right tables of a join
+    std::vector<TableEstimate> tables;
+    bool join = false;
+    JoinChoice join_choice;
+    // Estimated rows out and total cost
+    double rows = 0;
+    double cost = 0;
+  };
+
+private:
+  static double number(const variant_type &value)
+  {
+    if (auto val = std::get_if<int>(&value))
+    {
+      return *val;
+    }
+    if (auto val = std::get_if<double>(&value))
+    {
+      return *val;
+    }
+    return 0;
+  }
+
+  // The where expression's test value as the statistics of a column of the type hold it
+  static bool testValue(const WherePredicate &predicate, char type, variant_type &value)
+  {
+    if (type == 's')
+    {
+      value = predicate.test;
+      return true;
+    }
+    if (type == 'i' && predicate.has_int)
+    {
+      value = predicate.test_i;
+      return true;
+    }
+    if (type == 'f' && predicate.has_double)
+    {
+      value = predicate.test_d;
+      return true;
+    }
+    return false;
+  }
+
+  static const TableStats::Column *findColumn(const TableStats *stats, const std::string &name)
+  {
+    if (stats == nullptr)
+    {
+      return nullptr;
+    }
+    for (const TableStats::Column &column : stats->columns)
+    {
+      if (column.name == name)
+      {
+        return &column;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Fraction of a column's values below a value, interpolated within its histogram bucket
+   */
+  static double fractionBelow(const TableStats::Column &column, const variant_type &value)
+  {
+    size_t total = 0;
+    for (size_t count : column.counts)
+    {
+      total += count;
+    }
+    if (total == 0 || column.bounds.size() < 2 || !(column.bounds[0] < value))
+    {
+      return 0;
+    }
+    double below = 0;
+    for (size_t bucket = 0; bucket < column.counts.size(); bucket++)
+    {
+      const variant_type &lo = column.bounds[bucket];
+      const variant_type &hi = column.bounds[bucket + 1];
+      if (hi < value)
+      {
+        below += column.counts[bucket];
+        continue;
+      }
+      // Numbers are spread evenly over their bucket, strings fill half of it
+      double part = 0.5;
+      if (column.type == 'i' || column.type == 'f')
+      {
+        part = (number(value) - number(lo)) / std::max(number(hi) - number(lo), 1e-9);
+      }
+      below += std::clamp(part, 0.0, 1.0) * column.counts[bucket];
+      break;
+    }
+    return below / total;
+  }
+
+  /**
+   * @brief Fraction of the rows the where expression keeps, from a column's statistics
+   */
+  static double selectivity(const TableStats::Column &column, const WherePredicate &predicate)
+  {
+    double nulls = predicate(std::numeric_limits<int>::min()) ? column.nullFraction() : 0;
+    variant_type value;
+    if (column.bounds.empty() || !testValue(predicate, column.type, value))
+    {
+      return nulls;
+    }
+    // Values outside the histogram's bounds aren't in the table
+    double in_range = !(value < column.bounds.front()) && !(column.bounds.back() < value);
+    double equal = in_range / std::max(1.0, column.distinct());
+    double fraction = 0;
+    if (predicate.op == "=")
+    {
+      fraction = equal;
+    }
+    else if (predicate.op == "!=")
+    {
+      fraction = 1 - equal;
+    }
+    else if (predicate.op == "<")
+    {
+      fraction = fractionBelow(column, value);
+    }
+    else if (predicate.op == ">")
+    {
+      fraction = 1 - fractionBelow(column, value) - equal;
+    }
+    return std::clamp(fraction, 0.0, 1.0) * (1 - column.nullFraction()) + nulls;
+  }
+
+  // Guess of the fraction a where expression keeps when nothing is known of the column
+  static double defaultSelectivity(const std::string &op)
+  {
+    if (op == "=")
+    {
+      return 0.1;
+    }
+    if (op == "!=")
+    {
+      return 0.9;
+    }
+    return op == "<" || op == ">" ? 1.0 / 3 : 0;
+  }
+
+  /**
+   * @brief Estimates a table's rows and what the where expression keeps, and picks
+   * between a full scan and a zone map scan
+   *
+   * @param where [default: nullptr] (column_name operator value) the reader is given
+   */
+  static TableEstimate estimate(const std::string &name, const fs::path &path,
+                                std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    TableEstimate table;
+    table.name = name;
+    table.path = path;
+    std::shared_ptr<const TableStats> stats = TableStats::open(path);
+    std::shared_ptr<const ZoneMap> zones = ZoneMap::open(path);
+    size_t zone_rows = 0;
+    if (zones != nullptr)
+    {
+      table.pages = zones->pages.size();
+      for (const ZoneMap::Page &page : zones->pages)
+      {
+        zone_rows += page.rows;
+      }
+    }
+    table.analyzed = stats != nullptr;
+    if (stats != nullptr)
+    {
+      table.rows = stats->rows;
+    }
+    else if (zones != nullptr)
+    {
+      table.rows = zone_rows;
+    }
+    else
+    {
+      std::error_code error;
+      uintmax_t size = fs::file_size(path, error);
+      table.rows = error ? 0 : size / BYTES_PER_ROW_GUESS;
+    }
+    table.pages_read = table.pages;
+    table.cost = table.rows;
+    if (where == nullptr)
+    {
+      return table;
+    }
+
+    TableObject schema = ProtoGenerator::loadSchema(path);
+    WherePredicate predicate(schema, where);
+    if (predicate.column == -1)
+    {
+      return table;
+    }
+    std::string format = schema.getFormat();
+    // Pages a zone map scan reads, as the reader decides them but without counting Bloom probes
+    double zone_fraction = 1;
+    if (zones != nullptr && zones->format == format && zone_rows > 0)
+    {
+      variant_type null = std::numeric_limits<int>::min();
+      variant_type key;
+      bool bloom_key = predicate.equalityKey(format[predicate.column], key);
+      size_t pages_read = 0, rows_read = 0, seeks = 0;
+      bool reading = false;
+      for (const ZoneMap::Page &page : zones->pages)
+      {
+        const ZoneMap::Zone &zone = page.zones[predicate.column];
+        bool by_nulls = zone.nulls > 0 && predicate(null);
+        bool by_values = zone.values > 0 && predicate.mayMatch(zone.min, zone.max) &&
+                         (!bloom_key || !zone.known || zone.mayContain(key));
+        bool read = !zone.known || by_nulls || by_values;
+        pages_read += read;
+        rows_read += read ? page.rows : 0;
+        seeks += read && !reading;
+        reading = read;
+      }
+      zone_fraction = (double)rows_read / zone_rows;
+      // A scan reading every page pays for the seek without skipping anything
+      double zone_cost = table.rows * zone_fraction + seeks * PAGE_SEEK_COST;
+      if (zone_cost < table.cost)
+      {
+        table.access = Access::ZONE_MAP_SCAN;
+        table.pages_read = pages_read;
+        table.cost = zone_cost;
+      }
+    }
+    const TableStats::Column *column = findColumn(stats.get(), schema.fields[predicate.column].first);
+    if (column != nullptr)
+    {
+      table.selectivity = selectivity(*column, predicate);
+    }
+    else
+    {
+      table.selectivity = std::min(zone_fraction, defaultSelectivity(predicate.op));
+    }
+    return table;
+  }
+
+public:
+  /**
+   * @brief Plans reading a table, which openTBL reads from its lock copy when there is one
+   *
+   * @param where [default: nullptr] (column_name operator value) of the select
+   * @return Plan with no tables when the table doesn't exist
+   */
+  static Plan planScan(const std::string &db_name, const std::string &tbl_name,
+                       std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    Plan plan;
+    fs::path tbl_path = dataPath() / db_name / (tbl_name + ".lock");
+    if (!fs::exists(tbl_path))
+    {
+      tbl_path = dataPath() / db_name / (tbl_name + ".proto");
+    }
+    if (!fs::exists(tbl_path))
+    {
+      return plan;
+    }
+    plan.tables.push_back(estimate(tbl_name, tbl_path, where));
+    plan.rows = plan.tables[0].rows * plan.tables[0].selectivity;
+    plan.cost = plan.tables[0].cost;
+    return plan;
+  }
+
+  /**
+   * @brief Plans a join of two tables like joinTBL takes it. With only two tables
+   * the join order comes down to which table is read first to filter the other
+   * and which one the hash table is built on.
+   *
+   * @param where the (left key, operator, right key) checks, null joins on the aliases
+   * @param var_table the tables and their aliases
+   * @param join_sections the sections joined
+   * @return Plan with no tables when a table doesn't exist
+   */
+  static Plan planJoin(const std::string &db_name,
+                       std::tuple<std::string, std::string, std::string> *where,
+                       const std::vector<std::pair<std::string, std::string>> &var_table,
+                       std::array<bool, 3> join_sections)
+  {
+    Plan plan;
+    plan.join = true;
+    if (var_table.size() < 2)
+    {
+      return plan;
+    }
+    fs::path left_path = ProtoGenerator::joinTablePath(db_name, var_table[0].first);
+    fs::path right_path = ProtoGenerator::joinTablePath(db_name, var_table[1].first);
+    if (left_path.empty() || right_path.empty())
+    {
+      return plan;
+    }
+    TableEstimate left = estimate(var_table[0].first, left_path);
+    TableEstimate right = estimate(var_table[1].first, right_path);
+    std::string left_key = where != nullptr ? std::get<0>(*where) : var_table[0].second;
+    std::string right_key = where != nullptr ? std::get<2>(*where) : var_table[1].second;
+
+    // Every key is taken as distinct unless ANALYZE says otherwise
+    auto left_column = findColumn(TableStats::open(left_path).get(), left_key);
+    auto right_column = findColumn(TableStats::open(right_path).get(), right_key);
+    double left_distinct = left_column != nullptr ? left_column->distinct() : left.rows;
+    double right_distinct = right_column != nullptr ? right_column->distinct() : right.rows;
+    return costJoin(left, right, left_distinct, right_distinct, join_sections);
+  }
+
+  /**
+   * @brief Estimates the rows of a join of two tables and picks the strategy
+   * and sides with the lowest cost
+   *
+   * @param left_distinct distinct keys of the left table
+   * @param right_distinct distinct keys of the right table
+   * @param join_sections the sections joined
+   * @return Plan of the join of left and right
+   */
+  static Plan costJoin(const TableEstimate &left, const TableEstimate &right,
+                       double left_distinct, double right_distinct,
+                       std::array<bool, 3> join_sections)
+  {
+    Plan plan;
+    plan.join = true;
+    plan.tables = {left, right};
+    double l = left.rows, r = right.rows;
+    left_distinct = std::max(1.0, left_distinct);
+    right_distinct = std::max(1.0, right_distinct);
+    double inner = l * r / std::max(left_distinct, right_distinct);
+    plan.rows = join_sections[1] ? inner : 0;
+    if (join_sections[0])
+    {
+      plan.rows += l * (1 - std::min(1.0, right_distinct / left_distinct));
+    }
+    if (join_sections[2])
+    {
+      plan.rows += r * (1 - std::min(1.0, left_distinct / right_distinct));
+    }
+
+    // The smaller table is read first, so fewer keys filter the pages of the other,
+    // and the hash table is built on it
+    JoinChoice &choice = plan.join_choice;
+    choice.filter_from_left = l <= r;
+    choice.build_left = l < r;
+    double build = std::min(l, r), probe = std::max(l, r);
+    double nested = l * r * NESTED_LOOP_PAIR_COST;
+    double hash = 2 * build + probe + HASH_SETUP_COST;
+    double sort = SORT_COMPARE_COST * (l * std::log2(l + 1) + r * std::log2(r + 1)) + l + r;
+    // A hash table past the memory budget is left to the sort merge join, whose sorts spill.
+    // Only the sorts are bounded: like every join it holds both loaded tables and the matching pairs.
+    if (build * HASH_ENTRY_BYTES > ExternalSort::memoryBudget())
+    {
+      hash = std::numeric_limits<double>::infinity();
+    }
+    double join_cost = std::min({nested, hash, sort});
+    if (join_cost == nested)
+    {
+      choice.strategy = JoinStrategy::NESTED_LOOP;
+    }
+    else if (join_cost == hash)
+    {
+      choice.strategy = JoinStrategy::HASH;
+    }
+    else
+    {
+      choice.strategy = JoinStrategy::SORT_MERGE;
+    }
+    plan.cost = left.cost + right.cost + join_cost;
+    return plan;
+  }
+};
+
+#endif /* __PLANNER_HPP__ */
@@ -0,0 +1,286 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Prepared statements. A statement is lexed, parsed and matched
+ * to its evaluator once, then run any number of times with new values bound
+ * to its placeholders (? or $1). Used by PREPARE/EXECUTE and from C++.
+ */
+#ifndef __PREPARED_HPP__
+#define __PREPARED_HPP__
+
+#include <charconv>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include <arena.hpp>
+#include <ast.hpp>
+#include <lexer.hpp>
+#include <parser.hpp>
+#include <data_objs.hpp>
+#include <objects.hpp>
+#include <evaluator.hpp>
+
+/**
+ * @brief A parsed statement ready to be executed with bound parameters
+ *
+ * Example:
+ *   PreparedStatement insert("INSERT INTO Product VALUES (?, ?, ?);");
+ *   insert.execute({1, std::string("Gizmo"), 19.99}, &database);
+ */
+class PreparedStatement
+{
+private:
+  // The AST views the text and lives in the arena, both kept on the heap so moves don't invalidate them
+  std::unique_ptr<std::string> text;
+  std::unique_ptr<Arena> arena;
+  ast::Statement *statement = nullptr;
+  std::vector<ast::ParamSlot> params;
+  size_t param_count = 0;
+  // Resolved once instead of looking up the statement's evaluator on every run
+  evalFnType *fn = nullptr;
+  // Text of the bound values, which the placeholder tokens view
+  std::vector<std::string> bound;
+  std::vector<token_type::TokenType> bound_types;
+  bool ready = false;
+
+  /**
+   * @brief Rewrites every placeholder token with its bound value
+   */
+  void applyBindings()
+  {
+    for (const ast::ParamSlot &slot : params)
+    {
+      slot.value->type = bound_types[slot.index];
+      slot.value->literal = bound[slot.index];
+      if (slot.vartype != nullptr)
+      {
+        *slot.vartype = Token{bound_types[slot.index], token_type::names[bound_types[slot.index]]};
+      }
+    }
+    ready = true;
+  }
+
+public:
+  /**
+   * @brief Parses a single statement which may hold placeholders
+   *
+   * @param sql the statement text, copied
+   * @throws std::runtime_error on parse errors or when the statement can't be executed
+   */
+  explicit PreparedStatement(std::string sql) : text(new std::string(std::move(sql))),
+                                                arena(new Arena())
+  {
+    Lexer lexer(*text);
+    SQLParser parser(&lexer, arena.get());
+    parser.params = &params;
+    ast::Program *program = parser.parseSql();
+    if (program->statements.size() != 1)
+    {
+      throw std::runtime_error("!Failed to prepare, expected exactly one statement.");
+    }
+    statement = program->statements[0];
+    auto found = evalStatementFns.find(statement->tokenLiteral());
+    if (found == evalStatementFns.end() || statement->tokenLiteral() == "PREPARE" || statement->tokenLiteral() == "EXECUTE")
+    {
+      throw std::runtime_error("!Failed to prepare " + statement->tokenLiteral() + ", it can't be executed.");
+    }
+    fn = &found->second;
+    for (const ast::ParamSlot &slot : params)
+    {
+      param_count = std::max(param_count, slot.index + 1);
+    }
+    bound.resize(param_count);
+    bound_types.resize(param_count, token_type::IDENTIFIER);
+    ready = param_count == 0;
+  }
+
+  // A move can relocate short bound strings that the placeholder tokens view, so they're bound again before running
+  PreparedStatement(PreparedStatement &&other) noexcept
+      : text(std::move(other.text)), arena(std::move(other.arena)), statement(other.statement),
+        params(std::move(other.params)), param_count(other.param_count), fn(other.fn), bound(std::move(other.bound)),
+        bound_types(std::move(other.bound_types))
+  {
+    other.ready = false;
+  }
+
+  PreparedStatement &operator=(PreparedStatement &&other) noexcept
+  {
+    text = std::move(other.text);
+    arena = std::move(other.arena);
+    statement = other.statement;
+    params = std::move(other.params);
+    param_count = other.param_count;
+    fn = other.fn;
+    bound = std::move(other.bound);
+    bound_types = std::move(other.bound_types);
+    ready = false;
+    other.ready = false;
+    return *this;
+  }
+
+  size_t paramCount() const
+  {
+    return param_count;
+  }
+
+  /**
+   * @brief Binds one parameter from its literal text, as EXECUTE does
+   *
+   * @param index zero based parameter number
+   * @param type INT, FLOAT or IDENTIFIER for strings
+   * @param literal the value's text
+   */
+  void bindText(size_t index, token_type::TokenType type, std::string literal)
+  {
+    if (index >= param_count)
+    {
+      throw std::invalid_argument("parameter $" + std::to_string(index + 1) + " is out of range");
+    }
+    bound[index] = std::move(literal);
+    bound_types[index] = type;
+    ready = false;
+  }
+
+  /**
+   * @brief Binds every parameter from typed values
+   *
+   * @throws std::invalid_argument when the number of values doesn't match the placeholders
+   */
+  void bind(const std::vector<variant_type> &args)
+  {
+    if (args.size() != param_count)
+    {
+      throw std::invalid_argument("expected " + std::to_string(param_count) + " parameters but got " +
+                                  std::to_string(args.size()));
+    }
+    char number[32];
+    for (size_t i = 0; i < args.size(); i++)
+    {
+      if (auto val = std::get_if<int>(&args[i]))
+      {
+        bindText(i, token_type::INT, std::string(number, std::to_chars(number, number + sizeof(number), *val).ptr));
+      }
+      else if (auto val = std::get_if<double>(&args[i]))
+      {
+        std::string literal(number, std::to_chars(number, number + sizeof(number), *val).ptr);
+        // Keep a decimal point so the value is still read as a float
+        if (literal.find_first_of(".e") == std::string::npos)
+        {
+          literal += ".0";
+        }
+        bindText(i, token_type::FLOAT, literal);
+      }
+      else if (auto val = std::get_if<bool>(&args[i]))
+      {
+        bindText(i, token_type::INT, *val ? "1" : "0");
+      }
+      else if (auto val = std::get_if<std::string>(&args[i]))
+      {
+        bindText(i, token_type::IDENTIFIER, *val);
+      }
+    }
+    applyBindings();
+  }
+
+  /**
+   * @brief Runs the statement with the values bound last
+   */
+  object::Result *execute(DatabaseObject *current_database)
+  {
+    if (!ready)
+    {
+      applyBindings();
+    }
+    return (*fn)(statement, current_database);
+  }
+
+  /**
+   * @brief Binds args and runs the statement
+   */
+  object::Result *execute(const std::vector<variant_type> &args, DatabaseObject *current_database)
+  {
+    bind(args);
+    return (*fn)(statement, current_database);
+  }
+
+  /**
+   * @brief Runs the statement with literals taken from a statement of the same fingerprint
+   *
+   * @param literals the literals of the statement in order
+   */
+  object::Result *executeLiterals(const std::vector<std::pair<token_type::TokenType, std::string_view>> &literals,
+                                  DatabaseObject *current_database)
+  {
+    if (literals.size() != param_count)
+    {
+      throw std::invalid_argument("expected " + std::to_string(param_count) + " parameters but got " +
+                                  std::to_string(literals.size()));
+    }
+    for (size_t i = 0; i < literals.size(); i++)
+    {
+      bindText(i, literals[i].first, std::string(literals[i].second));
+    }
+    applyBindings();
+    return (*fn)(statement, current_database);
+  }
+
+  /**
+   * @brief Runs the statement with the arguments of an EXECUTE statement
+   */
+  object::Result *execute(ast::ColumnLiteralExpression *args, DatabaseObject *current_database)
+  {
+    size_t count = 0;
+    for (ast::ColumnLiteralExpression *arg = args; arg != nullptr; arg = arg->right)
+    {
+      count++;
+    }
+    if (count != param_count)
+    {
+      throw std::invalid_argument("expected " + std::to_string(param_count) + " parameters but got " +
+                                  std::to_string(count));
+    }
+    size_t index = 0;
+    for (ast::ColumnLiteralExpression *arg = args; arg != nullptr; arg = arg->right)
+    {
+      bindText(index++, arg->token_vartype.type, std::string(arg->token.literal));
+    }
+    applyBindings();
+    return (*fn)(statement, current_database);
+  }
+};
+
+// Defined in session.hpp, the statements prepared by name in the session running on this thread
+std::unordered_map<std::string, PreparedStatement> &preparedStatements();
+
+inline object::Result *evalPrepare(ast::PrepareStatement *node, DatabaseObject *)
+{
+  std::unordered_map<std::string, PreparedStatement> &prepared_statements = preparedStatements();
+  std::string name(*node->name);
+  prepared_statements.erase(name);
+  prepared_statements.emplace(name, PreparedStatement(std::string(node->text)));
+  return object::Result::ok(0, "Statement " + name + " prepared.");
+}
+
+inline object::Result *evalExecute(ast::ExecuteStatement *node, DatabaseObject *current_database)
+{
+  std::unordered_map<std::string, PreparedStatement> &prepared_statements = preparedStatements();
+  std::string name(*node->name);
+  auto found = prepared_statements.find(name);
+  if (found == prepared_statements.end())
+  {
+    return object::Result::failed(2, "!Failed to execute " + name + " because it was never prepared.");
+  }
+  try
+  {
+    return found->second.execute(node->args, current_database);
+  }
+  catch (const std::invalid_argument &e)
+  {
+    return object::Result::failed(3, "!Failed to execute " + name + ", " + e.what() + ".");
+  }
+}
+
+#endif /* __PREPARED_HPP__ */
@@ -15,8 +15,18 @@
 #include <string_view>
 #include <sstream>
 #include <fstream>
+#include <chrono>
+#include <charconv>
+#include <limits>
+#include <memory>
 #include <experimental/filesystem>
 #include <data_objs.hpp>
+#include <thread_pool.hpp>
+#include <mapped_file.hpp>
+#include <zone_map.hpp>
+#include <table_stats.hpp>
+#include <external_sort.hpp>
+#include <query_profile.hpp>
 #include <variant>
 
 namespace fs = std::experimental::filesystem;
@@ -26,12 +36,191 @@ using fieldmapType = std::vector<std::pair<std::string, std::tuple<std::string,
 namespace paths
 {
   const std::string PROTO_VERSION = "syntax = \"proto3\";";
-  auto PROTOC_PATH = fs::current_path() / "etc" / "protobuf" / "src" / "protoc";
-  auto PROJECT_ROOT = fs::current_path();
-  auto DATA_PATH = fs::current_path() / "data";
+  inline auto PROTOC_PATH = fs::current_path() / "etc" / "protobuf" / "src" / "protoc";
+  inline auto PROJECT_ROOT = fs::current_path();
+  // Data directory of statements run outside of a session, like the ProtoGenerator calls of the tests
+  inline auto DATA_PATH = fs::current_path() / "data";
+  // Data directory of the session whose statement runs on this thread, see SessionState::Scope
+  inline thread_local const fs::path *session_data_path = nullptr;
+
+  inline const fs::path &dataPath()
+  {
+    return session_data_path != nullptr ? *session_data_path : DATA_PATH;
+  }
 };
 using namespace paths;
 
+/**
+ * @brief A where expression resolved against the columns of a table. The
+ * test value is cast once up front instead of per row.
+ */
+struct WherePredicate
+{
+  // Column tested, -1 accepts every row
+  int column = -1;
+  std::string op;
+  std::string test;
+  // Failed casts are for when user inputs different type than expected for where expr
+  bool has_int = false;
+  bool has_double = false;
+  int test_i = 0;
+  double test_d = 0;
+
+  WherePredicate() = default;
+
+  /**
+   * @param tbl the table the where expression refers to
+   * @param where (column_name operator value), null accepts every row
+   */
+  WherePredicate(const TableObject &tbl, std::tuple<std::string, std::string, std::string> *where)
+  {
+    if (where == nullptr) {
+      return;
+    }
+    // Find Column Described by where[0]
+    for (int col = 0; col < (int)tbl.fields.size(); col++) {
+      if (tbl.fields[col].first == std::get<0>(*where)) {
+        column = col;
+      }
+    }
+    op = std::get<1>(*where);
+    test = std::get<2>(*where);
+    // Every predicate is parsed, string columns' too, so a number out of range only means no int or float matches
+    try {
+      test_i = std::stoi(test);
+      has_int = true;
+    } catch (const std::invalid_argument &ia) {
+    } catch (const std::out_of_range &oor) {}
+    try {
+      test_d = std::stod(test);
+      has_double = true;
+    } catch (const std::invalid_argument &ia) {
+    } catch (const std::out_of_range &oor) {}
+  }
+
+  bool operator()(const variant_type &value) const
+  {
+    if (op == "=") {
+      if (auto val = std::get_if<std::string>(&value)) {
+        return *val == test;
+      } else if (auto val = std::get_if<int>(&value)) {
+        return has_int && *val == test_i;
+      } else if (auto val = std::get_if<double>(&value)) {
+        return has_double && *val > test_d - 0.00001 && *val < test_d + 0.00001;
+      }
+    } else if (op == "!=") {
+      if (auto val = std::get_if<std::string>(&value)) {
+        return *val != test;
+      } else if (auto val = std::get_if<int>(&value)) {
+        return has_int && *val != test_i;
+      } else if (auto val = std::get_if<double>(&value)) {
+        return has_double && (*val <= test_d - 0.00001 || *val >= test_d + 0.00001);
+      }
+    } else if (op == "<") {
+      if (auto val = std::get_if<std::string>(&value)) {
+        return *val < test;
+      } else if (auto val = std::get_if<int>(&value)) {
+        return has_int && *val < test_i;
+      } else if (auto val = std::get_if<double>(&value)) {
+        return has_double && *val < test_d;
+      }
+    } else if (op == ">") {
+      if (auto val = std::get_if<std::string>(&value)) {
+        return *val > test;
+      } else if (auto val = std::get_if<int>(&value)) {
+        return has_int && *val > test_i;
+      } else if (auto val = std::get_if<double>(&value)) {
+        return has_double && *val > test_d;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Whether a value between min and max could pass, so a page of the
+   * column with those bounds has to be read. min and max hold the same type.
+   */
+  bool mayMatch(const variant_type &min, const variant_type &max) const
+  {
+    if (min.index() != max.index()) {
+      return true;
+    }
+    if (op != "=" && op != "!=" && op != "<" && op != ">") {
+      return false;
+    }
+    if (auto lo = std::get_if<std::string>(&min)) {
+      const std::string &hi = std::get<std::string>(max);
+      if (op == "=") return *lo <= test && test <= hi;
+      if (op == "!=") return !(*lo == test && hi == test);
+      if (op == "<") return *lo < test;
+      return hi > test;
+    } else if (auto lo = std::get_if<int>(&min)) {
+      int hi = std::get<int>(max);
+      if (!has_int) return false;
+      if (op == "=") return *lo <= test_i && test_i <= hi;
+      if (op == "!=") return !(*lo == test_i && hi == test_i);
+      if (op == "<") return *lo < test_i;
+      return hi > test_i;
+    } else if (auto lo = std::get_if<double>(&min)) {
+      double hi = std::get<double>(max);
+      if (!has_double) return false;
+      if (op == "=") return hi > test_d - 0.00001 && *lo < test_d + 0.00001;
+      if (op == "!=") return !(*lo > test_d - 0.00001 && hi < test_d + 0.00001);
+      if (op == "<") return *lo < test_d;
+      return hi > test_d;
+    }
+    return true;
+  }
+
+  /**
+   * @brief The value an = expression matches in a column of the type, which a
+   * Bloom filter of an int or char column can look up
+   *
+   * @return bool false when the expression has no such value
+   */
+  bool equalityKey(char type, variant_type &key) const
+  {
+    if (op != "=") {
+      return false;
+    }
+    if (type == 's') {
+      key = test;
+      return true;
+    }
+    if (type == 'i' && has_int) {
+      key = test_i;
+      return true;
+    }
+    return false;
+  }
+
+  bool accepts(const TableObject &tbl, size_t row) const
+  {
+    return column == -1 || (*this)(tbl.records[row * tbl.fields_size + column]);
+  }
+};
+
+// How joinTBL pairs up rows with equal keys
+enum class JoinStrategy
+{
+  NESTED_LOOP,
+  HASH,
+  SORT_MERGE
+};
+
+/**
+ * @brief How a join is run, chosen by the planner. The default is the hash
+ * join on the right table with the left table's keys filtering its pages.
+ */
+struct JoinChoice
+{
+  JoinStrategy strategy = JoinStrategy::HASH;
+  // Whether the hash table is built on the left table instead of the right
+  bool build_left = false;
+  // Whether the left table is read first and its keys skip pages of the right, or the other way
+  bool filter_from_left = true;
+};
+
 class ProtoGenerator
 {
   DatabaseObject *db_obj;
@@ -63,14 +252,16 @@ class ProtoGenerator
   // Create a new Table. Called on refresh
   void protocGenerate(DatabaseObject *database, TableObject table)
   {
-    if (!fs::exists(DATA_PATH / database->name()))
+    if (!fs::exists(dataPath() / database->name()))
     {
-      fs::create_directories(DATA_PATH / database->name());
+      fs::create_directories(dataPath() / database->name());
     }
     
-    std::ofstream protoFile(DATA_PATH / database->name() / (table.name() + ".proto"));
+    fs::path tbl_path = dataPath() / database->name() / (table.name() + ".proto");
+    bool analyzed = TableStats::exists(tbl_path);
+    std::ofstream protoFile(tbl_path);
     // Write metadata and fields
-    protoFile << generateMetadataComment(table.name(), database->name());
+    protoFile << generateMetadataComment(table.name(), database->name(), table.bloom_filters);
     protoFile << "message " << table.name() << " {\n";
     for (auto field : table.fields)
     {
@@ -78,29 +269,26 @@ class ProtoGenerator
     }
     protoFile << "}\n\n";
 
-    // Write data
+    // Write data, summarising every page of rows in the zone map as it's written
     int cols = table.fields.size();
     int rows = table.records.size() / cols;
     auto record_iter = table.records.begin();
+    std::vector<char> bloom_columns;
+    for (const auto &field : table.fields)
+    {
+      bloom_columns.push_back(std::find(table.bloom_filters.begin(), table.bloom_filters.end(), field.first) !=
+                              table.bloom_filters.end());
+    }
+    ZoneMap zones(table.getFormat(), bloom_columns);
+    bool zoned = zones.format.size() == (size_t)cols;
     for (int row = 0; row < rows; row++) {
+      if (zoned) {
+        uint64_t offset = row % ZoneMap::PAGE_ROWS == 0 ? (uint64_t)protoFile.tellp() : 0;
+        zones.addRow(offset, &table.records[row * cols]);
+      }
       protoFile << "\n";
       for (int col = 0; col < cols; col++) {
-        if (auto val = std::get_if<std::string>(&(*record_iter)))
-        {
-          std::cout << *val << std::endl;
-          protoFile << "'" << *val << "'";
-        }
-        else if (auto val = std::get_if<int>(&(*record_iter)))
-        {
-          std::cout << *val << std::endl;
-          protoFile << *val;
-        }
-        else if (auto val = std::get_if<double>(&(*record_iter)))
-        {
-          std::cout << *val << std::endl;
-          protoFile << *val;
-        }
-
+        writeValue(protoFile, *record_iter);
         if (col != cols - 1) {
           protoFile << ", ";
         }
@@ -110,134 +298,148 @@ class ProtoGenerator
     
     protoFile.flush();
     protoFile.close();
+    if (zoned) {
+      zones.save(tbl_path);
+    } else {
+      ZoneMap::remove(tbl_path);
+    }
+    // An analyzed table's statistics are collected again from the rows just written
+    if (analyzed) {
+      TableStats::analyze(table).save(tbl_path);
+    }
+  }
+
+  /**
+   * @brief Writes a record value the way it's stored in a table file
+   */
+  static void writeValue(std::ostream &out, const variant_type &value)
+  {
+    if (auto val = std::get_if<std::string>(&value))
+    {
+      out << "'" << *val << "'";
+    }
+    else if (auto val = std::get_if<int>(&value))
+    {
+      out << *val;
+    }
+    else if (auto val = std::get_if<double>(&value))
+    {
+      out << *val;
+    }
   }
 
   static std::string generateMetadataComment(std::string tableName,
-                                             std::string databaseName)
+                                             std::string databaseName,
+                                             const std::vector<std::string> &bloomFilters = {})
   {
     std::ostringstream ss;
     ss << "/*    METADATA-START\n";
     ss << "databaseName " << databaseName << std::endl;
     ss << "tableName " << tableName << std::endl;
+    if (!bloomFilters.empty())
+    {
+      ss << "bloomFilters";
+      for (const std::string &column : bloomFilters)
+      {
+        ss << " " << column;
+      }
+      ss << std::endl;
+    }
     ss << "METADATA-END    */\n";
     return ss.str();
   }
 
+public:
+  // Rows handed to a worker at a time by the parallel scans
+  static const int SCAN_MORSEL_ROWS = 16384;
+  // Bytes of a CSV file parsed by one worker during COPY FROM
+  static const size_t CSV_CHUNK_BYTES = 4 << 20;
+  // Build rows per hash join partition, small enough for the hash table to stay in cache
+  static const int JOIN_PARTITION_ROWS = 4096;
+  static const int JOIN_MAX_PARTITION_BITS = 10;
+  // Most distinct probe keys an inner join hands to the build side's reader to skip pages by
+  static const size_t JOIN_KEY_FILTER_MAX = 1024;
+
+  /**
+   * @brief Keys a table is read for, so pages holding none of them in the
+   * column are skipped. A blank key also wants the blank rows.
+   */
+  struct KeyFilter
+  {
+    std::string column;
+    // Distinct keys in order
+    std::vector<variant_type> keys;
+  };
+
   /**
    * @brief Get rows described by the where expression
-   * 
+   *
+   * The predicate is resolved once, then the table is split into morsels
+   * of SCAN_MORSEL_ROWS rows that the thread pool filters in parallel.
+   * Each morsel keeps its own matches so the merged rows stay sorted.
+   *
    * @param tbl The table to look through
-   * @param where the filter query for where expr
+   * @param predicate the where expression resolved against tbl
+   * @param first [default: 0] row to start at
    * @return std::vector<int> 
    */
-  static std::vector<int> getWhereRows(TableObject tbl,
-                                       std::tuple<std::string, std::string, std::string> *where = nullptr)
+  static std::vector<int> getWhereRows(const TableObject &tbl, const WherePredicate &predicate, int first = 0)
   {
-    // Find Column Described by where[0]
-    auto record_iter = tbl.records.begin();
-    int row = 0;
-    int col = 0;
-    int whereCol = -1;
-    for (auto rec = tbl.fields.begin(); rec != tbl.fields.end(); rec++) {
-      if (where != nullptr && rec->first == get<0>(*where)) {
-        whereCol = col;
+    std::vector<int> acceptedRows;
+    int cols = tbl.fields_size;
+    int rows = cols == 0 ? 0 : tbl.records.size() / cols;
+    first = std::min(first, rows);
+    // Accept all columns
+    if (predicate.column == -1) {
+      acceptedRows.resize(rows - first);
+      for (int row = first; row < rows; row++) {
+        acceptedRows[row - first] = row;
       }
-      col++;
+      return acceptedRows;
     }
 
-    // Filter out rows described by where
-    std::vector<int> acceptedRows;
-    int rows = tbl.records.size() / tbl.fields_size;
-    acceptedRows.reserve(rows);
-    int cols = tbl.fields_size;
-    record_iter = tbl.records.begin();
-    for (row = 0; row < rows; row++) {
-      // Accept all columns
-      if (whereCol == -1) {
-        acceptedRows.push_back(row);
-      } else {
-        auto begin_iter = record_iter;
-        // Test String to compare to
-        std::string test = std::get<2>(*where);
-        // Check if whereCol constraints
-        // Make appropriate casts for each type and operator
-        // Try catches are for when user inputs different type than expected for where expr
-        bool rowCheck = false;
-        for (col = 0; col < cols; col++) {
-          if (whereCol == col) {
-            if (std::get<1>(*where) == "=") {
-              if (auto val = std::get_if<std::string>(&(*record_iter))) {
-                if (*val == test) rowCheck = true;
-              } else if (auto val = std::get_if<int>(&(*record_iter))) {
-                try {
-                  if (*val == std::stoi(test)) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              } else if (auto val = std::get_if<double>(&(*record_iter))) {
-                try {
-                  double test_d = std::stod(test);
-                  double min = test_d - 0.00001;
-                  double max = test_d + 0.00001;
-                  if (*val > min && *val < max) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              }
-            } else if (std::get<1>(*where) == "!=") {
-              if (auto val = std::get_if<std::string>(&(*record_iter))) {
-                if (*val != test) rowCheck = true;
-              } else if (auto val = std::get_if<int>(&(*record_iter))) {
-                try {
-                  if (*val != std::stoi(test)) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              } else if (auto val = std::get_if<double>(&(*record_iter))) {
-                try {
-                  double test_d = std::stod(test);
-                  double min = test_d - 0.00001;
-                  double max = test_d + 0.00001;
-                  if (*val <= min || *val >= max) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              }
-            } else if (std::get<1>(*where) == "<") {
-              if (auto val = std::get_if<std::string>(&(*record_iter))) {
-                if (*val < test) rowCheck = true;
-              } else if (auto val = std::get_if<int>(&(*record_iter))) {
-                try {
-                  if (*val < std::stoi(test)) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              } else if (auto val = std::get_if<double>(&(*record_iter))) {
-                try {
-                  if (*val < std::stod(test)) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              }
-            } else if (std::get<1>(*where) == ">") {
-              if (auto val = std::get_if<std::string>(&(*record_iter))) {
-                if (*val > test) rowCheck = true;
-              } else if (auto val = std::get_if<int>(&(*record_iter))) {
-                try {
-                  if (*val > std::stoi(test)) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              } else if (auto val = std::get_if<double>(&(*record_iter))) {
-                try {
-                  if (*val > std::stod(test)) rowCheck = true;
-                } catch (const std::invalid_argument &ia) {}
-              }
-            }
-          }
-          record_iter++;
-        }
+    // Filter out rows described by where, one result vector per morsel
+    int morsels = (rows - first + SCAN_MORSEL_ROWS - 1) / SCAN_MORSEL_ROWS;
+    std::vector<std::vector<int>> morselRows(morsels);
+    ThreadPool::shared().parallelFor(first, rows, SCAN_MORSEL_ROWS, [&](size_t from, size_t to) {
+      std::vector<int> &matches = morselRows[(from - first) / SCAN_MORSEL_ROWS];
+      for (size_t row = from; row < to; row++) {
         // We found a condition that matched so push to acceptedRows
-        if (rowCheck) {
-          acceptedRows.push_back(row);
+        if (predicate.accepts(tbl, row)) {
+          matches.push_back(row);
         }
       }
+    });
+
+    size_t total = 0;
+    for (const auto &matches : morselRows) {
+      total += matches.size();
+    }
+    acceptedRows.reserve(total);
+    for (const auto &matches : morselRows) {
+      acceptedRows.insert(acceptedRows.end(), matches.begin(), matches.end());
     }
     return acceptedRows;
   }
 
-public:
+  /**
+   * @brief Get rows described by the where expression
+   *
+   * @param tbl The table to look through
+   * @param where the filter query for where expr
+   * @return std::vector<int> 
+   */
+  static std::vector<int> getWhereRows(const TableObject &tbl,
+                                       std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    return getWhereRows(tbl, WherePredicate(tbl, where));
+  }
+
   ProtoGenerator(DatabaseObject *db_obj) : db_obj(db_obj)
   {
     // ProtocolBuffer not needed until data stored
     // verifyProtoc();
-    auto dbNamePath = DATA_PATH / db_obj->name();
+    auto dbNamePath = dataPath() / db_obj->name();
     if (!fs::exists(dbNamePath))
     {
       fs::create_directories(dbNamePath);
@@ -250,20 +452,20 @@ public:
 
   static bool DBExists(std::string name)
   {
-    return fs::exists(DATA_PATH / name);
+    return fs::exists(dataPath() / name);
   }
 
   static bool createDB(std::string db_name)
   {
-    if (!fs::exists(DATA_PATH))
+    if (!fs::exists(dataPath()))
     {
-      fs::create_directories(DATA_PATH);
+      fs::create_directories(dataPath());
     }
-    if (fs::exists(DATA_PATH / db_name))
+    if (fs::exists(dataPath() / db_name))
     {
       return false;
     }
-    return fs::create_directory(DATA_PATH / db_name);
+    return fs::create_directory(dataPath() / db_name);
   }
 
 
@@ -275,9 +477,16 @@ public:
    * @param fields the fields defining the table schema
    * @return DatabaseObject the updated database object
    */
-  static DatabaseObject createTBL(std::string db_name, std::string tbl_name, fieldmapType fields)
+  /**
+   * @brief Creates an empty table
+   *
+   * @param bloom_filters [default: none] columns whose zone map pages keep Bloom filters
+   * @return DatabaseObject the database with just the new table, "nil" when it already exists
+   */
+  static DatabaseObject createTBL(std::string db_name, std::string tbl_name, fieldmapType fields,
+                                  std::vector<std::string> bloom_filters = {})
   {
-    auto db_path = DATA_PATH / db_name;
+    auto db_path = dataPath() / db_name;
     // Table already exists
     if (fs::exists(db_path / (tbl_name + ".proto")))
     {
@@ -289,6 +498,7 @@ public:
       auto second = field.second;
       tbl.addField(field.first, get<0>(second), get<1>(second));
     }
+    tbl.bloom_filters = std::move(bloom_filters);
     DatabaseObject curr_db(db_name);
     curr_db.insertTable(tbl);
     ProtoGenerator pg(&curr_db);
@@ -309,13 +519,22 @@ public:
         // Get the rows we want to delete (always sorted based on implementation)
         auto rowsToDelete = ProtoGenerator::getWhereRows(table, where);
         *delete_count = rowsToDelete.size();
-        // Quick algorithm to delete all the right rows in the organized array
-        // Delete from the back so values dont change as we iterate
-        for (auto rowToDelete = rowsToDelete.rbegin(); rowToDelete != rowsToDelete.rend(); rowToDelete++) {
-          int from = *rowToDelete * cols;
-          int to = from + cols;
-          table.records.erase(table.records.begin() + from, table.records.begin() + to);
+        // Compact the kept rows towards the front in a single pass
+        // rowsToDelete is always sorted based on implementation
+        auto rowToDelete = rowsToDelete.begin();
+        int kept = 0;
+        for (int row = 0; row < rows; row++) {
+          if (rowToDelete != rowsToDelete.end() && *rowToDelete == row) {
+            rowToDelete++;
+            continue;
+          }
+          if (kept != row) {
+            std::move(table.records.begin() + row * cols, table.records.begin() + (row + 1) * cols,
+                      table.records.begin() + kept * cols);
+          }
+          kept++;
         }
+        table.records.resize(kept * cols);
         ProtoGenerator pg(&db);
         return db;
       }
@@ -358,240 +577,887 @@ public:
   }
 
   /**
-   * @brief update table records based on a variety of constraints
-   * 
-   * The fields are scanned to determine the column of the filter and where constraints
+   * @brief Appends rows to a table file without loading or rewriting the table.
+   * The whole batch is checked against the table format first, casting ints
+   * into float columns, so either every row is written or none are.
    *
-   * @param db_name the database name
-   * @param tbl_name the table name
-   * @param where [default: nullptr]] (column_name operator value) to test for when printing values
-   * @param where [default: false] if its a lock it'll
-   * @return DatabaseObject updated database object
+   * @param db_name Name of the database
+   * @param tbl_name Name of the table
+   * @param rows Rows of values in a type-safe union (std::variant)
+   * @return false when the table doesn't exist
+   * @throws std::invalid_argument when a row doesn't match the table format
    */
-  static DatabaseObject updateTBL(std::string db_name,
-                                  std::string tbl_name,
-                                  std::unordered_map<std::string, std::string> what,
-                                  int *update_count,
-                                  std::tuple<std::string, std::string, std::string> *where = nullptr)
+  static bool appendTBL(std::string db_name,
+                        std::string tbl_name,
+                        std::vector<std::vector<variant_type>> rows)
   {
-    DatabaseObject db = loadDB(db_name);
-    for (auto &table : db.tables) {
-      if (table.name() == tbl_name) {
-        int rows = table.records.size() / table.fields_size;
-        int cols = table.fields_size;
-        // Find all the rows found by query and map to an associative array
-        std::vector<bool> acceptedRows(rows, false);
-        auto whereRows = ProtoGenerator::getWhereRows(table, where);
-        *update_count = whereRows.size();
-        for(auto row : whereRows) {
-          acceptedRows[row] = true;
+    auto tbl_path = dataPath() / db_name / (tbl_name + ".proto");
+    if (!fs::exists(tbl_path))
+    {
+      return false;
+    }
+    TableObject tbl = loadSchema(tbl_path);
+    std::string format = tbl.getFormat();
+    for (size_t row = 0; row < rows.size(); row++)
+    {
+      if (rows[row].size() != format.size())
+      {
+        throw std::invalid_argument("row " + std::to_string(row + 1) + " has " + std::to_string(rows[row].size()) +
+                                    " values but " + tbl_name + " has " + std::to_string(format.size()) + " columns");
+      }
+      for (size_t col = 0; col < format.size(); col++)
+      {
+        variant_type &value = rows[row][col];
+        bool matches = (format[col] == 's' && std::holds_alternative<std::string>(value)) ||
+                       (format[col] == 'i' && std::holds_alternative<int>(value)) ||
+                       (format[col] == 'f' && std::holds_alternative<double>(value));
+        if (format[col] == 'f' && std::holds_alternative<int>(value))
+        {
+          value = (double)std::get<int>(value);
+          matches = true;
         }
-        // Go through every row/col and if it's an acceptedRow change its values
-        std::string tableFormat = table.getFormat();
-        auto record_iter = table.records.begin();
-        for (int row = 0; row != rows; row++) {
-          for (int col = 0; col != cols; col++) {
-            if (acceptedRows[row] && what.find(table.fields[col].first) != what.end()) {
-              if (tableFormat[col] == 's') {
-                *record_iter = what[table.fields[col].first];
-              } else if (tableFormat[col] == 'i') {
-                *record_iter = std::stoi(what[table.fields[col].first]);
-              } else if (tableFormat[col] == 'f') {
-                *record_iter = std::stod(what[table.fields[col].first]);
-              }
-            }
-            record_iter++;
-          }
+        if (!matches)
+        {
+          throw std::invalid_argument("row " + std::to_string(row + 1) + " has the wrong type for " + tbl.fields[col].first);
         }
-        // Memory instance updated, now apply to file and update current_database
-        ProtoGenerator pg(&db);
-        return db;
       }
     }
-    *update_count = 0;
-    return DatabaseObject("nil");
-  }
 
-  /**
-   * @brief creates a table via join operations and uses printTBL to print the resulting table which then gets removed
-   * 
-   * @param db_name the database name
-   * @param where the checks using the var_table
-   * @param var_table the tables and their aliases
-   * @param join_sections the sections joined
-   * @return std::string 
-   */
-  static std::string printTBLJoin(std::string db_name,
-                                  std::tuple<std::string, std::string, std::string> *where,
-                                  std::vector<std::pair<std::string, std::string>> var_table,
-                                  std::array<bool, 3> join_sections) {
-    DatabaseObject db = loadDB(db_name);
-    TableObject temp_tbl("_tempJoin");
-    TableObject *tbl_left = nullptr;
-    TableObject *tbl_right = nullptr;
-    // populate the new table with fields of the old one
-    // Left
-    for (int i = 0; i < db.tables.size(); i++)
+    // Rows are separated by a newline and the file doesn't end in one, see protocGenerate.
+    // The zone map and statistics, when the table has up to date ones, are extended with the new rows.
+    std::shared_ptr<const ZoneMap> current = ZoneMap::open(tbl_path);
+    std::unique_ptr<ZoneMap> zones = current != nullptr ? std::make_unique<ZoneMap>(*current) : nullptr;
+    std::shared_ptr<const TableStats> current_stats = TableStats::open(tbl_path);
+    std::unique_ptr<TableStats> stats = current_stats != nullptr ? std::make_unique<TableStats>(*current_stats) : nullptr;
+    uint64_t file_size = fs::file_size(tbl_path);
+    std::ostringstream batch;
+    for (const auto &row : rows)
     {
-      if (db.tables[i].name() == var_table[0].first)
+      if (zones != nullptr)
+      {
+        zones->addRow(file_size + (uint64_t)batch.tellp(), row.data());
+      }
+      if (stats != nullptr)
+      {
+        stats->addRow(row.data());
+      }
+      batch << "\n";
+      for (size_t col = 0; col < row.size(); col++)
       {
-        tbl_left = &(db.tables[i]);
-        for (const auto &field : db.tables[i].fields) {
-          temp_tbl.fields.push_back(field);
+        writeValue(batch, row[col]);
+        if (col != row.size() - 1)
+        {
+          batch << ", ";
         }
       }
     }
-    // Right
-    for (int i = 0; i < db.tables.size(); i++)
+    ZoneMap::remove(tbl_path);
+    TableStats::remove(tbl_path);
+    std::ofstream protoFile(tbl_path, std::ios::app);
+    protoFile << batch.str();
+    protoFile.close();
+    if (zones != nullptr)
+    {
+      zones->save(tbl_path);
+    }
+    if (stats != nullptr)
+    {
+      stats->save(tbl_path);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Splits one CSV line into its fields. Fields may be wrapped in
+   * double quotes, which lets them hold commas, and "" inside quotes is a quote.
+   *
+   * @param line the line without its newline
+   * @param fields filled with the unquoted fields
+   */
+  static void splitCSVLine(std::string_view line, std::vector<std::string> &fields)
+  {
+    fields.clear();
+    if (!line.empty() && line.back() == '\r')
+    {
+      line.remove_suffix(1);
+    }
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++)
     {
-      if (db.tables[i].name() == var_table[1].first)
+      char ch = line[i];
+      if (quoted)
       {
-        tbl_right = &(db.tables[i]);
-        for (const auto &field : db.tables[i].fields) {
-          temp_tbl.fields.push_back(field);
+        if (ch == '"' && i + 1 < line.size() && line[i + 1] == '"')
+        {
+          field += '"';
+          i++;
+        }
+        else if (ch == '"')
+        {
+          quoted = false;
+        }
+        else
+        {
+          field += ch;
         }
       }
-    }
-    // Look to see if where condition matches and add variables 
-    // Get Index of value
-    int left_idx = -1;
-    int right_idx = -1;
-    for (int i = 0; i < tbl_left->fields.size(); i++) {
-      if (where == nullptr) {
-        std::cout << tbl_left->fields[i].first << " vs " << var_table[0].second << std::endl;
+      else if (ch == '"')
+      {
+        quoted = true;
       }
-      if (where != nullptr && tbl_left->fields[i].first == std::get<0>(*where)) {
-        left_idx = i;
-      } else if (where == nullptr && tbl_left->fields[i].first == var_table[0].second) {
-        left_idx = i;
+      else if (ch == ',')
+      {
+        fields.push_back(field);
+        field.clear();
       }
-    }
-    for (int i = 0; i < tbl_right->fields.size(); i++) {
-      if (where == nullptr)
-        std::cout << tbl_right->fields[i].first << " vs " << var_table[1].second << " vs " << var_table[1].first << std::endl;
-      if (where != nullptr && tbl_right->fields[i].first == std::get<2>(*where)) {
-        right_idx = i;
-      } else if (where == nullptr && tbl_right->fields[i].first == var_table[1].second) {
-        right_idx = i;
+      else
+      {
+        field += ch;
       }
     }
-    if (left_idx == -1 || right_idx == -1) {
-      return "Could not find property in table.\n";
+    fields.push_back(field);
+  }
+
+  /**
+   * @brief Imports a CSV file into a table, like a bulk INSERT. The file is split into
+   * chunks at line boundaries which are parsed and type checked in parallel, then
+   * appended to the table file in one write. A first line holding the column names is skipped.
+   *
+   * @param db_name Name of the database
+   * @param tbl_name Name of the table
+   * @param csv_path the file to read
+   * @return long rows imported, -1 when the table doesn't exist
+   * @throws std::invalid_argument naming the line when a row doesn't match the table
+   * @throws std::runtime_error when the file can't be opened
+   */
+  static long copyFromCSV(std::string db_name, std::string tbl_name, const std::string &csv_path)
+  {
+    auto tbl_path = dataPath() / db_name / (tbl_name + ".proto");
+    if (!fs::exists(tbl_path))
+    {
+      return -1;
     }
-    // Look through all records for the given index and see if records match
-    // In the future, create an unordered_map with variant record types
-    // Go through marked records and compare based on operator
-    // Only do if join_section[1] is true
-    
-    // Keep track of left and right columns included in inner in an associative array
-    std::vector<bool> left_inner(tbl_left->records.size()/tbl_left->fields.size(), false);
-    std::vector<bool> right_inner(tbl_right->records.size()/tbl_right->fields.size(), false);
+    TableObject tbl = loadSchema(tbl_path);
+    std::string format = tbl.getFormat();
+    if (format.empty() || format.find('b') != std::string::npos)
+    {
+      throw std::invalid_argument(tbl_name + " has columns COPY can't fill");
+    }
+    MappedFile csv(csv_path);
+    std::string_view text = csv.text();
 
-    if (join_sections[1]) {
-      for (int i = left_idx; i < tbl_left->records.size(); i+=tbl_left->fields_size) {
-        for (int j = right_idx; j < tbl_right->records.size(); j+=tbl_right->fields_size) {
-          //std::cout << "Sales[" << i << "/" << tbl_left->records.size() << "]\n";
-          //std::cout << "Employee[" << j << "/" << tbl_right->records.size() << "]\n";
-          if(auto value_l = std::get_if<std::string>(&tbl_left->records[i])) {
-            if(auto value_r = std::get_if<std::string>(&tbl_right->records[j])) {
-              // If type and record matches, add combined record to table
-              if (*value_l == *value_r) {
-                // Go to start of the row and add based on format
-                return "Float comparison not yet implemented\n";
+    // Skip a header naming the columns
+    std::vector<std::string> fields;
+    size_t first_end = std::min(text.find('\n'), text.size());
+    splitCSVLine(text.substr(0, first_end), fields);
+    bool header = fields.size() == tbl.fields.size();
+    for (size_t col = 0; header && col < fields.size(); col++)
+    {
+      header = fields[col] == tbl.fields[col].first;
+    }
+    size_t begin = header ? std::min(first_end + 1, text.size()) : 0;
+
+    // Chunks start right after a newline
+    std::vector<size_t> starts;
+    for (size_t pos = begin; pos < text.size();)
+    {
+      starts.push_back(pos);
+      size_t next = text.find('\n', std::min(text.size(), pos + CSV_CHUNK_BYTES));
+      pos = next == std::string_view::npos ? text.size() : next + 1;
+    }
+    starts.push_back(text.size());
+
+    // The zone map and statistics, when the table has up to date ones, are extended with the new rows
+    std::shared_ptr<const ZoneMap> current = ZoneMap::open(tbl_path);
+    std::shared_ptr<const TableStats> current_stats = TableStats::open(tbl_path);
+    bool keep_decoded = current != nullptr || current_stats != nullptr;
+    struct Chunk
+    {
+      std::string rows;
+      // Offset in rows of each row and its values as the reader decodes them, kept for the zone map and statistics
+      std::vector<uint64_t> row_offsets;
+      std::vector<variant_type> decoded;
+      long count = 0;
+      long lines = 0;
+      // Line in the chunk of the first error, 0 for none
+      long error_line = 0;
+      std::string error;
+    };
+    std::vector<Chunk> chunks(starts.size() - 1);
+    ThreadPool::shared().parallelFor(0, chunks.size(), 1, [&](size_t from, size_t to) {
+      std::vector<std::string> values;
+      for (size_t c = from; c < to; c++)
+      {
+        Chunk &chunk = chunks[c];
+        std::string_view part = text.substr(starts[c], starts[c + 1] - starts[c]);
+        std::ostringstream rows;
+        while (!part.empty() && chunk.error_line == 0)
+        {
+          size_t end = std::min(part.find('\n'), part.size());
+          std::string_view line = part.substr(0, end);
+          part.remove_prefix(std::min(end + 1, part.size()));
+          chunk.lines++;
+          if (line.empty() || line == "\r")
+          {
+            continue;
+          }
+          splitCSVLine(line, values);
+          if (values.size() != format.size())
+          {
+            chunk.error_line = chunk.lines;
+            chunk.error = "has " + std::to_string(values.size()) + " values but " + tbl_name + " has " +
+                          std::to_string(format.size()) + " columns";
+            break;
+          }
+          if (keep_decoded)
+          {
+            chunk.row_offsets.push_back(rows.tellp());
+          }
+          rows << "\n";
+          for (size_t col = 0; col < format.size() && chunk.error_line == 0; col++)
+          {
+            const std::string &value = values[col];
+            bool valid = true;
+            if (format[col] == 's')
+            {
+              // Table files split values on whitespace
+              valid = value.find_first_of(" \t\r\n") == std::string::npos;
+              rows << "'" << value << "'";
+              if (keep_decoded)
+              {
+                chunk.decoded.emplace_back(value);
               }
-            } else {
-              return "Record types don't match (string)";
             }
-          } else if(auto value_l = std::get_if<int>(&tbl_left->records[i])) {
-            if(auto value_r = std::get_if<int>(&tbl_right->records[j])) {
-              // If type and record matches, add combined record to table
-              if (*value_l == *value_r) {
-                left_inner[(i/tbl_left->fields_size)] = true;
-                right_inner[(i/tbl_right->fields_size)] = true;
-                // Go to start of the row and add based on format until end of row
-                // Start of row is a negative offset from i by column idx
-                // End of row (1+floor((i)/field_size))*fields_size
-                //std::cout << i-left_idx << "/" << (1+(i/tbl_left->fields_size))*tbl_left->fields_size << std::endl;
-                for (int idx = i - left_idx; idx < (1+(i/tbl_left->fields_size))*tbl_left->fields_size; idx++) {
-                  //std::cout << tbl_left->name() << ":" << tbl_left->fields[idx % tbl_left->fields_size].first << " ";
-                  if(auto value = std::get_if<std::string>(&tbl_left->records[idx])) {
-                    temp_tbl.addRecord("s", value->c_str());
-                    //std::cout << "(s)";
-                  } else if (auto value = std::get_if<int>(&tbl_left->records[idx])) {
-                    temp_tbl.addRecord("i", *value);
-                    //std::cout << "(i)";
-                  } else if (auto value = std::get_if<double>(&tbl_left->records[idx])) {
-                    temp_tbl.addRecord("f", *value);
-                  }
-                  //std::cout << std::endl;
+            else
+            {
+              const char *last = value.data() + value.size();
+              std::from_chars_result parsed;
+              if (format[col] == 'i')
+              {
+                int number;
+                parsed = std::from_chars(value.data(), last, number);
+                if (keep_decoded)
+                {
+                  chunk.decoded.emplace_back(number);
                 }
-                //std::cout << j-right_idx << "/" << (1+(j/tbl_right->fields_size))*tbl_right->fields_size << std::endl;
-                for (int idx = j - right_idx; idx < (1+(j/tbl_right->fields_size))*tbl_right->fields_size; idx++) {
-                  //std::cout << tbl_right->name() << ":" << tbl_right->fields[idx % tbl_left->fields_size].first << " ";
-                  if(auto value = std::get_if<std::string>(&tbl_right->records[idx])) {
-                    temp_tbl.addRecord("s", value->c_str());
-                    //std::cout << "(s)";
-                  } else if (auto value = std::get_if<int>(&tbl_right->records[idx])) {
-                    temp_tbl.addRecord("i", *value);
-                    //std::cout << "(i)";
-                  } else if (auto value = std::get_if<double>(&tbl_right->records[idx])) {
-                    temp_tbl.addRecord("f", *value);
-                  }
-                  //std::cout << std::endl;
+              }
+              else
+              {
+                double number;
+                parsed = std::from_chars(value.data(), last, number);
+                if (keep_decoded)
+                {
+                  chunk.decoded.emplace_back(number);
                 }
-                //std::cout << ".";
               }
-            } else {
-              return "Record types don't match (int)";
+              valid = !value.empty() && parsed.ec == std::errc() && parsed.ptr == last;
+              rows << value;
             }
-          } else if(auto value_l = std::get_if<double>(&tbl_left->records[i])) {
-            if(auto value_r = std::get_if<double>(&tbl_right->records[j])) {
-              // If type and record matches, add combined record to table
-              if (*value_l == *value_r) {
-                return "Float comparison not yet implemented\n";
-              }
-            } else {
-              return "Record types don't match (double)";
+            if (!valid)
+            {
+              chunk.error_line = chunk.lines;
+              chunk.error = "has an invalid value for " + tbl.fields[col].first;
+            }
+            else if (col != format.size() - 1)
+            {
+              rows << ", ";
             }
           }
+          chunk.count++;
         }
+        chunk.rows = rows.str();
+      }
+    });
+
+    long line = header ? 1 : 0;
+    long total = 0;
+    for (const Chunk &chunk : chunks)
+    {
+      if (chunk.error_line != 0)
+      {
+        throw std::invalid_argument("line " + std::to_string(line + chunk.error_line) + " " + chunk.error);
       }
+      line += chunk.lines;
+      total += chunk.count;
     }
-    //Print Left
-    if (join_sections[0]) {
-      //std::cout << "Left Rows:\n";
-      for (int i = 0; i < left_inner.size(); i++) {
-        if (!left_inner[i]) {
-          for (int idx = i * tbl_left->fields_size; idx < (i + 1) * tbl_left->fields_size; idx++) {
-            if(auto value = std::get_if<std::string>(&tbl_left->records[idx])) {
-              temp_tbl.addRecord("s", value->c_str());
-            } else if (auto value = std::get_if<int>(&tbl_left->records[idx])) {
-              temp_tbl.addRecord("i", *value);
-            } else if (auto value = std::get_if<double>(&tbl_left->records[idx])) {
-              temp_tbl.addRecord("f", *value);
+    std::unique_ptr<ZoneMap> zones = current != nullptr ? std::make_unique<ZoneMap>(*current) : nullptr;
+    if (zones != nullptr)
+    {
+      // Values are written as they appear in the CSV, so floats are read back unrounded
+      uint64_t offset = fs::file_size(tbl_path);
+      for (const Chunk &chunk : chunks)
+      {
+        for (size_t row = 0; row < chunk.row_offsets.size(); row++)
+        {
+          zones->addRow(offset + chunk.row_offsets[row], &chunk.decoded[row * format.size()], false);
+        }
+        offset += chunk.rows.size();
+      }
+    }
+    std::unique_ptr<TableStats> stats = current_stats != nullptr ? std::make_unique<TableStats>(*current_stats) : nullptr;
+    if (stats != nullptr)
+    {
+      for (const Chunk &chunk : chunks)
+      {
+        for (size_t row = 0; row < chunk.row_offsets.size(); row++)
+        {
+          stats->addRow(&chunk.decoded[row * format.size()], false);
+        }
+      }
+    }
+    ZoneMap::remove(tbl_path);
+    TableStats::remove(tbl_path);
+    std::ofstream protoFile(tbl_path, std::ios::app);
+    for (const Chunk &chunk : chunks)
+    {
+      protoFile << chunk.rows;
+    }
+    protoFile.close();
+    if (zones != nullptr)
+    {
+      zones->save(tbl_path);
+    }
+    if (stats != nullptr)
+    {
+      stats->save(tbl_path);
+    }
+    return total;
+  }
+
+  /**
+   * @brief Exports a table to a CSV file with a header of the column names.
+   * Rows are formatted in parallel morsels and written in order.
+   *
+   * @param db_name Name of the database
+   * @param tbl_name Name of the table
+   * @param csv_path the file to write, replaced if it exists
+   * @return long rows exported, -1 when the table doesn't exist
+   * @throws std::runtime_error when the file can't be written
+   */
+  static long copyToCSV(std::string db_name, std::string tbl_name, const std::string &csv_path)
+  {
+    auto tbl_path = dataPath() / db_name / (tbl_name + ".proto");
+    if (!fs::exists(tbl_path))
+    {
+      return -1;
+    }
+    TableObject tbl = loadTBL(tbl_path);
+    int cols = tbl.fields_size;
+    size_t rows = cols == 0 ? 0 : tbl.records.size() / cols;
+    std::vector<std::string> morselText((rows + SCAN_MORSEL_ROWS - 1) / SCAN_MORSEL_ROWS);
+    ThreadPool::shared().parallelFor(0, rows, SCAN_MORSEL_ROWS, [&](size_t from, size_t to) {
+      std::string out;
+      char number[32];
+      for (size_t row = from; row < to; row++)
+      {
+        for (int col = 0; col < cols; col++)
+        {
+          const variant_type &value = tbl.records[row * cols + col];
+          if (auto val = std::get_if<std::string>(&value))
+          {
+            if (val->find_first_of(",\"\n") == std::string::npos)
+            {
+              out += *val;
+            }
+            else
+            {
+              out += '"';
+              for (char ch : *val)
+              {
+                out += ch == '"' ? "\"\"" : std::string(1, ch);
+              }
+              out += '"';
+            }
+          }
+          else if (auto val = std::get_if<int>(&value))
+          {
+            out.append(number, std::to_chars(number, number + sizeof(number), *val).ptr);
+          }
+          else if (auto val = std::get_if<double>(&value))
+          {
+            out.append(number, std::to_chars(number, number + sizeof(number), *val).ptr);
+          }
+          out += col == cols - 1 ? '\n' : ',';
+        }
+      }
+      morselText[from / SCAN_MORSEL_ROWS] = std::move(out);
+    });
+
+    std::ofstream csv(csv_path, std::ios::trunc);
+    if (!csv)
+    {
+      throw std::runtime_error("!Failed to open " + csv_path + ".");
+    }
+    for (int col = 0; col < cols; col++)
+    {
+      csv << tbl.fields[col].first << (col == cols - 1 ? "\n" : ",");
+    }
+    for (const std::string &text : morselText)
+    {
+      csv << text;
+    }
+    return rows;
+  }
+
+  /**
+   * @brief update table records based on a variety of constraints
+   * 
+   * The fields are scanned to determine the column of the filter and where constraints
+   *
+   * @param db_name the database name
+   * @param tbl_name the table name
+   * @param where [default: nullptr]] (column_name operator value) to test for when printing values
+   * @param where [default: false] if its a lock it'll
+   * @return DatabaseObject updated database object
+   * @throws std::invalid_argument when a new value doesn't fit its column
+   */
+  static DatabaseObject updateTBL(std::string db_name,
+                                  std::string tbl_name,
+                                  std::unordered_map<std::string, std::string> what,
+                                  int *update_count,
+                                  std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    DatabaseObject db = loadDB(db_name);
+    for (auto &table : db.tables) {
+      if (table.name() == tbl_name) {
+        int cols = table.fields_size;
+        // Cast the new values once per column instead of once per row, and
+        // before the scan so a value the column can't hold changes nothing
+        std::string tableFormat = table.getFormat();
+        std::vector<std::pair<int, variant_type>> assignments;
+        for (int col = 0; col != cols; col++) {
+          auto value = what.find(table.fields[col].first);
+          if (value == what.end()) {
+            continue;
+          }
+          const char *last = value->second.data() + value->second.size();
+          std::from_chars_result parsed{last, std::errc()};
+          if (tableFormat[col] == 's') {
+            assignments.emplace_back(col, value->second);
+          } else if (tableFormat[col] == 'i') {
+            int number = 0;
+            parsed = std::from_chars(value->second.data(), last, number);
+            assignments.emplace_back(col, number);
+          } else if (tableFormat[col] == 'f') {
+            double number = 0;
+            parsed = std::from_chars(value->second.data(), last, number);
+            assignments.emplace_back(col, number);
+          }
+          if (value->second.empty() || parsed.ec != std::errc() || parsed.ptr != last) {
+            throw std::invalid_argument(value->second + " is not a valid value for " + value->first);
+          }
+        }
+        auto whereRows = ProtoGenerator::getWhereRows(table, where);
+        *update_count = whereRows.size();
+        // Go through the accepted rows in parallel morsels and change their values
+        ThreadPool::shared().parallelFor(0, whereRows.size(), SCAN_MORSEL_ROWS, [&](size_t from, size_t to) {
+          for (size_t i = from; i < to; i++) {
+            for (const auto &assignment : assignments) {
+              table.records[whereRows[i] * cols + assignment.first] = assignment.second;
             }
           }
-          // Add filler blank columns 
-          for (int idx = 0; idx < tbl_right->fields_size; idx++) {
-            temp_tbl.addRecord("i", std::numeric_limits<int>::min());
+        });
+        // Memory instance updated, now apply to file and update current_database
+        ProtoGenerator pg(&db);
+        return db;
+      }
+    }
+    *update_count = 0;
+    return DatabaseObject("nil");
+  }
+
+  /**
+   * @brief Radix partitioned parallel hash join on an equality key
+   *
+   * Both inputs are split across the thread pool by key hash so every
+   * partition builds and probes its own cache sized hash table.
+   * The right table is the build side and the left table probes it.
+   *
+   * @param left the probe table
+   * @param left_idx column of the key in the left table
+   * @param right the build table
+   * @param right_idx column of the key in the right table
+   * @param left_matched set to 1 for every left row with a match
+   * @param right_matched set to 1 for every right row with a match
+   * @return std::vector<std::pair<int, int>> matching (left row, right row) pairs in nested loop order
+   */
+  static std::vector<std::pair<int, int>> hashJoinRows(const TableObject &left, int left_idx,
+                                                       const TableObject &right, int right_idx,
+                                                       std::vector<char> &left_matched,
+                                                       std::vector<char> &right_matched)
+  {
+    int left_rows = left.fields_size == 0 ? 0 : left.records.size() / left.fields_size;
+    int right_rows = right.fields_size == 0 ? 0 : right.records.size() / right.fields_size;
+    left_matched.assign(left_rows, 0);
+    right_matched.assign(right_rows, 0);
+
+    // Enough partitions that each build side hash table stays around JOIN_PARTITION_ROWS
+    int bits = 0;
+    while (bits < JOIN_MAX_PARTITION_BITS && (right_rows >> bits) > JOIN_PARTITION_ROWS) {
+      bits++;
+    }
+    size_t partitions = size_t(1) << bits;
+    auto partitionOf = [bits](const variant_type &key) -> size_t {
+      if (bits == 0) {
+        return 0;
+      }
+      // Fibonacci hashing so identity hashes of ints still spread over the top bits
+      uint64_t hash = std::hash<variant_type>{}(key) * 0x9E3779B97F4A7C15ull;
+      return hash >> (64 - bits);
+    };
+
+    // Partition phase: every morsel scatters its row ids into its own partition lists
+    auto partition = [&](const TableObject &tbl, int idx, int rows) {
+      int morsels = (rows + SCAN_MORSEL_ROWS - 1) / SCAN_MORSEL_ROWS;
+      std::vector<std::vector<std::vector<int>>> scattered(morsels, std::vector<std::vector<int>>(partitions));
+      ThreadPool::shared().parallelFor(0, rows, SCAN_MORSEL_ROWS, [&](size_t from, size_t to) {
+        auto &lists = scattered[from / SCAN_MORSEL_ROWS];
+        for (size_t row = from; row < to; row++) {
+          lists[partitionOf(tbl.records[row * tbl.fields_size + idx])].push_back(row);
+        }
+      });
+      // Concatenate in morsel order so each partition keeps rows sorted
+      std::vector<std::vector<int>> result(partitions);
+      ThreadPool::shared().parallelFor(0, partitions, 1, [&](size_t from, size_t to) {
+        for (size_t p = from; p < to; p++) {
+          for (auto &lists : scattered) {
+            result[p].insert(result[p].end(), lists[p].begin(), lists[p].end());
+          }
+        }
+      });
+      return result;
+    };
+    auto left_parts = partition(left, left_idx, left_rows);
+    auto right_parts = partition(right, right_idx, right_rows);
+
+    // Build and probe phase, one partition at a time per worker
+    std::vector<std::vector<std::pair<int, int>>> part_pairs(partitions);
+    ThreadPool::shared().parallelFor(0, partitions, 1, [&](size_t from, size_t to) {
+      for (size_t p = from; p < to; p++) {
+        std::unordered_map<variant_type, std::vector<int>> table;
+        table.reserve(right_parts[p].size());
+        for (int row : right_parts[p]) {
+          table[right.records[row * right.fields_size + right_idx]].push_back(row);
+        }
+        for (size_t i = 0; i < left_parts[p].size(); i++) {
+          int row = left_parts[p][i];
+          // A many to many join can emit far more pairs than rows, so check often
+          if ((i & 1023) == 0) {
+            ThreadPool::checkCancelled();
+          }
+          auto match = table.find(left.records[row * left.fields_size + left_idx]);
+          if (match == table.end()) {
+            continue;
+          }
+          left_matched[row] = 1;
+          for (int right_row : match->second) {
+            right_matched[right_row] = 1;
+            part_pairs[p].emplace_back(row, right_row);
+          }
+        }
+      }
+    });
+
+    std::vector<std::pair<int, int>> pairs;
+    for (auto &part : part_pairs) {
+      pairs.insert(pairs.end(), part.begin(), part.end());
+    }
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+  }
+
+  /**
+   * @brief Compares every left row with every right row, which beats building
+   * a hash table when both tables are tiny
+   *
+   * @return std::vector<std::pair<int, int>> matching (left row, right row) pairs in nested loop order
+   */
+  static std::vector<std::pair<int, int>> nestedLoopJoinRows(const TableObject &left, int left_idx,
+                                                             const TableObject &right, int right_idx,
+                                                             std::vector<char> &left_matched,
+                                                             std::vector<char> &right_matched)
+  {
+    int left_rows = left.fields_size == 0 ? 0 : left.records.size() / left.fields_size;
+    int right_rows = right.fields_size == 0 ? 0 : right.records.size() / right.fields_size;
+    left_matched.assign(left_rows, 0);
+    right_matched.assign(right_rows, 0);
+    std::vector<std::pair<int, int>> pairs;
+    for (int row = 0; row < left_rows; row++) {
+      const variant_type &key = left.records[row * left.fields_size + left_idx];
+      for (int right_row = 0; right_row < right_rows; right_row++) {
+        if (key == right.records[right_row * right.fields_size + right_idx]) {
+          left_matched[row] = right_matched[right_row] = 1;
+          pairs.emplace_back(row, right_row);
+        }
+      }
+    }
+    return pairs;
+  }
+
+  /**
+   * @brief Sorts both tables on their key with ExternalSort, which spills past
+   * its memory budget, and merges the two sorted streams a batch at a time.
+   * Only the right rows of the current key are buffered. Used when the build
+   * side's hash table wouldn't fit in that budget.
+   *
+   * @return std::vector<std::pair<int, int>> matching (left row, right row) pairs in nested loop order
+   */
+  static std::vector<std::pair<int, int>> sortMergeJoinRows(const TableObject &left, int left_idx,
+                                                            const TableObject &right, int right_idx,
+                                                            std::vector<char> &left_matched,
+                                                            std::vector<char> &right_matched)
+  {
+    // Rows of one side in key order, read from its sort a morsel at a time
+    struct SortedRows
+    {
+      const TableObject &tbl;
+      int idx;
+      ExternalSort sort;
+      std::vector<int> batch;
+      size_t pos = 0;
+
+      SortedRows(const TableObject &tbl, int idx) : tbl(tbl), idx(idx), sort(tbl, {ExternalSort::Key{idx}})
+      {
+        int rows = tbl.fields_size == 0 ? 0 : tbl.records.size() / tbl.fields_size;
+        for (int row = 0; row < rows; row++) {
+          sort.add(row);
+        }
+        sort.finish();
+      }
+
+      bool valid()
+      {
+        if (pos == batch.size() && !sort.done()) {
+          ThreadPool::checkCancelled();
+          sort.next(SCAN_MORSEL_ROWS, batch);
+          pos = 0;
+        }
+        return pos < batch.size();
+      }
+
+      int row() const
+      {
+        return batch[pos];
+      }
+
+      const variant_type &key() const
+      {
+        return tbl.records[batch[pos] * tbl.fields_size + idx];
+      }
+    };
+    SortedRows l(left, left_idx), r(right, right_idx);
+    left_matched.assign(left.fields_size == 0 ? 0 : left.records.size() / left.fields_size, 0);
+    right_matched.assign(right.fields_size == 0 ? 0 : right.records.size() / right.fields_size, 0);
+
+    // Tables are loaded with one type per column, so variant order is the sort's order
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<int> run;
+    while (l.valid() && r.valid()) {
+      if (l.key() < r.key()) {
+        l.pos++;
+      } else if (r.key() < l.key()) {
+        r.pos++;
+      } else {
+        // The key lives in the table, so it stays valid as the batches move on
+        const variant_type &key = r.key();
+        run.clear();
+        while (r.valid() && r.key() == key) {
+          right_matched[r.row()] = 1;
+          run.push_back(r.row());
+          r.pos++;
+        }
+        while (l.valid() && l.key() == key) {
+          left_matched[l.row()] = 1;
+          for (int right_row : run) {
+            pairs.emplace_back(l.row(), right_row);
           }
+          l.pos++;
+        }
+      }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+  }
+
+  /**
+   * @brief Path of a table file a join or the planner reads, X_lock naming the
+   * copy a transaction locked
+   *
+   * @return fs::path empty when the table doesn't exist
+   */
+  static fs::path joinTablePath(const std::string &db_name, const std::string &name)
+  {
+    fs::path path = dataPath() / db_name / (name + ".proto");
+    if (!fs::exists(path) && name.size() > 5 && name.compare(name.size() - 5, 5, "_lock") == 0) {
+      path = dataPath() / db_name / (name.substr(0, name.size() - 5) + ".lock");
+    }
+    return fs::exists(path) ? path : fs::path();
+  }
+
+  /**
+   * @brief creates a temporary table via join operations
+   * 
+   * @param db_name the database name
+   * @param where the checks using the var_table
+   * @param var_table the tables and their aliases
+   * @param join_sections the sections joined
+   * @param choice [default: hash join built on the right] the strategy and sides the planner picked
+   * @return TableObject the joined rows, with INT_MIN filling the blanks of outer rows
+   * @throws std::invalid_argument with the message to show when the join can't be made
+   */
+  static TableObject joinTBL(std::string db_name,
+                             std::tuple<std::string, std::string, std::string> *where,
+                             std::vector<std::pair<std::string, std::string>> var_table,
+                             std::array<bool, 3> join_sections,
+                             const JoinChoice &choice = JoinChoice()) {
+    // Only the two joined tables are read
+    fs::path left_path = joinTablePath(db_name, var_table[0].first);
+    fs::path right_path = joinTablePath(db_name, var_table[1].first);
+    if (left_path.empty() || right_path.empty()) {
+      throw std::invalid_argument("!Failed to query table because it does not exist.");
+    }
+    std::string left_key = where != nullptr ? std::get<0>(*where) : var_table[0].second;
+    std::string right_key = where != nullptr ? std::get<2>(*where) : var_table[1].second;
+    auto columnOf = [](const TableObject &tbl, const std::string &name) {
+      int idx = -1;
+      for (size_t i = 0; i < tbl.fields.size(); i++) {
+        if (tbl.fields[i].first == name) {
+          idx = i;
+        }
+      }
+      return idx;
+    };
+    // An inner join only needs the rows of one table matching a key of the other. The
+    // table read first hands its keys, when there are few, to the other's reader,
+    // which skips the pages whose zone map and Bloom filter hold none of them.
+    bool left_first = choice.filter_from_left;
+    TableObject left(""), right("");
+    TableObject &first = left_first ? left : right;
+    first = loadTBL(left_first ? left_path : right_path);
+    int first_idx = columnOf(first, left_first ? left_key : right_key);
+    std::unique_ptr<KeyFilter> keys;
+    if (first_idx != -1 && !join_sections[0] && join_sections[1] && !join_sections[2]) {
+      keys = std::make_unique<KeyFilter>(KeyFilter{left_first ? right_key : left_key, {}});
+      std::vector<variant_type> &distinct = keys->keys;
+      int first_rows = first.records.size() / first.fields_size;
+      for (int row = 0; row < first_rows && distinct.size() <= 2 * JOIN_KEY_FILTER_MAX; row++) {
+        distinct.push_back(first.records[row * first.fields_size + first_idx]);
+        // Deduped every so often, so repeated keys don't give up on the filter
+        if (distinct.size() > 2 * JOIN_KEY_FILTER_MAX || row == first_rows - 1) {
+          std::sort(distinct.begin(), distinct.end());
+          distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+        }
+      }
+      if (distinct.size() > JOIN_KEY_FILTER_MAX) {
+        keys = nullptr;
+      }
+    }
+    (left_first ? right : left) = loadTBL(left_first ? right_path : left_path, std::numeric_limits<size_t>::max(),
+                                          nullptr, nullptr, keys.get());
+    TableObject *tbl_left = &left;
+    TableObject *tbl_right = &right;
+    int left_idx = columnOf(left, left_key);
+    int right_idx = columnOf(right, right_key);
+    // populate the new table with fields of the old ones
+    TableObject temp_tbl("_tempJoin");
+    temp_tbl.fields = left.fields;
+    temp_tbl.fields.insert(temp_tbl.fields.end(), right.fields.begin(), right.fields.end());
+    temp_tbl.fields_size = temp_tbl.fields.size();
+    if (left_idx == -1 || right_idx == -1) {
+      throw std::invalid_argument("Could not find property in table.");
+    }
+    // The key columns have to share a type to be compared
+    std::string left_format = tbl_left->getFormat();
+    std::string right_format = tbl_right->getFormat();
+    if (left_format[left_idx] != right_format[right_idx]) {
+      throw std::invalid_argument("Record types don't match");
+    }
+
+    QueryProfile::Timer timer("join");
+    // Keep track of left and right rows included in inner in an associative array
+    std::vector<char> left_inner;
+    std::vector<char> right_inner;
+    std::vector<std::pair<int, int>> pairs;
+    if (choice.strategy == JoinStrategy::NESTED_LOOP) {
+      pairs = nestedLoopJoinRows(left, left_idx, right, right_idx, left_inner, right_inner);
+    } else if (choice.strategy == JoinStrategy::SORT_MERGE) {
+      pairs = sortMergeJoinRows(left, left_idx, right, right_idx, left_inner, right_inner);
+    } else if (choice.build_left) {
+      // The right table probes, so swap the pairs back into left row order
+      pairs = hashJoinRows(right, right_idx, left, left_idx, right_inner, left_inner);
+      for (auto &pair : pairs) {
+        std::swap(pair.first, pair.second);
+      }
+      std::sort(pairs.begin(), pairs.end());
+    } else {
+      pairs = hashJoinRows(left, left_idx, right, right_idx, left_inner, right_inner);
+    }
+
+    // Copy the values of joined rows, using INT_MIN as the blank filler of outer rows
+    int left_cols = tbl_left->fields_size;
+    int right_cols = tbl_right->fields_size;
+    auto appendRow = [](TableObject &to, const TableObject *from, int row, int cols) {
+      if (from == nullptr) {
+        to.records.insert(to.records.end(), cols, std::numeric_limits<int>::min());
+      } else {
+        to.records.insert(to.records.end(), from->records.begin() + row * cols,
+                          from->records.begin() + (row + 1) * cols);
+      }
+    };
+    if (join_sections[1]) {
+      temp_tbl.records.reserve(pairs.size() * temp_tbl.fields_size);
+      for (size_t i = 0; i < pairs.size(); i++) {
+        const auto &pair = pairs[i];
+        if (i % SCAN_MORSEL_ROWS == 0) {
+          ThreadPool::checkCancelled();
+        }
+        appendRow(temp_tbl, tbl_left, pair.first, left_cols);
+        appendRow(temp_tbl, tbl_right, pair.second, right_cols);
+      }
+    }
+    // Left rows without a match
+    if (join_sections[0]) {
+      for (size_t i = 0; i < left_inner.size(); i++) {
+        if (!left_inner[i]) {
+          appendRow(temp_tbl, tbl_left, i, left_cols);
+          appendRow(temp_tbl, nullptr, i, right_cols);
         }
       }
     }
-    //Print Right
+    // Right rows without a match
     if (join_sections[2]) {
-      std::cout << "Right Rows:\n";
-      for (int row : right_inner)
-        std::cout << row << std::endl;
+      for (size_t i = 0; i < right_inner.size(); i++) {
+        if (!right_inner[i]) {
+          appendRow(temp_tbl, nullptr, i, left_cols);
+          appendRow(temp_tbl, tbl_right, i, right_cols);
+        }
+      }
+    }
+    if (timer.enabled()) {
+      timer.op.rows_in = left_inner.size() + right_inner.size();
+      timer.op.rows_out = temp_tbl.records.size() / temp_tbl.fields_size;
+      timer.op.memory = QueryProfile::tableBytes(temp_tbl) + pairs.capacity() * sizeof(pairs[0]);
     }
 
-    // Print temp tbl
-    DatabaseObject temp_db("temp");
-    temp_db.insertTable(temp_tbl);
+    return temp_tbl;
+  }
 
-    ProtoGenerator pg(&temp_db);
-    return printTBL(temp_db.name(), temp_tbl.name());
-    //return "";
+  /**
+   * @brief joins tables with joinTBL and uses formatTBL to print the result
+   *
+   * @return std::string the formatted table or the reason the join failed
+   */
+  static std::string printTBLJoin(std::string db_name,
+                                  std::tuple<std::string, std::string, std::string> *where,
+                                  std::vector<std::pair<std::string, std::string>> var_table,
+                                  std::array<bool, 3> join_sections) {
+    try {
+      // Print temp tbl straight from memory
+      return formatTBL(joinTBL(db_name, where, var_table, join_sections));
+    } catch (const std::invalid_argument &e) {
+      return e.what();
+    }
   }
 
   /**
@@ -603,7 +1469,7 @@ public:
    * @return false when lock exists. Otherwise true and lock file (backup) made
    */
   static bool lockTbl(std::string db_name, std::string tbl_name) {
-    auto db_path = DATA_PATH / db_name;
+    auto db_path = dataPath() / db_name;
     // If return false
     if (fs::exists(db_path / (tbl_name + ".lock"))) {
       return false;
@@ -621,8 +1487,18 @@ public:
    * @return false 
    */
   static bool resetTransaction(std::string db_name, std::string tbl_name) {
-    auto db_path = DATA_PATH / db_name;
-    fs::copy_file(db_path / (tbl_name + ".lock"), db_path / (tbl_name + ".proto"), fs::copy_options::overwrite_existing);
+    auto db_path = dataPath() / db_name;
+    fs::path tbl_path = db_path / (tbl_name + ".proto");
+    // The sidecars describe the rows rolled back. An analyzed table stays
+    // analyzed, its statistics are collected again from the restored rows.
+    bool analyzed = TableStats::exists(tbl_path);
+    fs::copy_file(db_path / (tbl_name + ".lock"), tbl_path, fs::copy_options::overwrite_existing);
+    ZoneMap::remove(tbl_path);
+    TableStats::remove(tbl_path);
+    if (analyzed) {
+      analyzeTBL(db_name, tbl_name);
+    }
+    return true;
   }
 
   /**
@@ -634,130 +1510,234 @@ public:
    * @return false 
    */
   static bool commitTransaction(std::string db_name, std::string tbl_name) {
-    auto db_path = DATA_PATH / db_name;
+    auto db_path = dataPath() / db_name;
     fs::remove(db_path / (tbl_name + ".lock"));
     fs::remove(db_path / (tbl_name + "_lock.proto"));
   }
 
   /**
-   * @brief prints table fields and records based on a variety of constraints
-   * 
-   * The fields are scanned to determine the column of the filter and where constraints
+   * @brief formats the fields and records of a table in memory
    *
-   * @param db_name the database name
-   * @param tbl_name the table name
+   * @param tbl the table to format
    * @param filter [default: nullptr] vector pointer with column names to print
    * @param where [default: nullptr]] (column_name operator value) to test for when printing values
    * @return std::string
    */
-  static std::string printTBL(std::string db_name, 
-                              std::string tbl_name, 
-                              std::vector<std::string> *filter = nullptr, 
-                              std::tuple<std::string, std::string, std::string> *where = nullptr)
+  static std::string formatTBL(const TableObject &tbl,
+                               std::vector<std::string> *filter = nullptr,
+                               std::tuple<std::string, std::string, std::string> *where = nullptr)
   {
-    DatabaseObject db = loadDB(db_name);
-    // If the lock exists print the generated lock table instead
-    if (fs::exists(DATA_PATH / db_name / (tbl_name + ".lock" ))) {
-      tbl_name = tbl_name + "_lock";
-    }
-    for (int i = 0; i < db.tables.size(); i++)
+    // Resolve the printed columns once instead of testing every cell
+    std::vector<int> columns = selectColumns(tbl, filter);
+    std::ostringstream ss;
+    ss << "| ";
+    for (int col : columns)
     {
-      if (db.tables[i].name() == tbl_name)
-      {
-        fieldmapType fields = db.tables[i].fields;
-        std::ostringstream ss;
-        ss << "| ";
-        std::vector<bool> skipCols(db.tables[i].fields_size, true);
-
-        // If query contains asterisk or is null, then don't filter
-        bool filtered = true;
-        if (filter == nullptr) {
-          filtered = false;
-        } else {
-          for (auto query : *filter) {
-            if (query == "*") {
-              filtered = false;
-            }
-          }
-        }
+      const auto &field = tbl.fields[col];
+      ss << field.first << " " << get<0>(field.second);
+      ss << (get<1>(field.second) > 1 ? ("(" + to_string(get<1>(field.second)) + ")") : "");
+      ss << " | ";
+    }
+    ss << "\n";
 
-        int col = 0;
-        for (auto i = fields.begin(); i != fields.end(); i++)
+    auto acceptedRows = getWhereRows(tbl, where);
+    int cols = tbl.fields_size;
+    // Format the accepted rows in parallel morsels, then append them in order
+    std::vector<std::string> morselText((acceptedRows.size() + SCAN_MORSEL_ROWS - 1) / SCAN_MORSEL_ROWS);
+    ThreadPool::shared().parallelFor(0, acceptedRows.size(), SCAN_MORSEL_ROWS, [&](size_t from, size_t to) {
+      std::ostringstream rs;
+      for (size_t r = from; r < to; r++)
+      {
+        // Print if it meets constraints
+        rs << "| ";
+        for (int col : columns)
         {
-          auto name = i->first;
-          auto field = i->second;
-          if (filter != nullptr) {
-            for (auto q : *filter) {
-              if (name == q) {
-                ss << name << " " << get<0>(field);
-                ss << (get<1>(field) > 1 ? ("(" + to_string(get<1>(field)) + ")") : "");
-                ss << " | ";
-                skipCols[col] = false;
-              }
+          const variant_type &value = tbl.records[acceptedRows[r] * cols + col];
+          if (auto val = std::get_if<std::string>(&value))
+          {
+            rs << *val << " | ";
+          }
+          else if (auto val = std::get_if<int>(&value))
+          {
+            if (*val == std::numeric_limits<int>::min()) {
+              rs << " | ";
+            } else {
+              rs << *val << " | ";
             }
           }
-          else // add all
+          else if (auto val = std::get_if<double>(&value))
           {
-            ss << name << " " << get<0>(field);
-            ss << (get<1>(field) > 1 ? ("(" + to_string(get<1>(field)) + ")") : "");
-            ss << " | ";
+            rs << *val << " | ";
           }
-
-
-          col++;
         }
-        ss << "\n";
+        rs << "\n";
+      }
+      morselText[from / SCAN_MORSEL_ROWS] = rs.str();
+    });
+    for (const auto &text : morselText) {
+      ss << text;
+    }
+    return ss.str();
+  }
 
-        int rows = db.tables[i].records.size() / db.tables[i].fields_size;
-        vector<bool> acceptRows(rows, false);
-        for(auto row : getWhereRows(db.tables[i], where)) {
-          acceptRows[row] = true;
-        }
-        int cols = db.tables[i].fields_size;
-        auto record_iter = db.tables[i].records.begin();
-        // Print if it meets constraints
-        for (int row = 0; row < rows; row++)
+  /**
+   * @brief Finds the columns to select
+   *
+   * @param tbl the table to select from
+   * @param filter column names, every column when null or holding *
+   * @return std::vector<int> the column numbers, in table order
+   */
+  static std::vector<int> selectColumns(const TableObject &tbl, std::vector<std::string> *filter)
+  {
+    bool all = filter == nullptr || std::find(filter->begin(), filter->end(), "*") != filter->end();
+    std::vector<int> columns;
+    for (int col = 0; col < tbl.fields_size; col++)
+    {
+      if (all || std::find(filter->begin(), filter->end(), tbl.fields[col].first) != filter->end())
+      {
+        columns.push_back(col);
+      }
+    }
+    return columns;
+  }
+
+  /**
+   * @brief Copies some columns of some rows into a new table
+   *
+   * @param tbl the table to read
+   * @param columns column numbers to keep, in order
+   * @param rows row numbers to keep, in order
+   * @return TableObject the projected rows
+   */
+  static TableObject projectRows(const TableObject &tbl, const std::vector<int> &columns, const std::vector<int> &rows)
+  {
+    TableObject res(tbl.name());
+    for (int col : columns)
+    {
+      res.fields.push_back(tbl.fields[col]);
+    }
+    res.fields_size = res.fields.size();
+    int cols = tbl.fields_size;
+    int res_cols = res.fields_size;
+    res.records.resize(rows.size() * res_cols);
+    // Each morsel fills its own rows of the result
+    ThreadPool::shared().parallelFor(0, rows.size(), SCAN_MORSEL_ROWS, [&](size_t from, size_t to) {
+      for (size_t r = from; r < to; r++)
+      {
+        for (int c = 0; c < res_cols; c++)
         {
-          if (acceptRows[row]) {
-            ss << "| ";
-          }
-          for (int col = 0; col < cols; col++)
-          {
-            if (acceptRows[row] && (!filtered || !skipCols[col])) {
-              if (auto val = std::get_if<std::string>(&(*record_iter)))
-              {
-                ss << *val << " | ";
-              }
-              else if (auto val = std::get_if<int>(&(*record_iter)))
-              {
-                if (*val == std::numeric_limits<int>::min()) {
-                  ss << " | ";
-                } else {
-                  ss << *val << " | ";
-                }
-              }
-              else if (auto val = std::get_if<double>(&(*record_iter)))
-              {
-                ss << *val << " | ";
-              }
-            }
-            record_iter++;
-          }
-          if (acceptRows[row]) {
-            ss << "\n";
-          }
+          res.records[r * res_cols + c] = tbl.records[rows[r] * cols + columns[c]];
         }
-        return ss.str();
       }
+    });
+    return res;
+  }
+
+  /**
+   * @brief Copies the columns in filter of the rows accepted by where into a new table
+   *
+   * @param tbl the table to read
+   * @param filter [default: nullptr] column names to keep, every column when null or holding *
+   * @param where [default: nullptr] (column_name operator value) the rows have to pass
+   * @return TableObject the projected rows, in table order
+   */
+  static TableObject projectTBL(const TableObject &tbl,
+                                std::vector<std::string> *filter = nullptr,
+                                std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    return projectRows(tbl, selectColumns(tbl, filter), getWhereRows(tbl, where));
+  }
+
+  /**
+   * @brief Loads the table a select reads, the lock table while a transaction changes it
+   *
+   * @param db_name the database name
+   * @param tbl_name the table name
+   * @param max_rows [default: every row] stop reading the file after this many rows
+   * @param columns [default: nullptr] names of the columns to load, every column when null
+   * @param where [default: nullptr] (column_name operator value) the rows will be filtered by,
+   * pages of rows that can't pass are left out
+   * @return std::shared_ptr<TableObject> the table, null when it doesn't exist
+   */
+  static std::shared_ptr<TableObject> openTBL(std::string db_name, std::string tbl_name,
+                                              size_t max_rows = std::numeric_limits<size_t>::max(),
+                                              const std::vector<std::string> *columns = nullptr,
+                                              std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    // Only the table's own file is read, not the rest of the database
+    fs::path tbl_path = dataPath() / db_name / (tbl_name + ".lock");
+    // If the lock exists select from the generated lock table instead
+    if (!fs::exists(tbl_path)) {
+      tbl_path = dataPath() / db_name / (tbl_name + ".proto");
+    }
+    if (!fs::exists(tbl_path)) {
+      return nullptr;
+    }
+    return std::make_shared<TableObject>(loadTBL(tbl_path, max_rows, columns, where));
+  }
+
+  /**
+   * @brief selects table fields and records based on a variety of constraints
+   *
+   * @param db_name the database name
+   * @param tbl_name the table name
+   * @param filter [default: nullptr] vector pointer with column names to select
+   * @param where [default: nullptr]] (column_name operator value) to test for when selecting values
+   * @return TableObject the selected columns and rows
+   * @throws std::invalid_argument with the message to show when the table doesn't exist
+   */
+  static TableObject selectTBL(std::string db_name,
+                               std::string tbl_name,
+                               std::vector<std::string> *filter = nullptr,
+                               std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    // Only the selected columns and the where column are loaded
+    std::vector<std::string> columns;
+    bool all = filter == nullptr || std::find(filter->begin(), filter->end(), "*") != filter->end();
+    if (!all)
+    {
+      columns = *filter;
+      if (where != nullptr)
+      {
+        columns.push_back(std::get<0>(*where));
+      }
+    }
+    std::shared_ptr<TableObject> tbl = openTBL(db_name, tbl_name, std::numeric_limits<size_t>::max(), all ? nullptr : &columns, where);
+    if (tbl == nullptr)
+    {
+      throw std::invalid_argument("!Failed to query table because it does not exist.");
+    }
+    return projectTBL(*tbl, filter, where);
+  }
+
+  /**
+   * @brief prints table fields and records based on a variety of constraints
+   * 
+   * The fields are scanned to determine the column of the filter and where constraints
+   *
+   * @param db_name the database name
+   * @param tbl_name the table name
+   * @param filter [default: nullptr] vector pointer with column names to print
+   * @param where [default: nullptr]] (column_name operator value) to test for when printing values
+   * @return std::string
+   */
+  static std::string printTBL(std::string db_name, 
+                              std::string tbl_name, 
+                              std::vector<std::string> *filter = nullptr, 
+                              std::tuple<std::string, std::string, std::string> *where = nullptr)
+  {
+    try {
+      return formatTBL(selectTBL(db_name, tbl_name, filter, where));
+    } catch (const std::invalid_argument &e) {
+      return e.what();
     }
-    return "!Failed to query table because it does not exist.";
   }
 
   // add a field to an existing table
   static DatabaseObject addFieldTBL(std::string db_name, std::string tbl_name, std::string fieldName, std::string fieldCount, std::string fieldType)
   {
     DatabaseObject db = loadDB(db_name);
-    for (int i = 0; i < db.tables.size(); i++)
+    for (size_t i = 0; i < db.tables.size(); i++)
     {
       if (db.tables[i].name() == tbl_name)
       {
@@ -773,121 +1753,445 @@ public:
   // Delete all files then remove the directory
   static bool deleteDB(std::string db_name)
   {
-    fs::remove_all(DATA_PATH / db_name);
-    return !fs::remove(DATA_PATH / db_name);
+    fs::remove_all(dataPath() / db_name);
+    return !fs::remove(dataPath() / db_name);
   }
 
   // Deletes a specific table from the database's path
   static bool dropTBL(std::string db_name, std::string tbl_name)
   {
-    return !fs::remove(DATA_PATH / db_name / (tbl_name + ".proto"));
+    ZoneMap::remove(dataPath() / db_name / (tbl_name + ".proto"));
+    TableStats::remove(dataPath() / db_name / (tbl_name + ".proto"));
+    return !fs::remove(dataPath() / db_name / (tbl_name + ".proto"));
   }
 
-  // Load database and parse table into the database and table classes
-  static DatabaseObject loadDB(std::string db_name)
+  /**
+   * @brief Collects a table's statistics and saves them next to it. Appends
+   * fold their rows in afterwards, rewrites of the table collect them again.
+   *
+   * @return std::shared_ptr<const TableStats> the statistics
+   * @throws std::invalid_argument with the message to show when the table doesn't exist
+   */
+  static std::shared_ptr<const TableStats> analyzeTBL(std::string db_name, std::string tbl_name)
   {
-    DatabaseObject res(db_name);
-    auto db_path = (DATA_PATH / db_name);
+    fs::path tbl_path = dataPath() / db_name / (tbl_name + ".proto");
+    if (!fs::exists(tbl_path))
+    {
+      throw std::invalid_argument("!Failed to analyze " + tbl_name + " because it does not exist.");
+    }
+    // Loaded values are already as the reader decodes them
+    auto stats = std::make_shared<TableStats>(TableStats::analyze(loadTBL(tbl_path), false));
+    stats->save(tbl_path);
+    return stats;
+  }
 
-    // Read metadata
-    std::string databaseName = "";
+  /**
+   * @brief Reads only the fields of a table file, skipping its records
+   *
+   * @param proto_path path of the .proto file
+   * @return TableObject the table with its fields and no records
+   */
+  static TableObject loadSchema(const fs::path &proto_path)
+  {
+    // The header is written line by line by protocGenerate:
+    // metadata comment, "message name {", "\tfield = type count" lines, "}"
+    std::ifstream db_file(proto_path);
+    std::string line;
     std::string tableName = "";
-    for (const auto &file : fs::directory_iterator(db_path))
+    std::vector<std::string> bloom_filters;
+    while (std::getline(db_file, line) && line.rfind("message ", 0) != 0)
     {
-      std::string path_str = file.path().string();
-      path_str = path_str.substr(path_str.length() - 5, path_str.length());
-      if (path_str != "proto" && path_str != ".lock") {
-        continue;
+      if (line.rfind("tableName ", 0) == 0)
+      {
+        tableName = line.substr(10);
       }
-
-      auto proto_path = file.path();
-
-      std::ifstream db_file(proto_path);
-      std::string prev = "";
-      std::string curr = "";
-      std::string next = "";
-      std::string count = "";
-      while (curr != "databaseName")
+      else if (line.rfind("bloomFilters ", 0) == 0)
       {
-        prev = curr;
-        curr = next;
-        db_file >> next;
+        std::istringstream columns(line.substr(13));
+        for (std::string column; columns >> column;)
+        {
+          bloom_filters.push_back(column);
+        }
       }
-      databaseName = next;
-      while (curr != "tableName")
+    }
+    TableObject tbl(tableName);
+    tbl.bloom_filters = std::move(bloom_filters);
+    while (std::getline(db_file, line) && line != "}")
+    {
+      std::istringstream field(line);
+      std::string name, equals, type;
+      int count = 1;
+      if (field >> name >> equals >> type >> count)
       {
-        prev = curr;
-        curr = next;
-        db_file >> next;
+        tbl.addField(name, type, count);
       }
-      tableName = next;
-      if (path_str == ".lock") {
-        tableName += "_lock";
+    }
+    return tbl;
+  }
+
+  /**
+   * @brief Parses one table file into a table object
+   *
+   * @param proto_path path of the .proto (or .lock) file
+   * @param max_rows [default: every row] rows to read before the rest of the file is skipped
+   * @param columns [default: nullptr] names of the columns to decode, every column when null.
+   * The others are skipped over and left out of the table, which keeps at least one column.
+   * @param where [default: nullptr] (column_name operator value) the rows will be filtered by.
+   * Pages of rows whose zone map shows they can't pass are skipped without being read, the
+   * rest are loaded whole and still have to be filtered. An = expression also looks the
+   * value up in the pages' Bloom filters.
+   * @param keys [default: nullptr] int or char keys wanted in a column, pages holding none of
+   * them by their zone map and Bloom filter are skipped like the where expression's
+   * @return TableObject the table with its fields and records
+   */
+  static TableObject loadTBL(const fs::path &proto_path, size_t max_rows = std::numeric_limits<size_t>::max(),
+                             const std::vector<std::string> *columns = nullptr,
+                             std::tuple<std::string, std::string, std::string> *where = nullptr,
+                             const KeyFilter *keys = nullptr)
+  {
+    // EXPLAIN ANALYZE counts the file's pages that were cached before they are read
+    QueryProfile::Timer timer("scan");
+    std::vector<unsigned char> resident;
+    if (timer.enabled())
+    {
+      resident = MappedFile::residentPages(proto_path.string());
+    }
+    std::string path_str = proto_path.string();
+    path_str = path_str.substr(path_str.length() - 5, path_str.length());
+
+    // Read metadata
+    std::string databaseName = "";
+    std::string tableName = "";
+    std::ifstream db_file(proto_path);
+    std::string prev = "";
+    std::string curr = "";
+    std::string next = "";
+    std::string count = "";
+    while (curr != "databaseName")
+    {
+      prev = curr;
+      curr = next;
+      db_file >> next;
+    }
+    databaseName = next;
+    while (curr != "tableName")
+    {
+      prev = curr;
+      curr = next;
+      db_file >> next;
+    }
+    tableName = next;
+    if (path_str == ".lock") {
+      tableName += "_lock";
+    }
+    timer.op.key = "scan " + tableName;
+    // The rest of the metadata lists the columns with Bloom filters, if any
+    std::vector<std::string> bloom_filters;
+    for (db_file >> next; db_file && next != "METADATA-END"; db_file >> next)
+    {
+      if (next != "bloomFilters")
+      {
+        bloom_filters.push_back(next);
       }
+    }
+    curr = next = "";
 
-      // Now read in message field to table and close file before we get to the actual data
-      TableObject tbl(tableName);
-      while (count != "}")
+    // Now read in message field to table and close file before we get to the actual data
+    TableObject tbl(tableName);
+    tbl.bloom_filters = bloom_filters;
+    while (count != "}")
+    {
+      while (curr != "=")
       {
-        while (curr != "=")
-        {
-          prev = curr;
-          curr = next;
-          next = count;
-          db_file >> count;
-        }
-        // std::cout << prev << ", " << curr << ',' << next << ", " << count << std::endl;
-        tbl.addField(prev, next, stoi(count.c_str()));
         prev = curr;
         curr = next;
         next = count;
         db_file >> count;
       }
+      // std::cout << prev << ", " << curr << ',' << next << ", " << count << std::endl;
+      tbl.addField(prev, next, stoi(count.c_str()));
+      prev = curr;
+      curr = next;
+      next = count;
       db_file >> count;
+    }
+    db_file >> count;
 
-      // Now get the format and read in the data
-      int size = tbl.fields.size();
-      std::string format = tbl.getFormat();
-      // Read in row
-      //db_file >> count;
-      while (!db_file.eof())
+    // Now get the format and read in the data
+    int size = tbl.fields.size();
+    std::string format = tbl.getFormat();
+    // Pages the where expression or keys can't match, found before the columns are projected
+    std::shared_ptr<const ZoneMap> zones =
+        (where != nullptr || keys != nullptr) && !format.empty() ? ZoneMap::open(proto_path) : nullptr;
+    std::vector<char> read_page;
+    // Pages read only because their Bloom filter let a value through, bit 1 for
+    // the where expression and 2 for the keys, checked for a match once loaded
+    std::vector<char> bloom_passed;
+    ZoneMap::BloomStats &bloom_stats = ZoneMap::bloomStats();
+    auto probe = [&](const ZoneMap::Zone &zone, bool contains)
+    {
+      bloom_stats.probes++;
+      bloom_stats.expected_millionths += (uint64_t)(zone.expectedFalsePositiveRate() * 1e6);
+      bloom_stats.skipped += !contains;
+      return contains;
+    };
+    int key_column = -1;
+    if (keys != nullptr)
+    {
+      key_column = std::find_if(tbl.fields.begin(), tbl.fields.end(), [&](const auto &field)
+                                { return field.first == keys->column; }) - tbl.fields.begin();
+      key_column = key_column < size && (format[key_column] == 'i' || format[key_column] == 's') ? key_column : -1;
+    }
+    if (zones != nullptr && zones->format == format)
+    {
+      WherePredicate predicate(tbl, where);
+      variant_type null = std::numeric_limits<int>::min();
+      variant_type key;
+      bool bloom_key = predicate.column != -1 && predicate.equalityKey(format[predicate.column], key);
+      bool null_key = key_column != -1 && std::binary_search(keys->keys.begin(), keys->keys.end(), null);
+      read_page.assign(zones->pages.size(), true);
+      bloom_passed.assign(zones->pages.size(), 0);
+      for (size_t page = 0; page < zones->pages.size(); page++)
       {
-        for (int i = 0; i < size; i++)
+        if (predicate.column != -1)
         {
-          if (format[i] == 's')
+          const ZoneMap::Zone &zone = zones->pages[page].zones[predicate.column];
+          bool by_nulls = zone.nulls > 0 && predicate(null);
+          bool by_values = zone.values > 0 && predicate.mayMatch(zone.min, zone.max);
+          if (zone.known && by_values && !by_nulls && bloom_key && !zone.bloom.empty())
           {
-            std::string fullString = count;
-            while (count[count.size() - 2] != '\'' && false) 
-            {
-              db_file >> count;
-              fullString += " " + count;
-            }
-
-            char type[1] = {format[i]};
-            if (fullString[fullString.size() - 1] == ',') {
-              tbl.addRecord(type, fullString.substr(1, fullString.size() - 3).c_str());
-            } else {
-              tbl.addRecord(type, fullString.substr(1, fullString.size() - 2).c_str());
-            }
+            by_values = probe(zone, zone.mayContain(key));
+            bloom_passed[page] |= by_values;
           }
-          else if (format[i] == 'f')
+          read_page[page] = !zone.known || by_nulls || by_values;
+        }
+        if (key_column != -1 && read_page[page])
+        {
+          const ZoneMap::Zone &zone = zones->pages[page].zones[key_column];
+          bool by_nulls = null_key && zone.nulls > 0;
+          auto from = keys->keys.end(), to = keys->keys.end();
+          if (zone.known && zone.values > 0 && zone.min.index() == zone.max.index())
           {
-            char type[1] = {format[i]};
-            tbl.addRecord(type, std::stod(&count[0]));
+            from = std::lower_bound(keys->keys.begin(), keys->keys.end(), zone.min);
+            to = std::upper_bound(from, keys->keys.end(), zone.max);
           }
-          else if (format[i] == 'i')
+          bool by_values = from != to;
+          if (by_values && !by_nulls && !zone.bloom.empty())
           {
-            char type[1] = {format[i]};
-            tbl.addRecord(type, std::stoi(&count[0]));
+            by_values = probe(zone, std::any_of(from, to, [&](const variant_type &value)
+                                                { return zone.mayContain(value); }));
+            bloom_passed[page] |= by_values << 1;
           }
+          read_page[page] = !zone.known || by_nulls || by_values;
+        }
+      }
+    }
+    // Columns left out of the select are never decoded. A table needs a column
+    // to count its rows by, so the first one is kept when nothing else is.
+    std::vector<char> keep(size, columns == nullptr);
+    if (columns != nullptr)
+    {
+      TableObject projected(tableName);
+      projected.bloom_filters = tbl.bloom_filters;
+      for (int i = 0; i < size; i++)
+      {
+        keep[i] = std::find(columns->begin(), columns->end(), tbl.fields[i].first) != columns->end();
+      }
+      if (size > 0 && std::find(keep.begin(), keep.end(), true) == keep.end())
+      {
+        keep[0] = true;
+      }
+      for (int i = 0; i < size; i++)
+      {
+        if (keep[i])
+        {
+          projected.fields.push_back(tbl.fields[i]);
+        }
+      }
+      projected.fields_size = projected.fields.size();
+      tbl = std::move(projected);
+    }
+    // Read in row
+    //db_file >> count;
+    size_t rows_read = 0;
+    size_t file_row = 0;
+    // Row of the table each loaded page starts at
+    std::vector<size_t> page_start(read_page.size(), std::numeric_limits<size_t>::max());
+    // A failed read is the end of the rows; eof alone is set by reading the last value
+    while (!db_file.fail() && rows_read < max_rows)
+    {
+      if (file_row % ZoneMap::PAGE_ROWS == 0 && file_row / ZoneMap::PAGE_ROWS < read_page.size())
+      {
+        size_t page = file_row / ZoneMap::PAGE_ROWS;
+        size_t wanted = page;
+        while (wanted < read_page.size() && !read_page[wanted])
+        {
+          wanted++;
+        }
+        if (wanted == read_page.size())
+        {
+          break;
+        }
+        if (wanted != page)
+        {
+          db_file.seekg(zones->pages[wanted].offset);
           db_file >> count;
+          file_row = wanted * ZoneMap::PAGE_ROWS;
         }
+        page_start[wanted] = rows_read;
       }
+      file_row++;
+      // Loading a large table is often most of a query's time
+      if (rows_read++ % SCAN_MORSEL_ROWS == 0)
+      {
+        ThreadPool::checkCancelled();
+      }
+      for (int i = 0; i < size; i++)
+      {
+        // addRecord reads the format until the terminator
+        char type[2] = {format[i], '\0'};
+        if (!keep[i])
+        {
+          // Columns left out are stepped over without being decoded
+          db_file >> count;
+          continue;
+        }
+        if (format[i] == 's')
+        {
+          std::string fullString = count;
+          while (count[count.size() - 2] != '\'' && false) 
+          {
+            db_file >> count;
+            fullString += " " + count;
+          }
 
-      res.insertTable(tbl);
-      db_file.close();
+          if (fullString[fullString.size() - 1] == ',') {
+            tbl.addRecord(type, fullString.substr(1, fullString.size() - 3).c_str());
+          } else {
+            tbl.addRecord(type, fullString.substr(1, fullString.size() - 2).c_str());
+          }
+        }
+        else if (format[i] == 'f')
+        {
+          tbl.addRecord(type, std::stod(&count[0]));
+        }
+        else if (format[i] == 'i')
+        {
+          tbl.addRecord(type, std::stoi(&count[0]));
+        }
+        db_file >> count;
+      }
     }
+    std::streamoff read_end = timer.enabled() && !db_file.fail() ? (std::streamoff)db_file.tellg() : -1;
+    db_file.close();
 
+    // A page the Bloom filter let through that has no matching row was a false positive
+    if (std::any_of(bloom_passed.begin(), bloom_passed.end(), [](char passed)
+                    { return passed != 0; }))
+    {
+      WherePredicate predicate(tbl, where);
+      int key_col = -1;
+      for (int col = 0; keys != nullptr && col < (int)tbl.fields.size(); col++)
+      {
+        key_col = tbl.fields[col].first == keys->column ? col : key_col;
+      }
+      size_t loaded = tbl.fields_size == 0 ? 0 : tbl.records.size() / tbl.fields_size;
+      for (size_t page = 0; page < bloom_passed.size(); page++)
+      {
+        size_t from = page_start[page];
+        if (bloom_passed[page] == 0 || from == std::numeric_limits<size_t>::max() ||
+            from + zones->pages[page].rows > loaded)
+        {
+          continue;
+        }
+        bool matched = false;
+        for (size_t row = from; row < from + zones->pages[page].rows && !matched; row++)
+        {
+          matched = (!(bloom_passed[page] & 1) || predicate.accepts(tbl, row)) &&
+                    (!(bloom_passed[page] & 2) || key_col == -1 ||
+                     std::binary_search(keys->keys.begin(), keys->keys.end(), tbl.records[row * tbl.fields_size + key_col]));
+        }
+        bloom_stats.false_positives += !matched;
+      }
+    }
+    if (timer.enabled())
+    {
+      std::error_code error;
+      uintmax_t file_size = fs::file_size(proto_path, error);
+      uintmax_t end = read_end < 0 ? file_size : read_end;
+      // The file up to where reading stopped, less the pages skipped
+      std::vector<std::pair<uintmax_t, uintmax_t>> spans{{0, end}};
+      for (size_t page = 0; page < read_page.size(); page++)
+      {
+        uintmax_t from = zones->pages[page].offset;
+        uintmax_t to = page + 1 < zones->pages.size() ? zones->pages[page + 1].offset : file_size;
+        if (!read_page[page] && from < spans.back().second)
+        {
+          spans.back().second = std::max(spans.back().first, from);
+          spans.emplace_back(std::min(to, end), end);
+        }
+      }
+      timer.op.addRead(spans, resident);
+      timer.op.rows_in = file_row;
+      timer.op.rows_out = tbl.fields_size == 0 ? 0 : tbl.records.size() / tbl.fields_size;
+      timer.op.memory = QueryProfile::tableBytes(tbl);
+    }
+    return tbl;
+  }
+
+  /**
+   * @brief Load database and parse table into the database and table classes
+   *
+   * Table files are parsed concurrently on the thread pool, largest first,
+   * so loading is bounded by the largest table rather than the sum of all.
+   * Tables keep the directory order and their parse times are recorded.
+   *
+   * @param db_name the database name
+   * @return DatabaseObject the loaded database
+   */
+  static DatabaseObject loadDB(std::string db_name)
+  {
+    DatabaseObject res(db_name);
+    auto db_path = (dataPath() / db_name);
+
+    std::vector<fs::path> table_paths;
+    for (const auto &file : fs::directory_iterator(db_path))
+    {
+      std::string path_str = file.path().string();
+      path_str = path_str.substr(path_str.length() - 5, path_str.length());
+      if (path_str != "proto" && path_str != ".lock") {
+        continue;
+      }
+      table_paths.push_back(file.path());
+    }
+
+    // Hand out the largest files first so a big table doesn't start last
+    std::vector<std::pair<uintmax_t, int>> by_size;
+    for (size_t i = 0; i < table_paths.size(); i++)
+    {
+      by_size.emplace_back(fs::file_size(table_paths[i]), i);
+    }
+    std::sort(by_size.rbegin(), by_size.rend());
+
+    std::vector<TableObject> tables(table_paths.size(), TableObject(""));
+    std::vector<double> load_ms(table_paths.size(), 0);
+    ThreadPool::shared().parallelFor(0, by_size.size(), 1, [&](size_t from, size_t to) {
+      for (size_t i = from; i < to; i++) {
+        int idx = by_size[i].second;
+        auto start = std::chrono::steady_clock::now();
+        tables[idx] = loadTBL(table_paths[idx]);
+        load_ms[idx] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        // Zone maps and statistics are cached with the catalog, so readers don't parse them per query
+        ZoneMap::open(table_paths[idx]);
+        TableStats::open(table_paths[idx]);
+      }
+    });
+
+    for (size_t i = 0; i < tables.size(); i++)
+    {
+      res.load_timings.emplace_back(tables[i].name(), load_ms[i]);
+      res.insertTable(std::move(tables[i]));
+    }
     return res;
   }
 };
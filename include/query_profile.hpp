@@ -0,0 +1,155 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: What each operator of a statement did while EXPLAIN ANALYZE
+ * ran it: wall time, rows in and out, bytes of table files read, how many
+ * of their pages were already in the OS page cache, which stands in for a
+ * buffer pool since tables are read through it, and the memory the
+ * operator's output holds. Operators only record when a profile is active
+ * on their thread, so statements run normally pay for a clock read.
+ */
+#ifndef __QUERY_PROFILE_HPP__
+#define __QUERY_PROFILE_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+#include <data_objs.hpp>
+
+class QueryProfile
+{
+public:
+  struct Operator
+  {
+    // What ran, e.g. "scan Product", "join", "aggregate", "sort", "project"
+    std::string key;
+    double ms = 0;
+    size_t rows_in = 0;
+    size_t rows_out = 0;
+    size_t bytes_read = 0;
+    // OS pages of table files that were in the page cache when read, and those that weren't
+    size_t cache_hits = 0;
+    size_t cache_misses = 0;
+    // Bytes of the rows the operator holds when done
+    size_t memory = 0;
+
+    /**
+     * @brief Counts the bytes of a file read and whether its pages were cached
+     *
+     * @param spans [from, to) byte ranges of the file read, in order
+     * @param resident flags of the file's OS pages from MappedFile::residentPages, taken before reading
+     */
+    void addRead(const std::vector<std::pair<uintmax_t, uintmax_t>> &spans, const std::vector<unsigned char> &resident)
+    {
+      size_t page_size = sysconf(_SC_PAGESIZE);
+      size_t counted = std::numeric_limits<size_t>::max();
+      for (const auto &[from, to] : spans)
+      {
+        if (to <= from)
+        {
+          continue;
+        }
+        bytes_read += to - from;
+        for (size_t page = from / page_size; page <= (to - 1) / page_size && page < resident.size(); page++)
+        {
+          // A page shared by two spans counts once
+          if (page != counted)
+          {
+            (resident[page] & 1 ? cache_hits : cache_misses)++;
+            counted = page;
+          }
+        }
+      }
+    }
+  };
+
+  // In the order the operators finished
+  std::vector<Operator> operators;
+
+  // The profile operators on this thread record into, null when none is active
+  static QueryProfile *&active()
+  {
+    static thread_local QueryProfile *profile = nullptr;
+    return profile;
+  }
+
+  /**
+   * @brief Makes a profile active on this thread while it lives
+   */
+  class Scope
+  {
+    QueryProfile *previous;
+
+  public:
+    explicit Scope(QueryProfile *profile) : previous(active())
+    {
+      active() = profile;
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    ~Scope()
+    {
+      active() = previous;
+    }
+  };
+
+  /**
+   * @brief Times an operator from construction and records it into the active
+   * profile when it goes out of scope. Fill in op while it runs.
+   */
+  class Timer
+  {
+    QueryProfile *profile;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    Operator op;
+
+    explicit Timer(std::string key) : profile(active()), start(std::chrono::steady_clock::now())
+    {
+      op.key = std::move(key);
+    }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    // Whether anything is recorded, so the counting can be skipped otherwise
+    bool enabled() const
+    {
+      return profile != nullptr;
+    }
+
+    ~Timer()
+    {
+      if (profile != nullptr)
+      {
+        op.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        profile->operators.push_back(std::move(op));
+      }
+    }
+  };
+
+  /**
+   * @brief Bytes a table's rows take, with the strings too long to be stored inline
+   */
+  static size_t tableBytes(const TableObject &tbl)
+  {
+    size_t bytes = tbl.records.capacity() * sizeof(variant_type);
+    for (const variant_type &value : tbl.records)
+    {
+      if (auto text = std::get_if<std::string>(&value))
+      {
+        bytes += text->capacity() > std::string().capacity() ? text->capacity() + 1 : 0;
+      }
+    }
+    return bytes;
+  }
+};
+
+#endif /* __QUERY_PROFILE_HPP__ */
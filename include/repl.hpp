@@ -2,65 +2,60 @@
  * AUTHOR: VINCENT PHAM
  * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
  * FILE DESC: REPL loop to handle errors and take stdin as input.
+ * A thin client of the library API in database.hpp that prints results.
  */
 #ifndef __REPL_HPP__
 #define __REPL_HPP__
 
-#include <lexer.hpp>
-#include <parser.hpp>
-#include <tokens.hpp>
-#include <ast.hpp>
 #include <iostream>
 #include <string>
 #include <unistd.h>
 #include <stdio.h>
-#include <data_objs.hpp>
-#include <proto_generator.hpp>
-#include <objects.hpp>
-#include <evaluator.hpp>
+#include <database.hpp>
 
 // Empty prompt if stdin is not from tty
 const std::string repl_prompt = isatty(fileno(stdin)) ? ">> " : "";
 
-void repl()
+/**
+ * @brief Prints a statement's result the way the interpreter always has:
+ * rows as a table, other statements as their message and errors to stderr
+ */
+inline void printResult(const ResultSet &result)
+{
+  if (result.status() == Status::ERROR)
+  {
+    std::cerr << result.message() << "\n";
+  }
+  else if (result.hasRows())
+  {
+    std::cout << result.format() << "\n";
+  }
+  else if (!result.message().empty())
+  {
+    std::cout << result.message() << "\n";
+  }
+}
+
+inline void repl(Connection &connection)
 {
-  DatabaseObject *current_database = new DatabaseObject("nil");
   std::string input;
-  cout << "Vincent Pham - CS457 Database Management Systems\n";
-  cout << "PA4 - SQL Lexer, Parser, and Evaluator\n";
+  std::cout << "Vincent Pham - CS457 Database Management Systems\n";
+  std::cout << "PA4 - SQL Lexer, Parser, and Evaluator\n";
   while (true)
   {
     std::cout << repl_prompt;
-    getline(cin, input);
-    std::cout << input << std::endl;
-    Lexer lexer(input);
-    SQLParser parser(&lexer);
-    try
-    {
-      ast::Program *program = parser.parseSql();
-      eval(program, current_database);
-    }
-    catch (const expected_token_error &e)
-    {
-      cerr << e.what() << endl;
-    }
-    catch (const unknown_type_error &e)
+    if (!getline(std::cin, input))
     {
-      cerr << e.what() << endl;
+      break;
     }
-    catch (const unassigned_parse_function_error &e)
-    {
-      cerr << e.what() << endl;
-    }
-    catch (const unknown_command_error &e)
-    {
-      cerr << e.what() << endl;
-    }
-    catch (const runtime_error &e)
+    std::cout << input << std::endl;
+    // Each line runs like a small script, sharing the session's plan cache
+    if (!connection.executeScript(input, printResult))
     {
-      cerr << e.what() << endl;
+      break;
     }
+    std::cout.flush();
   }
 }
 
-#endif /* __REPL_HPP__ */
\ No newline at end of file
+#endif /* __REPL_HPP__ */
@@ -0,0 +1,190 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Runs whole scripts. The script is split into statements on
+ * ';' across lines, parsed a batch at a time with a single parser and
+ * executed, handing each result to the caller instead of printing it.
+ * Statements with a cached plan for their fingerprint skip the parser.
+ */
+#ifndef __SCRIPT_HPP__
+#define __SCRIPT_HPP__
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <arena.hpp>
+#include <lexer.hpp>
+#include <parser.hpp>
+#include <data_objs.hpp>
+#include <evaluator.hpp>
+#include <objects.hpp>
+#include <status.hpp>
+#include <plan_cache.hpp>
+#include <thread_pool.hpp>
+
+/**
+ * @brief Splits a script into statements. A statement runs up to and including
+ * its ';', ignoring ones inside quotes or '--' comments. Interpreter commands
+ * such as .EXIT don't need a ';' and end with their line.
+ *
+ * @param script the whole script
+ * @return std::vector<std::string_view> statements viewing the script, without leading blanks or comments
+ */
+inline std::vector<std::string_view> splitStatements(std::string_view script)
+{
+  std::vector<std::string_view> statements;
+  size_t start = std::string_view::npos;
+  bool quoted = false;
+  bool command = false;
+  for (size_t i = 0; i < script.size(); i++)
+  {
+    char ch = script[i];
+    if (!quoted && ch == '-' && i + 1 < script.size() && script[i + 1] == '-')
+    {
+      while (i + 1 < script.size() && script[i + 1] != '\n')
+      {
+        i++;
+      }
+      continue;
+    }
+    if (start == std::string_view::npos)
+    {
+      if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')
+      {
+        continue;
+      }
+      start = i;
+      command = ch == '.';
+    }
+    if (ch == '\'')
+    {
+      quoted = !quoted;
+    }
+    else if ((!quoted && ch == ';') || (command && ch == '\n'))
+    {
+      size_t end = ch == ';' ? i + 1 : i;
+      statements.push_back(script.substr(start, end - start));
+      start = std::string_view::npos;
+      quoted = false;
+    }
+  }
+  if (start != std::string_view::npos)
+  {
+    statements.push_back(script.substr(start));
+  }
+  return statements;
+}
+
+// Statements parsed before executing them, and so kept in the arena together
+const size_t SCRIPT_BATCH_STATEMENTS = 4096;
+
+// Receives the result of every statement in script order
+using ResultHandler = std::function<void(std::unique_ptr<object::Result>)>;
+
+/**
+ * @brief Parses and runs every statement of a script. Errors, exceptions a
+ * statement throws included, are reported in script order as ERROR and
+ * don't stop the statements after them. When the thread
+ * runs under a ThreadPool::CancelScope, a cancelled script reports every
+ * statement it didn't finish as CANCELLED.
+ *
+ * @param script text of the script, which has to outlive the call
+ * @param current_database database in use, updated by the statements
+ * @param handle called with the result of each statement
+ * @return bool false when the script ran .EXIT, the statements after it don't run
+ */
+inline bool runScript(std::string_view script, DatabaseObject *current_database, const ResultHandler &handle)
+{
+  std::vector<std::string_view> statements = splitStatements(script);
+  Arena arena;
+  Lexer empty("");
+  SQLParser parser(&empty, &arena);
+  // Program, or plan and literals when the statement hit the plan cache,
+  // or the message of the error that stopped its parse
+  struct Parsed
+  {
+    ast::Program *program = nullptr;
+    std::shared_ptr<PreparedStatement> plan;
+    Fingerprint fingerprint;
+    std::string error;
+  };
+  std::vector<Parsed> batch;
+  batch.reserve(std::min(statements.size(), SCRIPT_BATCH_STATEMENTS));
+  for (size_t from = 0; from < statements.size(); from += SCRIPT_BATCH_STATEMENTS)
+  {
+    size_t to = std::min(statements.size(), from + SCRIPT_BATCH_STATEMENTS);
+    for (size_t i = from; i < to; i++)
+    {
+      Parsed parsed;
+      try
+      {
+        parsed.fingerprint = fingerprintStatement(statements[i]);
+        if (parsed.fingerprint.cacheable)
+        {
+          parsed.plan = planCache().get(parsed.fingerprint.text);
+        }
+        if (parsed.plan == nullptr || parsed.plan->paramCount() != parsed.fingerprint.literals.size())
+        {
+          parsed.plan = nullptr;
+          Lexer lexer(statements[i]);
+          parser.reset(&lexer);
+          parsed.program = parser.parseSql();
+        }
+      }
+      catch (const std::exception &e)
+      {
+        parsed.error = e.what();
+      }
+      batch.push_back(std::move(parsed));
+    }
+    for (auto &parsed : batch)
+    {
+      // A statement without a plan or program is one that failed to parse
+      size_t count = parsed.plan != nullptr ? 1 : (parsed.program != nullptr ? parsed.program->statements.size() : 1);
+      for (size_t i = 0; i < count; i++)
+      {
+        std::unique_ptr<object::Result> result;
+        try
+        {
+          ThreadPool::checkCancelled();
+          if (parsed.plan != nullptr)
+          {
+            result.reset(parsed.plan->executeLiterals(parsed.fingerprint.literals, current_database));
+          }
+          else if (parsed.program != nullptr)
+          {
+            result.reset(eval(parsed.program->statements[i], current_database));
+          }
+          else
+          {
+            result.reset(new object::Result(Status::ERROR, -1, parsed.error));
+          }
+        }
+        catch (const QueryCancelled &e)
+        {
+          result.reset(new object::Result(Status::CANCELLED, -1, e.what()));
+        }
+        catch (const std::exception &e)
+        {
+          // Whatever a statement throws fails it, and not the process
+          result.reset(new object::Result(Status::ERROR, -1, e.what()));
+        }
+        bool exit = result->status == Status::EXIT;
+        handle(std::move(result));
+        if (exit)
+        {
+          return false;
+        }
+      }
+    }
+    batch.clear();
+    arena.release();
+  }
+  return true;
+}
+
+#endif /* __SCRIPT_HPP__ */
@@ -0,0 +1,101 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: State that belongs to a session rather than to the process:
+ * its data directory, the transaction opened by BEGIN TRANSACTION, the
+ * statements PREPAREd by name and the plan cache. Every Connection has its
+ * own and makes it active on the thread running its statements. Statements
+ * run outside of a Connection share the process session, which keeps its
+ * tables in paths::DATA_PATH.
+ */
+#ifndef __SESSION_HPP__
+#define __SESSION_HPP__
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <experimental/filesystem>
+#include <evaluator.hpp>
+#include <plan_cache.hpp>
+#include <prepared.hpp>
+#include <proto_generator.hpp>
+
+namespace fs = std::experimental::filesystem;
+
+class SessionState
+{
+public:
+  // Directory holding the session's databases, empty for paths::DATA_PATH
+  fs::path data_path;
+  TransactionState transaction;
+  std::unordered_map<std::string, PreparedStatement> prepared_statements;
+  PlanCache plan_cache;
+
+  SessionState() = default;
+  explicit SessionState(fs::path data_path) : data_path(std::move(data_path)) {}
+
+  SessionState(const SessionState &) = delete;
+  SessionState &operator=(const SessionState &) = delete;
+
+  // The session whose statements run on this thread, null when none is active
+  static SessionState *&active()
+  {
+    static thread_local SessionState *session = nullptr;
+    return session;
+  }
+
+  // The session of statements run outside of a Connection
+  static SessionState &process()
+  {
+    static SessionState session;
+    return session;
+  }
+
+  static SessionState &current()
+  {
+    return active() != nullptr ? *active() : process();
+  }
+
+  /**
+   * @brief Makes a session active on this thread while it lives, its data
+   * directory included
+   */
+  class Scope
+  {
+    SessionState *previous;
+    const fs::path *previous_path;
+
+  public:
+    explicit Scope(SessionState *session) : previous(active()), previous_path(paths::session_data_path)
+    {
+      active() = session;
+      paths::session_data_path = session->data_path.empty() ? nullptr : &session->data_path;
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    ~Scope()
+    {
+      active() = previous;
+      paths::session_data_path = previous_path;
+    }
+  };
+};
+
+inline TransactionState &currentTransaction()
+{
+  return SessionState::current().transaction;
+}
+
+inline std::unordered_map<std::string, PreparedStatement> &preparedStatements()
+{
+  return SessionState::current().prepared_statements;
+}
+
+inline PlanCache &planCache()
+{
+  return SessionState::current().plan_cache;
+}
+
+#endif /* __SESSION_HPP__ */
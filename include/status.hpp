@@ -0,0 +1,28 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Status of an executed statement, shared by the evaluator
+ * and the library API.
+ */
+#ifndef __STATUS_HPP__
+#define __STATUS_HPP__
+
+/**
+ * @brief How a statement ended
+ *
+ * OK         the statement ran
+ * FAILED     the statement ran and refused, e.g. the table doesn't exist
+ * ERROR      the statement couldn't be parsed or threw while running
+ * EXIT       .EXIT was run, nothing after it runs
+ * CANCELLED  the statement was cancelled or timed out before it finished
+ */
+enum class Status : char
+{
+  OK,
+  FAILED,
+  ERROR,
+  EXIT,
+  CANCELLED,
+};
+
+#endif /* __STATUS_HPP__ */
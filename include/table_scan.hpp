@@ -0,0 +1,193 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Lazy scan over a loaded table, returned by SELECT. The
+ * where expression and column list are resolved once and rows are only
+ * filtered as they are asked for, so a cursor can pull a large result a
+ * batch at a time instead of copying all of it. With ORDER BY the rows
+ * come from an ExternalSort instead of table order. With LIMIT the scan
+ * stops testing rows once it has returned enough.
+ */
+#ifndef __TABLE_SCAN_HPP__
+#define __TABLE_SCAN_HPP__
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <data_objs.hpp>
+#include <external_sort.hpp>
+#include <proto_generator.hpp>
+#include <query_profile.hpp>
+#include <thread_pool.hpp>
+
+class TableScan
+{
+private:
+  std::shared_ptr<const TableObject> table;
+  std::vector<int> column_list;
+  WherePredicate predicate;
+  // Next row of the table to test
+  size_t next_row = 0;
+  // Rows in order when the scan is ordered
+  std::unique_ptr<ExternalSort> sorter;
+  // Rows of OFFSET still to skip and of LIMIT still to return
+  size_t skip = 0;
+  size_t remaining = std::numeric_limits<size_t>::max();
+
+  size_t rowCount() const
+  {
+    return table->fields_size == 0 ? 0 : table->records.size() / table->fields_size;
+  }
+
+  bool sourceDone() const
+  {
+    return sorter != nullptr ? sorter->done() : next_row >= rowCount();
+  }
+
+  // Next rows of the source in order, before OFFSET and LIMIT
+  void pull(size_t count, std::vector<int> &rows)
+  {
+    if (sorter != nullptr)
+    {
+      sorter->next(count, rows);
+      return;
+    }
+    rows.clear();
+    size_t total = rowCount();
+    for (; next_row < total && rows.size() < count; next_row++)
+    {
+      if (predicate.accepts(*table, next_row))
+      {
+        rows.push_back(next_row);
+      }
+    }
+  }
+
+public:
+  /**
+   * @param table the table to read, kept alive by the scan
+   * @param filter [default: nullptr] column names to select, every column when null or holding *
+   * @param where [default: nullptr] (column_name operator value) the rows have to pass
+   */
+  TableScan(std::shared_ptr<const TableObject> table,
+            std::vector<std::string> *filter = nullptr,
+            std::tuple<std::string, std::string, std::string> *where = nullptr)
+      : table(table),
+        column_list(ProtoGenerator::selectColumns(*table, filter)),
+        predicate(*table, where)
+  {
+  }
+
+  const TableObject &source() const
+  {
+    return *table;
+  }
+
+  std::shared_ptr<const TableObject> sharedSource() const
+  {
+    return table;
+  }
+
+  /**
+   * @brief Columns of the source table that are selected, in order
+   */
+  const std::vector<int> &columns() const
+  {
+    return column_list;
+  }
+
+  bool done() const
+  {
+    return remaining == 0 || sourceDone();
+  }
+
+  /**
+   * @brief Skips the first offset rows and stops after count more, for OFFSET and LIMIT.
+   * Set before orderBy so the sort only keeps the rows that are returned.
+   */
+  void limit(size_t offset, size_t count)
+  {
+    skip = offset;
+    remaining = count;
+  }
+
+  /**
+   * @brief Returns the rows ordered by keys instead of in table order. The rows
+   * left that pass the where expression are sorted here, spilling to disk
+   * past the sort's memory budget.
+   *
+   * @param keys columns of the source table, most significant first
+   */
+  void orderBy(const std::vector<ExternalSort::Key> &keys)
+  {
+    QueryProfile::Timer timer("sort");
+    size_t wanted = remaining == std::numeric_limits<size_t>::max() ? 0 : skip + remaining;
+    sorter = std::make_unique<ExternalSort>(*table, keys, 0, wanted);
+    size_t added = 0;
+    timer.op.rows_in = rowCount() - next_row;
+    for (size_t total = rowCount(); next_row < total; next_row++)
+    {
+      if (next_row % ProtoGenerator::SCAN_MORSEL_ROWS == 0)
+      {
+        ThreadPool::checkCancelled();
+      }
+      if (predicate.accepts(*table, next_row))
+      {
+        sorter->add(next_row);
+        added++;
+      }
+    }
+    sorter->finish();
+    // A top-k sort keeps only the rows it returns
+    timer.op.rows_out = wanted == 0 ? added : std::min(added, wanted);
+    timer.op.memory = sorter->peakBytes();
+  }
+
+  /**
+   * @brief Finds up to count more rows that pass the where expression
+   *
+   * @param count most rows to return
+   * @param rows filled with the row numbers of the source table
+   */
+  void next(size_t count, std::vector<int> &rows)
+  {
+    while (skip > 0 && !sourceDone())
+    {
+      pull(std::min<size_t>(skip, ProtoGenerator::SCAN_MORSEL_ROWS), rows);
+      skip -= rows.size();
+    }
+    pull(std::min(count, remaining), rows);
+    if (remaining != std::numeric_limits<size_t>::max())
+    {
+      remaining -= rows.size();
+    }
+  }
+
+  /**
+   * @brief Copies every remaining row into a table. Unlimited scans filter in
+   * parallel, limited ones stop once they have enough rows.
+   */
+  TableObject drain()
+  {
+    std::vector<int> rows;
+    if (sorter == nullptr && skip == 0 && remaining == std::numeric_limits<size_t>::max())
+    {
+      rows = ProtoGenerator::getWhereRows(*table, predicate, next_row);
+      next_row = rowCount();
+    }
+    else
+    {
+      std::vector<int> batch;
+      while (!done())
+      {
+        next(ProtoGenerator::SCAN_MORSEL_ROWS, batch);
+        rows.insert(rows.end(), batch.begin(), batch.end());
+      }
+    }
+    return ProtoGenerator::projectRows(*table, column_list, rows);
+  }
+};
+
+#endif /* __TABLE_SCAN_HPP__ */
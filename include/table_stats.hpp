@@ -0,0 +1,389 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Statistics of a table collected by ANALYZE: its row count and,
+ * per column, the blank count, a HyperLogLog sketch of the distinct values
+ * and an equi-depth histogram. They are kept next to the table in
+ * <table>.proto.stats and, once a table has them, refreshed by every write:
+ * appended rows are folded in and rewrites collect them again in the same
+ * pass. Values are summarised as the table reader decodes them. Like the
+ * zone map, the sidecar records a SidecarVersion that the cache checks.
+ */
+#ifndef __TABLE_STATS_HPP__
+#define __TABLE_STATS_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include <experimental/filesystem>
+#include <data_objs.hpp>
+#include <thread_pool.hpp>
+#include <zone_map.hpp>
+
+namespace fs = std::experimental::filesystem;
+
+class TableStats
+{
+public:
+  // A column has 2^HLL_BITS HyperLogLog registers, a standard error of about 1.6%
+  static constexpr int HLL_BITS = 12;
+  static constexpr size_t HLL_REGISTERS = size_t(1) << HLL_BITS;
+  static constexpr size_t HISTOGRAM_BUCKETS = 32;
+  // Values sorted for the histogram bounds, larger columns are sampled evenly
+  static constexpr size_t HISTOGRAM_SAMPLE = 1 << 16;
+
+  struct Column
+  {
+    std::string name;
+    // Format char, see TableObject::getFormat
+    char type = 'i';
+    size_t nulls = 0;
+    // Values that weren't blank
+    size_t values = 0;
+    std::vector<uint8_t> registers = std::vector<uint8_t>(HLL_REGISTERS, 0);
+    // Bucket i holds the values in (bounds[i], bounds[i + 1]], the first one also bounds[0].
+    // Equal bounds are merged, so heavy values may get a bucket to themselves.
+    std::vector<variant_type> bounds;
+    std::vector<size_t> counts;
+
+    /**
+     * @brief Folds a decoded value that isn't blank into the sketch and histogram
+     */
+    void add(const variant_type &value)
+    {
+      values++;
+      uint64_t hash = ZoneMap::hashValue(value);
+      uint64_t rest = hash << HLL_BITS;
+      uint8_t rank = rest == 0 ? 64 - HLL_BITS + 1 : __builtin_clzll(rest) + 1;
+      uint8_t &reg = registers[hash >> (64 - HLL_BITS)];
+      reg = std::max(reg, rank);
+      if (bounds.empty())
+      {
+        bounds = {value, value};
+        counts = {0};
+      }
+      counts[bucketOf(value)]++;
+    }
+
+    /**
+     * @brief Bucket of a value, widening the first or last bucket when it's past the bounds
+     */
+    size_t bucketOf(const variant_type &value)
+    {
+      if (!(bounds[0] < value))
+      {
+        bounds[0] = value;
+        return 0;
+      }
+      size_t bucket = std::lower_bound(bounds.begin() + 1, bounds.end(), value) - (bounds.begin() + 1);
+      if (bucket == counts.size())
+      {
+        bounds.back() = value;
+        bucket--;
+      }
+      return bucket;
+    }
+
+    /**
+     * @brief HyperLogLog estimate of the distinct values, with the small range correction
+     */
+    double distinct() const
+    {
+      double m = HLL_REGISTERS, sum = 0;
+      size_t zeros = 0;
+      for (uint8_t reg : registers)
+      {
+        sum += std::ldexp(1.0, -reg);
+        zeros += reg == 0;
+      }
+      double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+      if (estimate <= 2.5 * m && zeros > 0)
+      {
+        estimate = m * std::log(m / zeros);
+      }
+      return std::min(estimate, (double)values);
+    }
+
+    double nullFraction() const
+    {
+      return nulls + values == 0 ? 0 : (double)nulls / (nulls + values);
+    }
+  };
+
+  size_t rows = 0;
+  // Rows appended since ANALYZE or the last rewrite built the histograms
+  size_t appended = 0;
+  std::vector<Column> columns;
+
+private:
+  // The table file the statistics were made for and which save of them this is
+  SidecarVersion version;
+
+  // Statistics loaded so far by table file path
+  struct Cache
+  {
+    std::mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<const TableStats>> stats;
+  };
+
+  static Cache &cache()
+  {
+    static Cache shared;
+    return shared;
+  }
+
+  static bool isNull(const variant_type &value)
+  {
+    auto val = std::get_if<int>(&value);
+    return val != nullptr && *val == std::numeric_limits<int>::min();
+  }
+
+public:
+  static fs::path pathFor(const fs::path &tbl_path)
+  {
+    return tbl_path.string() + ".stats";
+  }
+
+  /**
+   * @brief Collects the statistics of a table, a column at a time on the pool
+   *
+   * @param round_floats [default: true] round floats as they are written, off when
+   * the table holds them as the reader decoded them
+   */
+  static TableStats analyze(const TableObject &tbl, bool round_floats = true)
+  {
+    TableStats stats;
+    std::string format = tbl.getFormat();
+    size_t cols = tbl.fields.size();
+    stats.rows = cols == 0 ? 0 : tbl.records.size() / cols;
+    stats.columns.resize(format.size() == cols ? cols : 0);
+    ThreadPool::shared().parallelFor(0, stats.columns.size(), 1, [&](size_t from, size_t to)
+                                     {
+      for (size_t col = from; col < to; col++)
+      {
+        Column &column = stats.columns[col];
+        column.name = tbl.fields[col].first;
+        column.type = format[col];
+        std::vector<variant_type> decoded;
+        decoded.reserve(stats.rows);
+        for (size_t row = 0; row < stats.rows; row++)
+        {
+          const variant_type &value = tbl.records[row * cols + col];
+          variant_type out;
+          if (isNull(value))
+          {
+            column.nulls++;
+          }
+          else if (ZoneMap::decoded(column.type, value, out, round_floats))
+          {
+            decoded.push_back(std::move(out));
+          }
+        }
+        if (decoded.empty())
+        {
+          continue;
+        }
+        // Bounds at even ranks of an even sample of the values
+        size_t stride = std::max<size_t>(1, decoded.size() / HISTOGRAM_SAMPLE);
+        std::vector<variant_type> sample;
+        for (size_t i = 0; i < decoded.size(); i += stride)
+        {
+          sample.push_back(decoded[i]);
+        }
+        std::sort(sample.begin(), sample.end());
+        for (size_t bucket = 0; bucket <= HISTOGRAM_BUCKETS; bucket++)
+        {
+          const variant_type &bound = sample[bucket * (sample.size() - 1) / HISTOGRAM_BUCKETS];
+          if (column.bounds.empty() || column.bounds.back() < bound)
+          {
+            column.bounds.push_back(bound);
+          }
+        }
+        if (column.bounds.size() == 1)
+        {
+          column.bounds.push_back(column.bounds[0]);
+        }
+        column.counts.assign(column.bounds.size() - 1, 0);
+        for (const variant_type &value : decoded)
+        {
+          column.add(value);
+        }
+      } });
+    return stats;
+  }
+
+  /**
+   * @brief Folds an appended row into the statistics
+   *
+   * @param values the row's values, one per column
+   * @param round_floats [default: true] round floats as they are written, off when the
+   * values are already as the reader decodes them
+   */
+  void addRow(const variant_type *values, bool round_floats = true)
+  {
+    rows++;
+    appended++;
+    for (size_t col = 0; col < columns.size(); col++)
+    {
+      variant_type out;
+      if (isNull(values[col]))
+      {
+        columns[col].nulls++;
+      }
+      else if (ZoneMap::decoded(columns[col].type, values[col], out, round_floats))
+      {
+        columns[col].add(out);
+      }
+    }
+  }
+
+  /**
+   * @brief Writes the statistics next to the table file, which has to be fully
+   * written, and keeps them in the cache
+   */
+  void save(const fs::path &tbl_path)
+  {
+    version = SidecarVersion::next(tbl_path);
+    std::ofstream out(pathFor(tbl_path));
+    out << "stats";
+    version.write(out);
+    out << " " << rows << " " << appended << " " << columns.size() << "\n";
+    for (const Column &column : columns)
+    {
+      out << "column " << column.name << " " << column.type << " " << column.nulls << " " << column.values << " "
+          << column.counts.size() << "\n";
+      for (const variant_type &bound : column.bounds)
+      {
+        ZoneMap::writeBound(out, bound);
+        out << " ";
+      }
+      out << "\n";
+      for (size_t count : column.counts)
+      {
+        out << count << " ";
+      }
+      out << "\n";
+      static const char digits[] = "0123456789abcdef";
+      for (uint8_t reg : column.registers)
+      {
+        out << digits[reg >> 4] << digits[reg & 15];
+      }
+      out << "\n";
+    }
+    out.close();
+    std::lock_guard<std::mutex> guard(cache().lock);
+    cache().stats[tbl_path.string()] = std::make_shared<const TableStats>(*this);
+  }
+
+  /**
+   * @brief Loads the statistics of a table file
+   *
+   * @return bool false when there are none, or they were made for another version of the file
+   */
+  bool load(const fs::path &tbl_path)
+  {
+    std::ifstream in(pathFor(tbl_path));
+    std::string word;
+    size_t count = 0;
+    if (!(in >> word) || word != "stats" || !version.read(in) || !(in >> rows >> appended >> count))
+    {
+      return false;
+    }
+    if (!version.matches(tbl_path))
+    {
+      return false;
+    }
+    columns.assign(count, Column{});
+    for (Column &column : columns)
+    {
+      size_t buckets = 0;
+      if (!(in >> word >> column.name >> column.type >> column.nulls >> column.values >> buckets) || word != "column")
+      {
+        return false;
+      }
+      column.bounds.resize(buckets == 0 ? 0 : buckets + 1);
+      column.counts.resize(buckets);
+      for (variant_type &bound : column.bounds)
+      {
+        if (!(in >> std::ws) || !ZoneMap::readBound(in, column.type, bound))
+        {
+          return false;
+        }
+      }
+      for (size_t &bucket : column.counts)
+      {
+        in >> bucket;
+      }
+      std::string hex;
+      if (!(in >> hex) || hex.size() != 2 * HLL_REGISTERS)
+      {
+        return false;
+      }
+      for (size_t reg = 0; reg < HLL_REGISTERS; reg++)
+      {
+        column.registers[reg] = std::stoi(hex.substr(2 * reg, 2), nullptr, 16);
+      }
+    }
+    return !in.fail();
+  }
+
+  /**
+   * @brief The statistics of a table file, from the cache while they're the ones
+   * saved for the file or else loaded and cached
+   *
+   * @return std::shared_ptr<const TableStats> null when the table hasn't been analyzed
+   */
+  static std::shared_ptr<const TableStats> open(const fs::path &tbl_path)
+  {
+    // Checked the same way as ZoneMap::open, same size rewrites by another process included
+    SidecarVersion current;
+    if (!SidecarVersion::peek(pathFor(tbl_path), "stats", current) || !current.matches(tbl_path))
+    {
+      std::lock_guard<std::mutex> guard(cache().lock);
+      cache().stats.erase(tbl_path.string());
+      return nullptr;
+    }
+    {
+      std::lock_guard<std::mutex> guard(cache().lock);
+      auto found = cache().stats.find(tbl_path.string());
+      if (found != cache().stats.end() && found->second->version.generation == current.generation)
+      {
+        return found->second;
+      }
+    }
+    auto stats = std::make_shared<TableStats>();
+    if (!stats->load(tbl_path))
+    {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(cache().lock);
+    cache().stats[tbl_path.string()] = stats;
+    return stats;
+  }
+
+  /**
+   * @brief Whether the table has statistics to keep up to date, even stale ones
+   */
+  static bool exists(const fs::path &tbl_path)
+  {
+    return fs::exists(pathFor(tbl_path));
+  }
+
+  static void remove(const fs::path &tbl_path)
+  {
+    std::error_code error;
+    fs::remove(pathFor(tbl_path), error);
+    std::lock_guard<std::mutex> guard(cache().lock);
+    cache().stats.erase(tbl_path.string());
+  }
+};
+
+#endif /* __TABLE_STATS_HPP__ */
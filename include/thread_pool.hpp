@@ -0,0 +1,669 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Work-stealing thread pool shared by every query. Scans, joins,
+ * sorts and loads split their input into morsels which run on the workers.
+ * Each worker owns a deque; idle workers steal from the front of the others.
+ */
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * @brief Thrown from inside a query once its CancelToken is cancelled or timed out
+ */
+class QueryCancelled : public std::runtime_error
+{
+public:
+  bool timed_out;
+
+  QueryCancelled(bool timed_out)
+      : std::runtime_error(timed_out ? "!Query timed out." : "!Query cancelled."), timed_out(timed_out) {}
+};
+
+/**
+ * @brief Cooperative cancellation of a query. Copies share their state, so
+ * the caller keeps one to cancel while the query checks another between
+ * morsels through ThreadPool::checkCancelled().
+ */
+class CancelToken
+{
+private:
+  struct State
+  {
+    std::atomic<bool> cancelled{false};
+    // How long the query may run once started, max() for no limit
+    std::chrono::steady_clock::duration timeout = std::chrono::steady_clock::duration::max();
+    // Set once by start(), max() until then
+    std::atomic<std::chrono::steady_clock::rep> deadline{std::chrono::steady_clock::duration::max().count()};
+  };
+  std::shared_ptr<State> state;
+
+public:
+  CancelToken() : state(std::make_shared<State>()) {}
+
+  /**
+   * @brief A token that cancels itself once timeout has passed. The clock
+   * starts when the query does, see start(), so time spent queued doesn't count.
+   */
+  static CancelToken withTimeout(std::chrono::milliseconds timeout)
+  {
+    CancelToken token;
+    token.state->timeout = timeout;
+    return token;
+  }
+
+  void cancel()
+  {
+    state->cancelled = true;
+  }
+
+  /**
+   * @brief Starts the timeout clock, later calls keep the first start
+   */
+  void start() const
+  {
+    if (state->timeout == std::chrono::steady_clock::duration::max())
+    {
+      return;
+    }
+    auto not_started = std::chrono::steady_clock::duration::max().count();
+    auto deadline = (std::chrono::steady_clock::now() + state->timeout).time_since_epoch().count();
+    state->deadline.compare_exchange_strong(not_started, deadline);
+  }
+
+  bool timedOut() const
+  {
+    auto deadline = state->deadline.load();
+    return deadline != std::chrono::steady_clock::duration::max().count() &&
+           std::chrono::steady_clock::now().time_since_epoch().count() >= deadline;
+  }
+
+  bool cancelled() const
+  {
+    return state->cancelled || timedOut();
+  }
+};
+
+class ThreadPool
+{
+public:
+  using Task = std::function<void()>;
+
+  /**
+   * @brief Settings read once when the pool is created
+   *
+   * @param workers number of worker threads (0 uses the hardware concurrency)
+   * @param query_parallelism max workers a single query may occupy (0 means all)
+   * @param pin_workers pins workers to cpus, spreading them across NUMA nodes
+   */
+  struct Config
+  {
+    unsigned workers = 0;
+    unsigned query_parallelism = 0;
+    bool pin_workers = false;
+  };
+
+private:
+  struct Worker
+  {
+    std::mutex lock;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  Config config;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<bool> stopping{false};
+  std::atomic<size_t> queued{0};
+  std::atomic<size_t> next_victim{0};
+  std::mutex idle_lock;
+  std::condition_variable idle;
+  // Whole queries from submitQuery, guarded by idle_lock
+  std::deque<Task> queries;
+
+  // Index of the worker running on this thread or -1 outside of the pool
+  static int &workerIndex()
+  {
+    thread_local int index = -1;
+    return index;
+  }
+
+  static ThreadPool *&workerPool()
+  {
+    thread_local ThreadPool *pool = nullptr;
+    return pool;
+  }
+
+  /**
+   * @brief Pops from the back of our own deque, otherwise steals from the front of another
+   *
+   * @param self index of the calling worker or -1 for an outside thread
+   * @param task set to the task found
+   * @return true a task was found
+   */
+  bool tryPop(int self, Task &task)
+  {
+    if (self >= 0)
+    {
+      Worker &own = *workers[self];
+      std::lock_guard<std::mutex> guard(own.lock);
+      if (!own.tasks.empty())
+      {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        queued--;
+        return true;
+      }
+    }
+    size_t count = workers.size();
+    size_t start = next_victim.fetch_add(1) % count;
+    for (size_t i = 0; i < count; i++)
+    {
+      size_t victim = (start + i) % count;
+      if ((int)victim == self)
+      {
+        continue;
+      }
+      Worker &other = *workers[victim];
+      std::lock_guard<std::mutex> guard(other.lock);
+      if (!other.tasks.empty())
+      {
+        task = std::move(other.tasks.front());
+        other.tasks.pop_front();
+        queued--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void workerLoop(int index)
+  {
+    workerIndex() = index;
+    workerPool() = this;
+    Task task;
+    while (true)
+    {
+      if (tryPop(index, task))
+      {
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> guard(idle_lock);
+      // Morsels go first so running queries finish before new ones start
+      if (!queries.empty())
+      {
+        task = std::move(queries.front());
+        queries.pop_front();
+        guard.unlock();
+        task();
+        task = nullptr;
+        continue;
+      }
+      idle.wait(guard, [this]()
+                { return stopping || queued > 0 || !queries.empty(); });
+      if (stopping && queued == 0 && queries.empty())
+      {
+        return;
+      }
+    }
+  }
+
+  /**
+   * @brief Lists cpus ordered so that consecutive workers land on different NUMA nodes
+   *
+   * @return std::vector<int> cpu ids, empty when the topology is unknown
+   */
+  static std::vector<int> numaCpuOrder()
+  {
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0;; node++)
+    {
+      std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      if (!cpulist)
+      {
+        break;
+      }
+      // Format: 0-3,8-11
+      std::vector<int> cpus;
+      std::string range;
+      while (std::getline(cpulist, range, ','))
+      {
+        size_t dash = range.find('-');
+        try
+        {
+          int first = std::stoi(range.substr(0, dash));
+          int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+          for (int cpu = first; cpu <= last; cpu++)
+          {
+            cpus.push_back(cpu);
+          }
+        }
+        catch (const std::invalid_argument &ia) {}
+      }
+      nodes.push_back(cpus);
+    }
+    std::vector<int> order;
+    for (size_t i = 0;; i++)
+    {
+      bool added = false;
+      for (auto &cpus : nodes)
+      {
+        if (i < cpus.size())
+        {
+          order.push_back(cpus[i]);
+          added = true;
+        }
+      }
+      if (!added)
+      {
+        break;
+      }
+    }
+    if (order.empty())
+    {
+      for (unsigned cpu = 0; cpu < std::thread::hardware_concurrency(); cpu++)
+      {
+        order.push_back(cpu);
+      }
+    }
+    return order;
+  }
+
+  void pinWorkers()
+  {
+#if defined(__linux__)
+    std::vector<int> cpus = numaCpuOrder();
+    if (cpus.empty())
+    {
+      return;
+    }
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[i % cpus.size()], &set);
+      pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpu_set_t), &set);
+    }
+#endif
+  }
+
+  static Config &sharedConfig()
+  {
+    static Config config;
+    return config;
+  }
+
+  static std::atomic<bool> &sharedStarted()
+  {
+    static std::atomic<bool> started{false};
+    return started;
+  }
+
+  // The config the shared pool is made with, after which it can't change
+  static Config startShared()
+  {
+    sharedStarted() = true;
+    return sharedConfig();
+  }
+
+  static unsigned &queryLimit()
+  {
+    thread_local unsigned limit = 0;
+    return limit;
+  }
+
+  // Token of the query running on this thread, null outside of a cancellable query
+  static const CancelToken *&currentToken()
+  {
+    thread_local const CancelToken *token = nullptr;
+    return token;
+  }
+
+public:
+  ThreadPool(Config config) : config(config)
+  {
+    unsigned count = config.workers;
+    if (count == 0)
+    {
+      count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    this->config.workers = count;
+    for (unsigned i = 0; i < count; i++)
+    {
+      workers.emplace_back(new Worker());
+    }
+    for (unsigned i = 0; i < count; i++)
+    {
+      workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, (int)i);
+    }
+    if (config.pin_workers)
+    {
+      pinWorkers();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> guard(idle_lock);
+      stopping = true;
+    }
+    idle.notify_all();
+    for (auto &worker : workers)
+    {
+      worker->thread.join();
+    }
+  }
+
+  /**
+   * @brief Process wide pool used by the query operators
+   */
+  static ThreadPool &shared()
+  {
+    static ThreadPool pool(startShared());
+    return pool;
+  }
+
+  /**
+   * @brief Sets the config of the shared pool, which has to be done before its first use
+   *
+   * @return bool false when the shared pool is already running, its config is kept then
+   */
+  static bool configure(Config config)
+  {
+    if (sharedStarted())
+    {
+      return false;
+    }
+    sharedConfig() = config;
+    return true;
+  }
+
+  unsigned size() const
+  {
+    return config.workers;
+  }
+
+  /**
+   * @brief Number of workers a parallel operator may use on this thread.
+   * Bounded by the query scope, the pool config and the pool size.
+   */
+  unsigned parallelism() const
+  {
+    unsigned limit = size();
+    if (config.query_parallelism > 0)
+    {
+      limit = std::min(limit, config.query_parallelism);
+    }
+    if (queryLimit() > 0)
+    {
+      limit = std::min(limit, queryLimit());
+    }
+    return limit;
+  }
+
+  /**
+   * @brief Limits the parallelism of every operator run by this thread until destroyed.
+   * Used per query so one large SELECT can't occupy every worker.
+   */
+  class QueryScope
+  {
+    unsigned previous;
+
+  public:
+    QueryScope(unsigned limit) : previous(queryLimit())
+    {
+      queryLimit() = limit;
+    }
+    ~QueryScope()
+    {
+      queryLimit() = previous;
+    }
+  };
+
+  /**
+   * @brief Makes the query run by this thread cancellable by token until destroyed,
+   * starting its timeout. Operators run by the pool for the query check the same token.
+   */
+  class CancelScope
+  {
+    const CancelToken *previous;
+
+  public:
+    CancelScope(const CancelToken *token) : previous(currentToken())
+    {
+      if (token != nullptr)
+      {
+        token->start();
+      }
+      currentToken() = token;
+    }
+    ~CancelScope()
+    {
+      currentToken() = previous;
+    }
+  };
+
+  /**
+   * @brief Throws QueryCancelled if the query run by this thread was cancelled or timed out.
+   * Called between morsels by parallelFor and inside long serial loops.
+   */
+  static void checkCancelled()
+  {
+    const CancelToken *token = currentToken();
+    if (token != nullptr && token->cancelled())
+    {
+      throw QueryCancelled(token->timedOut());
+    }
+  }
+
+  /**
+   * @brief Queues a whole query for an idle worker. Unlike submit() it is never
+   * picked up by runPending(), so a query waiting on its morsels doesn't end up
+   * running another query inside of it.
+   */
+  void submitQuery(Task task)
+  {
+    {
+      std::lock_guard<std::mutex> guard(idle_lock);
+      queries.push_back(std::move(task));
+    }
+    idle.notify_one();
+  }
+
+  /**
+   * @brief Queues a task. Workers push onto their own deque, other threads spread round robin.
+   */
+  void submit(Task task)
+  {
+    int self = workerPool() == this ? workerIndex() : -1;
+    size_t target = self >= 0 ? self : next_victim.fetch_add(1) % workers.size();
+    {
+      std::lock_guard<std::mutex> guard(workers[target]->lock);
+      workers[target]->tasks.push_back(std::move(task));
+      queued++;
+    }
+    {
+      std::lock_guard<std::mutex> guard(idle_lock);
+    }
+    idle.notify_one();
+  }
+
+  /**
+   * @brief Runs one queued task on the calling thread if there is one.
+   * Lets threads waiting on other tasks help instead of blocking a worker.
+   *
+   * @return true a task was run
+   */
+  bool runPending()
+  {
+    Task task;
+    int self = workerPool() == this ? workerIndex() : -1;
+    if (tryPop(self, task))
+    {
+      task();
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Splits [begin, end) into morsels that workers pick up dynamically.
+   * The calling thread takes morsels too and the first exception thrown is rethrown here.
+   *
+   * @param begin first index
+   * @param end one past the last index
+   * @param morsel size of each morsel
+   * @param fn called as fn(morsel_begin, morsel_end)
+   * @param parallelism [default: 0] max threads used, 0 uses parallelism()
+   */
+  void parallelFor(size_t begin, size_t end, size_t morsel, const std::function<void(size_t, size_t)> &fn,
+                   unsigned parallelism = 0)
+  {
+    runMorsels(begin, end, morsel, threadsFor(begin, end, morsel, parallelism),
+               [&](size_t from, size_t to, unsigned)
+               { fn(from, to); });
+  }
+
+  /**
+   * @brief parallelFor where every thread taking morsels folds them into its own
+   * Partial, so operators like aggregation need no locks. The partials are
+   * returned for the caller to merge.
+   *
+   * @param fn called as fn(partial, morsel_begin, morsel_end)
+   * @return std::vector<Partial> one per thread that took part, default constructed before it started
+   */
+  template <typename Partial, typename Fn>
+  std::vector<Partial> parallelPartials(size_t begin, size_t end, size_t morsel, Fn fn, unsigned parallelism = 0)
+  {
+    unsigned threads = threadsFor(begin, end, morsel, parallelism);
+    std::vector<Partial> partials(std::max(1u, threads));
+    runMorsels(begin, end, morsel, threads, [&](size_t from, size_t to, unsigned slot)
+               { fn(partials[slot], from, to); });
+    return partials;
+  }
+
+private:
+  // Threads parallelFor uses for the range, 0 when it is empty
+  unsigned threadsFor(size_t begin, size_t end, size_t morsel, unsigned parallelism) const
+  {
+    if (begin >= end)
+    {
+      return 0;
+    }
+    morsel = std::max<size_t>(1, morsel);
+    size_t morsels = (end - begin + morsel - 1) / morsel;
+    unsigned threads = parallelism == 0 ? this->parallelism() : std::min(parallelism, this->parallelism());
+    return (unsigned)std::min<size_t>(std::max(1u, threads), morsels);
+  }
+
+  /**
+   * @brief Runs the morsels on threads threads. Each thread passes its own slot,
+   * 0 for the caller and 1 to threads - 1 for the helpers.
+   */
+  void runMorsels(size_t begin, size_t end, size_t morsel, unsigned threads,
+                  const std::function<void(size_t, size_t, unsigned)> &fn)
+  {
+    if (threads == 0)
+    {
+      return;
+    }
+    morsel = std::max<size_t>(1, morsel);
+    size_t morsels = (end - begin + morsel - 1) / morsel;
+    if (threads == 1)
+    {
+      for (size_t from = begin; from < end; from += morsel)
+      {
+        checkCancelled();
+        fn(from, std::min(end, from + morsel), 0);
+      }
+      return;
+    }
+
+    struct Shared
+    {
+      std::atomic<size_t> next{0};
+      std::atomic<unsigned> running{0};
+      std::atomic<bool> failed{false};
+      std::exception_ptr error;
+      std::mutex error_lock;
+    } shared;
+    unsigned limit = queryLimit();
+    const CancelToken *token = currentToken();
+    auto run = [&](unsigned slot)
+    {
+      while (!shared.failed)
+      {
+        size_t index = shared.next.fetch_add(1);
+        if (index >= morsels)
+        {
+          break;
+        }
+        size_t from = begin + index * morsel;
+        try
+        {
+          checkCancelled();
+          fn(from, std::min(end, from + morsel), slot);
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> guard(shared.error_lock);
+          if (!shared.error)
+          {
+            shared.error = std::current_exception();
+          }
+          shared.failed = true;
+        }
+      }
+    };
+    shared.running = threads - 1;
+    for (unsigned i = 1; i < threads; i++)
+    {
+      submit([&, i, limit, token]()
+             {
+        QueryScope scope(limit);
+        CancelScope cancel(token);
+        run(i);
+        shared.running--; });
+    }
+    run(0);
+    // Help with other queued work while the helpers finish
+    while (shared.running > 0)
+    {
+      if (!runPending())
+      {
+        std::this_thread::yield();
+      }
+    }
+    if (shared.error)
+    {
+      std::rethrow_exception(shared.error);
+    }
+  }
+};
+
+#endif /* __THREAD_POOL_HPP__ */
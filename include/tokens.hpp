@@ -1,202 +1,352 @@
 /*
  * AUTHOR: VINCENT PHAM
  * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
- * FILE DESC: Tokens and some helper functions for looking up tokens. 
- * They're implemented as strings rather than an enum since it's useful for debugging.
+ * FILE DESC: Tokens and some helper functions for looking up tokens.
+ * Types are a compact enum with a name table kept for debugging, and
+ * reserved words are found through a perfect hash built at compile time.
  */
 
 #ifndef __TOKENS_HPP__
 #define __TOKENS_HPP__
 
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <sstream>
-#include <unordered_map>
 
 namespace token_type
 {
-  // set TokenType so we can change the type later
-  using TokenType = std::string;
-
-  // Define tokens with strings for debugging
-  const TokenType ILLEGAL = "ILLEGAL"; // Unknown Char
-  const TokenType ENDOFFILE = "EOF";
-
-  // Values/ID
-  const TokenType IDENTIFIER = "IDENTIFIER";
-  const TokenType TYPE = "TYPE";
-  const TokenType INT = "INT";
-  const TokenType FLOAT = "FLOAT";
-
-  // Types
-  const TokenType INT_TYPE = "INT_TYPE";
-  const TokenType CHAR_TYPE = "CHAR_TYPE";
-  const TokenType VARCHAR_TYPE = "VARCHAR_TYPE";
-  const TokenType FLOAT_TYPE = "FLOAT_TYPE";
-  const TokenType BOOL_TYPE = "BOOL_TYPE";
-
-  // Delimiters
-  const TokenType COMMA = ",";
-  const TokenType SEMICOLON = ";";
-
-  // Scope Symbols
-  const TokenType LPAREN = "(";
-  const TokenType RPAREN = ")";
-  const TokenType QUOTE = "'";
-
-  // Keywords
-  const TokenType TABLE = "TABLE";
-  const TokenType DATABASE = "DATABASE";
-  const TokenType CREATE = "CREATE";
-  const TokenType DROP = "DROP";
-  const TokenType SELECT = "SELECT";
-  const TokenType ALTER = "ALTER";
-  const TokenType USE = "USE";
-  const TokenType FROM = "FROM";
-  const TokenType ADD = "ADD";
-  const TokenType INSERT = "INSERT";
-  const TokenType INTO = "INTO";
-  const TokenType VALUES = "VALUES";
-  const TokenType DELETE = "DELETE";
-  const TokenType WHERE = "WHERE";
-  const TokenType UPDATE = "UPDATE";
-  const TokenType SET = "SET";
-  const TokenType ON = "ON";
-  const TokenType BEGIN = "BEGIN";
-  const TokenType TRANSACTION = "TRANSACTION";
-  const TokenType COMMIT = "COMMIT";
-
-  // Arithmetic
-  const TokenType BANG = "!";
-  const TokenType EQ = "=";
-  const TokenType NE = "!=";
-  const TokenType LT = "<";
-  const TokenType GT = ">";
-  const TokenType PLUS = "+";
-  const TokenType MINUS = "-";
-  const TokenType SLASH = "/";
-  const TokenType ASTERISK = "*";
-  
-  // JOINS
-  const TokenType LEFT = "LEFT";
-  const TokenType RIGHT = "RIGHT";
-  const TokenType INNER = "INNER";
-  const TokenType OUTER = "OUTER";
-  const TokenType JOIN = "JOIN";
-
-  const TokenType COMMAND = ".";
-  const TokenType EXIT_CMD = "EXIT";
-
-  std::unordered_map<std::string, TokenType> keyword = {
-      {"JOIN", JOIN},
-      {"INNER", INNER},
-      {"OUTER", OUTER},
-      {"LEFT", LEFT},
-      {"RIGHT", RIGHT},
-      {"TABLE", TABLE},
-      {"DATABASE", DATABASE},
-      {"CREATE", CREATE},
-      {"DROP", DROP},
-      {"SELECT", SELECT},
-      {"ALTER", ALTER},
-      {"USE", USE},
-      {"FROM", FROM},
-      {"ADD", ADD},
-      {"INSERT", INSERT},
-      {"INTO", INTO},
-      {"VALUES", VALUES},
-      {"DELETE", DELETE},
-      {"WHERE", WHERE},
-      {"UPDATE", UPDATE},
-      {"SET", SET},
-      {"ON", ON},
-      {"BEGIN", BEGIN},
-      {"TRANSACTION", TRANSACTION},
-      {"COMMIT", COMMIT}
+  // Compact token types. names[] below keeps a printable name for each one.
+  enum TokenType : uint8_t
+  {
+    ILLEGAL, // Unknown Char
+    ENDOFFILE,
+
+    // Values/ID
+    IDENTIFIER,
+    TYPE,
+    INT,
+    FLOAT,
+    STRING,
+    PARAM,
+
+    // Types
+    INT_TYPE,
+    CHAR_TYPE,
+    VARCHAR_TYPE,
+    FLOAT_TYPE,
+    BOOL_TYPE,
+
+    // Delimiters
+    COMMA,
+    SEMICOLON,
+
+    // Scope Symbols
+    LPAREN,
+    RPAREN,
+    QUOTE,
+
+    // Keywords
+    TABLE,
+    DATABASE,
+    CREATE,
+    DROP,
+    SELECT,
+    ALTER,
+    USE,
+    FROM,
+    ADD,
+    INSERT,
+    INTO,
+    VALUES,
+    DELETE,
+    WHERE,
+    UPDATE,
+    SET,
+    ON,
+    BEGIN,
+    TRANSACTION,
+    COMMIT,
+    COPY,
+    TO,
+    PREPARE,
+    EXECUTE,
+    AS,
+    GROUP,
+    BY,
+    ORDER,
+    ASC,
+    DESC,
+    LIMIT,
+    OFFSET,
+    WITH,
+    ANALYZE,
+    EXPLAIN,
+
+    // Arithmetic
+    BANG,
+    EQ,
+    NE,
+    LT,
+    GT,
+    PLUS,
+    MINUS,
+    SLASH,
+    ASTERISK,
+
+    // JOINS
+    LEFT,
+    RIGHT,
+    FULL,
+    INNER,
+    OUTER,
+    JOIN,
+
+    COMMAND,
+    EXIT_CMD,
+    STATS_CMD,
+
+    TOKEN_TYPE_COUNT
   };
 
-  std::unordered_map<std::string, TokenType> types = {
-      // Types
-      {"INT", INT_TYPE},
-      {"FLOAT", FLOAT_TYPE},
-      {"VARCHAR", VARCHAR_TYPE},
-      {"CHAR", CHAR_TYPE},
-      {"BOOL", BOOL_TYPE},
+  // Define token names with strings for debugging and error messages
+  constexpr const char *names[] = {
+      "ILLEGAL", "EOF",
+      "IDENTIFIER", "TYPE", "INT", "FLOAT", "STRING", "PARAM",
+      "INT_TYPE", "CHAR_TYPE", "VARCHAR_TYPE", "FLOAT_TYPE", "BOOL_TYPE",
+      ",", ";",
+      "(", ")", "'",
+      "TABLE", "DATABASE", "CREATE", "DROP", "SELECT", "ALTER", "USE", "FROM", "ADD",
+      "INSERT", "INTO", "VALUES", "DELETE", "WHERE", "UPDATE", "SET", "ON", "BEGIN",
+      "TRANSACTION", "COMMIT", "COPY", "TO", "PREPARE", "EXECUTE", "AS",
+      "GROUP", "BY", "ORDER", "ASC", "DESC", "LIMIT", "OFFSET",
+      "WITH", "ANALYZE", "EXPLAIN",
+      "!", "=", "!=", "<", ">", "+", "-", "/", "*",
+      "LEFT", "RIGHT", "FULL", "INNER", "OUTER", "JOIN",
+      ".", "EXIT", "STATS"};
+  static_assert(sizeof(names) / sizeof(names[0]) == TOKEN_TYPE_COUNT, "every token type needs a name");
+
+  inline std::string name(TokenType type)
+  {
+    return type < TOKEN_TYPE_COUNT ? names[type] : "UNKNOWN";
+  }
+
+  inline std::ostream &operator<<(std::ostream &os, TokenType type)
+  {
+    return os << name(type);
+  }
+
+  // Which lookup a reserved word answers to
+  enum class WordKind : uint8_t
+  {
+    KEYWORD,
+    TYPE,
+    COMMAND
+  };
+
+  struct ReservedWord
+  {
+    std::string_view word;
+    TokenType type;
+    WordKind kind;
   };
 
-  std::unordered_map<std::string, TokenType> commands = {
+  constexpr ReservedWord reserved[] = {
+      // Keywords
+      {"JOIN", JOIN, WordKind::KEYWORD},
+      {"INNER", INNER, WordKind::KEYWORD},
+      {"OUTER", OUTER, WordKind::KEYWORD},
+      {"LEFT", LEFT, WordKind::KEYWORD},
+      {"RIGHT", RIGHT, WordKind::KEYWORD},
+      {"FULL", FULL, WordKind::KEYWORD},
+      {"TABLE", TABLE, WordKind::KEYWORD},
+      {"DATABASE", DATABASE, WordKind::KEYWORD},
+      {"CREATE", CREATE, WordKind::KEYWORD},
+      {"DROP", DROP, WordKind::KEYWORD},
+      {"SELECT", SELECT, WordKind::KEYWORD},
+      {"ALTER", ALTER, WordKind::KEYWORD},
+      {"USE", USE, WordKind::KEYWORD},
+      {"FROM", FROM, WordKind::KEYWORD},
+      {"ADD", ADD, WordKind::KEYWORD},
+      {"INSERT", INSERT, WordKind::KEYWORD},
+      {"INTO", INTO, WordKind::KEYWORD},
+      {"VALUES", VALUES, WordKind::KEYWORD},
+      {"DELETE", DELETE, WordKind::KEYWORD},
+      {"WHERE", WHERE, WordKind::KEYWORD},
+      {"UPDATE", UPDATE, WordKind::KEYWORD},
+      {"SET", SET, WordKind::KEYWORD},
+      {"ON", ON, WordKind::KEYWORD},
+      {"BEGIN", BEGIN, WordKind::KEYWORD},
+      {"TRANSACTION", TRANSACTION, WordKind::KEYWORD},
+      {"COMMIT", COMMIT, WordKind::KEYWORD},
+      {"COPY", COPY, WordKind::KEYWORD},
+      {"TO", TO, WordKind::KEYWORD},
+      {"PREPARE", PREPARE, WordKind::KEYWORD},
+      {"EXECUTE", EXECUTE, WordKind::KEYWORD},
+      {"AS", AS, WordKind::KEYWORD},
+      {"GROUP", GROUP, WordKind::KEYWORD},
+      {"BY", BY, WordKind::KEYWORD},
+      {"ORDER", ORDER, WordKind::KEYWORD},
+      {"ASC", ASC, WordKind::KEYWORD},
+      {"DESC", DESC, WordKind::KEYWORD},
+      {"LIMIT", LIMIT, WordKind::KEYWORD},
+      {"OFFSET", OFFSET, WordKind::KEYWORD},
+      {"WITH", WITH, WordKind::KEYWORD},
+      {"ANALYZE", ANALYZE, WordKind::KEYWORD},
+      {"EXPLAIN", EXPLAIN, WordKind::KEYWORD},
+      // Types
+      {"INT", INT_TYPE, WordKind::TYPE},
+      {"FLOAT", FLOAT_TYPE, WordKind::TYPE},
+      {"VARCHAR", VARCHAR_TYPE, WordKind::TYPE},
+      {"CHAR", CHAR_TYPE, WordKind::TYPE},
+      {"BOOL", BOOL_TYPE, WordKind::TYPE},
       // Commands
-      {"EXIT", EXIT_CMD}};
+      {"EXIT", EXIT_CMD, WordKind::COMMAND},
+      {"STATS", STATS_CMD, WordKind::COMMAND},
+  };
+  constexpr size_t RESERVED_COUNT = sizeof(reserved) / sizeof(reserved[0]);
+
+  // Longest reserved word. Longer identifiers skip the lookup.
+  constexpr size_t MAX_KEYWORD_LENGTH = 11;
+  constexpr size_t RESERVED_TABLE_BITS = 8;
+  constexpr size_t RESERVED_TABLE_SIZE = 1 << RESERVED_TABLE_BITS;
 
-  TokenType lookUpIdentifier(std::string ident)
+  constexpr char upper(char ch)
   {
-    for (auto &ch : ident)
-    {
-      ch = toupper(ch);
-    }
-    if (commands.find(ident) != commands.end())
-    {
-      return commands[ident];
-    }
-    if (types.find(ident) != types.end())
+    return ('a' <= ch && ch <= 'z') ? ch - ('a' - 'A') : ch;
+  }
+
+  // FNV-1a over upper cased chars so the hash ignores case. The slot
+  // comes from the top bits since the low bits of FNV mix poorly.
+  constexpr size_t reservedSlot(std::string_view word, uint32_t seed)
+  {
+    uint32_t hash = seed;
+    for (char ch : word)
     {
-      return types[ident];
+      hash = (hash ^ (uint8_t)upper(ch)) * 16777619u;
     }
-    if (keyword.find(ident) != keyword.end())
+    return hash >> (32 - RESERVED_TABLE_BITS);
+  }
+
+  // Finds a seed that puts every reserved word in its own slot
+  constexpr uint32_t findReservedSeed()
+  {
+    for (uint32_t seed = 2166136261u; seed < 2166136261u + 1024; seed++)
     {
-      return keyword[ident];
+      bool used[RESERVED_TABLE_SIZE] = {};
+      bool perfect = true;
+      for (size_t i = 0; i < RESERVED_COUNT && perfect; i++)
+      {
+        size_t slot = reservedSlot(reserved[i].word, seed);
+        perfect = !used[slot];
+        used[slot] = true;
+      }
+      if (perfect)
+      {
+        return seed;
+      }
     }
-    return IDENTIFIER;
+    return 0;
   }
 
-  TokenType lookUpType(std::string type)
+  constexpr uint32_t RESERVED_SEED = findReservedSeed();
+  static_assert(RESERVED_SEED != 0, "no perfect hash seed for the reserved words");
+
+  struct ReservedTable
+  {
+    int8_t slots[RESERVED_TABLE_SIZE];
+  };
+
+  constexpr ReservedTable buildReservedTable()
   {
-    for (auto &ch : type)
+    ReservedTable table{};
+    for (size_t i = 0; i < RESERVED_TABLE_SIZE; i++)
     {
-      ch = toupper(ch);
+      table.slots[i] = -1;
     }
-    if (types.find(type) != types.end())
+    for (size_t i = 0; i < RESERVED_COUNT; i++)
     {
-      return types[type];
+      table.slots[reservedSlot(reserved[i].word, RESERVED_SEED)] = i;
     }
-    return TYPE;
+    return table;
   }
 
-  TokenType lookUpCommand(std::string cmd)
+  constexpr ReservedTable reservedTable = buildReservedTable();
+
+  /**
+   * @brief Looks up a reserved word ignoring case, without allocating
+   *
+   * @param literal the identifier as written
+   * @return const ReservedWord* the reserved word or nullptr
+   */
+  constexpr const ReservedWord *findReserved(std::string_view literal)
   {
-    for (auto &ch : cmd)
+    if (literal.size() > MAX_KEYWORD_LENGTH)
+    {
+      return nullptr;
+    }
+    int8_t slot = reservedTable.slots[reservedSlot(literal, RESERVED_SEED)];
+    if (slot < 0 || reserved[slot].word.size() != literal.size())
     {
-      ch = toupper(ch);
+      return nullptr;
     }
-    if (commands.find(cmd) != commands.end())
+    for (size_t i = 0; i < literal.size(); i++)
     {
-      return types[cmd];
+      if (upper(literal[i]) != reserved[slot].word[i])
+      {
+        return nullptr;
+      }
     }
-    return COMMAND;
+    return &reserved[slot];
   }
+
+  // Commands are only looked up after a '.', see lookUpCommand, so they stay usable as names
+  constexpr TokenType lookUpIdentifier(std::string_view literal)
+  {
+    const ReservedWord *word = findReserved(literal);
+    return (word == nullptr || word->kind == WordKind::COMMAND) ? IDENTIFIER : word->type;
+  }
+
+  constexpr TokenType lookUpType(std::string_view literal)
+  {
+    const ReservedWord *word = findReserved(literal);
+    return (word == nullptr || word->kind != WordKind::TYPE) ? TYPE : word->type;
+  }
+
+  constexpr TokenType lookUpCommand(std::string_view literal)
+  {
+    const ReservedWord *word = findReserved(literal);
+    return (word == nullptr || word->kind != WordKind::COMMAND) ? COMMAND : word->type;
+  }
+
+  static_assert(lookUpIdentifier("sElEcT") == SELECT, "keywords ignore case");
+  static_assert(lookUpIdentifier("selects") == IDENTIFIER, "only whole words match");
+  static_assert(lookUpType("varchar") == VARCHAR_TYPE, "types are reserved words");
+  static_assert(lookUpType("select") == TYPE, "keywords aren't types");
+  static_assert(lookUpIdentifier("stats") == IDENTIFIER, "commands aren't keywords");
 }
 
+/**
+ * @brief A token type and the span of source text it was read from.
+ * The literal is a view into the lexer input so it must outlive the token.
+ */
 struct Token
 {
-  token_type::TokenType type;
-  std::string literal;
+  token_type::TokenType type = token_type::ILLEGAL;
+  std::string_view literal;
+  // Offset of the literal in the lexer input
+  size_t offset = 0;
 
   Token() {}
 
-  Token(const Token &right) {
-    type = right.type;
-    literal = right.literal;
-  }
-
-  Token(token_type::TokenType type, char literal) : type(type),
-                                                    literal(std::string(1, literal)) {}
-
-  Token(token_type::TokenType type, std::string literal) : type(type),
-                                                           literal(literal) {}
+  Token(token_type::TokenType type, std::string_view literal, size_t offset = 0) : type(type),
+                                                                                   literal(literal),
+                                                                                   offset(offset) {}
 
-  void operator=(const Token &rhs)
+  size_t length() const
   {
-    type = rhs.type;
-    literal = rhs.literal;
+    return literal.size();
   }
 
   operator std::string() const
@@ -0,0 +1,586 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Zone maps of a table file. The rows of a table are split into
+ * pages of PAGE_ROWS rows, and for each page the zone map keeps where the
+ * page starts in the file and the min, max and null count of every column,
+ * as the reader decodes them. Columns made WITH (bloom_filter = col) also
+ * get a Bloom filter per page for equality tests. Readers seek past pages
+ * that a where expression or join can't match. They are kept next to the
+ * table in <table>.proto.zones, one header per page, and cached in memory
+ * once the catalog or a reader has loaded them. A sidecar records the
+ * version of the table it was made for and a generation of its own, so
+ * rewrites by another process are noticed even when they keep the sizes.
+ */
+#ifndef __ZONE_MAP_HPP__
+#define __ZONE_MAP_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include <experimental/filesystem>
+#include <data_objs.hpp>
+
+namespace fs = std::experimental::filesystem;
+
+/**
+ * @brief Which table file a sidecar like the zone map was made for, and which
+ * save of the sidecar it is. It's written after the sidecar's first word.
+ */
+struct SidecarVersion
+{
+  // Picked anew by every save, so a cached copy can tell when another process saved the sidecar again
+  uint64_t generation = 0;
+  // Size and last write time of the table file when the sidecar was saved
+  uintmax_t table_size = 0;
+  int64_t table_time = 0;
+
+  /**
+   * @brief The version of a sidecar about to be saved for a fully written table file
+   */
+  static SidecarVersion next(const fs::path &tbl_path)
+  {
+    SidecarVersion version;
+    std::random_device random;
+    version.generation = (uint64_t)random() << 32 | random();
+    version.table_size = fs::file_size(tbl_path);
+    version.table_time = writeTime(tbl_path);
+    return version;
+  }
+
+  /**
+   * @brief Whether the table file is still the one the sidecar was made for
+   */
+  bool matches(const fs::path &tbl_path) const
+  {
+    std::error_code error;
+    uintmax_t size = fs::file_size(tbl_path, error);
+    return !error && size == table_size && writeTime(tbl_path) == table_time;
+  }
+
+  /**
+   * @brief Reads the version of the sidecar at path, after its first word
+   *
+   * @return bool false when there is no sidecar or its first word isn't magic
+   */
+  static bool peek(const fs::path &path, const std::string &magic, SidecarVersion &version)
+  {
+    std::ifstream in(path);
+    std::string word;
+    return in >> word && word == magic && version.read(in);
+  }
+
+  void write(std::ostream &out) const
+  {
+    out << " " << generation << " " << table_size << " " << table_time;
+  }
+
+  bool read(std::istream &in)
+  {
+    return (bool)(in >> generation >> table_size >> table_time);
+  }
+
+private:
+  static int64_t writeTime(const fs::path &path)
+  {
+    std::error_code error;
+    auto time = fs::last_write_time(path, error);
+    return error ? -1 : std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+  }
+};
+
+class ZoneMap
+{
+public:
+  // Rows summarised by one page
+  static constexpr size_t PAGE_ROWS = 4096;
+  // Bloom filter bits per row of a page and bits set per value, about a 1% false positive rate
+  static constexpr size_t BLOOM_BITS_PER_ROW = 10;
+  static constexpr size_t BLOOM_HASHES = 7;
+  static constexpr size_t BLOOM_WORDS = PAGE_ROWS * BLOOM_BITS_PER_ROW / 64;
+
+  // How well the Bloom filters did, shown by .STATS
+  struct BloomStats
+  {
+    // Pages whose filter was tested after their min and max couldn't rule them out
+    std::atomic<size_t> probes{0};
+    std::atomic<size_t> skipped{0};
+    // Pages the filter let through that had no matching row
+    std::atomic<size_t> false_positives{0};
+    // Sum of the expected false positive rates of the probed filters, in millionths
+    std::atomic<uint64_t> expected_millionths{0};
+  };
+
+  static BloomStats &bloomStats()
+  {
+    static BloomStats stats;
+    return stats;
+  }
+
+  // Values of one column over a page
+  struct Zone
+  {
+    // False when the page has a value of another type than the column, so it can't be skipped
+    bool known = true;
+    // Blank values, INT_MIN in an int column
+    size_t nulls = 0;
+    // Values that aren't blank, min and max are only set when there are some
+    size_t values = 0;
+    variant_type min;
+    variant_type max;
+    // Bloom filter of the values, empty when the column has none
+    std::vector<uint64_t> bloom;
+
+    /**
+     * @brief Whether the page may hold the value, always true without a Bloom filter
+     */
+    bool mayContain(const variant_type &value) const
+    {
+      if (bloom.empty())
+      {
+        return true;
+      }
+      uint64_t hash = hashValue(value);
+      for (size_t i = 0; i < BLOOM_HASHES; i++)
+      {
+        size_t bit = bloomBit(hash, i);
+        if ((bloom[bit / 64] & (1ull << (bit % 64))) == 0)
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * @brief Chance the Bloom filter lets through a value the page doesn't hold
+     */
+    double expectedFalsePositiveRate() const
+    {
+      double bits = BLOOM_WORDS * 64.0;
+      return std::pow(1 - std::exp(-(double)BLOOM_HASHES * values / bits), (double)BLOOM_HASHES);
+    }
+  };
+
+  struct Page
+  {
+    // Byte offset in the table file of the newline before the page's first row
+    uint64_t offset = 0;
+    size_t rows = 0;
+    std::vector<Zone> zones;
+  };
+
+  // Format chars of the table's columns, see TableObject::getFormat
+  std::string format;
+  // Whether each column has Bloom filters
+  std::vector<char> bloom_columns;
+  std::vector<Page> pages;
+
+  // Hash of a value that is stable across runs, since the filters and table statistics
+  // built from it are saved: FNV-1a of strings, then splitmix64 so the top bits mix too
+  static uint64_t hashValue(const variant_type &value)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    if (auto val = std::get_if<std::string>(&value))
+    {
+      for (char ch : *val)
+      {
+        hash = (hash ^ (uint8_t)ch) * 1099511628211ull;
+      }
+    }
+    else if (auto val = std::get_if<int>(&value))
+    {
+      hash = (uint64_t)(uint32_t)*val + 0x9e3779b97f4a7c15ull;
+    }
+    else if (auto val = std::get_if<double>(&value))
+    {
+      std::memcpy(&hash, val, sizeof(hash));
+    }
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+    return hash ^ (hash >> 31);
+  }
+
+  /**
+   * @brief The value the table reader gets back for a value written by
+   * ProtoGenerator::writeValue. Floats are written with 6 significant
+   * digits, so they are rounded the same way here unless round_floats is off.
+   *
+   * @return bool false when the reader wouldn't decode it as the column's type
+   */
+  static bool decoded(char type, const variant_type &value, variant_type &out, bool round_floats)
+  {
+    if (type == 'i' && std::holds_alternative<int>(value))
+    {
+      out = value;
+      return true;
+    }
+    if (type == 'f' && (std::holds_alternative<int>(value) || std::holds_alternative<double>(value)))
+    {
+      double number = std::holds_alternative<int>(value) ? std::get<int>(value) : std::get<double>(value);
+      if (round_floats)
+      {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%g", number);
+        number = std::strtod(text, nullptr);
+      }
+      out = number;
+      return true;
+    }
+    if (type == 's' && std::holds_alternative<std::string>(value))
+    {
+      out = value;
+      return true;
+    }
+    return false;
+  }
+
+  // Values are saved as the reader decodes them, strings prefixed by their length
+  static void writeBound(std::ostream &out, const variant_type &value)
+  {
+    if (auto val = std::get_if<std::string>(&value))
+    {
+      out << val->size() << " " << *val;
+    }
+    else if (auto val = std::get_if<int>(&value))
+    {
+      out << *val;
+    }
+    else if (auto val = std::get_if<double>(&value))
+    {
+      out << std::setprecision(17) << *val;
+    }
+  }
+
+  static bool readBound(std::istream &in, char type, variant_type &value)
+  {
+    if (type == 's')
+    {
+      size_t length = 0;
+      if (!(in >> length) || in.get() != ' ')
+      {
+        return false;
+      }
+      std::string text(length, '\0');
+      in.read(text.data(), length);
+      value = std::move(text);
+    }
+    else if (type == 'i')
+    {
+      int val;
+      in >> val;
+      value = val;
+    }
+    else
+    {
+      double val;
+      in >> val;
+      value = val;
+    }
+    return !in.fail();
+  }
+
+private:
+  // The table file the zone map was made for and which save of it this is
+  SidecarVersion version;
+
+  // Zone maps loaded so far by table file path
+  struct Cache
+  {
+    std::mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<const ZoneMap>> maps;
+  };
+
+  static Cache &cache()
+  {
+    static Cache shared;
+    return shared;
+  }
+
+  // The i-th bit of a value, by double hashing the two halves of its hash
+  static size_t bloomBit(uint64_t hash, size_t i)
+  {
+    uint64_t h1 = (uint32_t)hash, h2 = (hash >> 32) | 1;
+    return (h1 + i * h2) % (BLOOM_WORDS * 64);
+  }
+
+public:
+  ZoneMap() = default;
+
+  /**
+   * @param format format chars of the table's columns
+   * @param bloom_columns [default: none] whether each column gets Bloom filters
+   */
+  explicit ZoneMap(std::string format, std::vector<char> bloom_columns = {})
+      : format(std::move(format)), bloom_columns(std::move(bloom_columns))
+  {
+    this->bloom_columns.resize(this->format.size(), false);
+  }
+
+  static fs::path pathFor(const fs::path &tbl_path)
+  {
+    return tbl_path.string() + ".zones";
+  }
+
+  /**
+   * @brief Adds the next row of the table to the last page, starting a new page every PAGE_ROWS rows
+   *
+   * @param offset byte offset of the row in the table file, kept for the first row of a page
+   * @param values the row's values, one per column
+   * @param round_floats [default: true] whether floats were written by ProtoGenerator::writeValue
+   * and so get read back rounded, false when they are already as the reader decodes them
+   */
+  void addRow(uint64_t offset, const variant_type *values, bool round_floats = true)
+  {
+    if (pages.empty() || pages.back().rows == PAGE_ROWS)
+    {
+      pages.push_back(Page{offset, 0, std::vector<Zone>(format.size())});
+      for (size_t col = 0; col < format.size(); col++)
+      {
+        if (bloom_columns[col])
+        {
+          pages.back().zones[col].bloom.assign(BLOOM_WORDS, 0);
+        }
+      }
+    }
+    Page &page = pages.back();
+    page.rows++;
+    for (size_t col = 0; col < format.size(); col++)
+    {
+      Zone &zone = page.zones[col];
+      variant_type value;
+      if (!zone.known)
+      {
+        continue;
+      }
+      if (!decoded(format[col], values[col], value, round_floats))
+      {
+        zone.known = false;
+        continue;
+      }
+      auto val = std::get_if<int>(&value);
+      if (val != nullptr && *val == std::numeric_limits<int>::min())
+      {
+        zone.nulls++;
+        continue;
+      }
+      if (zone.values == 0 || value < zone.min)
+      {
+        zone.min = value;
+      }
+      if (zone.values == 0 || zone.max < value)
+      {
+        zone.max = value;
+      }
+      zone.values++;
+      if (!zone.bloom.empty())
+      {
+        uint64_t hash = hashValue(value);
+        for (size_t i = 0; i < BLOOM_HASHES; i++)
+        {
+          size_t bit = bloomBit(hash, i);
+          zone.bloom[bit / 64] |= 1ull << (bit % 64);
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Writes the zone map next to the table file, which has to be fully
+   * written, and keeps it in the cache
+   */
+  void save(const fs::path &tbl_path)
+  {
+    version = SidecarVersion::next(tbl_path);
+    std::ofstream out(pathFor(tbl_path));
+    out << "zones";
+    version.write(out);
+    out << " " << PAGE_ROWS << " " << pages.size() << " " << format.size() << " " << format;
+    if (!format.empty())
+    {
+      out << " ";
+      for (char bloom : bloom_columns)
+      {
+        out << (bloom ? '1' : '0');
+      }
+    }
+    out << "\n";
+    for (const Page &page : pages)
+    {
+      out << "page " << page.offset << " " << page.rows << "\n";
+      for (size_t col = 0; col < format.size(); col++)
+      {
+        const Zone &zone = page.zones[col];
+        if (!zone.known)
+        {
+          out << "-\n";
+          continue;
+        }
+        out << format[col] << " " << zone.nulls << " " << zone.values;
+        if (zone.values > 0)
+        {
+          out << " ";
+          writeBound(out, zone.min);
+          out << " ";
+          writeBound(out, zone.max);
+        }
+        if (!zone.bloom.empty())
+        {
+          out << " b" << std::hex;
+          for (uint64_t word : zone.bloom)
+          {
+            out << " " << word;
+          }
+          out << std::dec;
+        }
+        out << "\n";
+      }
+    }
+    out.close();
+    std::lock_guard<std::mutex> guard(cache().lock);
+    cache().maps[tbl_path.string()] = std::make_shared<const ZoneMap>(*this);
+  }
+
+  /**
+   * @brief Loads the zone map of a table file
+   *
+   * @return bool false when there is none, or it was made for another version of the file
+   */
+  bool load(const fs::path &tbl_path)
+  {
+    std::ifstream in(pathFor(tbl_path));
+    std::string word;
+    size_t page_rows = 0, page_count = 0, columns = 0;
+    if (!(in >> word) || word != "zones" || !version.read(in) || !(in >> page_rows >> page_count >> columns) ||
+        page_rows != PAGE_ROWS)
+    {
+      return false;
+    }
+    if (!version.matches(tbl_path))
+    {
+      return false;
+    }
+    format.clear();
+    std::string bloom;
+    if (columns > 0 && (!(in >> format >> bloom) || bloom.size() != format.size()))
+    {
+      return false;
+    }
+    bloom_columns.assign(format.size(), false);
+    for (size_t col = 0; col < bloom.size(); col++)
+    {
+      bloom_columns[col] = bloom[col] == '1';
+    }
+    pages.assign(page_count, Page{});
+    for (Page &page : pages)
+    {
+      if (!(in >> word >> page.offset >> page.rows) || word != "page")
+      {
+        return false;
+      }
+      page.zones.resize(format.size());
+      for (size_t col = 0; col < format.size(); col++)
+      {
+        Zone &zone = page.zones[col];
+        char type;
+        in >> type;
+        if (type == '-')
+        {
+          zone.known = false;
+          continue;
+        }
+        if (type != format[col] || !(in >> zone.nulls >> zone.values))
+        {
+          return false;
+        }
+        if (zone.values > 0 && (!readBound(in, type, zone.min) || !readBound(in, type, zone.max)))
+        {
+          return false;
+        }
+        if (bloom_columns[col])
+        {
+          zone.bloom.resize(BLOOM_WORDS);
+          if (!(in >> word) || word != "b")
+          {
+            return false;
+          }
+          in >> std::hex;
+          for (uint64_t &bits : zone.bloom)
+          {
+            in >> bits;
+          }
+          in >> std::dec;
+          if (in.fail())
+          {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief The zone map of a table file, from the cache while it's the one saved
+   * for the file or else loaded and cached
+   *
+   * @return std::shared_ptr<const ZoneMap> null when the table has no up to date zone map
+   */
+  static std::shared_ptr<const ZoneMap> open(const fs::path &tbl_path)
+  {
+    // Another process may have saved the zone map again since it was cached, or
+    // rewritten the table without it, keeping the sizes of both
+    SidecarVersion current;
+    if (!SidecarVersion::peek(pathFor(tbl_path), "zones", current) || !current.matches(tbl_path))
+    {
+      std::lock_guard<std::mutex> guard(cache().lock);
+      cache().maps.erase(tbl_path.string());
+      return nullptr;
+    }
+    {
+      std::lock_guard<std::mutex> guard(cache().lock);
+      auto cached = cache().maps.find(tbl_path.string());
+      if (cached != cache().maps.end() && cached->second->version.generation == current.generation)
+      {
+        return cached->second;
+      }
+    }
+    auto loaded = std::make_shared<ZoneMap>();
+    if (!loaded->load(tbl_path))
+    {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(cache().lock);
+    cache().maps[tbl_path.string()] = loaded;
+    return loaded;
+  }
+
+  /**
+   * @brief Removes the zone map of a table file whose rows are changed without it
+   */
+  static void remove(const fs::path &tbl_path)
+  {
+    {
+      std::lock_guard<std::mutex> guard(cache().lock);
+      cache().maps.erase(tbl_path.string());
+    }
+    std::error_code error;
+    fs::remove(pathFor(tbl_path), error);
+  }
+};
+
+#endif /* __ZONE_MAP_HPP__ */
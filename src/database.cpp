@@ -0,0 +1,343 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Library side of database.hpp. Statements run through the same
+ * script runner, plan cache and evaluators as the repl, and their results
+ * are wrapped into ResultSets instead of being printed.
+ */
+
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <database.hpp>
+#include <objects.hpp>
+#include <proto_generator.hpp>
+#include <script.hpp>
+#include <session.hpp>
+#include <table_scan.hpp>
+#include <thread_pool.hpp>
+
+// Connections have their own session state, but their statements still read
+// and write the same table files, so statements from every connection run one at a time
+static std::mutex engine_lock;
+
+// Submitted queries waiting for their turn. A single task on the pool runs
+// them in order, so queued queries don't each hold a worker while they wait.
+static std::mutex async_lock;
+static std::deque<std::function<void()>> async_pending;
+static bool async_draining = false;
+
+static void drainAsync()
+{
+  while (true)
+  {
+    std::function<void()> job;
+    {
+      std::lock_guard<std::mutex> guard(async_lock);
+      if (async_pending.empty())
+      {
+        async_draining = false;
+        return;
+      }
+      job = std::move(async_pending.front());
+      async_pending.pop_front();
+    }
+    job();
+  }
+}
+
+static void enqueueAsync(std::function<void()> job)
+{
+  bool start;
+  {
+    std::lock_guard<std::mutex> guard(async_lock);
+    async_pending.push_back(std::move(job));
+    start = !async_draining;
+    async_draining = true;
+  }
+  if (start)
+  {
+    ThreadPool::shared().submitQuery(drainAsync);
+  }
+}
+
+// Declared type of a column as shown in table headers, e.g. varchar(20)
+static std::string columnType(const std::pair<std::string, std::tuple<std::string, int>> &field)
+{
+  int count = std::get<1>(field.second);
+  return std::get<0>(field.second) + (count > 1 ? "(" + std::to_string(count) + ")" : "");
+}
+
+static bool isNullValue(const variant_type &value)
+{
+  auto val = std::get_if<int>(&value);
+  return val != nullptr && *val == std::numeric_limits<int>::min();
+}
+
+bool ResultSet::Row::isNull(size_t col) const
+{
+  return isNullValue((*this)[col]);
+}
+
+size_t ResultSet::columnCount() const
+{
+  return table == nullptr ? 0 : table->fields_size;
+}
+
+size_t ResultSet::rowCount() const
+{
+  return table == nullptr || table->fields_size == 0 ? 0 : table->records.size() / table->fields_size;
+}
+
+std::vector<std::string> ResultSet::columns() const
+{
+  std::vector<std::string> names;
+  if (table != nullptr)
+  {
+    for (const auto &field : table->fields)
+    {
+      names.push_back(field.first);
+    }
+  }
+  return names;
+}
+
+std::vector<std::string> ResultSet::columnTypes() const
+{
+  std::vector<std::string> types;
+  if (table != nullptr)
+  {
+    for (const auto &field : table->fields)
+    {
+      types.push_back(columnType(field));
+    }
+  }
+  return types;
+}
+
+std::string ResultSet::format() const
+{
+  return table == nullptr ? "" : ProtoGenerator::formatTBL(*table);
+}
+
+const RowBatch::Column &RowBatch::typed(size_t col, Type type) const
+{
+  const Column &column = column_data.at(col);
+  if (column.type != type)
+  {
+    throw std::invalid_argument("column " + std::to_string(col) + " has another type");
+  }
+  return column;
+}
+
+double RowBatch::getDouble(size_t row, size_t col) const
+{
+  const Column &column = column_data.at(col);
+  if (column.type == Type::INT)
+  {
+    return column.ints[row];
+  }
+  return typed(col, Type::FLOAT).doubles[row];
+}
+
+std::vector<std::string> Cursor::columns() const
+{
+  std::vector<std::string> names;
+  if (scan != nullptr)
+  {
+    for (int col : scan->columns())
+    {
+      names.push_back(scan->source().fields[col].first);
+    }
+  }
+  return names;
+}
+
+std::vector<std::string> Cursor::columnTypes() const
+{
+  std::vector<std::string> types;
+  if (scan != nullptr)
+  {
+    for (int col : scan->columns())
+    {
+      types.push_back(columnType(scan->source().fields[col]));
+    }
+  }
+  return types;
+}
+
+bool Cursor::done() const
+{
+  return scan == nullptr || scan->done();
+}
+
+RowBatch Cursor::fetch(size_t count)
+{
+  RowBatch batch;
+  if (scan == nullptr)
+  {
+    return batch;
+  }
+  scan->next(count, row_buffer);
+  const TableObject &tbl = scan->source();
+  std::string format = tbl.getFormat();
+  batch.source = scan->sharedSource();
+  batch.row_count = row_buffer.size();
+  for (int col : scan->columns())
+  {
+    RowBatch::Column column;
+    switch (format[col])
+    {
+    case 'i':
+      column.type = RowBatch::Type::INT;
+      column.ints.reserve(row_buffer.size());
+      break;
+    case 'f':
+      column.type = RowBatch::Type::FLOAT;
+      column.doubles.reserve(row_buffer.size());
+      break;
+    case 'b':
+      column.type = RowBatch::Type::BOOL;
+      column.bools.reserve(row_buffer.size());
+      break;
+    default:
+      column.type = RowBatch::Type::STRING;
+      column.strings.reserve(row_buffer.size());
+      break;
+    }
+    column.nulls.reserve(row_buffer.size());
+    for (int row : row_buffer)
+    {
+      const variant_type &value = tbl.records[row * tbl.fields_size + col];
+      // Blanks are INT_MIN whatever the column's type, other values match it
+      bool null = isNullValue(value);
+      column.nulls.push_back(null);
+      switch (column.type)
+      {
+      case RowBatch::Type::INT:
+        column.ints.push_back(null ? 0 : std::get<int>(value));
+        break;
+      case RowBatch::Type::FLOAT:
+        column.doubles.push_back(null ? 0 : std::get<double>(value));
+        break;
+      case RowBatch::Type::BOOL:
+        column.bools.push_back(null ? false : std::get<bool>(value));
+        break;
+      case RowBatch::Type::STRING:
+        column.strings.push_back(null ? std::string_view() : std::string_view(std::get<std::string>(value)));
+        break;
+      }
+    }
+    batch.column_data.push_back(std::move(column));
+  }
+  return batch;
+}
+
+// Queries submitted on the connection hold the session, so it keeps its own copy
+// of the data directory rather than pointing at a Database that may be gone
+struct Connection::Session
+{
+  DatabaseObject current_database;
+  // The connection's data directory, transaction, prepared statements and plan cache
+  SessionState state;
+
+  Session(const std::string &data_path) : current_database("nil"), state(fs::absolute(data_path)) {}
+
+  /**
+   * @brief Runs a script for the connection, wrapping each result in a ResultSet
+   *
+   * @param token when set, makes the script cancellable and starts its timeout
+   * once the script holds the engine, not while it waits for it
+   */
+  bool run(std::string_view script, const std::function<void(const ResultSet &)> &each,
+           const CancelToken *token = nullptr)
+  {
+    std::lock_guard<std::mutex> guard(engine_lock);
+    SessionState::Scope scope(&state);
+    ThreadPool::CancelScope cancel(token);
+    return runScript(script, &current_database, [&](std::unique_ptr<object::Result> result)
+                     {
+      ResultSet set;
+      set.result_status = result->status;
+      set.result_message = std::move(result->message);
+      if (result->rows != nullptr)
+      {
+        set.table = std::make_shared<TableObject>(result->rows->drain());
+      }
+      each(set); });
+  }
+};
+
+Connection::Connection(Database &database) : session(std::make_shared<Session>(database.path()))
+{
+}
+
+Connection::Connection(Connection &&other) noexcept = default;
+Connection &Connection::operator=(Connection &&other) noexcept = default;
+Connection::~Connection() = default;
+
+bool Connection::executeScript(std::string_view script, const std::function<void(const ResultSet &)> &each)
+{
+  return session->run(script, each);
+}
+
+std::vector<ResultSet> Connection::executeScript(std::string_view script)
+{
+  std::vector<ResultSet> results;
+  executeScript(script, [&](const ResultSet &result)
+                { results.push_back(result); });
+  return results;
+}
+
+ResultSet Connection::execute(std::string_view sql)
+{
+  ResultSet last;
+  executeScript(sql, [&](const ResultSet &result)
+                { last = result; });
+  return last;
+}
+
+std::future<ResultSet> Connection::submit(std::string sql, CancelToken token)
+{
+  auto promise = std::make_shared<std::promise<ResultSet>>();
+  std::future<ResultSet> future = promise->get_future();
+  enqueueAsync([session = session, sql = std::move(sql), token, promise]()
+               {
+    try
+    {
+      // Every morsel of the query checks the token
+      ResultSet last;
+      session->run(sql, [&](const ResultSet &result)
+                   { last = result; }, &token);
+      promise->set_value(std::move(last));
+    }
+    catch (...)
+    {
+      promise->set_exception(std::current_exception());
+    } });
+  return future;
+}
+
+Cursor Connection::query(std::string_view sql)
+{
+  Cursor cursor;
+  std::lock_guard<std::mutex> guard(engine_lock);
+  SessionState::Scope scope(&session->state);
+  runScript(sql, &session->current_database, [&](std::unique_ptr<object::Result> result)
+            {
+    cursor.cursor_status = result->status;
+    cursor.cursor_message = std::move(result->message);
+    cursor.scan = std::move(result->rows); });
+  return cursor;
+}
+
+std::string Connection::currentDatabase() const
+{
+  return session->current_database.name();
+}
+
+Database::Database(std::string path) : data_path(std::move(path))
+{
+}
@@ -13,9 +13,28 @@
 #include <data_objs.hpp>
 #include <proto_generator.hpp>
 #include <evaluator.hpp>
+#include <thread_pool.hpp>
+#include <arena.hpp>
+#include <script.hpp>
+#include <prepared.hpp>
+#include <plan_cache.hpp>
+#include <database.hpp>
+#include <hash_aggregate.hpp>
+#include <external_sort.hpp>
+#include <table_stats.hpp>
+#include <planner.hpp>
+#include <query_profile.hpp>
 #include <string>
 #include <tuple>
 #include <variant>
+#include <atomic>
+#include <set>
+#include <mutex>
+#include <thread>
+
+// Gives the shared pool several workers even on single core machines. Set before
+// any test can start the pool, since configure has no effect after that.
+static const bool shared_pool_configured = ThreadPool::configure(ThreadPool::Config{4, 0, false});
 
 TEST(LexerTest, ReadNextTokenSingleChar)
 {
@@ -71,7 +90,8 @@ TEST(LexerTest, ReadNextTokenCode)
   expectedTokens.emplace_back(token_type::RPAREN, ")");
   expectedTokens.emplace_back(token_type::SEMICOLON, ";");
   expectedTokens.emplace_back(token_type::COMMAND, ".");
-  expectedTokens.emplace_back(token_type::EXIT_CMD, "EXIT");
+  // Commands are told apart from names by the parser
+  expectedTokens.emplace_back(token_type::IDENTIFIER, "EXIT");
   Lexer lexer(input);
   for (int i = 0; i < expectedTokens.size(); i++)
   {
@@ -81,6 +101,55 @@ TEST(LexerTest, ReadNextTokenCode)
   }
 }
 
+TEST(LexerTest, TokenSpansViewSource)
+{
+  std::string input = "insert into tbl_1 values(17, 19.99); -- trailing comment\n-- full line\nselect * from tbl_1;";
+  Lexer lexer(input);
+  std::vector<std::pair<token_type::TokenType, std::string>> expected = {
+      {token_type::INSERT, "insert"}, {token_type::INTO, "into"}, {token_type::IDENTIFIER, "tbl_1"},
+      {token_type::VALUES, "values"}, {token_type::LPAREN, "("}, {token_type::INT, "17"},
+      {token_type::COMMA, ","}, {token_type::FLOAT, "19.99"}, {token_type::RPAREN, ")"},
+      {token_type::SEMICOLON, ";"}, {token_type::SELECT, "select"}, {token_type::ASTERISK, "*"},
+      {token_type::FROM, "from"}, {token_type::IDENTIFIER, "tbl_1"}, {token_type::SEMICOLON, ";"},
+      {token_type::ENDOFFILE, ""}};
+  for (const auto &pair : expected)
+  {
+    Token token = lexer.nextToken();
+    EXPECT_EQ(token.type, pair.first);
+    EXPECT_EQ(token.literal, pair.second);
+    // Literals are spans of the input rather than copies
+    EXPECT_EQ(input.substr(token.offset, token.length()), pair.second);
+    if (token.length() > 0)
+    {
+      EXPECT_EQ(token.literal.data(), input.data() + token.offset);
+    }
+  }
+}
+
+TEST(LexerTest, ReservedWordsIgnoreCase)
+{
+  for (const auto &word : token_type::reserved)
+  {
+    std::string lower(word.word);
+    for (char &ch : lower)
+    {
+      ch = tolower(ch);
+    }
+    EXPECT_NE(token_type::findReserved(word.word), nullptr) << word.word;
+    EXPECT_EQ(token_type::findReserved(lower), &word) << lower;
+  }
+  EXPECT_EQ(token_type::lookUpIdentifier("Select"), token_type::SELECT);
+  EXPECT_EQ(token_type::lookUpIdentifier("selects"), token_type::IDENTIFIER);
+  EXPECT_EQ(token_type::lookUpIdentifier("sel"), token_type::IDENTIFIER);
+  EXPECT_EQ(token_type::lookUpIdentifier("a_very_long_column_name"), token_type::IDENTIFIER);
+  EXPECT_EQ(token_type::lookUpType("Float"), token_type::FLOAT_TYPE);
+  EXPECT_EQ(token_type::lookUpType("where"), token_type::TYPE);
+  EXPECT_EQ(token_type::lookUpCommand("exit"), token_type::EXIT_CMD);
+  EXPECT_EQ(token_type::lookUpIdentifier("stats"), token_type::IDENTIFIER);
+  EXPECT_EQ(token_type::lookUpCommand("int"), token_type::COMMAND);
+  EXPECT_EQ(token_type::name(token_type::NE), "!=");
+}
+
 TEST(ParserTest, CreateDatabaseStatements)
 {
   std::string input = "CREATE DATABASE db_1;\
@@ -126,6 +195,52 @@ TEST(ParserTest, CreateTableStatements)
   testCreateTableStatement(program->statements[1], "tbl_2");
 }
 
+TEST(ParserTest, CreateTableStatement_WithOptions)
+{
+  std::string input = "CREATE TABLE events (id int, tag varchar(8)) WITH (bloom_filter = id, bloom_filter = tag);";
+  Lexer lexer(input);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 1);
+  auto statement = dynamic_cast<ast::CreateTableStatement *>(program->statements[0]);
+  ASSERT_NE(statement->options, nullptr);
+  EXPECT_EQ(statement->options->token.literal, "bloom_filter");
+  EXPECT_EQ(statement->options->value.literal, "id");
+  ASSERT_NE(statement->options->right, nullptr);
+  EXPECT_EQ(statement->options->right->value.literal, "tag");
+  EXPECT_EQ(statement->options->right->right, nullptr);
+
+  std::string bad = "CREATE TABLE events (id int) WITH (bloom_filter);";
+  Lexer bad_lexer(bad);
+  SQLParser bad_parser(&bad_lexer);
+  EXPECT_THROW(bad_parser.parseSql(), std::runtime_error);
+}
+
+TEST(ParserTest, ExplainStatement)
+{
+  std::string input = "EXPLAIN SELECT * FROM t; EXPLAIN ANALYZE SELECT id FROM t WHERE id = 1; EXPLAIN ANALYZE t;";
+  Lexer lexer(input);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 3);
+  auto plain = dynamic_cast<ast::ExplainStatement *>(program->statements[0]);
+  ASSERT_NE(plain, nullptr);
+  EXPECT_FALSE(plain->analyze);
+  EXPECT_NE(dynamic_cast<ast::SelectTableStatement *>(plain->statement), nullptr);
+  auto analyzed = dynamic_cast<ast::ExplainStatement *>(program->statements[1]);
+  EXPECT_TRUE(analyzed->analyze);
+  EXPECT_EQ(analyzed->tokenLiteral(), "EXPLAIN");
+  // ANALYZE followed by a table name is the statement explained
+  auto analyze_table = dynamic_cast<ast::ExplainStatement *>(program->statements[2]);
+  EXPECT_FALSE(analyze_table->analyze);
+  EXPECT_NE(dynamic_cast<ast::AnalyzeTableStatement *>(analyze_table->statement), nullptr);
+
+  std::string nested = "EXPLAIN EXPLAIN SELECT * FROM t;";
+  Lexer nested_lexer(nested);
+  SQLParser nested_parser(&nested_lexer);
+  EXPECT_THROW(nested_parser.parseSql(), std::runtime_error);
+}
+
 TEST(ParserTest, IdentifierExpressions)
 {
   std::string input = "applesauce123;";
@@ -200,7 +315,7 @@ TEST(ParserTest, ColumnDefinitions)
   EXPECT_EQ(expression->token.literal, "a2");
   EXPECT_EQ(expression->token_vartype.literal, "char");
   ASSERT_NE(expression->count, nullptr);
-  EXPECT_EQ(std::string(expression->count->token.type), "INT");
+  EXPECT_EQ(expression->count->token.type, token_type::INT);
   EXPECT_EQ(expression->count->token.literal, "10");
 }
 
@@ -546,7 +661,17 @@ TEST(ParserTest, ParseCommands)
   ASSERT_EQ(program->statements.size(), 1);
   ast::Statement *statement = program->statements[0];
   EXPECT_EQ(std::string(*statement), "EXIT");
-  EXPECT_EQ(std::string(statement->token.type), "EXIT");
+  EXPECT_EQ(statement->token.type, token_type::EXIT_CMD);
+
+  // Command names are only commands after a '.'
+  std::string named = "CREATE TABLE stats (exit int); SELECT exit FROM stats s, stats t WHERE s.exit = t.exit; .STATS";
+  Lexer named_lexer(named);
+  SQLParser named_parser(&named_lexer);
+  program = named_parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 3);
+  EXPECT_EQ(std::string(*dynamic_cast<ast::CreateTableStatement *>(program->statements[0])->name), "stats");
+  EXPECT_EQ(program->statements[2]->token.type, token_type::STATS_CMD);
+  EXPECT_EQ(program->statements[2]->tokenLiteral(), "STATS");
 }
 
 TEST(TableTestMem, AddFieldRecords)
@@ -588,3 +713,1399 @@ TEST(TableTestMem, AddFieldRecords)
   }
 }
 
+
+TEST(ThreadPoolTest, ParallelForCoversRange)
+{
+  ThreadPool pool(ThreadPool::Config{4, 0, false});
+  std::vector<int> hits(10000, 0);
+  pool.parallelFor(0, hits.size(), 64, [&](size_t from, size_t to) {
+    for (size_t i = from; i < to; i++) {
+      hits[i]++;
+    }
+  });
+  for (int hit : hits) {
+    ASSERT_EQ(hit, 1);
+  }
+}
+
+TEST(ThreadPoolTest, NestedParallelForAndErrors)
+{
+  ThreadPool pool(ThreadPool::Config{2, 0, false});
+  std::atomic<int> total{0};
+  pool.parallelFor(0, 8, 1, [&](size_t, size_t) {
+    pool.parallelFor(0, 100, 10, [&](size_t from, size_t to) {
+      total += to - from;
+    });
+  });
+  EXPECT_EQ(total, 800);
+  EXPECT_THROW(pool.parallelFor(0, 100, 1, [](size_t from, size_t) {
+    if (from == 42) throw std::runtime_error("morsel failed");
+  }), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, QueryParallelismLimit)
+{
+  ThreadPool pool(ThreadPool::Config{4, 0, false});
+  std::mutex lock;
+  std::set<std::thread::id> threads;
+  {
+    ThreadPool::QueryScope scope(2);
+    EXPECT_EQ(pool.parallelism(), 2);
+    pool.parallelFor(0, 1000, 1, [&](size_t, size_t) {
+      std::lock_guard<std::mutex> guard(lock);
+      threads.insert(std::this_thread::get_id());
+    });
+  }
+  EXPECT_LE(threads.size(), 2);
+  EXPECT_EQ(pool.parallelism(), 4);
+}
+
+TEST(ThreadPoolTest, CancelledTokenStopsParallelFor)
+{
+  ThreadPool pool(ThreadPool::Config{4, 0, false});
+  CancelToken token;
+  ThreadPool::CancelScope scope(&token);
+  std::atomic<int> morsels{0};
+  EXPECT_THROW(pool.parallelFor(0, 1000, 1, [&](size_t from, size_t) {
+    if (from == 10) token.cancel();
+    morsels++;
+  }), QueryCancelled);
+  EXPECT_LT(morsels, 1000);
+  try
+  {
+    CancelToken timed = CancelToken::withTimeout(std::chrono::milliseconds(0));
+    ThreadPool::CancelScope inner(&timed);
+    ThreadPool::checkCancelled();
+    FAIL() << "expected a timeout";
+  }
+  catch (const QueryCancelled &e)
+  {
+    EXPECT_TRUE(e.timed_out);
+  }
+  // The timeout only counts once a query runs under the token
+  CancelToken queued = CancelToken::withTimeout(std::chrono::milliseconds(20));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(queued.cancelled());
+  {
+    ThreadPool::CancelScope running(&queued);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_THROW(ThreadPool::checkCancelled(), QueryCancelled);
+  }
+}
+
+TEST(ScanTest, ParallelWhereRowsAcrossMorsels)
+{
+  ASSERT_TRUE(shared_pool_configured);
+  EXPECT_EQ(ThreadPool::shared().size(), 4);
+  EXPECT_FALSE(ThreadPool::configure(ThreadPool::Config{2, 0, false}));
+  TableObject table("scan_table");
+  table.addField("id", "int", 1);
+  table.addField("name", "varchar", 10);
+  table.addField("price", "float", 1);
+  int rows = ProtoGenerator::SCAN_MORSEL_ROWS * 3 + 17;
+  for (int row = 0; row < rows; row++) {
+    table.addRecord("isf", row, row % 2 ? "odd" : "even", row * 0.5);
+  }
+
+  auto all = ProtoGenerator::getWhereRows(table);
+  ASSERT_EQ(all.size(), rows);
+  EXPECT_EQ(all.back(), rows - 1);
+
+  std::tuple<std::string, std::string, std::string> where{"id", ">", "100"};
+  auto greater = ProtoGenerator::getWhereRows(table, &where);
+  ASSERT_EQ(greater.size(), rows - 101);
+  EXPECT_TRUE(std::is_sorted(greater.begin(), greater.end()));
+  EXPECT_EQ(greater.front(), 101);
+
+  where = std::make_tuple("name", "=", "odd");
+  auto odd = ProtoGenerator::getWhereRows(table, &where);
+  ASSERT_EQ(odd.size(), rows / 2);
+  for (int row : odd) {
+    ASSERT_EQ(row % 2, 1);
+  }
+
+  where = std::make_tuple("price", "=", "1.5");
+  auto price = ProtoGenerator::getWhereRows(table, &where);
+  ASSERT_EQ(price.size(), 1);
+  EXPECT_EQ(price[0], 3);
+
+  where = std::make_tuple("id", "=", "Gizmo");
+  EXPECT_EQ(ProtoGenerator::getWhereRows(table, &where).size(), 0);
+
+  // Numbers out of range of an int or double match no number and compare as text
+  where = std::make_tuple("id", "=", "99999999999");
+  EXPECT_EQ(ProtoGenerator::getWhereRows(table, &where).size(), 0);
+  where = std::make_tuple("name", "<", "99999999999");
+  EXPECT_EQ(ProtoGenerator::getWhereRows(table, &where).size(), 0);
+  where = std::make_tuple("price", ">", "1e999");
+  EXPECT_EQ(ProtoGenerator::getWhereRows(table, &where).size(), 0);
+}
+
+TEST(AggregateTest, GroupsAcrossMorsels)
+{
+  TableObject table("agg_table");
+  table.addField("id", "int", 1);
+  table.addField("name", "varchar", 10);
+  table.addField("price", "float", 1);
+  int rows = ProtoGenerator::SCAN_MORSEL_ROWS * 3 + 17;
+  for (int row = 0; row < rows; row++) {
+    table.addRecord("isf", row, row % 3 == 0 ? "fizz" : "other", row * 0.5);
+  }
+  std::vector<int> all = ProtoGenerator::getWhereRows(table);
+
+  HashAggregate grouped(table, {{ast::AggregateFunction::NONE, "name"},
+                                {ast::AggregateFunction::COUNT, "*"},
+                                {ast::AggregateFunction::MAX, "id"},
+                                {ast::AggregateFunction::SUM, "price"}}, {"name"});
+  TableObject result = grouped.run(all);
+  ASSERT_EQ(result.fields_size, 4);
+  EXPECT_EQ(result.fields[1].first, "COUNT(*)");
+  EXPECT_EQ(std::get<0>(result.fields[3].second), "float");
+  ASSERT_EQ(result.records.size(), 8);
+  // Groups come out in the order they first appear
+  EXPECT_EQ(std::get<std::string>(result.records[0]), "fizz");
+  EXPECT_EQ(std::get<int>(result.records[1]), (rows + 2) / 3);
+  EXPECT_EQ(std::get<int>(result.records[2]), (rows - 1) / 3 * 3);
+  double total = 0;
+  for (int row = 0; row < rows; row += 3) {
+    total += row * 0.5;
+  }
+  EXPECT_DOUBLE_EQ(std::get<double>(result.records[3]), total);
+  EXPECT_EQ(std::get<std::string>(result.records[4]), "other");
+  EXPECT_EQ(std::get<int>(result.records[5]), rows - (rows + 2) / 3);
+
+  HashAggregate overall(table, {{ast::AggregateFunction::AVG, "id"}, {ast::AggregateFunction::MIN, "price"}}, {});
+  result = overall.run(all);
+  ASSERT_EQ(result.records.size(), 2);
+  EXPECT_DOUBLE_EQ(std::get<double>(result.records[0]), (rows - 1) / 2.0);
+  EXPECT_DOUBLE_EQ(std::get<double>(result.records[1]), 0);
+  // No rows still gives one row, with a blank where there were no values
+  result = overall.run({});
+  ASSERT_EQ(result.records.size(), 2);
+  EXPECT_EQ(std::get<int>(result.records[0]), std::numeric_limits<int>::min());
+
+  EXPECT_THROW(HashAggregate(table, {{ast::AggregateFunction::SUM, "name"}}, {}), std::invalid_argument);
+  EXPECT_THROW(HashAggregate(table, {{ast::AggregateFunction::NONE, "id"}}, {"name"}), std::invalid_argument);
+}
+
+TEST(ParserTest, SelectStatement_Aggregates)
+{
+  std::string test = "SELECT region, count(*), SUM(qty) FROM sales WHERE qty > 2 GROUP BY region, id;";
+  Lexer lexer(test);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 1);
+  ast::SelectTableStatement *statement = dynamic_cast<ast::SelectTableStatement *>(program->statements[0]);
+  ast::ColumnQueryExpression *column_query = statement->column_query;
+  EXPECT_EQ(column_query->aggregate, nullptr);
+  column_query = column_query->right;
+  ASSERT_NE(column_query->aggregate, nullptr);
+  EXPECT_EQ(ast::aggregateFunction(column_query->aggregate->literal), ast::AggregateFunction::COUNT);
+  EXPECT_EQ(column_query->token.type, token_type::ASTERISK);
+  EXPECT_EQ(column_query->right->token.literal, "qty");
+  ASSERT_NE(statement->query, nullptr);
+  ASSERT_NE(statement->group_by, nullptr);
+  EXPECT_EQ(statement->group_by->token.literal, "region");
+  EXPECT_EQ(statement->group_by->right->token.literal, "id");
+
+  test = "SELECT SUM(*) FROM sales;";
+  Lexer star(test);
+  SQLParser star_parser(&star);
+  EXPECT_THROW(star_parser.parseSql(), expected_token_error);
+}
+
+TEST(SortTest, SpillsRunsAndMerges)
+{
+  TableObject table("sort_table");
+  table.addField("id", "int", 1);
+  table.addField("name", "varchar", 20);
+  table.addField("price", "float", 1);
+  int rows = 50000;
+  for (int row = 0; row < rows; row++) {
+    // Names share their first 8 bytes so ties fall back to the full strings
+    std::string name = "product-" + std::to_string(row % 1000);
+    table.addRecord("isf", row, name.c_str(), ((row * 7919) % rows) - rows / 2 + 0.5);
+  }
+  table.records[5 * 3 + 2] = std::numeric_limits<int>::min();
+
+  // A budget of 4096 entries spills a run every 4096 rows
+  ExternalSort by_price(table, {{2, false}}, 4096 * 16);
+  for (int row = 0; row < rows; row++) {
+    by_price.add(row);
+  }
+  by_price.finish();
+  EXPECT_GT(by_price.spilledRuns(), 10);
+  std::vector<int> order, batch;
+  while (!by_price.done()) {
+    by_price.next(1000, batch);
+    order.insert(order.end(), batch.begin(), batch.end());
+  }
+  ASSERT_EQ(order.size(), rows);
+  // Blanks come first
+  EXPECT_EQ(order[0], 5);
+  for (size_t i = 2; i < order.size(); i++) {
+    ASSERT_LT(std::get<double>(table.records[order[i - 1] * 3 + 2]), std::get<double>(table.records[order[i] * 3 + 2]));
+  }
+
+  ExternalSort by_name(table, {{1, true}, {0, false}}, 4096 * 16);
+  for (int row = 0; row < rows; row++) {
+    by_name.add(row);
+  }
+  by_name.finish();
+  order.clear();
+  while (!by_name.done()) {
+    by_name.next(777, batch);
+    order.insert(order.end(), batch.begin(), batch.end());
+  }
+  ASSERT_EQ(order.size(), rows);
+  EXPECT_EQ(std::get<std::string>(table.records[order[0] * 3 + 1]), "product-999");
+  for (size_t i = 1; i < order.size(); i++) {
+    const std::string &prev = std::get<std::string>(table.records[order[i - 1] * 3 + 1]);
+    const std::string &curr = std::get<std::string>(table.records[order[i] * 3 + 1]);
+    ASSERT_TRUE(prev > curr || (prev == curr && order[i - 1] < order[i]));
+  }
+}
+
+TEST(SortTest, TopKMatchesFullSort)
+{
+  TableObject table("top_table");
+  table.addField("id", "int", 1);
+  table.addField("score", "int", 1);
+  int rows = 20000;
+  for (int row = 0; row < rows; row++) {
+    table.addRecord("ii", row, (row * 7919) % 1000);
+  }
+  ExternalSort full(table, {{1, true}});
+  ExternalSort top(table, {{1, true}}, 0, 25);
+  for (int row = 0; row < rows; row++) {
+    full.add(row);
+    top.add(row);
+  }
+  full.finish();
+  top.finish();
+  std::vector<int> expected, kept;
+  full.next(25, expected);
+  top.next(100, kept);
+  EXPECT_EQ(kept, expected);
+  EXPECT_TRUE(top.done());
+  EXPECT_EQ(top.spilledRuns(), 0);
+}
+
+TEST(ParserTest, SelectStatement_OrderBy)
+{
+  std::string test = "SELECT region, COUNT(*) FROM sales GROUP BY region ORDER BY count(*) DESC, region;";
+  Lexer lexer(test);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 1);
+  ast::SelectTableStatement *statement = dynamic_cast<ast::SelectTableStatement *>(program->statements[0]);
+  ast::OrderByExpression *order_by = statement->order_by;
+  ASSERT_NE(order_by, nullptr);
+  ASSERT_NE(order_by->aggregate, nullptr);
+  EXPECT_TRUE(order_by->descending);
+  ASSERT_NE(order_by->right, nullptr);
+  EXPECT_EQ(order_by->right->token.literal, "region");
+  EXPECT_FALSE(order_by->right->descending);
+  EXPECT_EQ(order_by->right->aggregate, nullptr);
+}
+
+TEST(ParserTest, SelectStatement_LimitOffset)
+{
+  std::string test = "SELECT * FROM product ORDER BY price LIMIT 10 OFFSET 20;";
+  Lexer lexer(test);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 1);
+  ast::SelectTableStatement *statement = dynamic_cast<ast::SelectTableStatement *>(program->statements[0]);
+  ASSERT_NE(statement->limit, nullptr);
+  EXPECT_EQ(statement->limit->literal, "10");
+  ASSERT_NE(statement->offset, nullptr);
+  EXPECT_EQ(statement->offset->literal, "20");
+
+  std::string bad = "SELECT * FROM product LIMIT name;";
+  Lexer bad_lexer(bad);
+  SQLParser bad_parser(&bad_lexer);
+  EXPECT_THROW(bad_parser.parseSql(), std::runtime_error);
+}
+
+TEST(ParserTest, SelectStatement_FullOuterJoin) {
+  std::string test = "SELECT * FROM Employee E full outer join Sales S on E.id = S.employeeID;";
+  Lexer lexer(test);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_NE(program, nullptr);
+  ASSERT_EQ(program->statements.size(), 1);
+
+  ast::SelectTableStatement *statement = dynamic_cast<ast::SelectTableStatement *>(program->statements[0]);
+  ast::JoinExpression *join_expr = statement->join_expr;
+  EXPECT_EQ(join_expr->token.literal, "outer");
+  EXPECT_EQ(join_expr->include->type, token_type::FULL);
+  EXPECT_EQ(join_expr->join_ident->literal, "Sales");
+  EXPECT_EQ(join_expr->where->value_alias->literal, "employeeID");
+}
+
+TEST(JoinTest, PartitionedHashJoinMatchesNestedLoop)
+{
+  TableObject left("left_table");
+  left.addField("id", "int", 1);
+  left.addField("name", "varchar", 10);
+  TableObject right("right_table");
+  right.addField("left_id", "int", 1);
+  right.addField("amount", "int", 1);
+  // Enough build rows for several partitions
+  int left_rows = 600;
+  int right_rows = ProtoGenerator::JOIN_PARTITION_ROWS * 2 + 1;
+  for (int row = 0; row < left_rows; row++) {
+    left.addRecord("is", row, "name");
+  }
+  for (int row = 0; row < right_rows; row++) {
+    // Keys 400..4399 so some rows on each side find no match, duplicates on the right
+    right.addRecord("ii", 400 + (row % 4000), row);
+  }
+
+  std::vector<char> left_matched, right_matched;
+  auto pairs = ProtoGenerator::hashJoinRows(left, 0, right, 0, left_matched, right_matched);
+
+  std::vector<std::pair<int, int>> expected;
+  for (int l = 0; l < left_rows; l++) {
+    for (int r = 0; r < right_rows; r++) {
+      if (std::get<int>(left.records[l * 2]) == std::get<int>(right.records[r * 2])) {
+        expected.emplace_back(l, r);
+      }
+    }
+  }
+  ASSERT_EQ(pairs, expected);
+  EXPECT_FALSE(left_matched[399]);
+  EXPECT_TRUE(left_matched[400]);
+  EXPECT_TRUE(right_matched[0]);
+  EXPECT_FALSE(right_matched[1000]);
+
+  // The sort merge join streams the same pairs out of sorts that spill runs
+  ExternalSort::configure(1 << 10);
+  std::vector<char> sorted_left, sorted_right;
+  EXPECT_EQ(ProtoGenerator::sortMergeJoinRows(left, 0, right, 0, sorted_left, sorted_right), expected);
+  EXPECT_EQ(sorted_left, left_matched);
+  EXPECT_EQ(sorted_right, right_matched);
+
+  // Runs of equal keys that cross the morsels read from the sorts
+  TableObject wide_left("wide_left"), wide_right("wide_right");
+  wide_left.addField("k", "int", 1);
+  wide_right.addField("k", "int", 1);
+  int wide_rows = ProtoGenerator::SCAN_MORSEL_ROWS + 100;
+  for (int row = 0; row < wide_rows; row++) {
+    wide_left.addRecord("i", row / 3);
+    wide_right.addRecord("i", (wide_rows - row) / 2);
+  }
+  std::unordered_map<int, std::vector<int>> right_by_key;
+  for (int row = 0; row < wide_rows; row++) {
+    right_by_key[std::get<int>(wide_right.records[row])].push_back(row);
+  }
+  expected.clear();
+  for (int row = 0; row < wide_rows; row++) {
+    for (int right_row : right_by_key[std::get<int>(wide_left.records[row])]) {
+      expected.emplace_back(row, right_row);
+    }
+  }
+  EXPECT_EQ(ProtoGenerator::sortMergeJoinRows(wide_left, 0, wide_right, 0, sorted_left, sorted_right), expected);
+  ExternalSort::configure(ExternalSort::DEFAULT_MEMORY_BUDGET);
+}
+
+TEST(LoadTest, ParallelLoadKeepsTablesAndTimings)
+{
+  paths::DATA_PATH = fs::temp_directory_path() / "sql_test_load";
+  fs::remove_all(paths::DATA_PATH);
+  ASSERT_TRUE(ProtoGenerator::createDB("db"));
+  fieldmapType fields = {{"id", make_tuple("int", 1)}, {"name", make_tuple("varchar", 10)}};
+  for (int t = 0; t < 8; t++) {
+    std::string name = "tbl_" + std::to_string(t);
+    ProtoGenerator::createTBL("db", name, fields);
+    for (int row = 0; row <= t; row++) {
+      ProtoGenerator::insertTBL("db", name, {row, std::string("n") + std::to_string(row)});
+    }
+  }
+
+  DatabaseObject db = ProtoGenerator::loadDB("db");
+  ASSERT_EQ(db.tables.size(), 8);
+  ASSERT_EQ(db.load_timings.size(), 8);
+  for (int i = 0; i < db.tables.size(); i++) {
+    const TableObject &tbl = db.tables[i];
+    EXPECT_EQ(db.load_timings[i].first, tbl.name());
+    int t = std::stoi(tbl.name().substr(4));
+    ASSERT_EQ(tbl.records.size(), (t + 1) * 2) << tbl.name();
+    EXPECT_EQ(std::get<int>(tbl.records[t * 2]), t);
+    EXPECT_EQ(std::get<std::string>(tbl.records[t * 2 + 1]), "n" + std::to_string(t));
+  }
+  // .STATS shows them for the database in use
+  std::unique_ptr<object::Result> stats(evalStats(nullptr, &db));
+  EXPECT_NE(stats->message.find("\nTable loads (db): "), std::string::npos);
+  for (const auto &timing : db.load_timings) {
+    EXPECT_NE(stats->message.find(" " + timing.first + " "), std::string::npos) << timing.first;
+  }
+  fs::remove_all(paths::DATA_PATH);
+}
+
+TEST(LoadTest, ProjectedLoadKeepsOnlyNamedColumns)
+{
+  paths::DATA_PATH = fs::temp_directory_path() / "sql_test_projection";
+  fs::remove_all(paths::DATA_PATH);
+  ASSERT_TRUE(ProtoGenerator::createDB("db"));
+  fieldmapType fields = {{"id", make_tuple("int", 1)}, {"name", make_tuple("varchar", 10)}, {"price", make_tuple("float", 1)}};
+  ProtoGenerator::createTBL("db", "wide", fields);
+  for (int row = 0; row < 5; row++) {
+    ProtoGenerator::insertTBL("db", "wide", {row, std::string("n") + std::to_string(row), row + 0.5});
+  }
+
+  std::vector<std::string> columns = {"price", "id"};
+  std::shared_ptr<TableObject> tbl = ProtoGenerator::openTBL("db", "wide", std::numeric_limits<size_t>::max(), &columns);
+  ASSERT_NE(tbl, nullptr);
+  // Kept columns stay in table order
+  ASSERT_EQ(tbl->fields_size, 2);
+  EXPECT_EQ(tbl->fields[0].first, "id");
+  EXPECT_EQ(tbl->fields[1].first, "price");
+  ASSERT_EQ(tbl->records.size(), 10);
+  EXPECT_EQ(std::get<int>(tbl->records[6]), 3);
+  EXPECT_DOUBLE_EQ(std::get<double>(tbl->records[7]), 3.5);
+
+  // Rows are still counted when no column is named
+  std::vector<std::string> none;
+  tbl = ProtoGenerator::openTBL("db", "wide", std::numeric_limits<size_t>::max(), &none);
+  ASSERT_EQ(tbl->fields_size, 1);
+  EXPECT_EQ(tbl->records.size(), 5);
+  fs::remove_all(paths::DATA_PATH);
+}
+
+TEST(LoadTest, ZoneMapsSkipPagesThatCantMatch)
+{
+  paths::DATA_PATH = fs::temp_directory_path() / "sql_test_zones";
+  fs::remove_all(paths::DATA_PATH);
+  ASSERT_TRUE(ProtoGenerator::createDB("db"));
+  fieldmapType fields = {{"id", make_tuple("int", 1)}, {"name", make_tuple("varchar", 10)}};
+  ProtoGenerator::createTBL("db", "events", fields);
+  int rows = 3 * ZoneMap::PAGE_ROWS;
+  std::vector<variant_type> values;
+  for (int row = 0; row < rows; row++) {
+    values.push_back(row);
+    values.push_back(std::string("n") + std::to_string(row % 10));
+  }
+  ProtoGenerator::insertTBL("db", "events", values);
+  fs::path tbl_path = paths::DATA_PATH / "db" / "events.proto";
+  ZoneMap zones;
+  ASSERT_TRUE(zones.load(tbl_path));
+  ASSERT_EQ(zones.pages.size(), 3);
+  EXPECT_EQ(std::get<int>(zones.pages[1].zones[0].min), ZoneMap::PAGE_ROWS);
+  EXPECT_EQ(std::get<std::string>(zones.pages[2].zones[1].max), "n9");
+
+  // Only the last page can hold ids past the second page
+  auto where = make_tuple(std::string("id"), std::string(">"), std::to_string(2 * ZoneMap::PAGE_ROWS));
+  std::shared_ptr<TableObject> tbl = ProtoGenerator::openTBL("db", "events", std::numeric_limits<size_t>::max(), nullptr, &where);
+  ASSERT_EQ(tbl->records.size() / 2, ZoneMap::PAGE_ROWS);
+  EXPECT_EQ(std::get<int>(tbl->records[0]), 2 * ZoneMap::PAGE_ROWS);
+  EXPECT_EQ(ProtoGenerator::getWhereRows(*tbl, &where).size(), ZoneMap::PAGE_ROWS - 1);
+  where = make_tuple(std::string("id"), std::string("<"), std::string("0"));
+  EXPECT_EQ(ProtoGenerator::openTBL("db", "events", std::numeric_limits<size_t>::max(), nullptr, &where)->records.size(), 0);
+
+  // Appended rows extend the zone map in a new page
+  ASSERT_TRUE(ProtoGenerator::appendTBL("db", "events", {{-1, std::string("late")}, {std::numeric_limits<int>::min(), std::string("blank")}}));
+  fs::path csv = paths::DATA_PATH / "events.csv";
+  std::ofstream(csv) << "id,name\n7,csv\n-5,csv\n";
+  ASSERT_EQ(ProtoGenerator::copyFromCSV("db", "events", csv.string()), 2);
+  ASSERT_TRUE(zones.load(tbl_path));
+  ASSERT_EQ(zones.pages.size(), 4);
+  const ZoneMap::Zone &ids = zones.pages[3].zones[0];
+  EXPECT_EQ(zones.pages[3].rows, 4);
+  EXPECT_EQ(ids.nulls, 1);
+  EXPECT_EQ(ids.values, 3);
+  EXPECT_EQ(std::get<int>(ids.min), -5);
+  EXPECT_EQ(std::get<int>(ids.max), 7);
+  // Blanks are INT_MIN, which passes id < 0, so the new page is read and the others aren't
+  tbl = ProtoGenerator::openTBL("db", "events", std::numeric_limits<size_t>::max(), nullptr, &where);
+  ASSERT_EQ(tbl->records.size() / 2, 4);
+  EXPECT_EQ(ProtoGenerator::getWhereRows(*tbl, &where).size(), 3);
+  where = make_tuple(std::string("id"), std::string("="), std::string("7"));
+  tbl = ProtoGenerator::openTBL("db", "events", std::numeric_limits<size_t>::max(), nullptr, &where);
+  EXPECT_EQ(tbl->records.size() / 2, ZoneMap::PAGE_ROWS + 4);
+
+  // Deletes rewrite the table and its zone map
+  int deleted = 0;
+  where = make_tuple(std::string("id"), std::string("<"), std::to_string(ZoneMap::PAGE_ROWS));
+  ProtoGenerator::deleteTBL("db", "events", &deleted, &where);
+  ASSERT_TRUE(zones.load(tbl_path));
+  EXPECT_EQ(deleted, ZoneMap::PAGE_ROWS + 4);
+  ASSERT_EQ(zones.pages.size(), 2);
+  EXPECT_EQ(std::get<int>(zones.pages[0].zones[0].min), ZoneMap::PAGE_ROWS);
+  EXPECT_EQ(zones.pages[1].rows, ZoneMap::PAGE_ROWS);
+  EXPECT_EQ(zones.pages[1].zones[0].nulls, 0);
+
+  // The last value of a file is read even when it ends a one column row
+  ProtoGenerator::createTBL("db", "single", {{"id", make_tuple("int", 1)}});
+  ProtoGenerator::insertTBL("db", "single", {1, 2, 3});
+  EXPECT_EQ(ProtoGenerator::openTBL("db", "single")->records.size(), 3);
+  fs::remove_all(paths::DATA_PATH);
+}
+
+TEST(LoadTest, ZoneMapsRewrittenByAnotherProcess)
+{
+  // The other process's database is the same table in another data path, copied over once updated
+  fs::path root = fs::temp_directory_path() / "sql_test_zones_shared";
+  fs::remove_all(root);
+  fieldmapType fields = {{"seat", make_tuple("int", 1)}, {"status", make_tuple("int", 1)}};
+  std::vector<variant_type> values;
+  for (int seat = 0; seat < 100; seat++) {
+    values.push_back(seat);
+    values.push_back(0);
+  }
+  for (const char *copy : {"here", "other"}) {
+    paths::DATA_PATH = root / copy;
+    ASSERT_TRUE(ProtoGenerator::createDB("db"));
+    ProtoGenerator::createTBL("db", "flights", fields);
+    ProtoGenerator::insertTBL("db", "flights", values);
+  }
+  fs::path here = root / "here" / "db" / "flights.proto", other = root / "other" / "db" / "flights.proto";
+  paths::DATA_PATH = root / "here";
+  auto where = make_tuple(std::string("status"), std::string("="), std::string("1"));
+  EXPECT_EQ(ProtoGenerator::openTBL("db", "flights", std::numeric_limits<size_t>::max(), nullptr, &where)->records.size(), 0);
+
+  // The update keeps the size of the table
+  paths::DATA_PATH = root / "other";
+  int updated = 0;
+  auto seat = make_tuple(std::string("seat"), std::string("="), std::string("22"));
+  ProtoGenerator::updateTBL("db", "flights", {{"status", "1"}}, &updated, &seat);
+  ASSERT_EQ(updated, 1);
+  ASSERT_EQ(fs::file_size(other), fs::file_size(here));
+  fs::copy_file(other, here, fs::copy_options::overwrite_existing);
+  fs::last_write_time(here, fs::last_write_time(other));
+  fs::copy_file(ZoneMap::pathFor(other), ZoneMap::pathFor(here), fs::copy_options::overwrite_existing);
+
+  // The cached zone map is dropped for the one saved with the update
+  paths::DATA_PATH = root / "here";
+  std::shared_ptr<const ZoneMap> zones = ZoneMap::open(here);
+  ASSERT_NE(zones, nullptr);
+  EXPECT_EQ(std::get<int>(zones->pages[0].zones[1].max), 1);
+  std::shared_ptr<TableObject> tbl = ProtoGenerator::openTBL("db", "flights", std::numeric_limits<size_t>::max(), nullptr, &where);
+  EXPECT_EQ(ProtoGenerator::getWhereRows(*tbl, &where).size(), 1);
+
+  // A table rewritten without its zone map isn't paired with the old one
+  std::ofstream(here, std::ios::app) << "\n100, 1";
+  EXPECT_EQ(ZoneMap::open(here), nullptr);
+  fs::remove_all(root);
+}
+
+TEST(LoadTest, TableStatsRewrittenByAnotherProcess)
+{
+  // As with the zone maps, the other process's table is updated in another data path and copied over
+  fs::path root = fs::temp_directory_path() / "sql_test_stats_shared";
+  fs::remove_all(root);
+  fieldmapType fields = {{"seat", make_tuple("int", 1)}, {"status", make_tuple("int", 1)}};
+  std::vector<variant_type> values;
+  for (int seat = 0; seat < 100; seat++) {
+    values.push_back(seat);
+    values.push_back(0);
+  }
+  for (const char *copy : {"here", "other"}) {
+    paths::DATA_PATH = root / copy;
+    ASSERT_TRUE(ProtoGenerator::createDB("db"));
+    ProtoGenerator::createTBL("db", "flights", fields);
+    ProtoGenerator::insertTBL("db", "flights", values);
+    ProtoGenerator::analyzeTBL("db", "flights");
+  }
+  fs::path here = root / "here" / "db" / "flights.proto", other = root / "other" / "db" / "flights.proto";
+  ASSERT_NE(TableStats::open(here), nullptr);
+  EXPECT_EQ(std::get<int>(TableStats::open(here)->columns[1].bounds.back()), 0);
+
+  paths::DATA_PATH = root / "other";
+  int updated = 0;
+  auto seat = make_tuple(std::string("seat"), std::string("="), std::string("22"));
+  ProtoGenerator::updateTBL("db", "flights", {{"status", "1"}}, &updated, &seat);
+  ASSERT_EQ(fs::file_size(other), fs::file_size(here));
+  fs::copy_file(other, here, fs::copy_options::overwrite_existing);
+  fs::last_write_time(here, fs::last_write_time(other));
+  fs::copy_file(TableStats::pathFor(other), TableStats::pathFor(here), fs::copy_options::overwrite_existing);
+
+  // The statistics cached before are dropped for the ones collected by the update
+  std::shared_ptr<const TableStats> stats = TableStats::open(here);
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(std::get<int>(stats->columns[1].bounds.back()), 1);
+  std::ofstream(here, std::ios::app) << "\n100, 1";
+  EXPECT_EQ(TableStats::open(here), nullptr);
+  fs::remove_all(root);
+}
+
+TEST(ArenaTest, ReleaseDestroysNodesAndReusesBlocks)
+{
+  Arena arena(1024);
+  std::string test = "UPDATE Product SET price = 14.99 WHERE name = 'Gizmo';";
+  size_t capacity = 0;
+  for (int i = 0; i < 100; i++)
+  {
+    Lexer lexer(test);
+    SQLParser parser(&lexer, &arena);
+    ast::Program *program = parser.parseSql();
+    ASSERT_EQ(program->statements.size(), 1);
+    EXPECT_GT(arena.bytesUsed(), 0);
+    arena.release();
+    EXPECT_EQ(arena.bytesUsed(), 0);
+    if (i == 0)
+    {
+      capacity = arena.capacity();
+    }
+    EXPECT_EQ(arena.capacity(), capacity);
+  }
+
+  // Destructors run once per object and oversized blocks are dropped
+  struct Counted
+  {
+    int *count;
+    std::string padding = std::string(64, 'x');
+    Counted(int *count) : count(count) {}
+    ~Counted() { (*count)++; }
+  };
+  int destroyed = 0;
+  for (int i = 0; i < 50; i++)
+  {
+    arena.make<Counted>(&destroyed);
+  }
+  arena.allocate(4096);
+  EXPECT_GT(arena.capacity(), capacity);
+  arena.release();
+  EXPECT_EQ(destroyed, 50);
+  EXPECT_LE(arena.capacity(), capacity);
+}
+
+TEST(ScriptTest, SplitStatementsAcrossLines)
+{
+  std::string script = "-- header comment; not a statement\n"
+                       "CREATE TABLE t (a int,\n  b varchar(10));\n"
+                       "insert into t values(1, 'a;b'); -- trailing; comment\n"
+                       "  .EXIT\n"
+                       "select * from t";
+  std::vector<std::string_view> statements = splitStatements(script);
+  ASSERT_EQ(statements.size(), 4);
+  EXPECT_EQ(statements[0], "CREATE TABLE t (a int,\n  b varchar(10));");
+  EXPECT_EQ(statements[1], "insert into t values(1, 'a;b');");
+  EXPECT_EQ(statements[2], ".EXIT");
+  EXPECT_EQ(statements[3], "select * from t");
+
+  // One parser reused across the statements
+  Arena arena;
+  Lexer empty("");
+  SQLParser parser(&empty, &arena);
+  for (std::string_view statement : {statements[0], std::string_view("insert into t values(1, 'ab');")})
+  {
+    Lexer lexer(statement);
+    parser.reset(&lexer);
+    ast::Program *program = parser.parseSql();
+    ASSERT_EQ(program->statements.size(), 1);
+  }
+}
+
+TEST(InsertTest, MultiRowValuesAppendInOneBatch)
+{
+  std::string test = "INSERT INTO product VALUES (1, 'Gizmo', 19.99), (2, 'Widget', 5);";
+  Lexer lexer(test);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 1);
+  auto statement = dynamic_cast<ast::InsertTableStatement *>(program->statements[0]);
+  ASSERT_NE(statement, nullptr);
+  ASSERT_EQ(statement->rows.size(), 2);
+  EXPECT_EQ(statement->column_list, statement->rows[0]);
+  EXPECT_EQ(statement->rows[1]->token.literal, "2");
+  EXPECT_EQ(statement->rows[1]->right->right->token.literal, "5");
+
+  paths::DATA_PATH = fs::temp_directory_path() / "sql_test_insert";
+  fs::remove_all(paths::DATA_PATH);
+  ASSERT_TRUE(ProtoGenerator::createDB("db"));
+  fieldmapType fields = {{"pid", make_tuple("int", 1)}, {"name", make_tuple("varchar", 20)}, {"price", make_tuple("float", 1)}};
+  ProtoGenerator::createTBL("db", "product", fields);
+  ASSERT_TRUE(ProtoGenerator::appendTBL("db", "product", {{1, std::string("Gizmo"), 19.99}, {2, std::string("Widget"), 5}}));
+  ASSERT_TRUE(ProtoGenerator::appendTBL("db", "product", {{3, std::string("Gadget"), 1.5}}));
+  // A bad row rejects the whole batch
+  EXPECT_THROW(ProtoGenerator::appendTBL("db", "product", {{4, std::string("ok"), 1.0}, {5, 6, 7.0}}), std::invalid_argument);
+  EXPECT_THROW(ProtoGenerator::appendTBL("db", "product", {{4, std::string("short")}}), std::invalid_argument);
+  EXPECT_FALSE(ProtoGenerator::appendTBL("db", "missing", {{1}}));
+
+  DatabaseObject db = ProtoGenerator::loadDB("db");
+  ASSERT_EQ(db.tables.size(), 1);
+  const TableObject &tbl = db.tables[0];
+  ASSERT_EQ(tbl.records.size(), 9);
+  EXPECT_EQ(std::get<std::string>(tbl.records[4]), "Widget");
+  EXPECT_DOUBLE_EQ(std::get<double>(tbl.records[5]), 5.0);
+  EXPECT_EQ(std::get<int>(tbl.records[6]), 3);
+  fs::remove_all(paths::DATA_PATH);
+}
+
+TEST(InsertTest, BoolColumnsRejectedWhenCreated)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_bool";
+  fs::remove_all(data);
+  Database database(data.string());
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db;");
+  // A table with a bool column could never be inserted into
+  ResultSet created = connection.execute("CREATE TABLE flags (id int, active bool);");
+  EXPECT_EQ(created.status(), Status::FAILED);
+  EXPECT_NE(created.message().find("column active is a bool"), std::string::npos);
+  EXPECT_FALSE(fs::exists(data / "db" / "flags.proto"));
+
+  ASSERT_TRUE(connection.execute("CREATE TABLE flags (id int);").ok());
+  EXPECT_EQ(connection.execute("ALTER TABLE flags ADD active BOOL;").status(), Status::FAILED);
+  ASSERT_TRUE(connection.execute("INSERT INTO flags VALUES (1), (2);").ok());
+  ResultSet rows = connection.execute("SELECT * FROM flags;");
+  ASSERT_EQ(rows.columnCount(), 1);
+  EXPECT_EQ(rows.rowCount(), 2);
+  fs::remove_all(data);
+}
+
+TEST(CopyTest, CSVImportExportRoundTrip)
+{
+  std::string test = "COPY product FROM '/tmp/extract-01.csv';";
+  Lexer lexer(test);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 1);
+  auto statement = dynamic_cast<ast::CopyTableStatement *>(program->statements[0]);
+  ASSERT_NE(statement, nullptr);
+  EXPECT_EQ(statement->name->value, "product");
+  EXPECT_EQ(statement->direction.type, token_type::FROM);
+  EXPECT_EQ(statement->path.literal, "/tmp/extract-01.csv");
+
+  paths::DATA_PATH = fs::temp_directory_path() / "sql_test_copy";
+  fs::remove_all(paths::DATA_PATH);
+  ASSERT_TRUE(ProtoGenerator::createDB("db"));
+  fieldmapType fields = {{"pid", make_tuple("int", 1)}, {"name", make_tuple("varchar", 20)}, {"price", make_tuple("float", 1)}};
+  ProtoGenerator::createTBL("db", "product", fields);
+  std::string csv_in = (paths::DATA_PATH / "in.csv").string();
+  std::string csv_out = (paths::DATA_PATH / "out.csv").string();
+  {
+    std::ofstream csv(csv_in);
+    csv << "pid,name,price\r\n";
+    for (int i = 0; i < 1000; i++)
+    {
+      csv << i << "," << (i % 2 ? "\"a,\"\"b\"\"\"" : "plain") << "," << i << ".5\n";
+    }
+  }
+  EXPECT_EQ(ProtoGenerator::copyFromCSV("db", "product", csv_in), 1000);
+  EXPECT_EQ(ProtoGenerator::copyFromCSV("db", "missing", csv_in), -1);
+  EXPECT_EQ(ProtoGenerator::copyToCSV("db", "product", csv_out), 1000);
+
+  std::ifstream csv(csv_out);
+  std::string line;
+  std::getline(csv, line);
+  EXPECT_EQ(line, "pid,name,price");
+  std::getline(csv, line);
+  EXPECT_EQ(line, "0,plain,0.5");
+  std::getline(csv, line);
+  EXPECT_EQ(line, "1,\"a,\"\"b\"\"\",1.5");
+
+  {
+    std::ofstream bad(csv_in);
+    bad << "1,ok,2\n2,three\n";
+  }
+  EXPECT_THROW(ProtoGenerator::copyFromCSV("db", "product", csv_in), std::invalid_argument);
+  EXPECT_EQ(ProtoGenerator::loadDB("db").tables[0].records.size(), 3000);
+  fs::remove_all(paths::DATA_PATH);
+}
+
+TEST(PreparedTest, PlaceholdersBindAtExecute)
+{
+  std::string test = "PREPARE up AS UPDATE product SET price = $2 WHERE pid = $1;";
+  Lexer lexer(test);
+  SQLParser parser(&lexer);
+  ast::Program *program = parser.parseSql();
+  ASSERT_EQ(program->statements.size(), 1);
+  auto statement = dynamic_cast<ast::PrepareStatement *>(program->statements[0]);
+  ASSERT_NE(statement, nullptr);
+  EXPECT_EQ(statement->name->value, "up");
+  EXPECT_EQ(statement->param_count, 2);
+  EXPECT_EQ(statement->text, "UPDATE product SET price = $2 WHERE pid = $1;");
+
+  // Placeholders outside of PREPARE are rejected
+  std::string bad = "INSERT INTO product VALUES (?, 'a', 1);";
+  Lexer bad_lexer(bad);
+  SQLParser bad_parser(&bad_lexer);
+  EXPECT_THROW(bad_parser.parseSql(), expected_token_error);
+  // So are numbers past the last placeholder, however many digits they have
+  for (std::string number : {"$0", "$65537", "$99999999999999999999"})
+  {
+    std::string text = "PREPARE p AS SELECT * FROM product WHERE pid = " + number + ";";
+    Lexer number_lexer(text);
+    SQLParser number_parser(&number_lexer);
+    EXPECT_THROW(number_parser.parseSql(), expected_token_error) << number;
+  }
+
+  paths::DATA_PATH = fs::temp_directory_path() / "sql_test_prepared";
+  fs::remove_all(paths::DATA_PATH);
+  ASSERT_TRUE(ProtoGenerator::createDB("db"));
+  fieldmapType fields = {{"pid", make_tuple("int", 1)}, {"name", make_tuple("varchar", 20)}, {"price", make_tuple("float", 1)}};
+  ProtoGenerator::createTBL("db", "product", fields);
+  DatabaseObject db("db");
+
+  PreparedStatement insert("INSERT INTO product VALUES (?, ?, ?);");
+  EXPECT_EQ(insert.paramCount(), 3);
+  for (int i = 0; i < 20; i++)
+  {
+    insert.execute({i, std::string("item") + std::to_string(i), i * 2.0}, &db);
+  }
+  EXPECT_THROW(insert.execute({1}, &db), std::invalid_argument);
+  PreparedStatement update(std::string(statement->text));
+  update.execute({7, 0.5}, &db);
+  // Values bound before a move are the ones run after it
+  update.bind({9, 1.5});
+  PreparedStatement moved(std::move(update));
+  moved.execute(&db);
+  PreparedStatement assigned("DELETE FROM product WHERE pid = ?;");
+  assigned.bind({19});
+  update = std::move(assigned);
+  update.execute(&db);
+
+  DatabaseObject loaded = ProtoGenerator::loadDB("db");
+  ASSERT_EQ(loaded.tables.size(), 1);
+  const TableObject &tbl = loaded.tables[0];
+  ASSERT_EQ(tbl.records.size(), 57);
+  EXPECT_EQ(std::get<std::string>(tbl.records[3 * 5 + 1]), "item5");
+  EXPECT_DOUBLE_EQ(std::get<double>(tbl.records[3 * 5 + 2]), 10.0);
+  EXPECT_DOUBLE_EQ(std::get<double>(tbl.records[3 * 7 + 2]), 0.5);
+  EXPECT_DOUBLE_EQ(std::get<double>(tbl.records[3 * 9 + 2]), 1.5);
+  fs::remove_all(paths::DATA_PATH);
+}
+
+TEST(PlanCacheTest, FingerprintsShareOnePlan)
+{
+  Fingerprint first = fingerprintStatement("update product set price = 2.5 where pid = 3;");
+  Fingerprint second = fingerprintStatement("UPDATE product SET price = 0.75 WHERE pid = 12;");
+  EXPECT_TRUE(first.cacheable);
+  EXPECT_EQ(first.text, second.text);
+  ASSERT_EQ(second.literals.size(), 2);
+  EXPECT_EQ(second.literals[0].first, token_type::FLOAT);
+  EXPECT_EQ(second.literals[1].first, token_type::INT);
+  EXPECT_EQ(second.literals[1].second, "12");
+  EXPECT_NE(first.text, fingerprintStatement("select name from product where pid = 'a';").text);
+  EXPECT_FALSE(fingerprintStatement("create table t (a int);").cacheable);
+  EXPECT_FALSE(fingerprintStatement("select * from t where a = ?;").cacheable);
+
+  PlanCache cache(2);
+  auto plan = cache.get(first.text);
+  ASSERT_NE(plan, nullptr);
+  EXPECT_EQ(plan->paramCount(), 2);
+  EXPECT_EQ(cache.get(second.text), plan);
+  cache.get(fingerprintStatement("delete from product where pid = 1;").text);
+  cache.get(fingerprintStatement("select * from product where price > 1.5;").text);
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.hits, 1);
+  EXPECT_EQ(cache.misses, 3);
+  EXPECT_EQ(cache.evictions, 1);
+  // The evicted plan stays usable by whoever still holds it
+  EXPECT_EQ(plan->paramCount(), 2);
+}
+
+TEST(LibraryTest, ConnectionsHaveTheirOwnSessions)
+{
+  fs::path first_path = fs::temp_directory_path() / "sql_test_session_first";
+  fs::path second_path = fs::temp_directory_path() / "sql_test_session_second";
+  fs::remove_all(first_path);
+  fs::remove_all(second_path);
+  Database first(first_path.string()), second(second_path.string());
+  Connection one = first.connect(), other = first.connect(), elsewhere = second.connect();
+
+  // Each database keeps its tables in its own directory
+  one.executeScript("CREATE DATABASE db; USE db; CREATE TABLE t (id int); INSERT INTO t VALUES (1);");
+  elsewhere.executeScript("CREATE DATABASE db; USE db; CREATE TABLE t (id int); INSERT INTO t VALUES (2), (3);");
+  EXPECT_EQ(one.execute("SELECT * FROM t;").rowCount(), 1);
+  EXPECT_EQ(elsewhere.execute("SELECT * FROM t;").rowCount(), 2);
+  EXPECT_TRUE(fs::exists(first_path / "db" / "t.proto"));
+  EXPECT_TRUE(fs::exists(second_path / "db" / "t.proto"));
+
+  // Statements prepared on a connection are its own
+  ASSERT_TRUE(one.execute("PREPARE find AS SELECT * FROM t WHERE id = ?;").ok());
+  EXPECT_EQ(one.execute("EXECUTE find(1);").rowCount(), 1);
+  ASSERT_TRUE(other.execute("USE db;").ok());
+  EXPECT_EQ(other.execute("EXECUTE find(1);").status(), Status::FAILED);
+
+  // So are transactions, the other connection finds the table locked by the first
+  ASSERT_TRUE(one.executeScript("BEGIN TRANSACTION; UPDATE t SET id = 5 WHERE id = 1;").back().ok());
+  ASSERT_TRUE(other.execute("BEGIN TRANSACTION;").ok());
+  EXPECT_EQ(other.execute("UPDATE t SET id = 6 WHERE id = 1;").message(), "Error: Table t is locked!");
+  EXPECT_EQ(other.execute("COMMIT;").message(), "Transaction abort.");
+  EXPECT_EQ(one.execute("COMMIT;").message(), "Transaction committed.");
+  EXPECT_EQ(std::get<int>(other.execute("SELECT * FROM t;").row(0)[0]), 5);
+  fs::remove_all(first_path);
+  fs::remove_all(second_path);
+}
+
+TEST(LibraryTest, ConnectionReturnsTypedResults)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_library";
+  fs::remove_all(data);
+  Database database(data.string());
+  Connection connection = database.connect();
+
+  testing::internal::CaptureStdout();
+  std::vector<ResultSet> results = connection.executeScript(
+      "CREATE DATABASE db;\n"
+      "USE db;\n"
+      "CREATE TABLE product (pid int, name varchar(20), price float);\n"
+      "INSERT INTO product VALUES (1, 'Gizmo', 19.99), (2, 'Widget', 5.5);\n"
+      "SELECT name, price FROM product WHERE pid > 1;\n"
+      "SELECT * FROM missing;\n"
+      "SELEC * FROM product;\n");
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+
+  ASSERT_EQ(results.size(), 7);
+  EXPECT_TRUE(results[0].ok());
+  EXPECT_EQ(results[0].message(), "Database db created.");
+  EXPECT_EQ(connection.currentDatabase(), "db");
+  EXPECT_EQ(results[3].message(), "2 new records inserted.");
+  EXPECT_FALSE(results[3].hasRows());
+
+  const ResultSet &select = results[4];
+  ASSERT_TRUE(select.hasRows());
+  EXPECT_EQ(select.columns(), (std::vector<std::string>{"name", "price"}));
+  EXPECT_EQ(select.columnTypes(), (std::vector<std::string>{"varchar(20)", "float"}));
+  ASSERT_EQ(select.rowCount(), 1);
+  for (const ResultSet::Row &row : select)
+  {
+    EXPECT_EQ(row.get<std::string>(0), "Widget");
+    EXPECT_DOUBLE_EQ(row.get<double>(1), 5.5);
+    EXPECT_FALSE(row.isNull(1));
+  }
+  EXPECT_EQ(select.format(), "| name varchar(20) | price float | \n| Widget | 5.5 | \n");
+
+  EXPECT_EQ(results[5].status(), Status::FAILED);
+  EXPECT_EQ(results[6].status(), Status::ERROR);
+  // Values that don't fit their column fail the statement instead of the process
+  ResultSet overflow = connection.execute("INSERT INTO product VALUES (3, 'Fits', 1.0), (99999999999, 'Big', 1.0);");
+  EXPECT_EQ(overflow.status(), Status::FAILED);
+  EXPECT_EQ(overflow.message(), "!Failed to insert into product, row 2 has an invalid value 99999999999.");
+  EXPECT_EQ(connection.execute("UPDATE product SET pid = 'zz' WHERE name = 'Gizmo';").message(),
+            "!Failed to update product, zz is not a valid value for pid.");
+  EXPECT_EQ(connection.execute("UPDATE product SET price = 'cheap' WHERE name = 'Gizmo';").status(), Status::FAILED);
+  EXPECT_EQ(connection.execute("SELECT * FROM product;").rowCount(), 2);
+  EXPECT_EQ(connection.execute(".EXIT").status(), Status::EXIT);
+  fs::remove_all(data);
+}
+
+TEST(LibraryTest, CursorFetchesTypedBatches)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_cursor";
+  fs::remove_all(data);
+  Database database(data.string());
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db; CREATE TABLE product (pid int, name varchar(20), price float);");
+  std::string insert = "INSERT INTO product VALUES (0, 'item0', 0.0)";
+  for (int i = 1; i < 100; i++)
+  {
+    insert += ", (" + std::to_string(i) + ", 'item" + std::to_string(i) + "', " + std::to_string(i) + ".5)";
+  }
+  ASSERT_TRUE(connection.execute(insert + ";").ok());
+
+  Cursor cursor = connection.query("SELECT pid, name, price FROM product WHERE pid > 9;");
+  ASSERT_TRUE(cursor.hasRows());
+  EXPECT_EQ(cursor.columns(), (std::vector<std::string>{"pid", "name", "price"}));
+  size_t fetched = 0;
+  int expected = 10;
+  while (!cursor.done())
+  {
+    RowBatch batch = cursor.fetch(32);
+    EXPECT_LE(batch.size(), 32);
+    ASSERT_EQ(batch.columnCount(), 3);
+    EXPECT_EQ(batch.column(0).type, RowBatch::Type::INT);
+    for (size_t row = 0; row < batch.size(); row++, expected++)
+    {
+      EXPECT_EQ(batch.getInt(row, 0), expected);
+      EXPECT_EQ(batch.getString(row, 1), "item" + std::to_string(expected));
+      EXPECT_DOUBLE_EQ(batch.getDouble(row, 2), expected + 0.5);
+      EXPECT_DOUBLE_EQ(batch.getDouble(row, 0), expected);
+      EXPECT_FALSE(batch.isNull(row, 2));
+    }
+    EXPECT_THROW(batch.getString(0, 0), std::invalid_argument);
+    fetched += batch.size();
+  }
+  EXPECT_EQ(fetched, 90);
+  EXPECT_TRUE(cursor.fetch(32).empty());
+
+  Cursor missing = connection.query("SELECT * FROM missing;");
+  EXPECT_EQ(missing.status(), Status::FAILED);
+  EXPECT_FALSE(missing.hasRows());
+  fs::remove_all(data);
+}
+
+TEST(BloomFilterTest, SkipsPagesMinMaxCant)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_bloom";
+  fs::remove_all(data);
+  Database database(data.string());
+  // The direct ProtoGenerator calls read the same tables as the connection
+  paths::DATA_PATH = data;
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db;");
+  EXPECT_EQ(connection.execute("CREATE TABLE bad (id int, price float) WITH (bloom_filter = price);").status(), Status::FAILED);
+  EXPECT_EQ(connection.execute("CREATE TABLE bad (id int) WITH (bloom_filter = pid);").status(), Status::FAILED);
+  EXPECT_EQ(connection.execute("CREATE TABLE bad (id int) WITH (fill = id);").status(), Status::FAILED);
+  ASSERT_TRUE(connection.execute("CREATE TABLE events (id int, tag int) WITH (bloom_filter = tag);").ok());
+  // Both pages span nearly the same tags, the first holds the even ones and the second the odd
+  std::string insert = "INSERT INTO events VALUES (0, 0)";
+  for (int row = 1; row < 2 * (int)ZoneMap::PAGE_ROWS; row++)
+  {
+    int tag = row < (int)ZoneMap::PAGE_ROWS ? 2 * row : 2 * (row - ZoneMap::PAGE_ROWS) + 1;
+    insert += ", (" + std::to_string(row) + ", " + std::to_string(tag) + ")";
+  }
+  ASSERT_TRUE(connection.execute(insert + ";").ok());
+  fs::path tbl_path = data / "db" / "events.proto";
+  EXPECT_EQ(ProtoGenerator::loadSchema(tbl_path).bloom_filters, std::vector<std::string>{"tag"});
+  ZoneMap zones;
+  ASSERT_TRUE(zones.load(tbl_path));
+  ASSERT_EQ(zones.pages.size(), 2);
+  EXPECT_TRUE(zones.pages[0].zones[0].bloom.empty());
+  EXPECT_TRUE(zones.pages[0].zones[1].mayContain(100));
+  EXPECT_FALSE(zones.pages[1].zones[1].mayContain(100));
+
+  ZoneMap::BloomStats &stats = ZoneMap::bloomStats();
+  size_t probes = stats.probes, skipped = stats.skipped;
+  auto where = make_tuple(std::string("tag"), std::string("="), std::string("101"));
+  std::shared_ptr<TableObject> tbl = ProtoGenerator::openTBL("db", "events", std::numeric_limits<size_t>::max(), nullptr, &where);
+  ASSERT_EQ(tbl->records.size() / 2, ZoneMap::PAGE_ROWS);
+  EXPECT_EQ(std::get<int>(tbl->records[0]), ZoneMap::PAGE_ROWS);
+  EXPECT_EQ(stats.probes, probes + 2);
+  EXPECT_EQ(stats.skipped, skipped + 1);
+  ResultSet found = connection.execute("SELECT id FROM events WHERE tag = 100;");
+  ASSERT_EQ(found.rowCount(), 1);
+  EXPECT_EQ(found.row(0).get<int>(0), 50);
+
+  // An inner join only reads the pages of events holding a wanted tag
+  ASSERT_TRUE(connection.execute("CREATE TABLE wanted (tag int, label varchar(8));").ok());
+  ASSERT_TRUE(connection.execute("INSERT INTO wanted VALUES (4, 'four'), (8, 'eight'), (9000, 'none');").ok());
+  skipped = stats.skipped;
+  where = make_tuple(std::string("tag"), std::string("="), std::string("tag"));
+  TableObject joined = ProtoGenerator::joinTBL("db", &where, {{"wanted", "w"}, {"events", "e"}}, {false, true, false});
+  EXPECT_EQ(joined.records.size() / joined.fields_size, 2);
+  ResultSet inner = connection.execute("SELECT * FROM wanted w INNER JOIN events e ON w.tag = e.tag;");
+  EXPECT_EQ(inner.rowCount(), 2);
+  ResultSet left = connection.execute("SELECT * FROM wanted w LEFT OUTER JOIN events e ON w.tag = e.tag;");
+  EXPECT_EQ(left.rowCount(), 3);
+  EXPECT_GT(stats.skipped, skipped);
+  EXPECT_NE(connection.execute(".STATS").message().find("Bloom filters:"), std::string::npos);
+
+  // A rewrite keeps the filters
+  ASSERT_TRUE(connection.execute("DELETE FROM events WHERE id = 0;").ok());
+  ASSERT_TRUE(zones.load(tbl_path));
+  EXPECT_FALSE(zones.pages[0].zones[1].bloom.empty());
+  fs::remove_all(data);
+}
+
+TEST(AnalyzeTest, KeepsTableStatistics)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_analyze";
+  fs::remove_all(data);
+  Database database(data.string());
+  // The direct ProtoGenerator calls read the same tables as the connection
+  paths::DATA_PATH = data;
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db; CREATE TABLE t (id int, g int, name varchar(8));");
+  std::string insert = "INSERT INTO t VALUES (0, 0, 'n0')";
+  for (int i = 1; i < 10000; i++)
+  {
+    insert += ", (" + std::to_string(i) + ", " + std::to_string(i % 100) + ", 'n" + std::to_string(i % 37) + "')";
+  }
+  ASSERT_TRUE(connection.execute(insert + ";").ok());
+  fs::path tbl_path = data / "db" / "t.proto";
+  EXPECT_EQ(TableStats::open(tbl_path), nullptr);
+  EXPECT_EQ(connection.execute("ANALYZE missing;").status(), Status::FAILED);
+  ResultSet analyzed = connection.execute("ANALYZE t;");
+  ASSERT_TRUE(analyzed.ok());
+  EXPECT_EQ(analyzed.message(), "Table t analyzed, 10000 rows.");
+
+  std::shared_ptr<const TableStats> stats = TableStats::open(tbl_path);
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(stats->rows, 10000);
+  ASSERT_EQ(stats->columns.size(), 3);
+  EXPECT_NEAR(stats->columns[0].distinct(), 10000, 300);
+  EXPECT_NEAR(stats->columns[1].distinct(), 100, 3);
+  EXPECT_NEAR(stats->columns[2].distinct(), 37, 2);
+  // Equi-depth buckets of the unique ids hold about the same number of rows
+  const TableStats::Column &ids = stats->columns[0];
+  ASSERT_EQ(ids.counts.size(), TableStats::HISTOGRAM_BUCKETS);
+  EXPECT_EQ(std::get<int>(ids.bounds.front()), 0);
+  EXPECT_EQ(std::get<int>(ids.bounds.back()), 9999);
+  for (size_t count : ids.counts)
+  {
+    EXPECT_NEAR(count, 10000 / TableStats::HISTOGRAM_BUCKETS, 2);
+  }
+
+  // Appends fold their rows in, blanks included, and reading the saved file gives the same
+  ASSERT_TRUE(ProtoGenerator::appendTBL("db", "t", {{20000, std::numeric_limits<int>::min(), std::string("zz")}}));
+  TableStats saved;
+  ASSERT_TRUE(saved.load(tbl_path));
+  EXPECT_EQ(saved.rows, 10001);
+  EXPECT_EQ(saved.appended, 1);
+  EXPECT_EQ(saved.columns[1].nulls, 1);
+  EXPECT_NEAR(saved.columns[1].nullFraction(), 1.0 / 10001, 1e-9);
+  EXPECT_EQ(std::get<int>(saved.columns[0].bounds.back()), 20000);
+  EXPECT_EQ(saved.columns[2].registers, TableStats::open(tbl_path)->columns[2].registers);
+
+  // Rewrites collect them again
+  ASSERT_TRUE(connection.execute("DELETE FROM t WHERE id > 4999;").ok());
+  stats = TableStats::open(tbl_path);
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(stats->rows, 5000);
+  EXPECT_EQ(stats->appended, 0);
+  EXPECT_EQ(stats->columns[1].nulls, 0);
+  EXPECT_NEAR(stats->columns[0].distinct(), 5000, 150);
+
+  // Rolling a transaction back keeps the table analyzed, with the statistics of the restored rows
+  ASSERT_TRUE(ProtoGenerator::lockTbl("db", "t"));
+  ASSERT_TRUE(connection.execute("DELETE FROM t WHERE id > 999;").ok());
+  EXPECT_EQ(TableStats::open(tbl_path)->rows, 1000);
+  ProtoGenerator::resetTransaction("db", "t");
+  ProtoGenerator::commitTransaction("db", "t");
+  stats = TableStats::open(tbl_path);
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(stats->rows, 5000);
+  EXPECT_EQ(std::get<int>(stats->columns[0].bounds.back()), 4999);
+  ASSERT_TRUE(connection.execute("DROP TABLE t;").ok());
+  EXPECT_FALSE(TableStats::exists(tbl_path));
+  fs::remove_all(data);
+}
+
+TEST(PlannerTest, PicksAccessAndJoinStrategy)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_planner";
+  fs::remove_all(data);
+  Database database(data.string());
+  // The direct ProtoGenerator calls read the same tables as the connection
+  paths::DATA_PATH = data;
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db; CREATE TABLE big (id int, g int);"
+                           "CREATE TABLE few (id int, label varchar(8)); CREATE TABLE other (id int); CREATE TABLE mid (id int);");
+  std::string values = " VALUES (0, 0)";
+  for (int i = 1; i < 5 * (int)ZoneMap::PAGE_ROWS; i++)
+  {
+    values += ", (" + std::to_string(i) + ", " + std::to_string(i % 100) + ")";
+  }
+  ASSERT_TRUE(connection.execute("INSERT INTO big" + values + ";").ok());
+  std::string mid = "INSERT INTO mid VALUES (0)";
+  for (int i = 1; i < 1000; i++)
+  {
+    mid += ", (" + std::to_string(3 * i) + ")";
+  }
+  ASSERT_TRUE(connection.execute(mid + ";").ok());
+  // Duplicate keys, keys past the end of big, and a key only other has
+  ASSERT_TRUE(connection.execute("INSERT INTO few VALUES (3, 'a'), (3, 'b'), (4100, 'c'), (99999, 'd');").ok());
+  ASSERT_TRUE(connection.execute("INSERT INTO other VALUES (3), (7), (123456);").ok());
+
+  // Only the first page can hold small ids, but every page holds each g
+  auto where = make_tuple(std::string("id"), std::string("<"), std::string("100"));
+  Planner::Plan plan = Planner::planScan("db", "big", &where);
+  ASSERT_EQ(plan.tables.size(), 1);
+  EXPECT_EQ(plan.tables[0].access, Planner::Access::ZONE_MAP_SCAN);
+  EXPECT_EQ(plan.tables[0].pages, 5);
+  EXPECT_EQ(plan.tables[0].pages_read, 1);
+  EXPECT_FALSE(plan.tables[0].analyzed);
+  auto by_group = make_tuple(std::string("g"), std::string("="), std::string("5"));
+  EXPECT_EQ(Planner::planScan("db", "big", &by_group).tables[0].access, Planner::Access::FULL_SCAN);
+  EXPECT_TRUE(Planner::planScan("db", "missing", &where).tables.empty());
+  ResultSet small_ids = connection.execute("SELECT id FROM big WHERE id < 100;");
+  EXPECT_EQ(small_ids.rowCount(), 100);
+
+  // ANALYZE makes the estimates follow the data
+  ASSERT_TRUE(connection.execute("ANALYZE big;").ok());
+  plan = Planner::planScan("db", "big", &where);
+  EXPECT_TRUE(plan.tables[0].analyzed);
+  EXPECT_NEAR(plan.rows, 100, 50);
+  EXPECT_NEAR(Planner::planScan("db", "big", &by_group).rows, 5 * ZoneMap::PAGE_ROWS / 100, 40);
+  auto missing_value = make_tuple(std::string("g"), std::string("="), std::string("500"));
+  EXPECT_EQ(Planner::planScan("db", "big", &missing_value).rows, 0);
+
+  // A few probes take a nested loop, bigger inputs a hash table built on the small side,
+  // and hash tables past the sort memory budget a sort merge join
+  auto on_id = make_tuple(std::string("id"), std::string("="), std::string("id"));
+  std::array<bool, 3> inner{false, true, false};
+  plan = Planner::planJoin("db", &on_id, {{"few", "f"}, {"other", "o"}}, inner);
+  ASSERT_EQ(plan.tables.size(), 2);
+  EXPECT_EQ(plan.join_choice.strategy, JoinStrategy::NESTED_LOOP);
+  plan = Planner::planJoin("db", &on_id, {{"mid", "m"}, {"big", "b"}}, inner);
+  EXPECT_EQ(plan.join_choice.strategy, JoinStrategy::HASH);
+  EXPECT_TRUE(plan.join_choice.build_left);
+  auto sized = [](double rows) {
+    Planner::TableEstimate table;
+    table.rows = rows;
+    table.cost = rows;
+    return table;
+  };
+  EXPECT_EQ(Planner::costJoin(sized(4), sized(20000), 4, 20000, inner).join_choice.strategy, JoinStrategy::NESTED_LOOP);
+  plan = Planner::costJoin(sized(1000), sized(20000), 1000, 20000, inner);
+  EXPECT_EQ(plan.join_choice.strategy, JoinStrategy::HASH);
+  EXPECT_TRUE(plan.join_choice.build_left);
+  EXPECT_TRUE(plan.join_choice.filter_from_left);
+  EXPECT_DOUBLE_EQ(plan.rows, 1000);
+  plan = Planner::costJoin(sized(20000), sized(1000), 20000, 1000, inner);
+  EXPECT_FALSE(plan.join_choice.build_left);
+  EXPECT_FALSE(plan.join_choice.filter_from_left);
+  EXPECT_EQ(Planner::costJoin(sized(20000), sized(20000), 100, 100, inner).join_choice.strategy, JoinStrategy::HASH);
+  ExternalSort::configure(1 << 10);
+  plan = Planner::costJoin(sized(20000), sized(20000), 20000, 20000, inner);
+  ExternalSort::configure(ExternalSort::DEFAULT_MEMORY_BUDGET);
+  EXPECT_EQ(plan.join_choice.strategy, JoinStrategy::SORT_MERGE);
+
+  // Every strategy and side gives the same rows for every kind of join
+  std::vector<JoinChoice> choices = {{JoinStrategy::NESTED_LOOP, false, true},
+                                     {JoinStrategy::HASH, true, false},
+                                     {JoinStrategy::SORT_MERGE, false, false}};
+  for (std::array<bool, 3> sections : {inner, std::array<bool, 3>{true, true, false},
+                                       std::array<bool, 3>{false, true, true}, std::array<bool, 3>{true, true, true}})
+  {
+    for (auto tables : {std::vector<std::pair<std::string, std::string>>{{"few", "f"}, {"mid", "m"}},
+                        std::vector<std::pair<std::string, std::string>>{{"few", "f"}, {"other", "o"}},
+                        std::vector<std::pair<std::string, std::string>>{{"mid", "m"}, {"other", "o"}}})
+    {
+      TableObject expected = ProtoGenerator::joinTBL("db", &on_id, tables, sections);
+      for (const JoinChoice &choice : choices)
+      {
+        TableObject joined = ProtoGenerator::joinTBL("db", &on_id, tables, sections, choice);
+        EXPECT_EQ(joined.records, expected.records);
+      }
+    }
+  }
+  ResultSet joined = connection.execute("SELECT * FROM few f INNER JOIN big b ON f.id = b.id;");
+  EXPECT_EQ(joined.rowCount(), 3);
+  ResultSet full = connection.execute("SELECT * FROM few f FULL OUTER JOIN other o ON f.id = o.id;");
+  EXPECT_EQ(full.rowCount(), 6);
+  fs::remove_all(data);
+}
+
+TEST(ExplainTest, ShowsPlanAndProfile)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_explain";
+  fs::remove_all(data);
+  Database database(data.string());
+  // The direct ProtoGenerator calls read the same tables as the connection
+  paths::DATA_PATH = data;
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db; CREATE TABLE big (id int, g int); CREATE TABLE few (id int);");
+  std::string insert = "INSERT INTO big VALUES (0, 0)";
+  for (int i = 1; i < 3 * (int)ZoneMap::PAGE_ROWS; i++)
+  {
+    insert += ", (" + std::to_string(i) + ", " + std::to_string(i % 10) + ")";
+  }
+  ASSERT_TRUE(connection.execute(insert + ";").ok());
+  ASSERT_TRUE(connection.execute("INSERT INTO few VALUES (1), (2);").ok());
+
+  ResultSet plan = connection.execute("EXPLAIN SELECT id FROM big WHERE id < 10 ORDER BY id DESC;");
+  ASSERT_TRUE(plan.ok());
+  EXPECT_EQ(plan.message(), "Project id  (estimated rows=4096)\n"
+                            "  -> Sort by id desc, filter id < 10\n"
+                            "    -> Zone Map Scan on big, pages 1/3, skipping by id < 10  (estimated rows=12288, cost=4160, not analyzed)");
+  std::string join = connection.execute("EXPLAIN SELECT * FROM few f INNER JOIN big b ON f.id = b.id;").message();
+  EXPECT_NE(join.find("Nested Loop Inner Join on f.id = b.id, keys of few skip pages of big"), std::string::npos);
+  EXPECT_EQ(connection.execute("EXPLAIN SELECT * FROM missing;").status(), Status::FAILED);
+
+  // EXPLAIN ANALYZE runs the statement and reports each operator
+  ResultSet analyzed = connection.execute("EXPLAIN ANALYZE SELECT id FROM big WHERE id < 10 ORDER BY id DESC;");
+  ASSERT_TRUE(analyzed.ok());
+  std::string text = analyzed.message();
+  EXPECT_NE(text.find("Project id  (estimated rows=4096)  (actual time="), std::string::npos);
+  // The sort tests the where expression, so it keeps 10 of the 4096 rows scanned
+  EXPECT_NE(text.find("filter id < 10  (actual time="), std::string::npos);
+  EXPECT_NE(text.find("rows in=4096, rows out=10"), std::string::npos);
+  EXPECT_NE(text.find("rows in=4096, rows out=4096"), std::string::npos);
+  EXPECT_NE(text.find("Execution time: "), std::string::npos);
+  ResultSet inserted = connection.execute("EXPLAIN ANALYZE INSERT INTO few VALUES (3);");
+  ASSERT_TRUE(inserted.ok());
+  EXPECT_EQ(inserted.message().rfind("INSERT statement  (actual time=", 0), 0);
+  EXPECT_EQ(connection.execute("SELECT * FROM few;").rowCount(), 3);
+
+  // Scans report the bytes they read and whether the pages were cached
+  QueryProfile profile;
+  auto where = make_tuple(std::string("id"), std::string(">"), std::string("10000"));
+  {
+    QueryProfile::Scope scope(&profile);
+    ProtoGenerator::openTBL("db", "big", std::numeric_limits<size_t>::max(), nullptr, &where);
+  }
+  ASSERT_EQ(profile.operators.size(), 1);
+  const QueryProfile::Operator &scan = profile.operators[0];
+  EXPECT_EQ(scan.key, "scan big");
+  EXPECT_EQ(scan.rows_out, 3 * ZoneMap::PAGE_ROWS - 2 * ZoneMap::PAGE_ROWS);
+  EXPECT_GT(scan.bytes_read, 0);
+  EXPECT_LT(scan.bytes_read, fs::file_size(data / "db" / "big.proto") / 2);
+  EXPECT_GT(scan.cache_hits + scan.cache_misses, 0);
+  EXPECT_GT(scan.memory, 0);
+  // Nothing is recorded without an active profile
+  ProtoGenerator::openTBL("db", "big");
+  EXPECT_EQ(profile.operators.size(), 1);
+  fs::remove_all(data);
+}
+
+TEST(LimitTest, LimitOffsetStopEarly)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_limit";
+  fs::remove_all(data);
+  Database database(data.string());
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db; CREATE TABLE product (pid int, price float);");
+  std::string insert = "INSERT INTO product VALUES (0, 0.0)";
+  for (int i = 1; i < 100; i++)
+  {
+    insert += ", (" + std::to_string(i) + ", " + std::to_string((i * 37) % 100) + ".5)";
+  }
+  ASSERT_TRUE(connection.execute(insert + ";").ok());
+
+  ResultSet first = connection.execute("SELECT pid FROM product LIMIT 5 OFFSET 10;");
+  ASSERT_EQ(first.rowCount(), 5);
+  EXPECT_EQ(first.row(0).get<int>(0), 10);
+  EXPECT_EQ(first.row(4).get<int>(0), 14);
+
+  ResultSet top = connection.execute("SELECT pid, price FROM product ORDER BY price DESC LIMIT 3 OFFSET 1;");
+  ASSERT_EQ(top.rowCount(), 3);
+  EXPECT_DOUBLE_EQ(top.row(0).get<double>(1), 98.5);
+  EXPECT_DOUBLE_EQ(top.row(2).get<double>(1), 96.5);
+
+  EXPECT_EQ(connection.execute("SELECT * FROM product WHERE pid > 95 LIMIT 10;").rowCount(), 4);
+  EXPECT_EQ(connection.execute("SELECT * FROM product OFFSET 200;").rowCount(), 0);
+  EXPECT_EQ(connection.execute("SELECT * FROM product LIMIT 'many';").status(), Status::FAILED);
+
+  Cursor cursor = connection.query("SELECT pid FROM product WHERE pid > 9 LIMIT 50;");
+  size_t fetched = 0;
+  while (!cursor.done())
+  {
+    fetched += cursor.fetch(16).size();
+  }
+  EXPECT_EQ(fetched, 50);
+  fs::remove_all(data);
+}
+
+TEST(LibraryTest, SubmitRunsAsyncAndCancels)
+{
+  fs::path data = fs::temp_directory_path() / "sql_test_submit";
+  fs::remove_all(data);
+  Database database(data.string());
+  Connection connection = database.connect();
+  connection.executeScript("CREATE DATABASE db; USE db; CREATE TABLE product (pid int, name varchar(20));"
+                           "INSERT INTO product VALUES (1, 'Gizmo'), (2, 'Widget');");
+
+  std::future<ResultSet> select = connection.submit("SELECT name FROM product WHERE pid = 2;");
+  CancelToken cancelled;
+  cancelled.cancel();
+  std::future<ResultSet> skipped = connection.submit("SELECT * FROM product;", cancelled);
+  std::future<ResultSet> timed_out = connection.submit("SELECT * FROM product;", CancelToken::withTimeout(std::chrono::milliseconds(0)));
+
+  ResultSet result = select.get();
+  ASSERT_TRUE(result.ok());
+  ASSERT_EQ(result.rowCount(), 1);
+  EXPECT_EQ(result.row(0).get<std::string>(0), "Widget");
+  ResultSet cancelled_result = skipped.get();
+  EXPECT_EQ(cancelled_result.status(), Status::CANCELLED);
+  EXPECT_EQ(cancelled_result.message(), "!Query cancelled.");
+  EXPECT_EQ(timed_out.get().message(), "!Query timed out.");
+  // Cancelling one query leaves the connection usable
+  EXPECT_EQ(connection.execute("SELECT * FROM product;").rowCount(), 2);
+
+  // A submitted query may outlive the Database and the Connection it came from
+  std::future<ResultSet> orphan;
+  {
+    auto owner = std::make_unique<Database>(data.string());
+    Connection temporary = owner->connect();
+    temporary.execute("USE db;");
+    orphan = temporary.submit("SELECT * FROM product;");
+  }
+  EXPECT_EQ(orphan.get().rowCount(), 2);
+  fs::remove_all(data);
+}
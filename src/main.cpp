@@ -5,9 +5,87 @@
  * to set up threaded processes.
  */
 
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <database.hpp>
+#include <external_sort.hpp>
 #include <repl.hpp>
-#include <ast.hpp>
+#include <mapped_file.hpp>
+#include <thread_pool.hpp>
 
-int main(void) {
-  repl();
-}
\ No newline at end of file
+// Reads the value of a numeric option, printing a usage error when it isn't a whole number up to limit
+static bool parseNumber(const char *option, const char *text, unsigned long limit, unsigned long &value) {
+  bool valid = false;
+  try {
+    size_t used = 0;
+    value = std::stoul(text, &used);
+    valid = text[0] != '-' && text[used] == '\0' && value <= limit;
+  } catch (const std::invalid_argument &e) {
+  } catch (const std::out_of_range &e) {}
+  if (!valid) {
+    std::cerr << "Invalid value for " << option << ": " << text << ", expected a whole number up to " << limit << "\n";
+  }
+  return valid;
+}
+
+int main(int argc, char **argv) {
+  // --workers N          size of the shared thread pool
+  // --query-parallelism N  max workers a single statement may use
+  // --pin-workers        pin workers to cpus across NUMA nodes
+  // --sort-memory MB     memory an ORDER BY sorts in before spilling runs to disk
+  // --script FILE        run the statements in FILE instead of the repl
+  ThreadPool::Config config;
+  const char *script_path = nullptr;
+  unsigned long number = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      if (!parseNumber(argv[i], argv[i + 1], UINT_MAX, number)) {
+        return EXIT_FAILURE;
+      }
+      config.workers = number;
+      i++;
+    } else if (strcmp(argv[i], "--query-parallelism") == 0 && i + 1 < argc) {
+      if (!parseNumber(argv[i], argv[i + 1], UINT_MAX, number)) {
+        return EXIT_FAILURE;
+      }
+      config.query_parallelism = number;
+      i++;
+    } else if (strcmp(argv[i], "--pin-workers") == 0) {
+      config.pin_workers = true;
+    } else if (strcmp(argv[i], "--sort-memory") == 0 && i + 1 < argc) {
+      // The budget is in bytes, so the MB have to fit a size_t once shifted
+      if (!parseNumber(argv[i], argv[i + 1], SIZE_MAX >> 20, number)) {
+        return EXIT_FAILURE;
+      }
+      ExternalSort::configure((size_t)number << 20);
+      i++;
+    } else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+      script_path = argv[++i];
+    } else {
+      std::cerr << "Unknown argument: " << argv[i] << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  ThreadPool::configure(config);
+  Database database;
+  Connection connection = database.connect();
+
+  // Scripts and piped input run in batch mode
+  if (script_path != nullptr || !isatty(fileno(stdin))) {
+    // Output is only flushed when the buffer fills up or the script ends
+    std::ios::sync_with_stdio(false);
+    std::unique_ptr<MappedFile> source;
+    try {
+      source.reset(script_path != nullptr ? new MappedFile(script_path) : new MappedFile(std::cin));
+    } catch (const std::runtime_error &e) {
+      std::cerr << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+    connection.executeScript(source->text(), printResult);
+    return EXIT_SUCCESS;
+  }
+  repl(connection);
+}
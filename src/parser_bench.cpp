@@ -0,0 +1,74 @@
+/*
+ * AUTHOR: VINCENT PHAM
+ * CLASS: CS457 DATABASE MANAGEMENT SYSTEMS
+ * FILE DESC: Parses a mix of statements in a loop, releasing the arena
+ * after each one like the repl does, and reports the parse throughput
+ * along with the resident memory so leaks show up as a growing RSS.
+ *
+ * Usage: parser_bench [statements, default 10000000]
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <arena.hpp>
+#include <lexer.hpp>
+#include <parser.hpp>
+
+/**
+ * @brief Resident set size in KiB read from /proc/self/statm
+ */
+long residentKiB()
+{
+  std::ifstream statm("/proc/self/statm");
+  long size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char **argv)
+{
+  long total = argc > 1 ? std::atol(argv[1]) : 10000000;
+  if (total <= 0)
+  {
+    std::cerr << "Usage: " << argv[0] << " [statements]\n";
+    return EXIT_FAILURE;
+  }
+  const std::string statements[] = {
+      "select * from Employee E left outer join Sales S on E.id = S.employeeID;",
+      "insert into Product values(3, 'Gizmo', 19.99);",
+      "update Product set price = 14.99 where name = 'Gizmo';",
+      "select name, price from Product where pid != 2;",
+      "create table Product (pid int, name varchar(20), price float);",
+      "delete from Product where price > 150;",
+  };
+  const long statement_count = sizeof(statements) / sizeof(statements[0]);
+  const long report_every = std::max(1L, total / 10);
+
+  Arena arena;
+  size_t parsed_nodes = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::cout << "statements\tstatements/sec\tRSS KiB\n";
+  for (long i = 1; i <= total; i++)
+  {
+    Lexer lexer(statements[i % statement_count]);
+    SQLParser parser(&lexer, &arena);
+    ast::Program *program = parser.parseSql();
+    parsed_nodes += program->statements.size();
+    arena.release();
+    if (i % report_every == 0 || i == total)
+    {
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << i << "\t" << (long)(i / elapsed.count()) << "\t" << residentKiB() << "\n";
+    }
+  }
+  if (parsed_nodes != (size_t)total)
+  {
+    std::cerr << "Parsed " << parsed_nodes << " statements, expected " << total << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}